@@ -20,7 +20,9 @@ set (CMAKE_EXE_LINKER_FLAGS_RELEASE_INIT "-s")
 
 if( CMAKE_SIZEOF_VOID_P EQUAL 8 )
     # This is a 64-bit OS
-    # LLST supports only 32-bit code
-    set (CMAKE_C_FLAGS_INIT "-m32 ${CMAKE_C_FLAGS_INIT}")
-    set (CMAKE_CXX_FLAGS_INIT "-m32 ${CMAKE_CXX_FLAGS_INIT}")
+    # The VM itself is word size generic, but JIT is built against i386 LLVM
+    if (USE_LLVM OR BUILD_32BIT)
+        set (CMAKE_C_FLAGS_INIT "-m32 ${CMAKE_C_FLAGS_INIT}")
+        set (CMAKE_CXX_FLAGS_INIT "-m32 ${CMAKE_CXX_FLAGS_INIT}")
+    endif()
 endif()
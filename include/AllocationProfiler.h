@@ -0,0 +1,122 @@
+/*
+ *    AllocationProfiler.h
+ *
+ *    Sampling profiler of the object allocations
+ *
+ *    LLST (LLVM Smalltalk or Low Level Smalltalk) version 0.4
+ *
+ *    LLST is
+ *        Copyright (C) 2012-2015 by Dmitry Kashitsyn   <korvin@deeptown.org>
+ *        Copyright (C) 2012-2015 by Roman Proskuryakov <humbug@deeptown.org>
+ *
+ *    LLST is based on the LittleSmalltalk which is
+ *        Copyright (C) 1987-2005 by Timothy A. Budd
+ *        Copyright (C) 2007 by Charles R. Childers
+ *        Copyright (C) 2005-2007 by Danny Reinhold
+ *
+ *    Original license of LittleSmalltalk may be found in the LICENSE file.
+ *
+ *
+ *    This file is part of LLST.
+ *    LLST is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    LLST is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with LLST.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef LLST_ALLOCATION_PROFILER_H_INCLUDED
+#define LLST_ALLOCATION_PROFILER_H_INCLUDED
+
+#include <types.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Allocation profiler records every allocation that crosses the next
+// boundary of sampleInterval bytes. So each sample represents roughly
+// sampleInterval allocated bytes. Allocation crossing several boundaries
+// at once is weighted by their count. Sample holds the class and the size
+// of the allocated object along with the allocation site which is the
+// method and the byte pointer of the executing context. Optionally the
+// whole chain of contexts is recorded to build the call tree.
+//
+// Methods may be moved by GC, so sites are stored by names.
+class AllocationProfiler {
+public:
+    AllocationProfiler(std::size_t sampleInterval, bool recordChains = false);
+    ~AllocationProfiler();
+
+    // Fast check done on every allocation. Returns the weight of the sample,
+    // which is the number of boundaries crossed, or zero if it is not sampled.
+    uint32_t shouldSample(std::size_t size) {
+        m_bytesUntilSample -= static_cast<int64_t>(size);
+        if (m_bytesUntilSample > 0)
+            return 0;
+
+        // Large allocation may cross several boundaries at once
+        const int64_t crossed = 1 + (-m_bytesUntilSample) / m_sampleInterval;
+        m_bytesUntilSample += crossed * m_sampleInterval;
+        return static_cast<uint32_t>(crossed);
+    }
+
+    // Context is the executing context or 0 if allocation is done outside of Smalltalk code.
+    // Byte pointer of the executing context is passed separately because VM keeps it
+    // out of the context object. Negative value means that byte pointer is unknown.
+    // Weight is the value returned by shouldSample().
+    void recordSample(TClass* klass, std::size_t size, uint32_t weight, TContext* context, int bytePointer);
+
+    void printReport() const;
+
+    // Weighted number of samples recorded at the site. Method is named as Class>>selector
+    // or <native>, byte pointer is -1 if it is unknown.
+    uint32_t getSiteSamples(const std::string& method, int bytePointer, const std::string& className) const;
+
+private:
+    struct TSiteKey {
+        std::string method;
+        int         bytePointer;
+        std::string className;
+
+        bool operator < (const TSiteKey& other) const;
+    };
+
+    struct TSiteInfo {
+        uint32_t samples;       // weighted
+        uint32_t allocations;   // sampled allocations
+        uint64_t sampledBytes;
+        TSiteInfo() : samples(0), allocations(0), sampledBytes(0) {}
+    };
+
+    struct TCallNode {
+        uint32_t totalSamples;
+        uint32_t selfSamples;
+        std::map<std::string, TCallNode*> children;
+        TCallNode() : totalSamples(0), selfSamples(0) {}
+        ~TCallNode();
+    };
+
+    static std::string getFrameName(TContext* context, int bytePointer);
+    void printCallNode(const TCallNode* node, const std::string& name, int depth) const;
+
+    const int64_t m_sampleInterval;
+    const bool    m_recordChains;
+    int64_t       m_bytesUntilSample;
+
+    uint32_t      m_totalSamples;
+
+    typedef std::map<TSiteKey, TSiteInfo> TSiteMap;
+    TSiteMap      m_sites;
+    TCallNode     m_callTree;
+};
+
+#endif
@@ -0,0 +1,116 @@
+/*
+ *    DispatchTable.h
+ *
+ *    Flattened method tables of the frequently missed classes
+ *
+ *    LLST (LLVM Smalltalk or Low Level Smalltalk) version 0.4
+ *
+ *    LLST is
+ *        Copyright (C) 2012-2015 by Dmitry Kashitsyn   <korvin@deeptown.org>
+ *        Copyright (C) 2012-2015 by Roman Proskuryakov <humbug@deeptown.org>
+ *
+ *    LLST is based on the LittleSmalltalk which is
+ *        Copyright (C) 1987-2005 by Timothy A. Budd
+ *        Copyright (C) 2007 by Charles R. Childers
+ *        Copyright (C) 2005-2007 by Danny Reinhold
+ *
+ *    Original license of LittleSmalltalk may be found in the LICENSE file.
+ *
+ *
+ *    This file is part of LLST.
+ *    LLST is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    LLST is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with LLST.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef LLST_DISPATCH_TABLE_H_INCLUDED
+#define LLST_DISPATCH_TABLE_H_INCLUDED
+
+#include <types.h>
+#include <vector>
+#include <tr1/unordered_map>
+
+class IMemoryManager;
+
+// Selector to method table of a class which includes all inherited methods,
+// so a lookup is a single probe instead of a walk through the hierarchy.
+// Slots are addressed by the selector hash kept in the symbol header.
+// Table is at most half full, so probe sequences are short.
+class DispatchTable {
+public:
+    DispatchTable() : m_mask(0), m_size(0), m_static(false) { }
+
+    // Collects the methods of the class and its parents. Methods of the
+    // subclasses override the ones of the parents with the same selector.
+    void build(TClass* klass, IMemoryManager* memoryManager);
+
+    // Unlike the method dictionaries the table is complete,
+    // so 0 means that the class does not understand the selector
+    TMethod* find(const TSymbol* selector, uint32_t hash) const;
+
+    std::size_t getSize() const { return m_size; }
+    bool isEmpty() const { return m_slots.empty(); }
+
+    // Class, selectors and methods of the table are not moved by the GC
+    bool isStatic() const { return m_static; }
+
+private:
+    struct TSlot {
+        uint32_t hash;
+        TSymbol* selector;
+        TMethod* method;
+    };
+
+    std::vector<TSlot> m_slots;
+    uint32_t    m_mask;
+    std::size_t m_size;
+    bool        m_static;
+
+    TSlot& findSlot(const TSymbol* selector, uint32_t hash);
+};
+
+// Dispatch tables of the VM. Tables are built for the classes whose
+// lookups miss the method cache more than the threshold.
+class DispatchTables {
+public:
+    static const uint32_t MISSES_THRESHOLD = 32;
+
+    DispatchTables() : m_tablesBuilt(0) { }
+
+    // Returns the table of the class or 0. Counts the miss otherwise
+    // and builds the table when the class exceeds the threshold.
+    const DispatchTable* get(TClass* klass, IMemoryManager* memoryManager);
+
+    // Methods were installed or removed, all tables are invalid
+    void flush() { m_classes.clear(); }
+
+    // Objects may have been moved by the GC. Only the tables
+    // referring to the static heap are valid after collection.
+    void flushMovable();
+
+    uint32_t getTablesBuilt() const { return m_tablesBuilt; }
+
+private:
+    struct TClassEntry {
+        uint32_t      misses;
+        DispatchTable table;
+
+        TClassEntry() : misses(0) { }
+    };
+
+    typedef std::tr1::unordered_map<TClass*, TClassEntry> TClassMap;
+    TClassMap m_classes;
+    uint32_t  m_tablesBuilt;
+};
+
+#endif
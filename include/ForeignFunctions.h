@@ -0,0 +1,94 @@
+/*
+ *    ForeignFunctions.h
+ *
+ *    Foreign function interface to the native shared libraries
+ *
+ *    LLST (LLVM Smalltalk or Low Level Smalltalk) version 0.4
+ *
+ *    LLST is
+ *        Copyright (C) 2012-2015 by Dmitry Kashitsyn   <korvin@deeptown.org>
+ *        Copyright (C) 2012-2015 by Roman Proskuryakov <humbug@deeptown.org>
+ *
+ *    LLST is based on the LittleSmalltalk which is
+ *        Copyright (C) 1987-2005 by Timothy A. Budd
+ *        Copyright (C) 2007 by Charles R. Childers
+ *        Copyright (C) 2005-2007 by Danny Reinhold
+ *
+ *    Original license of LittleSmalltalk may be found in the LICENSE file.
+ *
+ *
+ *    This file is part of LLST.
+ *    LLST is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    LLST is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with LLST.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef LLST_FOREIGN_FUNCTIONS_H_INCLUDED
+#define LLST_FOREIGN_FUNCTIONS_H_INCLUDED
+
+#include <types.h>
+#include <string>
+#include <vector>
+
+// Libraries and their symbols are referred from the image by SmallInteger
+// handles, so the image can not forge the native pointers. Functions are
+// called with the cdecl convention, every argument and the result are
+// passed as a machine word:
+//   SmallInteger      the value
+//   nil, true, false  0, 1, 0
+//   String, Symbol    pointer to the zero terminated copy of the bytes
+//   other binary      pointer to the bytes of the object
+// Floating point arguments are not supported. Neither are the variadic
+// functions such as printf: they are called through a non-variadic
+// prototype, which is undefined behaviour and breaks on the ABIs that pass
+// the variadic arguments differently (x86-64 expects the count of vector
+// registers in %al, Apple AArch64 passes them on the stack). Call a fixed
+// arity wrapper, e.g. puts or vsnprintf, instead. Bytes of the binary objects
+// are valid only until the call returns, because nothing is allocated
+// in the heap while the foreign code runs. Use ByteArray for the buffers
+// written by the function, strings are passed as copies.
+class ForeignFunctions {
+public:
+    static const std::size_t MAX_ARGUMENTS = 8;
+
+    ~ForeignFunctions();
+
+    // Handle of the library or -1
+    int32_t open(const std::string& name);
+    bool close(int32_t library);
+
+    // Handle of the function or variable of the library or -1
+    int32_t resolve(int32_t library, const std::string& name);
+    void* getAddress(int32_t library, int32_t symbol) const;
+
+    // Marshals the Array of arguments and calls the function. If text is
+    // given, the zero terminated string the result points to is copied
+    // into it while the marshaled arguments are still alive, because the
+    // function may return a pointer into one of them.
+    bool call(int32_t library, int32_t function, TObject* arguments, intptr_t& result, std::string* text = 0) const;
+
+    static intptr_t invoke(void* function, const intptr_t* arguments, std::size_t count);
+
+private:
+    struct TForeignSymbol {
+        int32_t library;
+        void*   address; // 0 if the library is closed
+    };
+
+    std::vector<void*>          m_libraries; // 0 if closed
+    std::vector<TForeignSymbol> m_symbols;
+};
+
+extern ForeignFunctions foreignFunctions;
+
+#endif
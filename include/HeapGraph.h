@@ -0,0 +1,86 @@
+/*
+ *    HeapGraph.h
+ *
+ *    Object graph of the heap along with the dominator tree
+ *    and retained sizes of objects used by the heap analyzer
+ *
+ *    LLST (LLVM Smalltalk or Low Level Smalltalk) version 0.4
+ *
+ *    LLST is
+ *        Copyright (C) 2012-2015 by Dmitry Kashitsyn   <korvin@deeptown.org>
+ *        Copyright (C) 2012-2015 by Roman Proskuryakov <humbug@deeptown.org>
+ *
+ *    LLST is based on the LittleSmalltalk which is
+ *        Copyright (C) 1987-2005 by Timothy A. Budd
+ *        Copyright (C) 2007 by Charles R. Childers
+ *        Copyright (C) 2005-2007 by Danny Reinhold
+ *
+ *    Original license of LittleSmalltalk may be found in the LICENSE file.
+ *
+ *
+ *    This file is part of LLST.
+ *    LLST is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    LLST is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with LLST.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LLST_HEAP_GRAPH_H_INCLUDED
+#define LLST_HEAP_GRAPH_H_INCLUDED
+
+#include <memory.h>
+
+#include <vector>
+
+// Objects of the heap are represented as a graph. Node 0 is an artificial
+// root that refers to the globals and to the additional roots passed to
+// build(). Every other node corresponds to a single object of the heap.
+class HeapGraph {
+public:
+    typedef uint32_t TNodeIndex;
+    static const TNodeIndex invalidNode = ~0u;
+
+    std::vector<TObject*> objects;  // objects[0] is unused (artificial root)
+    std::vector<uint32_t> shallowSize;
+
+    // Edges are stored in the compressed form: successors of the
+    // node i are edges[edgeOffsets[i]] .. edges[edgeOffsets[i+1] - 1]
+    std::vector<uint32_t>   edgeOffsets;
+    std::vector<TNodeIndex> edges;
+
+    std::vector<TNodeIndex> reversePostOrder;
+    std::vector<TNodeIndex> orderNumber;     // position of the node in reversePostOrder
+    std::vector<TNodeIndex> immediateDominator;
+    std::vector<uint32_t>   retainedSize;
+
+    void build(IMemoryManager& memoryManager, const std::vector<TObject*>& roots);
+    void calculateDominators();
+    void calculateRetainedSizes();
+
+    struct TClassRecord {
+        TClass*  klass;
+        uint32_t instances;
+        uint32_t shallowSize;
+        uint32_t retainedSize;
+        TClassRecord() : klass(0), instances(0), shallowSize(0), retainedSize(0) {}
+    };
+
+    // Reachable instances of every class ordered by the retained size
+    std::vector<TClassRecord> getClassTable() const;
+
+    TNodeIndex findNode(TObject* object) const;
+    bool isReachable(TNodeIndex node) const { return orderNumber[node] != invalidNode; }
+private:
+    void addEdge(TObject* target);
+    TNodeIndex intersect(TNodeIndex left, TNodeIndex right) const;
+};
+
+#endif
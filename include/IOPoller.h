@@ -0,0 +1,82 @@
+/*
+ *    IOPoller.h
+ *
+ *    Readiness notifications of the file descriptors
+ *
+ *    LLST (LLVM Smalltalk or Low Level Smalltalk) version 0.4
+ *
+ *    LLST is
+ *        Copyright (C) 2012-2015 by Dmitry Kashitsyn   <korvin@deeptown.org>
+ *        Copyright (C) 2012-2015 by Roman Proskuryakov <humbug@deeptown.org>
+ *
+ *    LLST is based on the LittleSmalltalk which is
+ *        Copyright (C) 1987-2005 by Timothy A. Budd
+ *        Copyright (C) 2007 by Charles R. Childers
+ *        Copyright (C) 2005-2007 by Danny Reinhold
+ *
+ *    Original license of LittleSmalltalk may be found in the LICENSE file.
+ *
+ *
+ *    This file is part of LLST.
+ *    LLST is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    LLST is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with LLST.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef LLST_IO_POLLER_H_INCLUDED
+#define LLST_IO_POLLER_H_INCLUDED
+
+#include <stdint.h>
+#include <cstddef>
+#include <map>
+#include <vector>
+
+// Descriptors which Smalltalk processes wait for. A process that would
+// block parks itself with the ioWait primitive and the Scheduler resumes it
+// when the descriptor is reported ready by the ioPoll primitive.
+class IOPoller {
+public:
+    // Same values as the poll() and epoll flags
+    enum TEvents {
+        readable = 1,
+        writable = 4
+    };
+
+    IOPoller() : m_pollID(-1) { }
+    ~IOPoller();
+
+    // Watches the descriptor until it becomes ready. Events are added to
+    // the ones already watched, so the reader and the writer of the same
+    // descriptor are both reported. Fails for the descriptors epoll does
+    // not support, e.g. for the regular files.
+    bool watch(int fileID, uint32_t events);
+
+    // Stops watching the descriptor before it is closed. Descriptor is
+    // reported by the next wait, so the processes waiting for it are
+    // resumed and fail on it instead of waiting forever.
+    void unwatch(int fileID);
+
+    // Waits up to timeout milliseconds, negative timeout waits forever.
+    // Descriptors reported ready are not watched anymore. Watched descriptors
+    // closed behind our back are reported instead of waiting forever.
+    bool wait(int timeout, std::vector<int>& ready);
+
+    std::size_t getWatchedCount() const { return m_watched.size(); }
+
+private:
+    int m_pollID;
+    std::map<int, uint32_t> m_watched; // events by descriptor
+    std::vector<int> m_unwatched;      // reported by the next wait
+};
+
+#endif
@@ -0,0 +1,120 @@
+/*
+ *    LargeInteger.h
+ *
+ *    Arbitrary precision integer arithmetic
+ *
+ *    LLST (LLVM Smalltalk or Low Level Smalltalk) version 0.4
+ *
+ *    LLST is
+ *        Copyright (C) 2012-2015 by Dmitry Kashitsyn   <korvin@deeptown.org>
+ *        Copyright (C) 2012-2015 by Roman Proskuryakov <humbug@deeptown.org>
+ *
+ *    LLST is based on the LittleSmalltalk which is
+ *        Copyright (C) 1987-2005 by Timothy A. Budd
+ *        Copyright (C) 2007 by Charles R. Childers
+ *        Copyright (C) 2005-2007 by Danny Reinhold
+ *
+ *    Original license of LittleSmalltalk may be found in the LICENSE file.
+ *
+ *
+ *    This file is part of LLST.
+ *    LLST is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    LLST is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with LLST.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifndef LLST_LARGE_INTEGER_H_INCLUDED
+#define LLST_LARGE_INTEGER_H_INCLUDED
+
+#include <types.h>
+
+#include <string>
+#include <vector>
+
+// LargeInteger is a signed integer of unlimited precision. The magnitude
+// is stored as a vector of 32 bit digits, least significant digit first,
+// without leading zero digits. Zero is never negative.
+//
+// In the image large values are instances of Integer. These are binary
+// objects where the first byte holds the sign (0 or 1) and the rest is
+// the magnitude in little endian byte order. Values that fit into the
+// SmallInt range are always represented by SmallInt.
+class LargeInteger {
+public:
+    typedef uint32_t TDigit;
+    typedef std::vector<TDigit> TDigits;
+
+    // Operands shorter than this many digits are multiplied by the schoolbook method
+    static const std::size_t KARATSUBA_THRESHOLD = 32;
+
+    LargeInteger() : m_negative(false) { }
+    explicit LargeInteger(int64_t value);
+
+    // Conversion from and to the object representation
+    static LargeInteger fromBytes(const uint8_t* bytes, std::size_t size);
+    std::size_t getByteSize() const;
+    void toBytes(uint8_t* bytes) const;
+
+    bool isZero() const { return m_digits.empty(); }
+    bool isNegative() const { return m_negative; }
+
+    // Returns false if the value does not fit into the SmallInt range
+    bool toSmallInt(intptr_t& value) const;
+    // Lowest 64 bits of the two's complement representation
+    uint64_t truncated() const;
+
+    // Nearest double, infinity if the value is too large
+    double toDouble() const;
+    // Fractional part is discarded. Fails on infinity and NaN.
+    static bool fromDouble(double value, LargeInteger& result);
+
+    // Returns negative, zero or positive value like strcmp()
+    int compare(const LargeInteger& other) const;
+
+    LargeInteger operator-() const;
+    LargeInteger operator+(const LargeInteger& other) const;
+    LargeInteger operator-(const LargeInteger& other) const;
+    LargeInteger operator*(const LargeInteger& other) const { return multiply(*this, other); }
+
+    static LargeInteger multiply(const LargeInteger& left, const LargeInteger& right,
+                                 std::size_t karatsubaThreshold = KARATSUBA_THRESHOLD);
+
+    // Truncating division: quotient is rounded towards zero and the
+    // remainder has the sign of the dividend. Fails on division by zero.
+    static bool divMod(const LargeInteger& dividend, const LargeInteger& divisor,
+                       LargeInteger& quotient, LargeInteger& remainder);
+
+    // Bit operations treat values as infinite two's complement numbers
+    LargeInteger bitAnd(const LargeInteger& other) const;
+    LargeInteger bitOr(const LargeInteger& other) const;
+    LargeInteger bitXor(const LargeInteger& other) const;
+    // Shifts left if count is positive and right if it is negative.
+    // Right shift rounds towards negative infinity.
+    LargeInteger shifted(intptr_t count) const;
+
+    // Base should be in range 2..36
+    std::string toString(unsigned base = 10) const;
+
+private:
+    enum TBitOperation { bitOperationAnd, bitOperationOr, bitOperationXor };
+    LargeInteger bitOperation(const LargeInteger& other, TBitOperation operation) const;
+
+    LargeInteger(const TDigits& digits, bool negative);
+    void normalize();
+
+    TDigits m_digits;
+    bool    m_negative;
+};
+
+#endif
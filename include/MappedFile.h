@@ -0,0 +1,87 @@
+/*
+ *    MappedFile.h
+ *
+ *    Memory mapped files exposed as binary objects
+ *
+ *    LLST (LLVM Smalltalk or Low Level Smalltalk) version 0.4
+ *
+ *    LLST is
+ *        Copyright (C) 2012-2015 by Dmitry Kashitsyn   <korvin@deeptown.org>
+ *        Copyright (C) 2012-2015 by Roman Proskuryakov <humbug@deeptown.org>
+ *
+ *    LLST is based on the LittleSmalltalk which is
+ *        Copyright (C) 1987-2005 by Timothy A. Budd
+ *        Copyright (C) 2007 by Charles R. Childers
+ *        Copyright (C) 2005-2007 by Danny Reinhold
+ *
+ *    Original license of LittleSmalltalk may be found in the LICENSE file.
+ *
+ *
+ *    This file is part of LLST.
+ *    LLST is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    LLST is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with LLST.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef LLST_MAPPED_FILE_H_INCLUDED
+#define LLST_MAPPED_FILE_H_INCLUDED
+
+#include <types.h>
+#include <memory.h>
+#include <sys/types.h>
+#include <map>
+#include <string>
+
+// Files are mapped privately right after a page holding the object header,
+// so the contents are the bytes of an ordinary binary object which lives
+// outside of the heaps and is never copied by the GC. Writes to the object
+// are not stored to the file. Mappings are released when the collector
+// does not reach the object anymore or when they are closed explicitly.
+class MappedFiles : public IExternalObjectOwner {
+public:
+    explicit MappedFiles(IMemoryManager* memoryManager) : m_memoryManager(memoryManager) { }
+    virtual ~MappedFiles();
+
+    // Object of the class holding the file contents or 0. The class
+    // should reside in the static heap, because the GC does not update it.
+    TByteObject* map(const std::string& fileName, TClass* klass);
+
+    // Object sharing the pages with the bytes [start, start + size) of the
+    // mapped object or 0. Start of the slice should be aligned to the word.
+    TByteObject* slice(const TByteObject* object, std::size_t start, std::size_t size);
+
+    // Releases the file; object remains valid but becomes empty
+    bool close(TByteObject* object);
+
+    bool isMapped(const TObject* object) const { return m_mappings.find(const_cast<TObject*>(object)) != m_mappings.end(); }
+    std::size_t getCount() const { return m_mappings.size(); }
+
+    virtual void releaseObject(TObject* object);
+
+private:
+    struct TMapping {
+        uint8_t*    base;
+        std::size_t length;
+        int         fileID; // -1 when closed
+        off_t       offset; // of the object contents in the file
+    };
+    typedef std::map<TObject*, TMapping> TMappings;
+
+    TByteObject* mapRange(int fileID, off_t offset, std::size_t size, TClass* klass);
+    static void unmap(const TMapping& mapping);
+
+    IMemoryManager* m_memoryManager;
+    TMappings m_mappings;
+};
+
+#endif
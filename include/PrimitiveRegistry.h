@@ -0,0 +1,149 @@
+/*
+ *    PrimitiveRegistry.h
+ *
+ *    Table of the primitives with their properties and loadable native modules
+ *
+ *    LLST (LLVM Smalltalk or Low Level Smalltalk) version 0.4
+ *
+ *    LLST is
+ *        Copyright (C) 2012-2015 by Dmitry Kashitsyn   <korvin@deeptown.org>
+ *        Copyright (C) 2012-2015 by Roman Proskuryakov <humbug@deeptown.org>
+ *
+ *    LLST is based on the LittleSmalltalk which is
+ *        Copyright (C) 1987-2005 by Timothy A. Budd
+ *        Copyright (C) 2007 by Charles R. Childers
+ *        Copyright (C) 2005-2007 by Danny Reinhold
+ *
+ *    Original license of LittleSmalltalk may be found in the LICENSE file.
+ *
+ *
+ *    This file is part of LLST.
+ *    LLST is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    LLST is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with LLST.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef LLST_PRIMITIVE_REGISTRY_H_INCLUDED
+#define LLST_PRIMITIVE_REGISTRY_H_INCLUDED
+
+#include <memory.h>
+#include <new>
+#include <map>
+#include <string>
+#include <vector>
+
+// Native implementation of the primitive. Arguments are passed in the order
+// they were pushed, so the receiver of <N self arg> is args[0].
+typedef TObject* (*TPrimitiveFunction)(uint8_t opcode, TObjectArray& args, bool& primitiveFailed);
+
+struct TPrimitiveDescriptor {
+    enum TFlags {
+        // Primitive allocates in the heap or runs Smalltalk code,
+        // so the objects may be moved when it returns
+        mayCollect   = 1,
+        // Result depends only on the arguments, nothing is modified
+        isPure       = 2,
+        // JIT emits the code of the primitive in place of the call
+        isInlineable = 4,
+        // Primitive needs the process state and is performed by the VM itself
+        isVMOwned    = 8
+    };
+
+    const char*        name;     // 0 if the primitive is not defined
+    TPrimitiveFunction function; // 0 if the primitive is owned by the VM
+    int8_t             arity;    // arguments used by the primitive, -1 if it varies
+    uint8_t            flags;
+
+    bool isDefined() const { return name != 0; }
+    bool mayCollectGarbage() const { return flags & mayCollect; }
+    bool isPureFunction() const { return flags & isPure; }
+    bool isInlinedByJIT() const { return flags & isInlineable; }
+    bool isOwnedByVM() const { return flags & isVMOwned; }
+    // Extra arguments are ignored, missing ones fail the primitive
+    bool acceptsArguments(std::size_t count) const { return arity < 0 || static_cast<std::size_t>(arity) <= count; }
+};
+
+// Primitives are looked up by the opcode in the table of descriptors.
+// Properties are used by the interpreter to pass the arguments without
+// allocating them in the heap and by the JIT to decide which values
+// need to be protected by the GC roots around the primitive call.
+//
+// Native modules are shared libraries loaded at runtime. They export
+// the C function named "llstRegisterPrimitives" which adds their entries
+// by name. Such primitives are called with <128 name args...> and may
+// not allocate objects because they have no access to the heap.
+class PrimitiveRegistry {
+public:
+    static const std::size_t TABLE_SIZE = 256;
+    static const char* const MODULE_ENTRY_POINT;
+
+    PrimitiveRegistry();
+
+    const TPrimitiveDescriptor& get(uint8_t opcode) const { return m_table[opcode]; }
+    const TPrimitiveDescriptor& operator [](uint8_t opcode) const { return m_table[opcode]; }
+
+    // Fails if the opcode is already taken
+    bool add(uint8_t opcode, const char* name, TPrimitiveFunction function, int8_t arity, uint8_t flags);
+
+    // Named primitives of the native modules. Fails if the name is already taken.
+    bool addNamed(const std::string& name, TPrimitiveFunction function, int8_t arity, uint8_t flags = 0);
+    const TPrimitiveDescriptor* findNamed(const std::string& name) const;
+    std::size_t getNamedCount() const { return m_named.size(); }
+
+    // Opens the shared library and calls its entry point. Returns false
+    // and reports the reason if the module can not be loaded.
+    bool loadModule(const std::string& path);
+    std::size_t getModulesCount() const { return m_modules.size(); }
+
+    TObject* call(uint8_t opcode, TObjectArray& args, bool& primitiveFailed) const;
+    TObject* callNamed(TObjectArray& args, bool& primitiveFailed) const;
+
+private:
+    struct TNamedPrimitive {
+        std::string          name; // descriptor points to this storage
+        TPrimitiveDescriptor descriptor;
+    };
+    typedef std::map<std::string, TNamedPrimitive> TNamedPrimitives;
+
+    TPrimitiveDescriptor m_table[TABLE_SIZE];
+    TNamedPrimitives     m_named;
+    std::vector<void*>   m_modules; // handles are kept until exit
+
+    void addVMOwned(uint8_t opcode, const char* name, int8_t arity, uint8_t flags);
+};
+
+typedef void (*TModuleEntryPoint)(PrimitiveRegistry& registry);
+
+extern PrimitiveRegistry primitiveRegistry;
+
+// Array of the arguments placed on the native stack. It may be passed only
+// to the primitives that do not collect garbage, so the array is never moved.
+class TStackArguments {
+public:
+    static const std::size_t MAX_COUNT = 15;
+
+    explicit TStackArguments(std::size_t count)
+        : m_array(new (m_storage) TObjectArray(count, classRegistry.get<TObjectArray>())) { }
+
+    TObjectArray& operator *() { return *m_array; }
+    TObject*& operator [](std::size_t index) { return (*m_array)[index]; }
+
+private:
+    TObject*      m_storage[sizeof(TObjectArray) / sizeof(TObject*) + MAX_COUNT];
+    TObjectArray* m_array;
+};
+
+// Standard primitives implemented in primitives.cpp
+void registerStandardPrimitives(PrimitiveRegistry& registry);
+
+#endif
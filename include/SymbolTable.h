@@ -0,0 +1,93 @@
+/*
+ *    SymbolTable.h
+ *
+ *    Native table of the interned symbols
+ *
+ *    LLST (LLVM Smalltalk or Low Level Smalltalk) version 0.4
+ *
+ *    LLST is
+ *        Copyright (C) 2012-2015 by Dmitry Kashitsyn   <korvin@deeptown.org>
+ *        Copyright (C) 2012-2015 by Roman Proskuryakov <humbug@deeptown.org>
+ *
+ *    LLST is based on the LittleSmalltalk which is
+ *        Copyright (C) 1987-2005 by Timothy A. Budd
+ *        Copyright (C) 2007 by Charles R. Childers
+ *        Copyright (C) 2005-2007 by Danny Reinhold
+ *
+ *    Original license of LittleSmalltalk may be found in the LICENSE file.
+ *
+ *
+ *    This file is part of LLST.
+ *    LLST is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    LLST is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with LLST.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef LLST_SYMBOL_TABLE_H_INCLUDED
+#define LLST_SYMBOL_TABLE_H_INCLUDED
+
+#include <types.h>
+#include <deque>
+#include <vector>
+
+class IMemoryManager;
+
+// Hash set of the symbols keyed by their contents. It mirrors the symbols
+// tree of the Symbol class, so interning does not compare the symbols as
+// strings level by level. Symbols of the dynamic heap are registered as
+// GC roots, so the table survives collections. Hashes are kept in the
+// symbol headers and do not change when the symbols are moved.
+class SymbolTable {
+public:
+    explicit SymbolTable(IMemoryManager* memoryManager)
+        : m_memoryManager(memoryManager), m_mask(0), m_built(false) { }
+    ~SymbolTable() { clear(); }
+
+    // Collects the symbols from the tree of the Symbol class. Returns
+    // false if the image does not keep the symbols where expected.
+    bool build(TClass* symbolClass);
+    bool isBuilt() const { return m_built; }
+    void clear();
+
+    // Symbol with the same contents or 0
+    TSymbol* find(const uint8_t* bytes, std::size_t size) const;
+    TSymbol* find(const TByteObject* name) const { return find(name->getBytes(), name->getSize()); }
+
+    // Adds the newly created symbol
+    void insert(TSymbol* symbol);
+
+    std::size_t getSize() const { return m_symbols.size(); }
+
+private:
+    // Position is the index in m_symbols plus one, zero marks an empty slot
+    struct TSlot {
+        uint32_t hash;
+        uint32_t position;
+    };
+
+    struct TEntry {
+        TObject* symbol;  // first member, the address is registered as the GC root
+        bool     isRoot;
+    };
+
+    IMemoryManager*    m_memoryManager;
+    std::deque<TEntry> m_symbols; // deque does not move the elements when grown
+    std::vector<TSlot> m_slots;
+    uint32_t           m_mask;
+    bool               m_built;
+
+    void addSlot(uint32_t hash, uint32_t position);
+    void rehash(std::size_t capacity);
+};
+
+#endif
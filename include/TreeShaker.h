@@ -0,0 +1,117 @@
+/*
+ *    TreeShaker.h
+ *
+ *    Removes classes, methods and symbols that are not reachable
+ *    from the given roots, so that a minimal image may be written
+ *
+ *    LLST (LLVM Smalltalk or Low Level Smalltalk) version 0.4
+ *
+ *    LLST is
+ *        Copyright (C) 2012-2015 by Dmitry Kashitsyn   <korvin@deeptown.org>
+ *        Copyright (C) 2012-2015 by Roman Proskuryakov <humbug@deeptown.org>
+ *
+ *    LLST is based on the LittleSmalltalk which is
+ *        Copyright (C) 1987-2005 by Timothy A. Budd
+ *        Copyright (C) 2007 by Charles R. Childers
+ *        Copyright (C) 2005-2007 by Danny Reinhold
+ *
+ *    Original license of LittleSmalltalk may be found in the LICENSE file.
+ *
+ *
+ *    This file is part of LLST.
+ *    LLST is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    LLST is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with LLST.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef LLST_TREE_SHAKER_H_INCLUDED
+#define LLST_TREE_SHAKER_H_INCLUDED
+
+#include <types.h>
+#include <memory.h>
+
+#include <set>
+#include <list>
+#include <string>
+#include <vector>
+#include <tr1/unordered_set>
+
+// Tree shaker walks the object graph starting from the globals, classes
+// the VM refers to by name and the user provided roots. Since messages
+// are bound by selector, a method is reachable only when its class is
+// reachable and its selector is a root selector or is referenced by
+// some other reachable object, e.g. as a literal of a reachable method.
+// Classes stored in the globals dictionary and symbols stored in the
+// symbol table are not roots by themselves, so they are removed unless
+// something else refers to them.
+//
+// Shaker modifies the loaded image in place. New dictionaries and symbol
+// table nodes are owned by the shaker, so it should outlive the writing
+// of the shaken image.
+class TreeShaker {
+public:
+    struct TReport {
+        std::vector<std::string> removedClasses;
+        std::vector<std::string> removedMethods; // in the form of Class>>selector
+        std::size_t removedSymbols;
+        std::size_t keptSymbols;
+        TReport() : removedSymbols(0), keptSymbols(0) {}
+    };
+
+    explicit TreeShaker(const Image& image);
+
+    void addRootClass(const std::string& name) { m_rootClasses.insert(name); }
+    void addRootSelector(const std::string& selector) { m_rootSelectors.insert(selector); }
+
+    // Returns false if the image does not have the expected structure
+    bool shake();
+
+    const TReport& getReport() const { return m_report; }
+    void printReport(bool verbose) const;
+
+private:
+    typedef std::tr1::unordered_set<TObject*> TObjectSet;
+
+    const Image&          m_image;
+    std::set<std::string> m_rootClasses;
+    std::set<std::string> m_rootSelectors;
+
+    TClass*               m_classClass;
+    TClass*               m_symbolClass;
+    TObject*              m_symbolTable;
+    std::size_t           m_symbolTableIndex; // field of the Symbol class holding the table
+
+    TObjectSet            m_marked;
+    TObjectSet            m_liveSelectors;
+    std::vector<TClass*>  m_liveClasses;
+    std::vector<TObject*> m_pending;
+
+    TReport               m_report;
+    std::list< std::vector<TObject*> > m_objects;
+
+    bool     isClass(TObject* object) const;
+    bool     isLiveSelector(TSymbol* selector) const;
+    void     mark(TObject* object);
+    void     markPending();
+    bool     markMethods();
+
+    TObject* newObject(TClass* klass, std::size_t fieldsCount);
+    TDictionary* filterDictionary(TDictionary* dictionary, const std::vector<bool>& keep);
+    void     shakeMethods();
+    void     shakeGlobals();
+    void     shakeSymbols();
+    void     collectSymbols(TObject* node, std::vector<TObject*>& symbols);
+    TObject* buildTree(TClass* nodeClass, const std::vector<TObject*>& symbols, std::size_t first, std::size_t last);
+};
+
+#endif
@@ -44,10 +44,13 @@ struct args
     std::size_t maxHeapSize;
     std::string imagePath;
     std::string memoryManagerType;
+    std::size_t allocationProfileInterval;
+    int         allocationProfileChains;
     int         showHelp;
     int         showVersion;
     args() :
-        heapSize(0), maxHeapSize(0), memoryManagerType(), showHelp(false), showVersion(false)
+        heapSize(0), maxHeapSize(0), memoryManagerType(), allocationProfileInterval(0),
+        allocationProfileChains(false), showHelp(false), showVersion(false)
     {
     }
     void parse(int argc, char **argv);
@@ -91,6 +91,8 @@ struct TObjectTypes {
     llvm::StructType* blockReturn;
     llvm::StructType* process;
 
+    // Machine word integer type used for SmallInteger values and object sizes
+    llvm::IntegerType* word;
 
     void initializeFromModule(llvm::Module* module) {
         object      = module->getTypeByName("TObject");
@@ -106,6 +108,7 @@ struct TObjectTypes {
         byteObject  = module->getTypeByName("TByteObject");
         blockReturn = module->getTypeByName("TBlockReturn");
         process     = module->getTypeByName("TProcess");
+        word        = llvm::cast<llvm::IntegerType>(module->getTypeByName("TSize")->getElementType(0));
     }
 };
 
@@ -113,18 +116,15 @@ struct TJITGlobals {
     llvm::GlobalValue* nilObject;
     llvm::GlobalValue* trueObject;
     llvm::GlobalValue* falseObject;
-    llvm::GlobalValue* smallIntClass;
-    llvm::GlobalValue* arrayClass;
-    llvm::GlobalValue* contextClass;
+    // Slots of the TClassRegistry, see MethodCompiler::getKnownClass()
+    llvm::GlobalValue* classRegistry;
     llvm::GlobalValue* binarySelectors[3];
 
     void initializeFromModule(llvm::Module* module) {
         nilObject          = module->getGlobalVariable("nilObject");
         trueObject         = module->getGlobalVariable("trueObject");
         falseObject        = module->getGlobalVariable("falseObject");
-        smallIntClass      = module->getGlobalVariable("SmallInt");
-        arrayClass         = module->getGlobalVariable("Array");
-        contextClass       = module->getGlobalVariable("Context");
+        classRegistry      = module->getGlobalVariable("classRegistry");
         binarySelectors[0] = module->getGlobalVariable("<");
         binarySelectors[1] = module->getGlobalVariable("<=");
         binarySelectors[2] = module->getGlobalVariable("+");
@@ -278,6 +278,8 @@ private:
     void encodePhiIncomings(TJITContext& jit, st::PhiNode* phiNode);
     void setNodeValue(TJITContext& jit, st::ControlNode* node, llvm::Value* value);
     llvm::Value* getArgument(TJITContext& jit, std::size_t index = 0);
+    // Loads the class from the registry slot, so redefined classes are seen by the compiled code
+    llvm::Value* getKnownClass(TJITContext& jit, TClassRegistry::TIndex index);
 
     llvm::Value* allocateRoot(TJITContext& jit, llvm::Type* type);
     llvm::Value* protectPointer(TJITContext& jit, llvm::Value* value);
@@ -321,6 +323,12 @@ private:
                                 llvm::Value* rightObject,
                                 llvm::Value*& primitiveResult,
                                 llvm::BasicBlock* primitiveFailedBB);
+    void compileFloatPrimitive(TJITContext& jit,
+                                uint8_t /*primitive::FloatOpcode*/ opcode,
+                                llvm::Value* leftObject,
+                                llvm::Value* rightObject,
+                                llvm::Value*& primitiveResult,
+                                llvm::BasicBlock* primitiveFailedBB);
 
     TObjectAndSize createArray(TJITContext& jit, uint32_t elementsCount);
     llvm::Function* createFunction(TMethod* method);
@@ -371,14 +379,15 @@ public:
 };
 
 extern "C" {
-    TObject*     newOrdinaryObject(TClass* klass, uint32_t slotSize);
-    TByteObject* newBinaryObject(TClass* klass, uint32_t dataSize);
+    TObject*     newOrdinaryObject(TClass* klass, std::size_t slotSize);
+    TByteObject* newBinaryObject(TClass* klass, std::size_t dataSize);
     TObject*     sendMessage(TContext* callingContext, TSymbol* message, TObjectArray* arguments, TClass* receiverClass, uint32_t callSiteIndex);
     TBlock*      createBlock(TContext* callingContext, uint8_t argLocation, uint16_t bytePointer);
     TObject*     invokeBlock(TBlock* block, TContext* callingContext);
     void         emitBlockReturn(TObject* value, TContext* targetContext);
     const void*  getBlockReturnType();
     void         checkRoot(TObject* value, TObject** objectSlot);
+    TObject*     callRuntimePrimitive(uint8_t opcode, TObjectArray* args, bool& primitiveFailed);
 
     bool         bulkReplace(TObject* destination,
                             TObject* destinationStartOffset,
@@ -412,8 +421,8 @@ private:
 
     TBlock*  createBlock(TContext* callingContext, uint8_t argLocation, uint16_t bytePointer);
 
-    friend TObject*     newOrdinaryObject(TClass* klass, uint32_t slotSize);
-    friend TByteObject* newBinaryObject(TClass* klass, uint32_t dataSize);
+    friend TObject*     newOrdinaryObject(TClass* klass, std::size_t slotSize);
+    friend TByteObject* newBinaryObject(TClass* klass, std::size_t dataSize);
     friend TObject*     sendMessage(TContext* callingContext, TSymbol* message, TObjectArray* arguments, TClass* receiverClass, uint32_t callSiteIndex);
     friend TBlock*      createBlock(TContext* callingContext, uint8_t argLocation, uint16_t bytePointer);
     friend TObject*     invokeBlock(TBlock* block, TContext* callingContext);
@@ -38,9 +38,12 @@
 #include <cstddef>
 #include <stdint.h>
 #include <tr1/memory>
+#include <tr1/unordered_map>
 #include <types.h>
 #include <vector>
 #include <list>
+#include <map>
+#include <string>
 #include <fstream>
 #include "Timer.h"
 
@@ -140,6 +143,22 @@ private:
     object_ptr(const object_ptr& value);
 };
 
+// Heap visitor is used to walk over all objects allocated by
+// the memory manager. See IMemoryManager::walkHeap() for details.
+class IHeapVisitor {
+public:
+    virtual void visitObject(TObject* object) = 0;
+    virtual ~IHeapVisitor() {}
+};
+
+// Owner of the objects placed outside of the heaps, see registerExternalObject()
+class IExternalObjectOwner {
+public:
+    // Object is not reachable anymore and may be released
+    virtual void releaseObject(TObject* object) = 0;
+    virtual ~IExternalObjectOwner() {}
+};
+
 // Generic interface to a memory manager.
 // Custom implementations such as BakerMemoryManager
 // implement this interface.
@@ -147,6 +166,17 @@ class IMemoryManager {
 protected:
     std::tr1::shared_ptr<IGCLogger> m_gcLogger;
     IMemoryManager(): m_gcLogger(new EmptyGCLogger()){}
+
+    // Visits objects placed one after another in the region [begin, end).
+    // Objects are allocated without gaps so the next one starts right
+    // after the slot of the previous one.
+    static void walkRegion(IHeapVisitor& visitor, uint8_t* begin, uint8_t* end) {
+        while (begin < end) {
+            TObject* object = reinterpret_cast<TObject*>(begin);
+            begin += object->getSlotSize();
+            visitor.visitObject(object);
+        }
+    }
 public:
     virtual void setLogger(std::tr1::shared_ptr<IGCLogger> logger){
         m_gcLogger = logger;
@@ -154,6 +184,10 @@ public:
 
     virtual bool initializeHeap(std::size_t heapSize, std::size_t maxSize = 0) = 0;
     virtual bool initializeStaticHeap(std::size_t staticHeapSize) = 0;
+    // Static heap may be provided by the caller, e.g. mapped from the image
+    // file. Static heap grows down, so the last usedSize bytes are occupied
+    // and the rest is free. Such heap is not released.
+    virtual void adoptStaticHeap(void* heap, std::size_t heapSize, std::size_t usedSize) = 0;
 
     virtual void* allocate(std::size_t size, bool* collectionOccured = 0) = 0;
     virtual void* staticAllocate(std::size_t size) = 0;
@@ -168,12 +202,48 @@ public:
     virtual void  registerExternalHeapPointer(object_ptr& pointer) = 0;
     virtual void  releaseExternalHeapPointer(object_ptr& pointer) = 0;
 
+    // Objects placed outside of the heaps, e.g. memory mapped files. They are
+    // never moved. The owner is asked to release the object when a full
+    // collection does not reach it anymore. Class of the object should not move.
+    virtual void  registerExternalObject(TObject* object, IExternalObjectOwner* owner) = 0;
+    virtual void  unregisterExternalObject(TObject* object) = 0;
+
     virtual uint32_t allocsBeyondCollection() = 0;
     virtual TMemoryManagerInfo getStat() = 0;
 
+    // Calls visitor for every object residing in the static heap and in the
+    // dynamic heap. Dynamic heap may contain garbage objects that was not yet
+    // collected, so caller should collect garbage before walking if only
+    // live objects are of interest. Heap should not be altered during the walk.
+    virtual void walkHeap(IHeapVisitor& visitor) = 0;
+
     virtual ~IMemoryManager() {};
 };
 
+// Heap census calculates the amount of instances and the
+// total space occupied by them for every class in the heap.
+class HeapCensus : public IHeapVisitor {
+public:
+    struct TClassInfo {
+        TClass*  klass;
+        uint32_t instances;
+        uint32_t bytes;
+        TClassInfo(TClass* klass = 0) : klass(klass), instances(0), bytes(0) {}
+    };
+
+    HeapCensus() : m_totalObjects(0), m_totalBytes(0) {}
+    virtual void visitObject(TObject* object);
+
+    // Returns class records sorted by the occupied space
+    std::vector<TClassInfo> getHistogram() const;
+    void printHistogram(std::size_t maxEntries = 0) const;
+private:
+    typedef std::map<TClass*, TClassInfo> TClassMap;
+    TClassMap m_classes;
+    uint32_t  m_totalObjects;
+    uint32_t  m_totalBytes;
+};
+
 // When pointer to a heap object is stored outside of the heap,
 // specific actions need to be taken in order to prevent pointer
 // invalidation due to GC procedure. External pointers need to be
@@ -292,6 +362,7 @@ protected:
     std::size_t m_staticHeapSize;
     uint8_t*  m_staticHeapBase;
     uint8_t*  m_staticHeapPointer;
+    bool      m_staticHeapOwned;
 
 
     struct TRootPointers {
@@ -331,12 +402,29 @@ protected:
     // pointers so they will point to correct location even after
     // garbage collection.
     object_ptr* m_externalPointersHead;
+
+    // Objects outside of the heaps are marked when the collector reaches them.
+    // Address bounds filter out the static objects without the map lookup.
+    struct TExternalObject {
+        IExternalObjectOwner* owner;
+        bool isReachable;
+    };
+    typedef std::map<TMovableObject*, TExternalObject> TExternalObjects;
+    TExternalObjects m_externalObjects;
+    uint8_t* m_externalObjectsBegin;
+    uint8_t* m_externalObjectsEnd;
+
+    void markExternalObject(TMovableObject* object);
+    void resetExternalMarks();
+    // Should be called after the full collection only
+    void releaseUnreachableObjects();
 public:
     BakerMemoryManager();
     virtual ~BakerMemoryManager();
 
     virtual bool  initializeHeap(std::size_t heapSize, std::size_t maxHeapSize = 0);
     virtual bool  initializeStaticHeap(std::size_t staticHeapSize);
+    virtual void  adoptStaticHeap(void* heap, std::size_t heapSize, std::size_t usedSize);
     virtual void* allocate(std::size_t requestedSize, bool* gcOccured = 0);
     virtual void* staticAllocate(std::size_t requestedSize);
     virtual void  collectGarbage();
@@ -350,11 +438,15 @@ public:
     virtual void  registerExternalHeapPointer(object_ptr& pointer);
     virtual void  releaseExternalHeapPointer(object_ptr& pointer);
 
+    virtual void  registerExternalObject(TObject* object, IExternalObjectOwner* owner);
+    virtual void  unregisterExternalObject(TObject* object);
+
     // Returns amount of allocations that were done after last GC
     // May be used as a flag that GC had just took place
     virtual uint32_t allocsBeyondCollection() { return m_memoryInfo.allocationsCount; }
 
     virtual TMemoryManagerInfo getStat();
+    virtual void walkHeap(IHeapVisitor& visitor);
 };
 
 class GenerationalMemoryManager : public BakerMemoryManager
@@ -384,23 +476,26 @@ public:
     virtual bool checkRoot(TObject* value, TObject** objectSlot);
     virtual void collectGarbage();
     virtual TMemoryManagerInfo getStat();
+    virtual void walkHeap(IHeapVisitor& visitor);
 };
 
 class NonCollectMemoryManager : public IMemoryManager
 {
 protected:
     TMemoryManagerInfo m_memoryInfo;
-    std::auto_ptr<IGCLogger> m_gcLogger;
 
     size_t    m_heapSize;
     uint8_t*  m_heapBase;
     uint8_t*  m_heapPointer;
 
     std::vector<void*> m_usedHeaps;
+    // Final heap pointers of the filled heaps, i.e. all except the last one
+    std::vector<uint8_t*> m_usedHeapPointers;
 
     size_t    m_staticHeapSize;
     uint8_t*  m_staticHeapBase;
     uint8_t*  m_staticHeapPointer;
+    bool      m_staticHeapOwned;
 
     void growHeap();
 public:
@@ -409,6 +504,7 @@ public:
 
     virtual bool  initializeHeap(size_t heapSize, size_t maxHeapSize = 0);
     virtual bool  initializeStaticHeap(size_t staticHeapSize);
+    virtual void  adoptStaticHeap(void* heap, size_t heapSize, size_t usedSize);
     virtual void* allocate(size_t requestedSize, bool* gcOccured = 0);
     virtual void* staticAllocate(size_t requestedSize);
     virtual bool  isInStaticHeap(void* location);
@@ -420,9 +516,13 @@ public:
     virtual void  releaseExternalPointer(TObject** /*pointer*/) {}
     virtual void  registerExternalHeapPointer(object_ptr& /*pointer*/) {}
     virtual void  releaseExternalHeapPointer(object_ptr& /*pointer*/) {}
+    // Nothing is collected, so owner releases the objects by itself
+    virtual void  registerExternalObject(TObject* /*object*/, IExternalObjectOwner* /*owner*/) {}
+    virtual void  unregisterExternalObject(TObject* /*object*/) {}
     virtual bool  checkRoot(TObject* /*value*/, TObject** /*objectSlot*/) { return false; }
     virtual uint32_t allocsBeyondCollection() { return 0; }
     virtual TMemoryManagerInfo getStat();
+    virtual void walkHeap(IHeapVisitor& visitor);
 };
 
 class LLVMMemoryManager : public BakerMemoryManager {
@@ -452,39 +552,147 @@ public:
 
 extern "C" { extern LLVMMemoryManager::TStackEntry* llvm_gc_root_chain; }
 
+struct TGlobals;
+
 class Image
 {
+public:
+    // Classic encoding stores numbers as runs of 0xFF bytes plus the
+    // remainder and inline integers as 32 or 64 bit little endian words.
+    // Compact encoding starts with the header and stores all numbers as
+    // LEB128 varints (zigzag for the inline integers), so it does not
+    // depend on the byte order. Byte object payloads are stored raw.
+    enum TImageEncoding {
+        classicEncoding = 1,
+        compactEncoding = 2
+    };
+
+    // Stored in the headers of the compact and native images.
+    // Classic images have no header, so they never have external sources.
+    enum TImageFlags {
+        externalSourcesFlag = 1 // text fields of the methods refer to the sources file
+    };
+
 private:
     std::vector<TObject*> m_indirects;
     std::ifstream m_inputStream;
+    TImageEncoding m_encoding;
+
+    // Compact image header: magic, encoding, then three 64 bit little endian
+    // counters that allow to size the static heap exactly at any word size
+    // and the 64 bit little endian image flags
+    struct TCompactImageHeader {
+        char     magic[7];
+        uint8_t  encoding;
+        uint64_t pointerWords;  // headers and fields of all objects
+        uint64_t binaryBytes;   // payloads of the byte objects
+        uint64_t binaryObjects; // each one may take up to a word of padding
+        uint64_t flags;         // TImageFlags
+    };
 
     enum TImageRecordType {
         invalidObject = 0,
         ordinaryObject,
-        inlineInteger,  // inline 32 bit integer in network byte order
+        inlineInteger,  // inline 32 bit integer in little endian byte order
         byteObject,     //
         previousObject, // link to previously loaded object
-        nilObject       // uninitialized (nil) field
+        nilObject,      // uninitialized (nil) field
+        inlineLongInteger, // inline 64 bit integer that does not fit into inlineInteger
+
+        // Records of the serialized object graphs, see ImageWriter::writeGraph()
+        globalObject,   // class or other global resolved by name
+        symbolObject,   // symbol resolved by name from the symbol table
+        charObject,     // unique character resolved by value
+        trueObject,
+        falseObject,
+        metaclassObject // metaclass resolved by the name of its instance class
     };
 
     uint32_t readWord();
+    uint64_t readVarint();
     TObject* readObject();
     template<typename ResultType>
     ResultType* readObject() { return static_cast<ResultType*>(readObject()); }
 
+    bool     openImage(const std::string& fileName);
+    void     readGlobals();
+
+    // Native image is the static heap stored as is, so it may be mapped
+    // into memory directly. Pointers are stored as if the heap was placed
+    // at the preferred base address. If the heap is mapped elsewhere, each
+    // pointer listed in the relocation table is adjusted by the difference.
+    struct TNativeImageHeader {
+        char     magic[8];
+        uint32_t version;
+        uint32_t byteOrder;         // BYTE_ORDER_MARK in the writer's byte order
+        uint32_t wordSize;
+        uint32_t globalsCount;
+        uint64_t preferredBase;
+        uint64_t heapOffset;        // aligned to NATIVE_IMAGE_ALIGNMENT
+        uint64_t heapSize;
+        uint64_t relocationsOffset;
+        uint64_t relocationsCount;  // uint32_t word indices of the pointer slots
+        uint64_t flags;             // TImageFlags
+        uint64_t globals[15];       // heap offsets in the order of readGlobals()
+    };
+
+    static TObject** getGlobalSlot(TGlobals& source, std::size_t index);
+
+    bool     isNativeImage(const std::string& fileName);
+    bool     loadNativeImage(const std::string& fileName);
+
+    // Moves the loaded objects within the static heap so that
+    // objects used together by the method lookup are adjacent
+    void     applyLocalityLayout();
+
     IMemoryManager* m_memoryManager;
+    void*           m_mappedHeap;
+    std::size_t     m_mappedHeapSize;
+    std::string     m_fileName;
+    bool            m_externalSources;
+    bool            m_localityLayout;
 public:
     Image(IMemoryManager* manager)
-        : m_memoryManager(manager)
+        : m_encoding(classicEncoding), m_memoryManager(manager), m_mappedHeap(0), m_mappedHeapSize(0),
+          m_externalSources(false), m_localityLayout(true)
     { }
+    ~Image();
 
+    // Address the native image heap is preferably mapped to
+    static const uintptr_t NATIVE_IMAGE_BASE;
+
+    // Loads either the classic or the native image
     bool     loadImage(const std::string& fileName);
-    void     storeImage(const char* fileName);
+
+    // Objects of the classic and compact images are laid out in the order
+    // of serialization unless the locality layout is enabled (default).
+    // Native images are laid out by the writer.
+    void     setLocalityLayout(bool enabled) { m_localityLayout = enabled; }
+    const std::string& getFileName() const { return m_fileName; }
+
+    // Writes objects reachable from the globals in the format of the loaded image.
+    // If externalSources is set, method sources are written to the sources file.
+    bool     storeImage(const std::string& fileName, bool externalSources);
+
+    // Method sources may be stored in the separate file next to the image.
+    // Text field of such method holds the SmallInt offset of the record
+    // which is the decimal length of the text, newline and the text itself.
+    static std::string getSourcesFileName(const std::string& imageFileName);
+    static bool readSource(const std::string& sourcesFileName, std::size_t offset, std::string& text);
+    static bool readSource(std::istream& sources, std::size_t offset, std::string& text);
+    bool     readSource(std::size_t offset, std::string& text) const { return readSource(getSourcesFileName(m_fileName), offset, text); }
+    // Mode is recorded in the header of the image when it is written
+    bool     hasExternalSources() const { return m_externalSources; }
+
+    // Loads the heap dump written by ImageWriter::writeHeapDump().
+    // Objects that are not reachable from the globals are stored to roots.
+    bool     loadHeapDump(const std::string& fileName, std::vector<TObject*>& roots);
 
     template<typename N> TObject* getGlobal(const N* name) const;
     template<typename T, typename N> T* getGlobal(const N* name) const { return static_cast<T*>(getGlobal(name)); }
 
     class ImageWriter;
+    class GraphReader;
     // GLobal VM objects
 };
 
@@ -506,20 +714,194 @@ struct TGlobals {
 
 extern TGlobals globals;
 
+// Classes known to the VM. They are not stored in the image but resolved
+// by name from the globals dictionary once the image is loaded, so the VM
+// never looks them up when allocating. Resolution is repeated whenever the
+// method cache is flushed, which happens after each collection and when a
+// class is redefined. Missing classes (like Float in older images) are 0.
+struct TClassRegistry {
+    enum TIndex {
+        arrayClass = 0,
+        blockClass,
+        byteArrayClass,
+        charClass,
+        classClass,
+        contextClass,
+        dictionaryClass,
+        floatClass,
+        integerClass,
+        methodClass,
+        nodeClass,
+        processClass,
+        smallIntClass,
+        stringClass,
+        stringBufferClass,
+        symbolClass,
+        classesCount
+    };
+
+    // Order of the slots is shared with the JIT, see MethodCompiler::getKnownClass()
+    TClass* classes[classesCount];
+
+    static const char* const names[classesCount];
+
+    TClass* operator[](TIndex index) const { return classes[index]; }
+
+    // Class of the instances of T. Only specializations below are defined.
+    template<class T> TClass* get() const;
+
+    void resolve(const TDictionary* globalsObject);
+    void clear();
+};
+
+template<> inline TClass* TClassRegistry::get<TObjectArray>() const { return classes[arrayClass]; }
+template<> inline TClass* TClassRegistry::get<TSymbolArray>() const { return classes[arrayClass]; }
+template<> inline TClass* TClassRegistry::get<TBlock>()       const { return classes[blockClass]; }
+template<> inline TClass* TClassRegistry::get<TByteArray>()   const { return classes[byteArrayClass]; }
+template<> inline TClass* TClassRegistry::get<TChar>()        const { return classes[charClass]; }
+template<> inline TClass* TClassRegistry::get<TClass>()       const { return classes[classClass]; }
+template<> inline TClass* TClassRegistry::get<TContext>()     const { return classes[contextClass]; }
+template<> inline TClass* TClassRegistry::get<TDictionary>()  const { return classes[dictionaryClass]; }
+template<> inline TClass* TClassRegistry::get<TFloat>()       const { return classes[floatClass]; }
+template<> inline TClass* TClassRegistry::get<TMethod>()      const { return classes[methodClass]; }
+template<> inline TClass* TClassRegistry::get<TNode>()        const { return classes[nodeClass]; }
+template<> inline TClass* TClassRegistry::get<TProcess>()     const { return classes[processClass]; }
+template<> inline TClass* TClassRegistry::get<TString>()      const { return classes[stringClass]; }
+template<> inline TClass* TClassRegistry::get<TStringBuffer>() const { return classes[stringBufferClass]; }
+template<> inline TClass* TClassRegistry::get<TSymbol>()      const { return classes[symbolClass]; }
+
+extern TClassRegistry classRegistry;
+
 class Image::ImageWriter
 {
 private:
-    std::vector<TObject*> m_writtenObjects; //used to link objects together with type 'previousObject'
+    typedef std::tr1::unordered_map<TObject*, uint32_t> TObjectIndex;
+
+    TObjectIndex          m_writtenObjects; //used to link objects together with type 'previousObject'
+    std::vector<TObject*> m_pendingObjects; // explicit stack of writeObject()
+    std::vector<uint8_t>  m_buffer;         // whole image is written to the file at once
     TGlobals              m_globals;
+    TImageEncoding        m_encoding;
+    TCompactImageHeader   m_header;         // counters are updated by writeObject()
+
+    typedef std::tr1::unordered_map<TObject*, TObject*> TTextMap;
+
+    TClass*               m_methodClass;
+    std::string           m_sourcesInput;   // resolves texts of the methods loaded with external sources
+    std::ifstream         m_sourcesStream;  // sources input opened once for the whole image
+    bool                  m_externalSources;
+    std::vector<uint8_t>  m_sources;        // sources file being written
+    TTextMap              m_methodTexts;    // text field of each method as it is written
+    std::list< std::vector<TObject*> > m_temporaryObjects; // texts loaded back from the sources
+
+    // Returns the field value to be written which differs from
+    // the actual one only for the text field of the methods
+    TObject*         getField(TObject* object, uint32_t index);
+    TObject*         getMethodText(TMethod* method);
+    void             beginSources();
+    bool             writeSources(const char* imageFileName);
+
+    bool                  m_graph;          // writing the serialized object graph, not the image
 
     TImageRecordType getObjectType(TObject* object) const;
-    int              getPreviousObjectIndex(TObject* object) const;
-    void             writeWord(std::ofstream& os, uint32_t word);
-    void             writeObject(std::ofstream& os, TObject* object);
+    TImageRecordType getGraphObjectType(TObject* object) const;
+    TClass*          getInstanceClass(TClass* metaclass) const;
+    uint32_t         getPreviousObjectIndex(TObject* object) const;
+    void             writeWord(uint32_t word);
+    void             writeVarint(uint64_t value);
+    void             beginImage();
+    void             endImage();
+    bool             writeObject(TObject* object);
+    void             writeName(const TByteObject* name);
+    void             writeGlobals();
+
+    // Data is written to the temporary file which replaces the target
+    // one only after it is synced, so a failure never damages the image.
+    static bool      writeFile(const char* fileName, const std::vector<uint8_t>& data);
 public:
     ImageWriter();
     ImageWriter& setGlobals(const TGlobals& globals);
-    void writeTo(const char* fileName);
+    ImageWriter& setEncoding(TImageEncoding encoding);
+    // Texts of the methods that refer to the inputFileName are resolved. If externalize
+    // is set, all texts are written to the sources file next to the written image.
+    ImageWriter& setSources(const std::string& inputFileName, bool externalize);
+    bool writeTo(const char* fileName);
+
+    // Heap dump is an image followed by the additional roots, each
+    // prefixed by a non zero word. Zero word marks the end of the dump.
+    // Additional roots are the heap objects that were not written along
+    // with the globals, e.g. ones referenced only from the hptr<>.
+    bool writeHeapDump(const char* fileName, IMemoryManager* memoryManager);
+
+    // Writes objects reachable from the globals as the native image
+    // laid out for the heap mapped to the preferredBase address.
+    bool writeNativeImage(const char* fileName, uintptr_t preferredBase = Image::NATIVE_IMAGE_BASE);
+
+    // Serializes objects reachable from the root in the compact encoding.
+    // Classes, symbols, characters and booleans are written by reference
+    // and are resolved by the reader. Metaclasses are written by the name
+    // of their instance class. Methods, the execution state and the classes
+    // not registered in globals can not be serialized, false is returned
+    // if the graph contains them.
+    bool writeGraph(TObject* root, std::vector<uint8_t>& buffer);
+};
+
+// Parses the graph written by ImageWriter::writeGraph() without touching
+// the heap. Each record that creates or resolves an object becomes a node
+// in the order of writing. Nodes of the ordinary and byte objects refer to
+// their class and fields, the rest should be resolved by the caller.
+class Image::GraphReader
+{
+public:
+    enum TNodeKind {
+        ordinaryNode,
+        byteNode,
+        globalNode,     // data is the name of the global
+        metaclassNode,  // data is the name of the global whose class it is
+        symbolNode,     // data is the name of the symbol
+        charNode        // size is the value of the character
+    };
+
+    struct TNode {
+        TNodeKind   kind;
+        std::size_t offset;     // name or bytes of the object within the graph
+        std::size_t size;       // count of the fields or bytes, length of the name
+        uint32_t    classNode;  // global node of the class for the objects
+        std::size_t firstField; // position in the references of the ordinary objects
+    };
+
+    // Either the immediate object (SmallInt, nil, true, false) or a node
+    struct TReference {
+        TObject* immediate;
+        uint32_t node;
+    };
+
+    GraphReader() : m_data(0), m_size(0), m_position(0) { m_root.immediate = 0; m_root.node = 0; }
+
+    // Returns false if the data is not a well formed graph
+    bool read(const uint8_t* data, std::size_t size);
+
+    const std::vector<TNode>& getNodes() const { return m_nodes; }
+    const TReference& getRoot() const { return m_root; }
+    const TReference& getField(const TNode& node, std::size_t index) const { return m_fields[node.firstField + index]; }
+    const uint8_t*    getData(const TNode& node) const { return m_data + node.offset; }
+
+private:
+    const uint8_t*          m_data;
+    std::size_t             m_size;
+    std::size_t             m_position;
+    std::vector<TNode>      m_nodes;
+    std::vector<TReference> m_fields;
+    TReference              m_root;
+
+    // Slot filled by the next record, field -1 is the class of the node
+    struct TSlot {
+        uint32_t node;
+        int32_t  field;
+    };
+
+    bool readVarint(uint64_t& value);
+    bool readRecord(TReference& reference, std::vector<TSlot>& pending);
 };
 
 #endif
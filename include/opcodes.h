@@ -111,6 +111,21 @@ enum {
     integerNew        = 32,
     flushCache        = 34,
     bulkReplace       = 38,
+    heapCensus        = 110,
+    heapDump          = 111,
+    saveImage         = 112,
+    methodSource      = 113,
+    callNamed         = 128,
+    loadModule        = 129,
+    arraySort         = 130,
+    shallowCopy       = 131,
+    deepCopy          = 132,
+    serializeGraph    = 133,
+    materializeGraph  = 134,
+    bufferAppend      = 135,
+    bufferAppendByte  = 136,
+    bufferAppendInt   = 137,
+    bufferFreeze      = 138,
     LLVMsendMessage   = 252,
     getSystemTicks    = 253
 };
@@ -125,7 +140,8 @@ enum SmallIntOpcode {
     smallIntSub,
     smallIntBitOr = 36,
     smallIntBitAnd = 37,
-    smallIntBitShift = 39
+    smallIntBitShift = 39,
+    smallIntBitXor = 41
 };
 
 enum {
@@ -143,7 +159,32 @@ enum {
     ioFileSetStatIntoArray = 105,
     ioFileReadIntoByteArray = 106,
     ioFileWriteFromByteArray = 107,
-    ioFileSeek = 108
+    ioFileSeek = 108,
+    ioFileWriteRange = 114,
+    ioFileReadLine,
+    ioFileFlush,
+    ioFileMap,
+    ioFileMapSlice,
+    ioFileUnmap,
+    ioWait,
+    ioPoll,
+    ioWaitBlocking,
+    socketListen,
+    socketAccept,
+    socketConnect,
+    socketError,
+    socketPort
+};
+
+enum ForeignOpcode {
+    ffiOpen = 230,
+    ffiClose,
+    ffiResolve = 233,
+    ffiCall,
+    ffiCallInt,
+    ffiCallString,
+    ffiGetInt = 240,
+    ffiSetInt
 };
 
 enum IntegerOpcode {
@@ -153,7 +194,38 @@ enum IntegerOpcode {
     integerMul,
     integerSub,
     integerLess,
-    integerEqual
+    integerEqual,
+    integerAsSmallInt = 33,
+    integerTruncSmallInt = 40,
+    integerPrintString = 42
+};
+
+enum FloatOpcode {
+    floatAdd = 50,
+    floatSub,
+    floatMul,
+    floatDiv,
+    floatLess,
+    floatEqual,
+    floatTruncated,
+    floatNew,
+    floatPrintString,
+    floatParse
+};
+
+enum SymbolOpcode {
+    symbolIntern = 60,
+    symbolHash,
+    symbolEqual,
+    symbolLess
+};
+
+enum StringOpcode {
+    stringHash = 64,
+    stringEqual,
+    stringLess,
+    stringIndexOf,
+    stringOccurrencesOf
 };
 }
 
@@ -38,7 +38,17 @@
 #include <types.h>
 
 TObject* callPrimitive(uint8_t opcode, TObjectArray* arguments, bool& primitiveFailed);
-TObject* callSmallIntPrimitive(uint8_t opcode, int32_t leftOperand, int32_t rightOperand, bool& primitiveFailed);
+TObject* callSmallIntPrimitive(uint8_t opcode, intptr_t leftOperand, intptr_t rightOperand, bool& primitiveFailed);
 TObject* callIOPrimitive(uint8_t opcode, TObjectArray& args, bool& primitiveFailed);
+// Libraries, symbols and calls of the foreign function interface
+TObject* callFFIPrimitive(uint8_t opcode, TObjectArray& args, bool& primitiveFailed);
+// Sorts the array of SmallIntegers or strings in place: <130 array isStable>
+TObject* sortArray(uint8_t opcode, TObjectArray& args, bool& primitiveFailed);
+// Hashing, comparison and search over the bytes of strings, symbols and byte arrays
+TObject* callStringPrimitive(uint8_t opcode, TObject* receiver, TObject* argument, bool& primitiveFailed);
+
+// Integer and Float primitives allocate their results, so they are performed by the VM
+bool isIntegerPrimitive(uint8_t opcode);
+bool isFloatPrimitive(uint8_t opcode);
 
 #endif
@@ -36,6 +36,7 @@
 #define LLST_TYPES_H_INCLUDED
 
 #include <stdint.h>
+#include <cstring>
 #include <sys/types.h>
 #include <new>
 #include <string>
@@ -53,43 +54,71 @@ inline std::size_t correctPadding(std::size_t size) { return (size + sizeof(void
 //inline size_t correctPadding(size_t size) { return (size + 3) & ~3; }
 
 // VM handles the special case when object pointer has lowest bit set to 1
-// In that case pointer is treated as explicit 31 bit integer equal to (value >> 1)
-inline bool isSmallInteger(const TObject* value) { return reinterpret_cast<int32_t>(value) & 1; }
+// In that case pointer is treated as explicit integer equal to (value >> 1).
+// SmallInteger occupies the whole machine word except the tag bit, so it is
+// 31 bit wide on 32-bit platforms and 63 bit wide on 64-bit ones.
+inline bool isSmallInteger(const TObject* value) { return reinterpret_cast<intptr_t>(value) & 1; }
 
 // This is a special interpretation of Smalltalk's SmallInteger
 // The struct is binary compatible with the TObject*
 struct TInteger {
-    TInteger(int32_t value) : m_value( reinterpret_cast<int32_t>(newInteger(value)) ) { }
-    TInteger(const TObject* value) : m_value( isSmallInteger(value) ? reinterpret_cast<int32_t>(value) : throw std::bad_cast() ) { }
+    TInteger(intptr_t value) : m_value( reinterpret_cast<intptr_t>(newInteger(value)) ) { }
+#if __SIZEOF_POINTER__ > 4
+    // On 64-bit platforms the overloads below keep 32-bit arguments
+    // (including literal 0) from being ambiguous with the pointer constructor
+    TInteger(int32_t value)   : m_value( reinterpret_cast<intptr_t>(newInteger(value)) ) { }
+    TInteger(uint32_t value)  : m_value( reinterpret_cast<intptr_t>(newInteger(value)) ) { }
+    TInteger(uintptr_t value) : m_value( reinterpret_cast<intptr_t>(newInteger(static_cast<intptr_t>(value))) ) { }
+#endif
+    TInteger(const TObject* value) : m_value( isSmallInteger(value) ? reinterpret_cast<intptr_t>(value) : throw std::bad_cast() ) { }
 
-    int32_t getValue() const { return getIntegerValue(reinterpret_cast<TObject*>(m_value)); }
-    int32_t rawValue() const { return m_value; }
+    intptr_t getValue() const { return getIntegerValue(reinterpret_cast<TObject*>(m_value)); }
+    intptr_t rawValue() const { return m_value; }
 
-    operator int32_t() const { return getValue(); }
-    int32_t  operator +(int32_t right) const { return getValue() + right; }
-    int32_t  operator -(int32_t right) const { return getValue() - right; }
+    operator intptr_t() const { return getValue(); }
+    intptr_t operator +(intptr_t right) const { return getValue() + right; }
+    intptr_t operator -(intptr_t right) const { return getValue() - right; }
+#if __SIZEOF_POINTER__ > 4
+    intptr_t operator +(int32_t right) const { return getValue() + right; }
+    intptr_t operator -(int32_t right) const { return getValue() - right; }
+#endif
     operator TObject*() const { return reinterpret_cast<TObject*>(m_value); }
 
+    // Range of values that fit into the tagged representation
+    static const intptr_t MAX_VALUE = static_cast<intptr_t>(~static_cast<uintptr_t>(0) >> 2);
+    static const intptr_t MIN_VALUE = -MAX_VALUE - 1;
+    static bool isValid(intptr_t value) { return value >= MIN_VALUE && value <= MAX_VALUE; }
+
 private:
-    int32_t m_value;
+    intptr_t m_value;
 protected:
-    static int32_t  getIntegerValue(const TObject* value) { return reinterpret_cast<int32_t>(value) >> 1; }
-    static TObject* newInteger(int32_t value) { return reinterpret_cast<TObject*>((value << 1) | 1); }
+    static intptr_t getIntegerValue(const TObject* value) { return reinterpret_cast<intptr_t>(value) >> 1; }
+    static TObject* newInteger(intptr_t value) { return reinterpret_cast<TObject*>((static_cast<uintptr_t>(value) << 1) | 1); }
 };
 
 // Helper struct used to hold object size and special
-// status flags packed in a 4 bytes space. TSize is used
+// status flags packed in a machine word. TSize is used
 // in the TObject hierarchy and in the TMovableObject in GC
 struct TSize {
 private:
     // Raw value holder. Do not edit this value directly
-    uint32_t data;
+    uintptr_t data;
 
     static const int FLAG_RELOCATED = 1;
     static const int FLAG_BINARY    = 2;
     static const int FLAGS_MASK     = FLAG_RELOCATED | FLAG_BINARY;
+
+#if __SIZEOF_POINTER__ > 4
+    // On 64-bit platforms the upper half of the word is spare. It holds the
+    // hash of the binary object contents or the tag of an ordinary object,
+    // zero if not known.
+    static const int       HASH_SHIFT = 32;
+    static const uintptr_t SIZE_MASK  = (static_cast<uintptr_t>(1) << HASH_SHIFT) - 1;
+#else
+    static const uintptr_t SIZE_MASK  = ~static_cast<uintptr_t>(0);
+#endif
 public:
-    TSize(uint32_t size, bool binary = false, bool relocated = false)
+    TSize(std::size_t size, bool binary = false, bool relocated = false)
     {
         data  = (size << 2);
         data |= binary    ? FLAG_BINARY : 0;
@@ -98,8 +127,15 @@ public:
 
     TSize(const TSize& size) : data(size.data) { }
 
-    uint32_t getSize() const { return data >> 2; }
-    uint32_t setSize(uint32_t size) { return data = (data & 3) | (size << 2); }
+    std::size_t getSize() const { return (data & SIZE_MASK) >> 2; }
+    std::size_t setSize(std::size_t size) { return data = (data & ~SIZE_MASK) | (data & FLAGS_MASK) | (size << 2); }
+#if __SIZEOF_POINTER__ > 4
+    uint32_t getHash() const { return static_cast<uint32_t>(data >> HASH_SHIFT); }
+    void setHash(uint32_t hash) { data = (data & SIZE_MASK) | (static_cast<uintptr_t>(hash) << HASH_SHIFT); }
+#else
+    uint32_t getHash() const { return 0; }
+    void setHash(uint32_t) { }
+#endif
     bool isBinary() const { return data & FLAG_BINARY; }
     bool isRelocated() const { return data & FLAG_RELOCATED; }
     void setBinary() { data |= FLAG_BINARY; }
@@ -143,16 +179,28 @@ public:
     void setClass(TClass* aClass) { klass = aClass; }
 
     // By default objects subject to non binary specification
-    explicit TObject(uint32_t fieldsCount, TClass* klass, bool isObjectBinary = false)
+    explicit TObject(std::size_t fieldsCount, TClass* klass, bool isObjectBinary = false)
         : size(fieldsCount, isObjectBinary), klass(klass) { }
 
-    uint32_t getSize() const { return size.getSize(); }
+    std::size_t getSize() const { return size.getSize(); }
     TClass*  getClass() const { return klass; }
 
     // delegated methods from TSize
     bool isBinary() const { return size.isBinary(); }
     bool isRelocated() const { return size.isRelocated(); }
 
+    // Hash of the binary contents stored in the header, see TSymbol::getHash().
+    // Ordinary objects may keep a tag there, see TDictionary::find().
+    uint32_t getHeaderHash() const { return size.getHash(); }
+    void setHeaderHash(uint32_t hash) { size.setHash(hash); }
+
+    // Amount of heap space occupied by the object including the header.
+    // Binary objects are padded the same way as in the allocation routines.
+    std::size_t getSlotSize() const {
+        return isBinary() ? correctPadding(sizeof(TObject) + getSize())
+                          : sizeof(TObject) + getSize() * sizeof(TObject*);
+    }
+
     // TODO boundary checks
     TObject** getFields() { return fields; }
     TObject*  getField(uint32_t index) { return fields[index]; }
@@ -177,7 +225,7 @@ private:
     static const char* InstanceClassName() { return ""; }
 public:
     // Byte objects are said to be binary
-    explicit TByteObject(uint32_t dataSize, TClass* klass) : TObject(dataSize, klass, true) { }
+    explicit TByteObject(std::size_t dataSize, TClass* klass) : TObject(dataSize, klass, true) { }
 
     uint8_t* getBytes() { return bytes; }
     const uint8_t* getBytes() const { return bytes; }
@@ -219,6 +267,15 @@ struct TSymbol : public TByteObject {
     static const char* InstanceClassName() { return "Symbol"; }
     std::string toString() const { return std::string(reinterpret_cast<const char*>(bytes), getSize()); }
 
+    // Hash of the symbol text. It is computed when the symbol is interned
+    // or loaded and kept in the object header where there is room for it.
+    uint32_t getHash() const { const uint32_t hash = getHeaderHash(); return hash ? hash : getHash(bytes, getSize()); }
+    void updateHash() { setHeaderHash(getHash(bytes, getSize())); }
+
+    // Hash of the text is never zero
+    static uint32_t getHash(const uint8_t* text, std::size_t size);
+    static uint32_t getHash(const char* text) { return getHash(reinterpret_cast<const uint8_t*>(text), std::strlen(text)); }
+
     // Helper comparison function functional object. Compares two symbols (or it's string representation).
     // Returns true when 'left' is found to be less than 'right'.
     struct TCompareFunctor {
@@ -237,6 +294,15 @@ struct TString : public TByteObject {
     static const char* InstanceClassName() { return "String"; }
 };
 
+// TFloat represents the Smalltalk's Float class.
+// Floats are binary objects holding the IEEE double in host byte order.
+struct TFloat : public TByteObject {
+    static const char* InstanceClassName() { return "Float"; }
+
+    double getValue() const { double value; std::memcpy(&value, bytes, sizeof(value)); return value; }
+    void setValue(double value) { std::memcpy(bytes, &value, sizeof(value)); }
+};
+
 // Chars are intermediate representation of single printable character
 // When #String>>at: method is called an instance of Char is returned.
 // Note that actually String is NOT the array of Chars. String is binary
@@ -346,6 +412,17 @@ struct TDictionary : public TObject {
     template<typename K> TObject* find(const K* key) const;
     template<typename T, typename K> T* find(const K* key) const { return static_cast<T*>(find(key)); }
 
+    // Same as above when the hash of the key is already known, see TSymbol::getHash()
+    template<typename K> TObject* find(const K* key, uint32_t hash) const;
+    template<typename T, typename K> T* find(const K* key, uint32_t hash) const { return static_cast<T*>(find(key, hash)); }
+
+    // On 64-bit platforms keys are found by the open addressing hash index
+    // which is kept outside of the heap and tagged in the header of the keys
+    // array. Index is built on the first lookup and rebuilt when the keys
+    // array is replaced. Indices survive the GC, they should be dropped when
+    // methods are installed or removed. 32-bit platforms use binary search.
+    static void flushIndices();
+
     static const char* InstanceClassName() { return "Dictionary"; }
 };
 
@@ -368,6 +445,15 @@ struct TNode : public TObject {
     static const char* InstanceClassName() { return "Node"; }
 };
 
+// Growable buffer of bytes, see StringBuffer>>freeze.
+// Size of the backing string is the capacity of the buffer.
+struct TStringBuffer : public TObject {
+    TString*      bytes;
+    TInteger      size;
+
+    static const char* InstanceClassName() { return "StringBuffer"; }
+};
+
 struct TProcess : public TObject {
     TContext*     context;
     TObject*      state;
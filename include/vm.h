@@ -36,10 +36,18 @@
 #define LLST_VM_H_INCLUDED
 
 #include <list>
+#include <csignal>
 
 #include <types.h>
 #include <memory.h>
 #include <instructions.h>
+#include <DispatchTable.h>
+#include <SymbolTable.h>
+#include <MappedFile.h>
+#include <IOPoller.h>
+
+class AllocationProfiler;
+class LargeInteger;
 
 template <int I>
 struct Int2Type
@@ -63,6 +71,7 @@ public:
         returnReturned,
         returnTimeExpired,
         returnBreak,
+        returnWaiting,
 
         returnNoReturn = 255
     };
@@ -81,6 +90,10 @@ private:
 
         hptr<TObject>  returnedValue;
 
+        // Process is executed by the time slices, so it may be
+        // suspended and resumed later by the Scheduler
+        bool           isTimeSliced;
+
         void loadPointers() {
             bytePointer = currentContext->bytePointer;
             stackTop    = currentContext->stackTop;
@@ -110,7 +123,8 @@ private:
             m_vm(vm),
             currentContext( static_cast<TContext*>(globals.nilObject), mm),
             instruction(opcode::extended),
-            returnedValue(globals.nilObject, mm)
+            returnedValue(globals.nilObject, mm),
+            isTimeSliced(false)
         { }
     };
 
@@ -133,13 +147,64 @@ private:
 public:
     TMethod* lookupMethod(TSymbol* selector, TClass* klass);
 
+    // Interned symbol with the contents of the string or 0
+    TSymbol* findSymbol(TObject* name);
+
+    // Mapping, slicing and closing of the memory mapped files
+    TObject* callMappedFilePrimitive(uint8_t opcode, TObject* receiver, TObject* first, TObject* second, bool& primitiveFailed);
+
+    // Array of the descriptors that became ready for the waiting processes
+    TObject* pollDescriptors(TObject* timeout, bool& primitiveFailed);
+
+    // Closes the descriptor. Processes waiting for it are resumed by the next poll.
+    TObject* closeDescriptor(TObject* fileID, bool& primitiveFailed);
+
+    // Calls the foreign function returning char* and copies the result to the new string
+    TObject* callForeignString(TObject* library, TObject* function, TObject* arguments, bool& primitiveFailed);
+
+    // Shallow copy of the object or the deep copy of the graph of at most limit objects
+    TObject* copyObject(uint8_t opcode, TObject* original, TObject* limit, bool& primitiveFailed);
+
+    // ByteArray with the serialized graph of the root and back, see Image::ImageWriter::writeGraph()
+    TObject* serializeGraph(TObject* root, bool& primitiveFailed);
+    TObject* materializeGraph(TObject* data, bool& primitiveFailed);
+
+    // Appending to the StringBuffer and turning its contents into the string
+    TObject* callBufferPrimitive(uint8_t opcode, TObject* buffer, TObject* argument, bool& primitiveFailed);
+
     bool checkRoot(TObject* value, TObject** objectSlot);
 private:
 
+    // Backing string of the buffer with the room for count more bytes, 0 if the heap is exhausted
+    TString* reserveBuffer(hptr<TStringBuffer>& buffer, std::size_t count);
+
+    // New object of the same class with the same fields or bytes, 0 if the heap is exhausted
+    TObject* cloneObject(TObject* original);
+
     void updateMethodCache(TSymbol* selector, TClass* klass, TMethod* method);
 
-    // flush the method lookup cache
-    void flushMethodCache();
+    // Flattened method tables of the frequently missed classes
+    DispatchTables m_dispatchTables;
+
+    // Mirrors the symbols tree of the image, see MetaSymbol>>new:
+    SymbolTable m_symbolTable;
+
+    // Files mapped by the MappedFile class
+    MappedFiles m_mappedFiles;
+
+    // Descriptors the parked processes wait for, see Scheduler
+    IOPoller m_ioPoller;
+
+    // flush the method lookup cache. Dispatch tables
+    // survive the GC if they refer to the static heap only.
+    void flushMethodCache(bool methodsChanged = true);
+
+    // Well-known classes are resolved when the image is loaded and when the
+    // classes are redefined. Classes residing in the dynamic heap are
+    // referred by the registry slots registered as the GC roots.
+    bool m_classRoots[TClassRegistry::classesCount];
+    void resolveClasses();
+    void releaseClassRoots();
 
     void doPushConstant(TVMExecutionContext& ec);
     void doPushBlock(TVMExecutionContext& ec);
@@ -164,8 +229,46 @@ private:
     bool m_lastGCOccured;
     void onCollectionOccured();
 
+    AllocationProfiler* m_allocationProfiler;
+    void sampleAllocation(TClass* klass, std::size_t size, uint32_t weight);
+
+    // Set asynchronously by requestHeapCensus() and requestImageSave()
+    static volatile std::sig_atomic_t s_heapCensusRequested;
+    static volatile std::sig_atomic_t s_imageSaveRequested;
+
+public:
+    // Execution frames form a list of contexts being executed by the
+    // interpreter and by the JIT compiled code. Frame is registered for
+    // the time of it's existance, so frames should be stack allocated.
+    // Allocation profiler uses the innermost frame to find the allocating method.
+    class TExecutionFrame {
+    private:
+        SmalltalkVM*     m_vm;
+        TExecutionFrame* m_previous;
+    public:
+        // Context is GC safe, byte pointer is 0 if it is not tracked (JIT code)
+        const hptr<TContext>& context;
+        const uint16_t*       bytePointer;
+
+        TExecutionFrame(SmalltalkVM* vm, const hptr<TContext>& context, const uint16_t* bytePointer = 0)
+            : m_vm(vm), m_previous(vm->m_topFrame), context(context), bytePointer(bytePointer)
+        { m_vm->m_topFrame = this; }
+
+        ~TExecutionFrame() { m_vm->m_topFrame = m_previous; }
+    };
+private:
+    TExecutionFrame* m_topFrame;
+
 public:
     bool doBulkReplace( TObject* destination, TObject* destinationStartOffset, TObject* destinationStopOffset, TObject* source, TObject* sourceStartOffset);
+    // Performs SmallInt and Integer primitives. Operands may be either SmallInt or Integer.
+    // Results that do not fit into SmallInt are promoted to Integer. Unary primitives take nil as the argument.
+    TObject* callIntegerPrimitive(uint8_t opcode, TObject* receiver, TObject* argument, bool& failed);
+    // Returns SmallInt if the value fits, otherwise allocates Integer
+    TObject* newIntegerObject(const LargeInteger& value);
+    // Performs Float primitives. Integer operands are converted to double.
+    TObject* callFloatPrimitive(uint8_t opcode, TObject* receiver, TObject* argument, bool& failed);
+    TObject* newFloatObject(double value);
     //This function is used to lookup and return method for #doesNotUnderstand for a given selector of a given object with appropriate arguments.
     void setupVarsForDoesNotUnderstand(/*out*/ hptr<TMethod>& method,/*out*/ hptr<TObjectArray>& arguments, TSymbol* selector, TClass* receiverClass);
 
@@ -175,12 +278,18 @@ public:
     TObject*     newOrdinaryObject(TClass* klass, std::size_t slotSize);
 
     SmalltalkVM(Image* image, IMemoryManager* memoryManager)
-        : m_cacheHits(0), m_cacheMisses(0), m_messagesSent(0), m_image(image),
-        m_memoryManager(memoryManager), m_lastGCOccured(false) //, ec(memoryManager)
+        : m_cacheHits(0), m_cacheMisses(0), m_messagesSent(0),
+        m_symbolTable(memoryManager), m_mappedFiles(memoryManager), m_image(image), m_memoryManager(memoryManager), m_lastGCOccured(false), m_allocationProfiler(0),
+        m_topFrame(0) //, ec(memoryManager)
     {
+        for (std::size_t i = 0; i < TClassRegistry::classesCount; i++)
+            m_classRoots[i] = false;
+
         flushMethodCache();
     }
 
+    ~SmalltalkVM() { releaseClassRoots(); }
+
     TExecuteResult execute(TProcess* p, uint32_t ticks);
     template<class T> hptr<T> newObject(std::size_t dataSize = 0, bool registerPointer = true);
 
@@ -190,6 +299,24 @@ public:
     template<class T> hptr<T> newPointer(T* object) { return hptr<T>(object, m_memoryManager); }
 
     void printVMStat();
+
+    // Allocation profiler is optional. Pass 0 to disable profiling.
+    void setAllocationProfiler(AllocationProfiler* profiler) { m_allocationProfiler = profiler; }
+    // JIT runtime registers execution frames only when profiling is enabled
+    bool isProfilingAllocations() const { return m_allocationProfiler != 0; }
+
+    // Collects garbage and prints the class histogram of the live objects
+    void printHeapCensus();
+    // Collects garbage and writes the heap dump to the file
+    void dumpHeap(const char* fileName);
+    // Writes the snapshot of the objects reachable from the globals
+    bool saveImage(const std::string& fileName, bool externalSources);
+
+    // Heap census may be requested from the signal handler. It is
+    // performed as soon as VM reaches the next instruction boundary.
+    static void requestHeapCensus() { s_heapCensusRequested = 1; }
+    // Same for the snapshot which replaces the image VM was started with
+    static void requestImageSave() { s_imageSaveRequested = 1; }
 };
 
 template<class T> hptr<T> SmalltalkVM::newObject(std::size_t dataSize /*= 0*/, bool registerPointer /*= true*/)
@@ -207,7 +334,7 @@ template<class T> hptr<T> SmalltalkVM::newObject(std::size_t dataSize /*= 0*/, b
 
 template<class T> hptr<T> SmalltalkVM::newObjectWrapper(/*InstancesAreBinary*/ Int2Type<false>, std::size_t dataSize /*= 0*/, bool registerPointer /*= true*/)
 {
-    TClass* klass = m_image->getGlobal<TClass>(T::InstanceClassName());
+    TClass* klass = classRegistry.get<T>();
     if (!klass)
         return hptr<T>( static_cast<T*>(globals.nilObject), m_memoryManager);
 
@@ -217,7 +344,7 @@ template<class T> hptr<T> SmalltalkVM::newObjectWrapper(/*InstancesAreBinary*/ I
 
 template<class T> hptr<T> SmalltalkVM::newObjectWrapper(/*InstancesAreBinary*/ Int2Type<true>,  std::size_t dataSize /*= 0*/, bool registerPointer /*= true*/)
 {
-    TClass* klass = m_image->getGlobal<TClass>(T::InstanceClassName());
+    TClass* klass = classRegistry.get<T>();
     if (!klass)
         return hptr<T>( static_cast<T*>(globals.nilObject), m_memoryManager );
 
@@ -0,0 +1,210 @@
+/*
+ *    AllocationProfiler.cpp
+ *
+ *    Sampling profiler of the object allocations
+ *
+ *    LLST (LLVM Smalltalk or Low Level Smalltalk) version 0.4
+ *
+ *    LLST is
+ *        Copyright (C) 2012-2015 by Dmitry Kashitsyn   <korvin@deeptown.org>
+ *        Copyright (C) 2012-2015 by Roman Proskuryakov <humbug@deeptown.org>
+ *
+ *    LLST is based on the LittleSmalltalk which is
+ *        Copyright (C) 1987-2005 by Timothy A. Budd
+ *        Copyright (C) 2007 by Charles R. Childers
+ *        Copyright (C) 2005-2007 by Danny Reinhold
+ *
+ *    Original license of LittleSmalltalk may be found in the LICENSE file.
+ *
+ *
+ *    This file is part of LLST.
+ *    LLST is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    LLST is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with LLST.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <AllocationProfiler.h>
+#include <memory.h>
+
+#include <cstdio>
+#include <sstream>
+#include <functional>
+
+// Deeper context chains are truncated
+static const int MAX_CHAIN_DEPTH = 256;
+
+// Call tree nodes with less samples are not shown
+static const float MIN_CALL_NODE_RATIO = 0.005;
+
+AllocationProfiler::AllocationProfiler(std::size_t sampleInterval, bool recordChains /*= false*/)
+    : m_sampleInterval(sampleInterval ? sampleInterval : 1), m_recordChains(recordChains),
+      m_bytesUntilSample(m_sampleInterval), m_totalSamples(0)
+{ }
+
+AllocationProfiler::~AllocationProfiler()
+{ }
+
+AllocationProfiler::TCallNode::~TCallNode()
+{
+    std::map<std::string, TCallNode*>::iterator iChild = children.begin();
+    for (; iChild != children.end(); ++iChild)
+        delete iChild->second;
+}
+
+bool AllocationProfiler::TSiteKey::operator < (const TSiteKey& other) const
+{
+    if (method != other.method)
+        return method < other.method;
+    if (bytePointer != other.bytePointer)
+        return bytePointer < other.bytePointer;
+    return className < other.className;
+}
+
+static std::string getClassName(TClass* klass)
+{
+    if (!klass || isSmallInteger(klass) || isSmallInteger(klass->name) || klass->name == globals.nilObject)
+        return "<unknown>";
+    return klass->name->toString();
+}
+
+static std::string getMethodName(TMethod* method)
+{
+    if (!method || isSmallInteger(method) || method == globals.nilObject)
+        return "<native>";
+    return getClassName(method->klass) + ">>" + method->name->toString();
+}
+
+std::string AllocationProfiler::getFrameName(TContext* context, int bytePointer)
+{
+    std::ostringstream ss;
+    ss << getMethodName(context->method);
+    if (bytePointer >= 0)
+        ss << "@" << bytePointer;
+    return ss.str();
+}
+
+void AllocationProfiler::recordSample(TClass* klass, std::size_t size, uint32_t weight, TContext* context, int bytePointer)
+{
+    const bool isInSmalltalk = context && context != globals.nilObject;
+
+    TSiteKey key;
+    key.method      = isInSmalltalk ? getMethodName(context->method) : "<native>";
+    key.bytePointer = isInSmalltalk ? bytePointer : -1;
+    key.className   = getClassName(klass);
+
+    TSiteInfo& site = m_sites[key];
+    site.samples += weight;
+    site.allocations++;
+    site.sampledBytes += size;
+    m_totalSamples += weight;
+
+    if (!m_recordChains)
+        return;
+
+    // Byte pointer of the innermost context is passed explicitly,
+    // outer contexts have their pointers stored on message send.
+    std::vector<std::string> chain;
+    for (TContext* current = isInSmalltalk ? context : 0;
+         current && current != globals.nilObject && chain.size() < MAX_CHAIN_DEPTH;
+         current = current->previousContext)
+    {
+        int currentBytePointer = -1;
+        if (current == context)
+            currentBytePointer = bytePointer;
+        else if (isSmallInteger(current->bytePointer))
+            currentBytePointer = current->bytePointer;
+
+        chain.push_back(getFrameName(current, currentBytePointer));
+    }
+
+    // Tree grows from the outermost context to the allocation site
+    TCallNode* node = &m_callTree;
+    node->totalSamples += weight;
+    for (std::vector<std::string>::reverse_iterator iFrame = chain.rbegin(); iFrame != chain.rend(); ++iFrame) {
+        TCallNode*& child = node->children[*iFrame];
+        if (!child)
+            child = new TCallNode();
+        node = child;
+        node->totalSamples += weight;
+    }
+    node->selfSamples += weight;
+}
+
+uint32_t AllocationProfiler::getSiteSamples(const std::string& method, int bytePointer, const std::string& className) const
+{
+    TSiteKey key;
+    key.method      = method;
+    key.bytePointer = bytePointer;
+    key.className   = className;
+
+    TSiteMap::const_iterator iSite = m_sites.find(key);
+    return (iSite != m_sites.end()) ? iSite->second.samples : 0;
+}
+
+void AllocationProfiler::printCallNode(const TCallNode* node, const std::string& name, int depth) const
+{
+    const float ratio = 100.0 * node->totalSamples / m_callTree.totalSamples;
+    std::printf("%7.2f%% %8u %8u  %*s%s\n", ratio, node->totalSamples, node->selfSamples, depth * 2, "", name.c_str());
+
+    // Children are ordered by the amount of samples
+    typedef std::map<std::string, TCallNode*>::const_iterator TChildIterator;
+    typedef std::multimap<uint32_t, TChildIterator, std::greater<uint32_t> > TChildren;
+    TChildren children;
+
+    for (TChildIterator iChild = node->children.begin(); iChild != node->children.end(); ++iChild) {
+        if (iChild->second->totalSamples >= MIN_CALL_NODE_RATIO * m_callTree.totalSamples)
+            children.insert(std::make_pair(iChild->second->totalSamples, iChild));
+    }
+
+    for (TChildren::const_iterator iChild = children.begin(); iChild != children.end(); ++iChild)
+        printCallNode(iChild->second->second, iChild->second->first, depth + 1);
+}
+
+void AllocationProfiler::printReport() const
+{
+    std::printf("\nAllocation profile: %u samples, one sample per %lld bytes\n",
+        m_totalSamples, static_cast<long long>(m_sampleInterval));
+    if (!m_totalSamples)
+        return;
+
+    // Flat profile ordered by the amount of samples
+    typedef std::multimap<uint32_t, TSiteMap::const_iterator, std::greater<uint32_t> > TSites;
+    TSites sites;
+    for (TSiteMap::const_iterator iSite = m_sites.begin(); iSite != m_sites.end(); ++iSite)
+        sites.insert(std::make_pair(iSite->second.samples, iSite));
+
+    std::printf("%8s %8s %12s %12s  %s\n", "%", "samples", "estimated", "avg size", "site and class");
+    for (TSites::const_iterator iSite = sites.begin(); iSite != sites.end(); ++iSite) {
+        const TSiteKey&  key  = iSite->second->first;
+        const TSiteInfo& info = iSite->second->second;
+
+        std::ostringstream name;
+        name << key.method;
+        if (key.bytePointer >= 0)
+            name << "@" << key.bytePointer;
+        name << " " << key.className;
+
+        std::printf("%7.2f%% %8u %12lld %12llu  %s\n",
+            100.0 * info.samples / m_totalSamples,
+            info.samples,
+            static_cast<long long>(info.samples * m_sampleInterval),
+            static_cast<unsigned long long>(info.sampledBytes / info.allocations),
+            name.str().c_str());
+    }
+
+    if (!m_recordChains)
+        return;
+
+    std::printf("\nAllocation call tree:\n%8s %8s %8s  %s\n", "total", "samples", "self", "context");
+    printCallNode(&m_callTree, "<root>", 0);
+}
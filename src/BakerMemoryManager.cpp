@@ -39,9 +39,9 @@
 
 #include <cassert>
 bool is_aligned_properly(void *p) {
-    return uint32_t(p) % sizeof(void*) == 0;
+    return reinterpret_cast<uintptr_t>(p) % sizeof(void*) == 0;
 }
-bool is_aligned_properly(uint32_t x) {
+bool is_aligned_properly(std::size_t x) {
     return x % sizeof(void*) == 0;
 }
 
@@ -49,13 +49,15 @@ BakerMemoryManager::BakerMemoryManager() :
     m_memoryInfo(), m_heapSize(0), m_maxHeapSize(0), m_heapOne(0), m_heapTwo(0),
     m_activeHeapOne(true), m_inactiveHeapBase(0), m_inactiveHeapPointer(0),
     m_activeHeapBase(0), m_activeHeapPointer(0), m_staticHeapSize(0),
-    m_staticHeapBase(0), m_staticHeapPointer(0), m_externalPointersHead(0)
+    m_staticHeapBase(0), m_staticHeapPointer(0), m_staticHeapOwned(true), m_externalPointersHead(0),
+    m_externalObjectsBegin(0), m_externalObjectsEnd(0)
 {}
 
 BakerMemoryManager::~BakerMemoryManager()
 {
     // TODO Reset the external pointers to catch the null pointers if something goes wrong
-    std::free(m_staticHeapBase);
+    if (m_staticHeapOwned)
+        std::free(m_staticHeapBase);
     std::free(m_heapOne);
     std::free(m_heapTwo);
 }
@@ -77,6 +79,17 @@ bool BakerMemoryManager::initializeStaticHeap(std::size_t heapSize)
     return true;
 }
 
+void BakerMemoryManager::adoptStaticHeap(void* heap, std::size_t heapSize, std::size_t usedSize)
+{
+    if (m_staticHeapOwned)
+        std::free(m_staticHeapBase);
+
+    m_staticHeapBase = static_cast<uint8_t*>(heap);
+    m_staticHeapPointer = m_staticHeapBase + heapSize - usedSize;
+    m_staticHeapSize = heapSize;
+    m_staticHeapOwned = false;
+}
+
 bool BakerMemoryManager::initializeHeap(std::size_t heapSize, std::size_t maxHeapSize /* = 0 */)
 {
     // To initialize properly we need a heap with an even size
@@ -166,7 +179,7 @@ void* BakerMemoryManager::allocate(std::size_t requestedSize, bool* gcOccured /*
         if (newHeapSize < m_maxHeapSize) {
             growHeap(requestedSize);
         } else {
-            std::fprintf(stderr, "Could not allocate %u bytes because doing so would exceed heap limit %u\n", requestedSize, m_maxHeapSize);
+            std::fprintf(stderr, "Could not allocate %zu bytes because doing so would exceed heap limit %zu\n", requestedSize, m_maxHeapSize);
             return 0;
         }
 
@@ -201,7 +214,7 @@ void* BakerMemoryManager::allocate(std::size_t requestedSize, bool* gcOccured /*
 
     // TODO Grow the heap if object still not fits
 
-    std::fprintf(stderr, "Could not allocate %u bytes in heap\n", requestedSize);
+    std::fprintf(stderr, "Could not allocate %zu bytes in heap\n", requestedSize);
     return 0;
 }
 
@@ -210,7 +223,7 @@ void* BakerMemoryManager::staticAllocate(std::size_t requestedSize)
     uint8_t* newPointer = m_staticHeapPointer - requestedSize;
     if (newPointer < m_staticHeapBase)
     {
-        std::fprintf(stderr, "Could not allocate %u bytes in static heaps\n", requestedSize);
+        std::fprintf(stderr, "Could not allocate %zu bytes in static heaps\n", requestedSize);
         return 0; // TODO Report memory allocation error
     }
     m_staticHeapPointer = newPointer;
@@ -247,8 +260,15 @@ BakerMemoryManager::TMovableObject* BakerMemoryManager::moveObject(TMovableObjec
             if (!inOldSpace)
             {
                 // Object does not belong to a heap.
-                // Either it is located in static space
+                // Either it is located in static space,
+                // outside of the heaps (see registerExternalObject())
                 // or this is a broken pointer
+                if ((reinterpret_cast<uint8_t*>(currentObject) >= m_externalObjectsBegin) &&
+                    (reinterpret_cast<uint8_t*>(currentObject) < m_externalObjectsEnd))
+                {
+                    markExternalObject(currentObject);
+                }
+
                 replacement   = currentObject;
                 currentObject = previousObject;
                 break;
@@ -282,6 +302,9 @@ BakerMemoryManager::TMovableObject* BakerMemoryManager::moveObject(TMovableObjec
                 m_activeHeapPointer -= sizeof(TByteObject) + correctPadding(dataSize);
                 objectCopy = new (m_activeHeapPointer) TMovableObject(dataSize, true);
 
+                // Hash of the contents (if any) is kept along with the size
+                objectCopy->size.setHash(currentObject->size.getHash());
+
                 // Copying byte data. data[0] is the class pointer,
                 // actual binary data starts from the data[1]
                 uint8_t* source      = reinterpret_cast<uint8_t*>( & currentObject->data[1] );
@@ -310,6 +333,9 @@ BakerMemoryManager::TMovableObject* BakerMemoryManager::moveObject(TMovableObjec
                 m_activeHeapPointer -= sizeof(TObject) + fieldsCount * sizeof (TObject*);
                 objectCopy = new (m_activeHeapPointer) TMovableObject(fieldsCount, false);
 
+                // Tag of the object (if any) is kept along with the size
+                objectCopy->size.setHash(currentObject->size.getHash());
+
                 currentObject->size.setRelocated();
 
                 // Initializing indices. Actual field copying
@@ -405,7 +431,9 @@ void BakerMemoryManager::collectGarbage()
     // Then moving them to the new active heap.
 
     // Moving the live objects in the new heap
+    resetExternalMarks();
     moveObjects();
+    releaseUnreachableObjects();
 
 
     std::memset(m_inactiveHeapBase, 0, m_heapSize / 2);
@@ -502,6 +530,62 @@ void BakerMemoryManager::registerExternalHeapPointer(object_ptr& pointer) {
     m_externalPointersHead = &pointer;
 }
 
+void BakerMemoryManager::registerExternalObject(TObject* object, IExternalObjectOwner* owner)
+{
+    TExternalObject& entry = m_externalObjects[reinterpret_cast<TMovableObject*>(object)];
+    entry.owner = owner;
+    entry.isReachable = true;
+
+    uint8_t* const begin = reinterpret_cast<uint8_t*>(m_externalObjects.begin()->first);
+    uint8_t* const last  = reinterpret_cast<uint8_t*>(m_externalObjects.rbegin()->first);
+    m_externalObjectsBegin = begin;
+    m_externalObjectsEnd   = last + 1;
+}
+
+void BakerMemoryManager::unregisterExternalObject(TObject* object)
+{
+    m_externalObjects.erase(reinterpret_cast<TMovableObject*>(object));
+
+    if (m_externalObjects.empty()) {
+        m_externalObjectsBegin = 0;
+        m_externalObjectsEnd   = 0;
+    } else {
+        m_externalObjectsBegin = reinterpret_cast<uint8_t*>(m_externalObjects.begin()->first);
+        m_externalObjectsEnd   = reinterpret_cast<uint8_t*>(m_externalObjects.rbegin()->first) + 1;
+    }
+}
+
+void BakerMemoryManager::markExternalObject(TMovableObject* object)
+{
+    TExternalObjects::iterator iObject = m_externalObjects.find(object);
+    if (iObject != m_externalObjects.end())
+        iObject->second.isReachable = true;
+}
+
+void BakerMemoryManager::resetExternalMarks()
+{
+    TExternalObjects::iterator iObject = m_externalObjects.begin();
+    for (; iObject != m_externalObjects.end(); ++iObject)
+        iObject->second.isReachable = false;
+}
+
+void BakerMemoryManager::releaseUnreachableObjects()
+{
+    std::vector<TExternalObjects::value_type> unreachable;
+
+    TExternalObjects::iterator iObject = m_externalObjects.begin();
+    for (; iObject != m_externalObjects.end(); ++iObject) {
+        if (! iObject->second.isReachable)
+            unreachable.push_back(*iObject);
+    }
+
+    // Owner may unregister the objects, so the map is not iterated here
+    for (std::size_t i = 0; i < unreachable.size(); i++) {
+        unregisterExternalObject(reinterpret_cast<TObject*>(unreachable[i].first));
+        unreachable[i].second.owner->releaseObject(reinterpret_cast<TObject*>(unreachable[i].first));
+    }
+}
+
 void BakerMemoryManager::releaseExternalHeapPointer(object_ptr& pointer) {
     if (m_externalPointersHead == &pointer) {
         m_externalPointersHead = pointer.next;
@@ -530,3 +614,11 @@ TMemoryManagerInfo BakerMemoryManager::getStat()
 {
     return m_memoryInfo;
 }
+
+void BakerMemoryManager::walkHeap(IHeapVisitor& visitor)
+{
+    // Large objects do not have a separate space. Heap is grown
+    // to fit them, so they are walked along with the others.
+    walkRegion(visitor, m_staticHeapPointer, m_staticHeapBase + m_staticHeapSize);
+    walkRegion(visitor, m_activeHeapPointer, m_activeHeapBase + m_heapSize / 2);
+}
@@ -144,7 +144,7 @@ void CompletionEngine::initialize(TDictionary*) {
 }
 bool CompletionEngine::readline(const std::string& prompt, std::string& result) {
     std::cout << prompt << std::flush;
-    return std::getline(std::cin, result);
+    return !std::getline(std::cin, result).fail();
 }
 
 void CompletionEngine::addHistory(const std::string&) { }
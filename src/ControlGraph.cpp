@@ -234,7 +234,7 @@ public:
         m_currentDomain = &domain;
 
         if (traces_enabled) {
-            std::printf("GraphLinker::visitDomain : processing domain %p, block offset %.2u, referrers %u, local stack %u, requested args %.2u\n",
+            std::printf("GraphLinker::visitDomain : processing domain %p, block offset %.2u, referrers %zu, local stack %zu, requested args %.2zu\n",
                 &domain,
                 domain.getBasicBlock()->getOffset(),
                 domain.getBasicBlock()->getReferers().size(),
@@ -243,7 +243,7 @@ public:
             );
 
             for (std::size_t index = 0; index < domain.getRequestedArguments().size(); index++)
-                std::printf("GraphLinker::visitDomain : arg request %u, node index %.2u\n",
+                std::printf("GraphLinker::visitDomain : arg request %zu, node index %.2u\n",
                             index, domain.getRequestedArguments()[index].requestingNode->getIndex());
         }
 
@@ -384,7 +384,7 @@ ControlNode* GraphLinker::optimizePhi(PhiNode* phi)
     assert(incomingValues.size());
 
     if (traces_enabled)
-        std::printf("GraphLinker::optimizePhi : phi node %u has %u unique incoming values\n", phi->getIndex(), incomingValues.size());
+        std::printf("GraphLinker::optimizePhi : phi node %u has %zu unique incoming values\n", phi->getIndex(), incomingValues.size());
 
     if (incomingValues.size() > 1)
         return phi; // Phi is ok, no need to optimize. Leave everything as is.
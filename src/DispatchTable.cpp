@@ -0,0 +1,144 @@
+/*
+ *    DispatchTable.cpp
+ *
+ *    Flattened method tables of the frequently missed classes
+ *
+ *    LLST (LLVM Smalltalk or Low Level Smalltalk) version 0.4
+ *
+ *    LLST is
+ *        Copyright (C) 2012-2015 by Dmitry Kashitsyn   <korvin@deeptown.org>
+ *        Copyright (C) 2012-2015 by Roman Proskuryakov <humbug@deeptown.org>
+ *
+ *    LLST is based on the LittleSmalltalk which is
+ *        Copyright (C) 1987-2005 by Timothy A. Budd
+ *        Copyright (C) 2007 by Charles R. Childers
+ *        Copyright (C) 2005-2007 by Danny Reinhold
+ *
+ *    Original license of LittleSmalltalk may be found in the LICENSE file.
+ *
+ *
+ *    This file is part of LLST.
+ *    LLST is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    LLST is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with LLST.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <DispatchTable.h>
+#include <memory.h>
+#include <cstring>
+
+namespace {
+
+// Symbols are unique, so comparing the contents is rarely needed
+inline bool isEqual(const TSymbol* symbol, const TSymbol* key)
+{
+    return symbol == key
+        || (symbol->getSize() == key->getSize() && std::memcmp(symbol->getBytes(), key->getBytes(), key->getSize()) == 0);
+}
+
+} // namespace
+
+DispatchTable::TSlot& DispatchTable::findSlot(const TSymbol* selector, uint32_t hash)
+{
+    uint32_t slot = hash & m_mask;
+    while (m_slots[slot].selector) {
+        if (m_slots[slot].hash == hash && isEqual(m_slots[slot].selector, selector))
+            break;
+        slot = (slot + 1) & m_mask;
+    }
+
+    return m_slots[slot];
+}
+
+void DispatchTable::build(TClass* klass, IMemoryManager* memoryManager)
+{
+    // Root of the hierarchy goes first, so the subclasses override its methods
+    std::vector<TClass*> hierarchy;
+    std::size_t methodsCount = 0;
+    for (TClass* current = klass; current != globals.nilObject; current = current->parentClass) {
+        hierarchy.push_back(current);
+        methodsCount += current->methods->keys->getSize();
+    }
+
+    std::size_t capacity = 8;
+    while (capacity < methodsCount * 2)
+        capacity *= 2;
+
+    const TSlot empty = { 0, 0, 0 };
+    m_slots.assign(capacity, empty);
+    m_mask = capacity - 1;
+    m_size = 0;
+    m_static = memoryManager->isInStaticHeap(klass);
+
+    for (std::size_t i = hierarchy.size(); i > 0; i--) {
+        TClass* const current = hierarchy[i - 1];
+        TSymbolArray* const selectors = current->methods->keys;
+        TObjectArray* const methods = current->methods->values;
+        m_static = m_static && memoryManager->isInStaticHeap(current);
+
+        for (std::size_t position = 0; position < selectors->getSize(); position++) {
+            TSymbol* const selector = selectors->getField(position);
+            if (isSmallInteger(selector) || !selector->isBinary())
+                continue;
+
+            TMethod* const method = methods->getField<TMethod>(position);
+            const uint32_t hash = selector->getHash();
+            TSlot& slot = findSlot(selector, hash);
+            if (! slot.selector) {
+                slot.hash = hash;
+                slot.selector = selector;
+                m_size++;
+            }
+            slot.method = method;
+
+            m_static = m_static
+                && memoryManager->isInStaticHeap(selector)
+                && memoryManager->isInStaticHeap(method);
+        }
+    }
+}
+
+TMethod* DispatchTable::find(const TSymbol* selector, uint32_t hash) const
+{
+    for (uint32_t slot = hash & m_mask; m_slots[slot].selector; slot = (slot + 1) & m_mask) {
+        if (m_slots[slot].hash == hash && isEqual(m_slots[slot].selector, selector))
+            return m_slots[slot].method;
+    }
+
+    return 0;
+}
+
+const DispatchTable* DispatchTables::get(TClass* klass, IMemoryManager* memoryManager)
+{
+    TClassEntry& entry = m_classes[klass];
+    if (! entry.table.isEmpty())
+        return &entry.table;
+
+    if (++entry.misses < MISSES_THRESHOLD)
+        return 0;
+
+    entry.table.build(klass, memoryManager);
+    m_tablesBuilt++;
+    return &entry.table;
+}
+
+void DispatchTables::flushMovable()
+{
+    TClassMap::iterator iEntry = m_classes.begin();
+    while (iEntry != m_classes.end()) {
+        if (iEntry->second.table.isStatic())
+            ++iEntry;
+        else
+            m_classes.erase(iEntry++);
+    }
+}
@@ -0,0 +1,170 @@
+/*
+ *    ForeignFunctions.cpp
+ *
+ *    Foreign function interface to the native shared libraries
+ *
+ *    LLST (LLVM Smalltalk or Low Level Smalltalk) version 0.4
+ *
+ *    LLST is
+ *        Copyright (C) 2012-2015 by Dmitry Kashitsyn   <korvin@deeptown.org>
+ *        Copyright (C) 2012-2015 by Roman Proskuryakov <humbug@deeptown.org>
+ *
+ *    LLST is based on the LittleSmalltalk which is
+ *        Copyright (C) 1987-2005 by Timothy A. Budd
+ *        Copyright (C) 2007 by Charles R. Childers
+ *        Copyright (C) 2005-2007 by Danny Reinhold
+ *
+ *    Original license of LittleSmalltalk may be found in the LICENSE file.
+ *
+ *
+ *    This file is part of LLST.
+ *    LLST is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    LLST is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with LLST.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <ForeignFunctions.h>
+#include <memory.h>
+
+#include <cstdio>
+#include <cstring>
+#include <dlfcn.h>
+
+ForeignFunctions foreignFunctions;
+
+ForeignFunctions::~ForeignFunctions()
+{
+    for (std::size_t library = 0; library < m_libraries.size(); library++) {
+        if (m_libraries[library])
+            dlclose(m_libraries[library]);
+    }
+}
+
+int32_t ForeignFunctions::open(const std::string& name)
+{
+    void* const handle = dlopen(name.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        std::fprintf(stderr, "Could not open the library: %s\n", dlerror());
+        return -1;
+    }
+
+    m_libraries.push_back(handle);
+    return m_libraries.size() - 1;
+}
+
+bool ForeignFunctions::close(int32_t library)
+{
+    if (library < 0 || static_cast<std::size_t>(library) >= m_libraries.size() || !m_libraries[library])
+        return false;
+
+    // Handles of the symbols stay taken, so they are not reused by mistake
+    for (std::size_t symbol = 0; symbol < m_symbols.size(); symbol++) {
+        if (m_symbols[symbol].library == library)
+            m_symbols[symbol].address = 0;
+    }
+
+    dlclose(m_libraries[library]);
+    m_libraries[library] = 0;
+    return true;
+}
+
+int32_t ForeignFunctions::resolve(int32_t library, const std::string& name)
+{
+    if (library < 0 || static_cast<std::size_t>(library) >= m_libraries.size() || !m_libraries[library])
+        return -1;
+
+    void* const address = dlsym(m_libraries[library], name.c_str());
+    if (!address)
+        return -1;
+
+    const TForeignSymbol symbol = { library, address };
+    m_symbols.push_back(symbol);
+    return m_symbols.size() - 1;
+}
+
+void* ForeignFunctions::getAddress(int32_t library, int32_t symbol) const
+{
+    if (symbol < 0 || static_cast<std::size_t>(symbol) >= m_symbols.size())
+        return 0;
+
+    const TForeignSymbol& entry = m_symbols[symbol];
+    return (entry.library == library) ? entry.address : 0;
+}
+
+bool ForeignFunctions::call(int32_t library, int32_t function, TObject* arguments, intptr_t& result, std::string* text) const
+{
+    void* const address = getAddress(library, function);
+    if (!address || isSmallInteger(arguments) || arguments->isBinary())
+        return false;
+
+    const std::size_t count = arguments->getSize();
+    if (count > MAX_ARGUMENTS)
+        return false;
+
+    intptr_t values[MAX_ARGUMENTS];
+    std::string strings[MAX_ARGUMENTS];
+    TClass* const stringClass = classRegistry.get<TString>();
+    TClass* const symbolClass = classRegistry.get<TSymbol>();
+
+    for (std::size_t index = 0; index < count; index++) {
+        TObject* const argument = arguments->getField(index);
+
+        if (isSmallInteger(argument))
+            values[index] = TInteger(argument).getValue();
+        else if (argument == globals.nilObject || argument == globals.falseObject)
+            values[index] = 0;
+        else if (argument == globals.trueObject)
+            values[index] = 1;
+        else if (argument->getClass() == stringClass || argument->getClass() == symbolClass) {
+            const TByteObject* const text = static_cast<TByteObject*>(argument);
+            strings[index].assign(reinterpret_cast<const char*>(text->getBytes()), text->getSize());
+            values[index] = reinterpret_cast<intptr_t>(strings[index].c_str());
+        } else if (argument->isBinary())
+            values[index] = reinterpret_cast<intptr_t>(static_cast<TByteObject*>(argument)->getBytes());
+        else
+            return false;
+    }
+
+    result = invoke(address, values, count);
+    if (text && result)
+        text->assign(reinterpret_cast<const char*>(result));
+    return true;
+}
+
+intptr_t ForeignFunctions::invoke(void* function, const intptr_t* a, std::size_t count)
+{
+    typedef intptr_t W;
+
+    // ISO C++ forbids the direct cast of the object pointer to the function pointer.
+    // void (*)() is the generic function pointer type, casts from it to the
+    // prototypes of other arity are well defined.
+    typedef void (*TAnyFunction)();
+    TAnyFunction target = 0;
+    std::memcpy(&target, &function, sizeof(target));
+
+    // Arguments fit the registers or the stack slots of the same size, so the
+    // function is called through the prototype with the matching arity.
+    // Variadic functions can not be called this way, see the class comment.
+    switch (count) {
+        case 0: return reinterpret_cast<W (*)()>(target)();
+        case 1: return reinterpret_cast<W (*)(W)>(target)(a[0]);
+        case 2: return reinterpret_cast<W (*)(W, W)>(target)(a[0], a[1]);
+        case 3: return reinterpret_cast<W (*)(W, W, W)>(target)(a[0], a[1], a[2]);
+        case 4: return reinterpret_cast<W (*)(W, W, W, W)>(target)(a[0], a[1], a[2], a[3]);
+        case 5: return reinterpret_cast<W (*)(W, W, W, W, W)>(target)(a[0], a[1], a[2], a[3], a[4]);
+        case 6: return reinterpret_cast<W (*)(W, W, W, W, W, W)>(target)(a[0], a[1], a[2], a[3], a[4], a[5]);
+        case 7: return reinterpret_cast<W (*)(W, W, W, W, W, W, W)>(target)(a[0], a[1], a[2], a[3], a[4], a[5], a[6]);
+        case 8: return reinterpret_cast<W (*)(W, W, W, W, W, W, W, W)>(target)(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+    }
+    return 0;
+}
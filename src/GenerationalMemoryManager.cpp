@@ -187,6 +187,8 @@ void GenerationalMemoryManager::collectRightToLeft()
     // m_inactiveHeapPointer remains the same
     m_activeHeapPointer = m_heapOne + m_heapSize / 2;
 
+    // Only the full collection reaches every live object
+    resetExternalMarks();
     moveObjects();
 
     // Objects were moved from right heap to the left one.
@@ -200,6 +202,7 @@ void GenerationalMemoryManager::collectRightToLeft()
 
     // Moving objects back to the right heap
     collectLeftToRight(true);
+    releaseUnreachableObjects();
 
     // m_activeHeapPointer remains there and used for futher allocations
     // because heap one remains active
@@ -227,6 +230,14 @@ TMemoryManagerInfo GenerationalMemoryManager::getStat() {
     return info;
 }
 
+void GenerationalMemoryManager::walkHeap(IHeapVisitor& visitor)
+{
+    // Young objects are located in the heap one, old ones in the heap two
+    walkRegion(visitor, m_staticHeapPointer, m_staticHeapBase + m_staticHeapSize);
+    walkRegion(visitor, m_activeHeapPointer, m_heapOne + m_heapSize / 2);
+    walkRegion(visitor, m_inactiveHeapPointer, m_heapTwo + m_heapSize / 2);
+}
+
 bool GenerationalMemoryManager::isInYoungHeap(void* location)
 {
     return (location >= m_activeHeapPointer) && (location < m_heapOne + m_heapSize / 2);
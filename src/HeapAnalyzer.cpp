@@ -0,0 +1,159 @@
+/*
+ *    HeapAnalyzer.cpp
+ *
+ *    Offline analyzer of the heap dumps. Calculates retained
+ *    sizes of objects and classes using the dominator tree.
+ *
+ *    LLST (LLVM Smalltalk or Low Level Smalltalk) version 0.4
+ *
+ *    LLST is
+ *        Copyright (C) 2012-2015 by Dmitry Kashitsyn   <korvin@deeptown.org>
+ *        Copyright (C) 2012-2015 by Roman Proskuryakov <humbug@deeptown.org>
+ *
+ *    LLST is based on the LittleSmalltalk which is
+ *        Copyright (C) 1987-2005 by Timothy A. Budd
+ *        Copyright (C) 2007 by Charles R. Childers
+ *        Copyright (C) 2005-2007 by Danny Reinhold
+ *
+ *    Original license of LittleSmalltalk may be found in the LICENSE file.
+ *
+ *
+ *    This file is part of LLST.
+ *    LLST is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    LLST is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with LLST.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <HeapGraph.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+std::string getClassName(TClass* klass)
+{
+    if (!klass || isSmallInteger(klass) || !klass->name || isSmallInteger(klass->name))
+        return "<broken class>";
+
+    if (klass->name == globals.nilObject)
+        return "<unnamed class>";
+
+    return klass->name->toString();
+}
+
+std::string describeObject(TObject* object)
+{
+    std::string description = getClassName(object->getClass());
+
+    // Showing contents of strings and symbols helps to identify the object
+    TClass* klass = object->getClass();
+    if (object->isBinary() && (klass == globals.stringClass || klass == globals.badMethodSymbol->getClass())) {
+        TByteObject* byteObject = static_cast<TByteObject*>(object);
+        const uint32_t length = std::min<uint32_t>(byteObject->getSize(), 32);
+        description += " '" + std::string(reinterpret_cast<const char*>(byteObject->getBytes()), length) + "'";
+    }
+
+    return description;
+}
+
+} // namespace
+
+static void printClassTable(const HeapGraph& graph, std::size_t maxEntries)
+{
+    const std::vector<HeapGraph::TClassRecord> records = graph.getClassTable();
+
+    std::printf("\n%12s %12s %12s  %s\n", "instances", "shallow", "retained", "class");
+    for (std::size_t i = 0; i < records.size() && i < maxEntries; i++) {
+        std::printf("%12u %12u %12u  %s\n", records[i].instances, records[i].shallowSize,
+            records[i].retainedSize, getClassName(records[i].klass).c_str());
+    }
+}
+
+static bool compareNodesByRetainedSize(const std::pair<uint32_t, HeapGraph::TNodeIndex>& left,
+                                       const std::pair<uint32_t, HeapGraph::TNodeIndex>& right)
+{
+    return left.first > right.first;
+}
+
+static void printTopObjects(const HeapGraph& graph, std::size_t maxEntries)
+{
+    std::vector< std::pair<uint32_t, HeapGraph::TNodeIndex> > nodes;
+    nodes.reserve(graph.reversePostOrder.size());
+    for (std::size_t i = 1; i < graph.reversePostOrder.size(); i++) {
+        const HeapGraph::TNodeIndex node = graph.reversePostOrder[i];
+        nodes.push_back(std::make_pair(graph.retainedSize[node], node));
+    }
+
+    const std::size_t entries = std::min(maxEntries, nodes.size());
+    std::partial_sort(nodes.begin(), nodes.begin() + entries, nodes.end(), compareNodesByRetainedSize);
+
+    std::printf("\n%12s %12s  %s\n", "retained", "shallow", "object");
+    for (std::size_t i = 0; i < entries; i++) {
+        const HeapGraph::TNodeIndex node = nodes[i].second;
+        std::printf("%12u %12u  %p %s\n", graph.retainedSize[node], graph.shallowSize[node],
+            graph.objects[node], describeObject(graph.objects[node]).c_str());
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        std::fprintf(stderr, "Usage: %s <heap dump> [entries to show]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const std::size_t maxEntries = (argc > 2) ? std::atoi(argv[2]) : 30;
+
+    // Dump is loaded into the static heap, dynamic heap is not used
+    NonCollectMemoryManager memoryManager;
+    memoryManager.initializeHeap(sizeof(TObject));
+
+    Image image(&memoryManager);
+    std::vector<TObject*> roots;
+
+    try {
+        if (!image.loadHeapDump(argv[1], roots)) {
+            std::fprintf(stderr, "Could not allocate memory for the heap dump\n");
+            return EXIT_FAILURE;
+        }
+    } catch (const std::exception& error) {
+        std::fprintf(stderr, "Could not read heap dump: %s\n", error.what());
+        return EXIT_FAILURE;
+    }
+
+    HeapGraph graph;
+    graph.build(memoryManager, roots);
+    graph.calculateDominators();
+    graph.calculateRetainedSizes();
+
+    uint32_t totalSize = 0;
+    uint32_t unreachableObjects = 0;
+    uint32_t unreachableSize = 0;
+    for (std::size_t node = 1; node < graph.objects.size(); node++) {
+        totalSize += graph.shallowSize[node];
+        if (!graph.isReachable(node)) {
+            unreachableObjects++;
+            unreachableSize += graph.shallowSize[node];
+        }
+    }
+
+    std::printf("%zu objects, %u bytes total, %u unreachable objects (%u bytes), %zu additional roots\n",
+        graph.objects.size() - 1, totalSize, unreachableObjects, unreachableSize, roots.size());
+
+    printClassTable(graph, maxEntries);
+    printTopObjects(graph, maxEntries);
+
+    return EXIT_SUCCESS;
+}
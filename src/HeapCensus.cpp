@@ -0,0 +1,107 @@
+/*
+ *    HeapCensus.cpp
+ *
+ *    Implementation of the heap class histogram
+ *
+ *    LLST (LLVM Smalltalk or Low Level Smalltalk) version 0.4
+ *
+ *    LLST is
+ *        Copyright (C) 2012-2015 by Dmitry Kashitsyn   <korvin@deeptown.org>
+ *        Copyright (C) 2012-2015 by Roman Proskuryakov <humbug@deeptown.org>
+ *
+ *    LLST is based on the LittleSmalltalk which is
+ *        Copyright (C) 1987-2005 by Timothy A. Budd
+ *        Copyright (C) 2007 by Charles R. Childers
+ *        Copyright (C) 2005-2007 by Danny Reinhold
+ *
+ *    Original license of LittleSmalltalk may be found in the LICENSE file.
+ *
+ *
+ *    This file is part of LLST.
+ *    LLST is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    LLST is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with LLST.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <memory.h>
+
+#include <cstdio>
+#include <algorithm>
+
+void HeapCensus::visitObject(TObject* object)
+{
+    TClass* klass = object->getClass();
+
+    TClassMap::iterator iClass = m_classes.find(klass);
+    if (iClass == m_classes.end())
+        iClass = m_classes.insert(std::make_pair(klass, TClassInfo(klass))).first;
+
+    const uint32_t slotSize = object->getSlotSize();
+
+    iClass->second.instances++;
+    iClass->second.bytes += slotSize;
+
+    m_totalObjects++;
+    m_totalBytes += slotSize;
+}
+
+namespace {
+
+bool compareBySpace(const HeapCensus::TClassInfo& left, const HeapCensus::TClassInfo& right)
+{
+    if (left.bytes != right.bytes)
+        return left.bytes > right.bytes;
+    return left.instances > right.instances;
+}
+
+std::string getClassName(TClass* klass)
+{
+    if (!klass || isSmallInteger(klass) || !klass->name || isSmallInteger(klass->name))
+        return "<broken class>";
+
+    if (klass->name == globals.nilObject)
+        return "<unnamed class>";
+
+    return klass->name->toString();
+}
+
+} // namespace
+
+std::vector<HeapCensus::TClassInfo> HeapCensus::getHistogram() const
+{
+    std::vector<TClassInfo> histogram;
+    histogram.reserve(m_classes.size());
+
+    for (TClassMap::const_iterator iClass = m_classes.begin(); iClass != m_classes.end(); ++iClass)
+        histogram.push_back(iClass->second);
+
+    std::sort(histogram.begin(), histogram.end(), compareBySpace);
+    return histogram;
+}
+
+void HeapCensus::printHistogram(std::size_t maxEntries /*= 0*/) const
+{
+    const std::vector<TClassInfo> histogram = getHistogram();
+
+    std::printf("Heap census: %u objects, %u bytes, %zu classes\n",
+        m_totalObjects, m_totalBytes, histogram.size());
+    std::printf("%12s %12s %7s  %s\n", "instances", "bytes", "%", "class");
+
+    const std::size_t entries = (maxEntries && maxEntries < histogram.size()) ? maxEntries : histogram.size();
+    for (std::size_t i = 0; i < entries; i++) {
+        const TClassInfo& info = histogram[i];
+        const float ratio = m_totalBytes ? 100.0 * info.bytes / m_totalBytes : 0;
+
+        std::printf("%12u %12u %6.2f%%  %s\n",
+            info.instances, info.bytes, ratio, getClassName(info.klass).c_str());
+    }
+}
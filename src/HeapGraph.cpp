@@ -0,0 +1,297 @@
+/*
+ *    HeapGraph.cpp
+ *
+ *    Object graph of the heap along with the dominator tree
+ *    and retained sizes of objects used by the heap analyzer
+ *
+ *    LLST (LLVM Smalltalk or Low Level Smalltalk) version 0.4
+ *
+ *    LLST is
+ *        Copyright (C) 2012-2015 by Dmitry Kashitsyn   <korvin@deeptown.org>
+ *        Copyright (C) 2012-2015 by Roman Proskuryakov <humbug@deeptown.org>
+ *
+ *    LLST is based on the LittleSmalltalk which is
+ *        Copyright (C) 1987-2005 by Timothy A. Budd
+ *        Copyright (C) 2007 by Charles R. Childers
+ *        Copyright (C) 2005-2007 by Danny Reinhold
+ *
+ *    Original license of LittleSmalltalk may be found in the LICENSE file.
+ *
+ *
+ *    This file is part of LLST.
+ *    LLST is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    LLST is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with LLST.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <HeapGraph.h>
+
+#include <algorithm>
+#include <map>
+
+namespace {
+
+class TObjectCollector : public IHeapVisitor {
+public:
+    std::vector<TObject*>& objects;
+    TObjectCollector(std::vector<TObject*>& objects) : objects(objects) {}
+    virtual void visitObject(TObject* object) { objects.push_back(object); }
+};
+
+} // namespace
+
+const HeapGraph::TNodeIndex HeapGraph::invalidNode;
+
+HeapGraph::TNodeIndex HeapGraph::findNode(TObject* object) const
+{
+    if (isSmallInteger(object) || !object)
+        return invalidNode;
+
+    std::vector<TObject*>::const_iterator iObject = std::lower_bound(objects.begin() + 1, objects.end(), object);
+    if (iObject == objects.end() || *iObject != object)
+        return invalidNode;
+
+    return std::distance(objects.begin(), iObject);
+}
+
+void HeapGraph::addEdge(TObject* target)
+{
+    const TNodeIndex node = findNode(target);
+    if (node != invalidNode)
+        edges.push_back(node);
+}
+
+void HeapGraph::build(IMemoryManager& memoryManager, const std::vector<TObject*>& roots)
+{
+    objects.push_back(0);
+
+    TObjectCollector collector(objects);
+    memoryManager.walkHeap(collector);
+
+    // Walk goes through the regions in address order,
+    // but regions themselves may be placed arbitrarily
+    std::sort(objects.begin() + 1, objects.end());
+
+    shallowSize.resize(objects.size(), 0);
+    edgeOffsets.reserve(objects.size() + 1);
+
+    // Artificial root
+    edgeOffsets.push_back(0);
+    addEdge(globals.nilObject);
+    addEdge(globals.trueObject);
+    addEdge(globals.falseObject);
+    addEdge(globals.globalsObject);
+    addEdge(globals.initialMethod);
+    for (int i = 0; i < 3; i++)
+        addEdge(globals.binaryMessages[i]);
+    addEdge(globals.badMethodSymbol);
+
+    // Well-known classes are taken from the registry
+    for (std::size_t i = 0; i < TClassRegistry::classesCount; i++)
+        addEdge(classRegistry.classes[i]);
+
+    for (std::size_t i = 0; i < roots.size(); i++)
+        addEdge(roots[i]);
+
+    for (std::size_t index = 1; index < objects.size(); index++) {
+        TObject* object = objects[index];
+
+        edgeOffsets.push_back(edges.size());
+        shallowSize[index] = object->getSlotSize();
+
+        addEdge(object->getClass());
+        if (object->isBinary())
+            continue;
+
+        for (uint32_t field = 0; field < object->getSize(); field++)
+            addEdge(object->getField(field));
+    }
+
+    edgeOffsets.push_back(edges.size());
+}
+
+void HeapGraph::calculateDominators()
+{
+    const std::size_t nodesCount = objects.size();
+
+    // Stage 1. Depth first traversal from the artificial root. Nodes
+    //          are numbered in the reverse post order of traversal.
+    std::vector<TNodeIndex> postOrder;
+    postOrder.reserve(nodesCount);
+
+    std::vector<bool> visited(nodesCount, false);
+    std::vector< std::pair<TNodeIndex, uint32_t> > stack; // node and the next edge to follow
+
+    visited[0] = true;
+    stack.push_back(std::make_pair(0u, edgeOffsets[0]));
+
+    while (!stack.empty()) {
+        const TNodeIndex node = stack.back().first;
+        uint32_t& edge = stack.back().second;
+
+        if (edge == edgeOffsets[node + 1]) {
+            postOrder.push_back(node);
+            stack.pop_back();
+            continue;
+        }
+
+        const TNodeIndex successor = edges[edge++];
+        if (!visited[successor]) {
+            visited[successor] = true;
+            stack.push_back(std::make_pair(successor, edgeOffsets[successor]));
+        }
+    }
+
+    reversePostOrder.assign(postOrder.rbegin(), postOrder.rend());
+
+    orderNumber.assign(nodesCount, invalidNode);
+    for (std::size_t i = 0; i < reversePostOrder.size(); i++)
+        orderNumber[reversePostOrder[i]] = i;
+
+    // Predecessors of reachable nodes in the compressed form
+    std::vector<uint32_t> predecessorOffsets(nodesCount + 1, 0);
+    for (TNodeIndex node = 0; node < nodesCount; node++) {
+        if (!isReachable(node))
+            continue;
+        for (uint32_t edge = edgeOffsets[node]; edge < edgeOffsets[node + 1]; edge++)
+            predecessorOffsets[edges[edge] + 1]++;
+    }
+    for (std::size_t i = 1; i <= nodesCount; i++)
+        predecessorOffsets[i] += predecessorOffsets[i - 1];
+
+    std::vector<TNodeIndex> predecessors(predecessorOffsets[nodesCount]);
+    std::vector<uint32_t> fill(predecessorOffsets.begin(), predecessorOffsets.end() - 1);
+    for (TNodeIndex node = 0; node < nodesCount; node++) {
+        if (!isReachable(node))
+            continue;
+        for (uint32_t edge = edgeOffsets[node]; edge < edgeOffsets[node + 1]; edge++)
+            predecessors[fill[edges[edge]]++] = node;
+    }
+
+    // Stage 2. Iterative algorithm by Cooper, Harvey and Kennedy.
+    //          Repeat until immediate dominators stop changing.
+    immediateDominator.assign(nodesCount, invalidNode);
+    immediateDominator[0] = 0;
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+
+        for (std::size_t i = 1; i < reversePostOrder.size(); i++) {
+            const TNodeIndex node = reversePostOrder[i];
+            TNodeIndex newDominator = invalidNode;
+
+            for (uint32_t p = predecessorOffsets[node]; p < predecessorOffsets[node + 1]; p++) {
+                const TNodeIndex predecessor = predecessors[p];
+                if (immediateDominator[predecessor] == invalidNode)
+                    continue;
+
+                newDominator = (newDominator == invalidNode) ? predecessor : intersect(predecessor, newDominator);
+            }
+
+            if (immediateDominator[node] != newDominator) {
+                immediateDominator[node] = newDominator;
+                changed = true;
+            }
+        }
+    }
+}
+
+HeapGraph::TNodeIndex HeapGraph::intersect(TNodeIndex left, TNodeIndex right) const
+{
+    while (left != right) {
+        while (orderNumber[left] > orderNumber[right])
+            left = immediateDominator[left];
+        while (orderNumber[right] > orderNumber[left])
+            right = immediateDominator[right];
+    }
+    return left;
+}
+
+void HeapGraph::calculateRetainedSizes()
+{
+    retainedSize.assign(shallowSize.begin(), shallowSize.end());
+
+    // Dominator always precedes the node in the reverse post order,
+    // so walking backwards accumulates the sizes from bottom to top.
+    for (std::size_t i = reversePostOrder.size() - 1; i > 0; i--) {
+        const TNodeIndex node = reversePostOrder[i];
+        retainedSize[immediateDominator[node]] += retainedSize[node];
+    }
+}
+
+static bool compareByRetainedSize(const HeapGraph::TClassRecord& left, const HeapGraph::TClassRecord& right)
+{
+    return left.retainedSize > right.retainedSize;
+}
+
+std::vector<HeapGraph::TClassRecord> HeapGraph::getClassTable() const
+{
+    typedef std::map<TClass*, TClassRecord> TClassMap;
+    TClassMap classes;
+
+    // Retained size of a class is a sum of retained sizes of its instances
+    // excluding ones dominated by other instances of the same class.
+    // Dominator tree is walked in depth keeping count of class instances
+    // on the path from the root to the current node.
+    const std::size_t nodesCount = objects.size();
+    std::vector<uint32_t> childOffsets(nodesCount + 1, 0);
+    for (std::size_t i = 1; i < reversePostOrder.size(); i++)
+        childOffsets[immediateDominator[reversePostOrder[i]] + 1]++;
+    for (std::size_t i = 1; i <= nodesCount; i++)
+        childOffsets[i] += childOffsets[i - 1];
+
+    std::vector<TNodeIndex> children(childOffsets[nodesCount]);
+    std::vector<uint32_t> fill(childOffsets.begin(), childOffsets.end() - 1);
+    for (std::size_t i = 1; i < reversePostOrder.size(); i++) {
+        const TNodeIndex node = reversePostOrder[i];
+        children[fill[immediateDominator[node]]++] = node;
+    }
+
+    std::map<TClass*, uint32_t> classesOnPath;
+    std::vector< std::pair<TNodeIndex, uint32_t> > stack;
+    stack.push_back(std::make_pair(0u, childOffsets[0]));
+
+    while (!stack.empty()) {
+        const TNodeIndex node = stack.back().first;
+        uint32_t& child = stack.back().second;
+
+        if (child == childOffsets[node + 1]) {
+            if (node)
+                classesOnPath[objects[node]->getClass()]--;
+            stack.pop_back();
+            continue;
+        }
+
+        const TNodeIndex next = children[child++];
+        TClass* klass = objects[next]->getClass();
+
+        TClassRecord& record = classes[klass];
+        record.klass = klass;
+        record.instances++;
+        record.shallowSize += shallowSize[next];
+
+        uint32_t& onPath = classesOnPath[klass];
+        if (onPath == 0)
+            record.retainedSize += retainedSize[next];
+        onPath++;
+
+        stack.push_back(std::make_pair(next, childOffsets[next]));
+    }
+
+    std::vector<TClassRecord> records;
+    for (TClassMap::const_iterator iClass = classes.begin(); iClass != classes.end(); ++iClass)
+        records.push_back(iClass->second);
+    std::sort(records.begin(), records.end(), compareByRetainedSize);
+
+    return records;
+}
@@ -0,0 +1,119 @@
+/*
+ *    IOPoller.cpp
+ *
+ *    Readiness notifications of the file descriptors
+ *
+ *    LLST (LLVM Smalltalk or Low Level Smalltalk) version 0.4
+ *
+ *    LLST is
+ *        Copyright (C) 2012-2015 by Dmitry Kashitsyn   <korvin@deeptown.org>
+ *        Copyright (C) 2012-2015 by Roman Proskuryakov <humbug@deeptown.org>
+ *
+ *    LLST is based on the LittleSmalltalk which is
+ *        Copyright (C) 1987-2005 by Timothy A. Budd
+ *        Copyright (C) 2007 by Charles R. Childers
+ *        Copyright (C) 2005-2007 by Danny Reinhold
+ *
+ *    Original license of LittleSmalltalk may be found in the LICENSE file.
+ *
+ *
+ *    This file is part of LLST.
+ *    LLST is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    LLST is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with LLST.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <IOPoller.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+IOPoller::~IOPoller()
+{
+    if (m_pollID >= 0)
+        close(m_pollID);
+}
+
+bool IOPoller::watch(int fileID, uint32_t events)
+{
+    if (m_pollID < 0 && (m_pollID = epoll_create1(EPOLL_CLOEXEC)) < 0)
+        return false;
+
+    // Descriptor may be waited for by several processes
+    std::map<int, uint32_t>::const_iterator watched = m_watched.find(fileID);
+    if (watched != m_watched.end())
+        events |= watched->second;
+
+    epoll_event event = epoll_event();
+    event.events  = (events & (readable | writable)) | EPOLLONESHOT;
+    event.data.fd = fileID;
+
+    // Descriptor reported ready before is still registered but disarmed
+    if (epoll_ctl(m_pollID, EPOLL_CTL_ADD, fileID, &event) < 0) {
+        if (errno != EEXIST || epoll_ctl(m_pollID, EPOLL_CTL_MOD, fileID, &event) < 0)
+            return false;
+    }
+
+    m_watched[fileID] = events & (readable | writable);
+    return true;
+}
+
+void IOPoller::unwatch(int fileID)
+{
+    std::map<int, uint32_t>::iterator watched = m_watched.find(fileID);
+    if (watched == m_watched.end())
+        return;
+
+    epoll_ctl(m_pollID, EPOLL_CTL_DEL, fileID, 0);
+    m_watched.erase(watched);
+    m_unwatched.push_back(fileID);
+}
+
+bool IOPoller::wait(int timeout, std::vector<int>& ready)
+{
+    ready.swap(m_unwatched);
+    m_unwatched.clear();
+
+    // Epoll silently drops the closed descriptors, so they would never be reported
+    if (timeout < 0) {
+        std::map<int, uint32_t>::iterator watched = m_watched.begin();
+        while (watched != m_watched.end()) {
+            if (fcntl(watched->first, F_GETFD) < 0 && errno == EBADF) {
+                ready.push_back(watched->first);
+                m_watched.erase(watched++);
+            } else
+                ++watched;
+        }
+    }
+
+    if (m_watched.empty())
+        return true;
+
+    // Descriptors already reported should not wait for the others
+    if (! ready.empty())
+        timeout = 0;
+
+    std::vector<epoll_event> events(m_watched.size());
+    const int count = epoll_wait(m_pollID, &events[0], events.size(), timeout);
+    if (count < 0)
+        return errno == EINTR;
+
+    // Errors and hang ups are reported as readiness, the next read or write gets them
+    for (int i = 0; i < count; i++) {
+        ready.push_back(events[i].data.fd);
+        m_watched.erase(events[i].data.fd);
+    }
+
+    return true;
+}
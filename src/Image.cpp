@@ -44,9 +44,40 @@
 #include <algorithm>
 #include <iostream>
 #include <stdexcept>
+#include <set>
+#include <limits>
+#include <tr1/unordered_map>
+#include <tr1/unordered_set>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 // Placeholder for root objects
 TGlobals globals;
+TClassRegistry classRegistry;
+
+const char* const TClassRegistry::names[TClassRegistry::classesCount] = {
+    "Array", "Block", "ByteArray", "Char", "Class", "Context", "Dictionary",
+    "Float", "Integer", "Method", "Node", "Process", "SmallInt", "String", "StringBuffer", "Symbol"
+};
+
+void TClassRegistry::resolve(const TDictionary* globalsObject)
+{
+    if (! globalsObject) {
+        clear();
+        return;
+    }
+
+    for (std::size_t i = 0; i < classesCount; i++)
+        classes[i] = globalsObject->find<TClass>(names[i]);
+}
+
+void TClassRegistry::clear()
+{
+    for (std::size_t i = 0; i < classesCount; i++)
+        classes[i] = 0;
+}
 
 template<typename N>
 TObject* Image::getGlobal(const N* name) const {
@@ -58,15 +89,70 @@ TObject* Image::getGlobal(const N* name) const {
 template TObject* Image::getGlobal<char>(const char* key) const;
 template TObject* Image::getGlobal<TSymbol>(const TSymbol* key) const;
 
+namespace {
+
+const char COMPACT_IMAGE_MAGIC[7] = { 'L', 'L', 'S', 'T', 'I', 'M', 'G' };
+const std::size_t COMPACT_IMAGE_HEADER_SIZE = 40;
+const int MAX_VARINT_SHIFT = 70; // ten bytes hold any 64 bit value
+const char GRAPH_MAGIC[8] = { 'L', 'L', 'S', 'T', 'G', 'R', 'P', 'H' };
+
+inline uint64_t zigzagEncode(int64_t value) { return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63); }
+inline int64_t  zigzagDecode(uint64_t value) { return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1); }
+
+// Header counters are stored in little endian regardless of the host
+uint64_t readLittleEndian(const uint8_t* bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++)
+        value |= static_cast<uint64_t>(bytes[i]) << (i * 8);
+    return value;
+}
+
+void writeLittleEndian(uint8_t* bytes, uint64_t value)
+{
+    for (int i = 0; i < 8; i++)
+        bytes[i] = static_cast<uint8_t>(value >> (i * 8));
+}
+
+} // namespace
+
+uint64_t Image::readVarint()
+{
+    uint64_t value = 0;
+    uint8_t  byte  = 0;
+    int      shift = 0;
+
+    // LEB128: 7 bits per byte starting from the least significant ones,
+    // high bit is set on every byte except the last one
+    do {
+        const int next = m_inputStream.get();
+        if (next == std::char_traits<char>::eof() || shift >= MAX_VARINT_SHIFT)
+            throw std::runtime_error("Truncated or malformed varint in the image");
+
+        byte = static_cast<uint8_t>(next);
+        if (shift < 64)
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    return value;
+}
+
 uint32_t Image::readWord()
 {
+    if (m_encoding == compactEncoding)
+        return static_cast<uint32_t>(readVarint());
+
     uint32_t value = 0;
     uint8_t  byte  = 0;
 
     // Very stupid yet simple multibyte encoding
     // value = FF + FF ... + x where x < FF
     do {
-        byte = m_inputStream.get();
+        const int next = m_inputStream.get();
+        if (next == std::char_traits<char>::eof())
+            throw std::runtime_error("Truncated image");
+
+        byte = static_cast<uint8_t>(next);
         value += byte;
     } while ( byte == 0xFF );
     return value;
@@ -101,9 +187,36 @@ TObject* Image::readObject()
         }
 
         case inlineInteger: {
-            uint32_t value = m_inputStream.get() | (m_inputStream.get() << 8) |
-                            (m_inputStream.get() << 16) | (m_inputStream.get() << 24);
-            return TInteger(value); // FIXME endianness
+            if (m_encoding == compactEncoding) {
+                const int64_t integer = zigzagDecode(readVarint());
+                if (integer < TInteger::MIN_VALUE || integer > TInteger::MAX_VALUE) {
+                    std::fprintf(stderr, "Integer %lld at offset %lld does not fit into SmallInt\n",
+                        static_cast<long long>(integer), static_cast<long long>(m_inputStream.tellg()));
+                    std::exit(1);
+                }
+                return TInteger(static_cast<intptr_t>(integer));
+            }
+
+            // Value is sign extended to the machine word so that
+            // images written by 32-bit VMs are loaded by widening
+            uint32_t value = 0;
+            for (int shift = 0; shift < 32; shift += 8)
+                value |= static_cast<uint32_t>(m_inputStream.get() & 0xFF) << shift;
+            return TInteger(static_cast<intptr_t>(static_cast<int32_t>(value)));
+        }
+
+        case inlineLongInteger: {
+            uint64_t value = 0;
+            for (int shift = 0; shift < 64; shift += 8)
+                value |= static_cast<uint64_t>(m_inputStream.get() & 0xFF) << shift;
+
+            const int64_t integer = static_cast<int64_t>(value);
+            if (integer < TInteger::MIN_VALUE || integer > TInteger::MAX_VALUE) {
+                std::fprintf(stderr, "Integer %lld at offset %lld does not fit into SmallInt\n",
+                    static_cast<long long>(integer), static_cast<long long>(m_inputStream.tellg()));
+                std::exit(1);
+            }
+            return TInteger(static_cast<intptr_t>(integer));
         }
 
         case byteObject: {
@@ -119,8 +232,13 @@ TObject* Image::readObject()
             TByteObject* newByteObject = new(objectSlot) TByteObject(dataSize, 0);
             m_indirects.push_back(newByteObject);
 
-            for (uint32_t i = 0; i < dataSize; i++)
-                (*newByteObject)[i] = static_cast<uint8_t>(readWord());
+            if (m_encoding == compactEncoding) {
+                if (dataSize)
+                    m_inputStream.read(reinterpret_cast<char*>(newByteObject->getBytes()), dataSize);
+            } else {
+                for (uint32_t i = 0; i < dataSize; i++)
+                    (*newByteObject)[i] = static_cast<uint8_t>(readWord());
+            }
 
             TClass* objectClass = readObject<TClass>();
             newByteObject->setClass(objectClass);
@@ -143,7 +261,7 @@ TObject* Image::readObject()
     }
 }
 
-bool Image::loadImage(const std::string& fileName)
+bool Image::openImage(const std::string& fileName)
 {
     m_inputStream.exceptions( std::ifstream::eofbit | std::ifstream::badbit );
     m_inputStream.open(fileName.c_str(), std::ifstream::binary);
@@ -159,14 +277,49 @@ bool Image::loadImage(const std::string& fileName)
     //Reset the position to the beginning of the file
     m_inputStream.seekg(0);
 
+    // Multiplier of 1.5 of imageFileSize should be a good estimation for static heap size.
+    // Object headers and fields are twice as large on 64-bit platforms.
+    const std::size_t wordScale = sizeof(TObject*) / sizeof(uint32_t);
+    std::size_t staticHeapSize = fileSize * 1.5 * wordScale;
+
+    // Compact image tells the exact size of the heap
+    m_encoding = classicEncoding;
+    if (fileSize >= static_cast<std::ifstream::pos_type>(COMPACT_IMAGE_HEADER_SIZE)) {
+        uint8_t bytes[COMPACT_IMAGE_HEADER_SIZE];
+        m_inputStream.read(reinterpret_cast<char*>(bytes), sizeof(bytes));
+
+        TCompactImageHeader header;
+        std::memcpy(header.magic, bytes, sizeof(header.magic));
+        header.encoding      = bytes[7];
+        header.pointerWords  = readLittleEndian(bytes + 8);
+        header.binaryBytes   = readLittleEndian(bytes + 16);
+        header.binaryObjects = readLittleEndian(bytes + 24);
+        header.flags         = readLittleEndian(bytes + 32);
+
+        if (std::memcmp(header.magic, COMPACT_IMAGE_MAGIC, sizeof(header.magic)) == 0) {
+            if (header.encoding != compactEncoding || (header.flags & ~static_cast<uint64_t>(externalSourcesFlag)))
+                throw std::runtime_error("Unsupported encoding of image file " + fileName);
+
+            m_encoding = compactEncoding;
+            m_externalSources = header.flags & externalSourcesFlag;
+            staticHeapSize = header.pointerWords * sizeof(TObject*) + header.binaryBytes
+                           + header.binaryObjects * sizeof(TObject*);
+        } else {
+            m_inputStream.seekg(0);
+        }
+    }
+
     // TODO Check whether heap is already initialized
-    // Multiplier of 1.5 of imageFileSize should be a good estimation for static heap size
-    if ( !m_memoryManager->initializeStaticHeap(fileSize * 1.5) ) {
+    if ( !m_memoryManager->initializeStaticHeap(staticHeapSize) ) {
         return false;
     }
 
     m_indirects.reserve(4096);
+    return true;
+}
 
+void Image::readGlobals()
+{
     globals.nilObject     = readObject();
 
     globals.trueObject    = readObject();
@@ -185,36 +338,430 @@ bool Image::loadImage(const std::string& fileName)
 
     globals.badMethodSymbol = readObject<TSymbol>();
 
-    std::fprintf(stdout, "Image read complete. Loaded %d objects\n", m_indirects.size());
+    classRegistry.resolve(globals.globalsObject);
+}
+
+namespace {
+
+const char     NATIVE_IMAGE_MAGIC[8]   = { 'L', 'L', 'S', 'T', 'H', 'E', 'A', 'P' };
+const uint32_t NATIVE_IMAGE_VERSION    = 4;
+const uint32_t BYTE_ORDER_MARK         = 0x01020304;
+const uint32_t NATIVE_IMAGE_ALIGNMENT  = 64 * 1024; // largest page size we care about
+const uint32_t NATIVE_IMAGE_HEADROOM   = 4;         // free static space is heap size / headroom
+const std::size_t IMAGE_GLOBALS_COUNT  = 15;
+
+} // namespace
+
+const uintptr_t Image::NATIVE_IMAGE_BASE = sizeof(void*) == 8 ?
+    static_cast<uintptr_t>(0x200000000000ULL) : static_cast<uintptr_t>(0x50000000);
+
+TObject** Image::getGlobalSlot(TGlobals& source, std::size_t index)
+{
+    switch (index) {
+        case 0:  return &source.nilObject;
+        case 1:  return &source.trueObject;
+        case 2:  return &source.falseObject;
+        case 3:  return reinterpret_cast<TObject**>(&source.globalsObject);
+        case 4:  return reinterpret_cast<TObject**>(&source.smallIntClass);
+        case 5:  return reinterpret_cast<TObject**>(&source.integerClass);
+        case 6:  return reinterpret_cast<TObject**>(&source.arrayClass);
+        case 7:  return reinterpret_cast<TObject**>(&source.blockClass);
+        case 8:  return reinterpret_cast<TObject**>(&source.contextClass);
+        case 9:  return reinterpret_cast<TObject**>(&source.stringClass);
+        case 10: return reinterpret_cast<TObject**>(&source.initialMethod);
+        case 11:
+        case 12:
+        case 13: return &source.binaryMessages[index - 11];
+        default: return reinterpret_cast<TObject**>(&source.badMethodSymbol);
+    }
+}
+
+Image::~Image()
+{
+    if (m_mappedHeap)
+        munmap(m_mappedHeap, m_mappedHeapSize);
+}
+
+bool Image::isNativeImage(const std::string& fileName)
+{
+    // First byte of the classic image is a small record type
+    char magic[sizeof(NATIVE_IMAGE_MAGIC)];
+    std::ifstream stream(fileName.c_str(), std::ifstream::binary);
+    if (! stream.read(magic, sizeof(magic)))
+        return false;
+
+    return std::memcmp(magic, NATIVE_IMAGE_MAGIC, sizeof(magic)) == 0;
+}
+
+bool Image::loadNativeImage(const std::string& fileName)
+{
+    const int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Could not open image file " + fileName);
+
+    TNativeImageHeader header;
+    if (pread(fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header))) {
+        close(fd);
+        throw std::runtime_error("Could not read native image header of " + fileName);
+    }
+
+    if (header.version != NATIVE_IMAGE_VERSION
+        || header.byteOrder != BYTE_ORDER_MARK
+        || header.wordSize != sizeof(TObject*)
+        || header.globalsCount != IMAGE_GLOBALS_COUNT
+        || header.heapOffset % NATIVE_IMAGE_ALIGNMENT)
+    {
+        close(fd);
+        throw std::runtime_error("Native image " + fileName + " was written for a different platform or version");
+    }
+
+    m_externalSources = header.flags & externalSourcesFlag;
+
+    // Static heap grows down, so its free space is reserved right below the image
+    const std::size_t headroom = (header.heapSize / NATIVE_IMAGE_HEADROOM / NATIVE_IMAGE_ALIGNMENT + 1) * NATIVE_IMAGE_ALIGNMENT;
+    const std::size_t regionSize = headroom + header.heapSize;
+    const uintptr_t regionBase = header.preferredBase > headroom ? header.preferredBase - headroom : 0;
+
+    uint8_t* const region = static_cast<uint8_t*>(mmap(reinterpret_cast<void*>(regionBase), regionSize,
+                            PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (region == MAP_FAILED) {
+        close(fd);
+        std::fprintf(stderr, "Could not reserve the static heap: %s\n", std::strerror(errno));
+        return false;
+    }
+
+    // Private mapping keeps the file intact while the heap is modified
+    void* const heap = mmap(region + headroom, header.heapSize,
+                            PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, header.heapOffset);
+    if (heap == MAP_FAILED) {
+        munmap(region, regionSize);
+        close(fd);
+        std::fprintf(stderr, "Could not map native image: %s\n", std::strerror(errno));
+        return false;
+    }
+
+    // Heap is mapped elsewhere, so every pointer has to be fixed up
+    const uintptr_t delta = reinterpret_cast<uintptr_t>(heap) - header.preferredBase;
+    if (delta) {
+        std::vector<uint32_t> relocations(header.relocationsCount);
+        const ssize_t relocationsSize = relocations.size() * sizeof(uint32_t);
+        if (relocationsSize && pread(fd, &relocations[0], relocationsSize, header.relocationsOffset) != relocationsSize) {
+            munmap(region, regionSize);
+            close(fd);
+            throw std::runtime_error("Could not read relocations of " + fileName);
+        }
+
+        uintptr_t* const slots = static_cast<uintptr_t*>(heap);
+        for (std::size_t i = 0; i < relocations.size(); i++)
+            slots[relocations[i]] += delta;
+    }
+
+    close(fd);
+
+    m_mappedHeap = region;
+    m_mappedHeapSize = regionSize;
+    m_memoryManager->adoptStaticHeap(region, regionSize, header.heapSize);
+
+    uint8_t* const heapBase = static_cast<uint8_t*>(heap);
+    for (std::size_t i = 0; i < IMAGE_GLOBALS_COUNT; i++)
+        *getGlobalSlot(globals, i) = reinterpret_cast<TObject*>(heapBase + header.globals[i]);
+
+    classRegistry.resolve(globals.globalsObject);
+
+    std::fprintf(stdout, "Native image mapped at %p. Applied %zu relocations\n",
+        heap, delta ? static_cast<std::size_t>(header.relocationsCount) : 0);
+
+    return true;
+}
+
+namespace {
+
+class TLocalityLayout {
+public:
+    explicit TLocalityLayout(const std::vector<TObject*>& objects)
+        : m_objects(objects.begin(), objects.end()) { m_ordered.reserve(objects.size()); }
+
+    void place(TObject* object) {
+        if (object && !isSmallInteger(object) && m_objects.count(object) && m_placed.insert(object).second)
+            m_ordered.push_back(object);
+    }
+
+    std::vector<TObject*>& getOrdered() { return m_ordered; }
+
+private:
+    typedef std::tr1::unordered_set<TObject*> TObjectSet;
+    TObjectSet            m_objects;
+    TObjectSet            m_placed;
+    std::vector<TObject*> m_ordered;
+};
+
+// Orders objects so that the ones touched together by the method lookup and
+// dispatch are adjacent. Symbols compared by the binary search of the method
+// dictionaries form a dense region. Each class is followed by its method
+// dictionary with keys and values, then by its methods each followed by the
+// bytecodes and literals. Remaining objects keep their relative order.
+void orderForLocality(const TGlobals& roots, std::vector<TObject*>& objects)
+{
+    TClass* const classClass  = roots.globalsObject->find<TClass>(TClass::InstanceClassName());
+    TClass* const symbolClass = roots.globalsObject->find<TClass>(TSymbol::InstanceClassName());
+    TClass* const methodClass = roots.globalsObject->find<TClass>(TMethod::InstanceClassName());
+    if (!classClass || !symbolClass || !methodClass)
+        return;
+
+    TLocalityLayout layout(objects);
+
+    for (std::size_t i = 0; i < objects.size(); i++) {
+        if (objects[i]->getClass() == symbolClass)
+            layout.place(objects[i]);
+    }
+
+    for (std::size_t i = 0; i < objects.size(); i++) {
+        TObject* const object = objects[i];
+        if (object->isBinary())
+            continue;
+
+        // Metaclasses are instances of Class, classes are instances of metaclasses
+        TClass* const klass = static_cast<TClass*>(object);
+        if (klass->getClass() != classClass && klass->getClass()->getClass() != classClass)
+            continue;
+
+        layout.place(klass);
+
+        TDictionary* const methods = klass->methods;
+        if (isSmallInteger(methods) || methods->isBinary() || methods == roots.nilObject)
+            continue;
+
+        layout.place(methods);
+        layout.place(methods->keys);
+        layout.place(methods->values);
+
+        for (std::size_t j = 0; j < methods->values->getSize(); j++) {
+            TMethod* const method = methods->values->getField<TMethod>(j);
+            if (isSmallInteger(method) || method->getClass() != methodClass)
+                continue;
+
+            layout.place(method);
+            layout.place(method->byteCodes);
+            layout.place(method->literals);
+        }
+    }
+
+    for (std::size_t i = 0; i < objects.size(); i++)
+        layout.place(objects[i]);
+
+    objects.swap(layout.getOrdered());
+}
+
+} // namespace
+
+void Image::applyLocalityLayout()
+{
+    if (m_indirects.empty())
+        return;
+
+    // Objects are allocated downwards one after another,
+    // so together they occupy a single range of the static heap
+    uint8_t* base = reinterpret_cast<uint8_t*>(m_indirects.front());
+    uint8_t* end  = base;
+    std::size_t heapSize = 0;
+    for (std::size_t i = 0; i < m_indirects.size(); i++) {
+        uint8_t* const slot = reinterpret_cast<uint8_t*>(m_indirects[i]);
+        const std::size_t slotSize = m_indirects[i]->getSlotSize();
+
+        base = std::min(base, slot);
+        end  = std::max(end, slot + slotSize);
+        heapSize += slotSize;
+    }
+
+    if (static_cast<std::size_t>(end - base) != heapSize)
+        return;
+
+    std::vector<TObject*> objects(m_indirects);
+    orderForLocality(globals, objects);
+
+    typedef std::tr1::unordered_map<TObject*, TObject*> TForwardingMap;
+    TForwardingMap forwarding;
+    std::vector<uint8_t> heap(heapSize);
+
+    for (std::size_t i = 0, offset = 0; i < objects.size(); i++) {
+        forwarding[objects[i]] = reinterpret_cast<TObject*>(base + offset);
+        std::memcpy(&heap[offset], objects[i], objects[i]->getSlotSize());
+        offset += objects[i]->getSlotSize();
+    }
+
+    // Pointers of the copies are rewritten to the new locations
+    for (std::size_t i = 0, offset = 0; i < objects.size(); i++) {
+        TObject* const copy = reinterpret_cast<TObject*>(&heap[offset]);
+        offset += copy->getSlotSize();
+
+        copy->setClass(static_cast<TClass*>(forwarding[copy->getClass()]));
+        if (copy->isBinary())
+            continue;
+
+        for (std::size_t field = 0; field < copy->getSize(); field++) {
+            TObject* const value = copy->getField(field);
+            if (!isSmallInteger(value))
+                copy->putField(field, forwarding[value]);
+        }
+    }
+
+    std::memcpy(base, &heap[0], heapSize);
+
+    for (std::size_t i = 0; i < IMAGE_GLOBALS_COUNT; i++) {
+        TObject** const slot = getGlobalSlot(globals, i);
+        *slot = forwarding[*slot];
+    }
+
+    // Classes were resolved at their old addresses
+    classRegistry.resolve(globals.globalsObject);
+
+    for (std::size_t i = 0; i < m_indirects.size(); i++)
+        m_indirects[i] = forwarding[m_indirects[i]];
+}
+
+bool Image::loadImage(const std::string& fileName)
+{
+    // Indices of the previously loaded dictionaries are not needed anymore
+    TDictionary::flushIndices();
+
+    m_fileName = fileName;
+    m_externalSources = false;
+
+    if ( isNativeImage(fileName) )
+        return loadNativeImage(fileName);
+
+    if ( !openImage(fileName) )
+        return false;
+
+    readGlobals();
+
+    if (m_localityLayout)
+        applyLocalityLayout();
+
+    // Hashes are kept in the headers of the symbols
+    TClass* const symbolClass = classRegistry.get<TSymbol>();
+    for (std::size_t i = 0; i < m_indirects.size(); i++) {
+        if (m_indirects[i]->getClass() == symbolClass)
+            static_cast<TSymbol*>(m_indirects[i])->updateHash();
+    }
+
+    std::fprintf(stdout, "Image read complete. Loaded %zu objects\n", m_indirects.size());
+    m_indirects.clear();
+
+    return true;
+}
+
+bool Image::loadHeapDump(const std::string& fileName, std::vector<TObject*>& roots)
+{
+    TDictionary::flushIndices();
+
+    if ( !openImage(fileName) )
+        return false;
+
+    readGlobals();
+
+    // Additional roots are prefixed with a non zero word
+    while (readWord() != 0)
+        roots.push_back(readObject());
+
+    std::fprintf(stdout, "Heap dump read complete. Loaded %zu objects, %zu additional roots\n", m_indirects.size(), roots.size());
     m_indirects.clear();
 
     return true;
 }
 
-void Image::ImageWriter::writeWord(std::ofstream& os, uint32_t word)
+std::string Image::getSourcesFileName(const std::string& imageFileName)
+{
+    const std::string extension(".image");
+    if (imageFileName.size() > extension.size()
+        && imageFileName.compare(imageFileName.size() - extension.size(), extension.size(), extension) == 0)
+    {
+        return imageFileName.substr(0, imageFileName.size() - extension.size()) + ".sources";
+    }
+
+    return imageFileName + ".sources";
+}
+
+bool Image::readSource(const std::string& sourcesFileName, std::size_t offset, std::string& text)
+{
+    std::ifstream stream(sourcesFileName.c_str(), std::ifstream::binary);
+    return readSource(stream, offset, text);
+}
+
+bool Image::readSource(std::istream& sources, std::size_t offset, std::string& text)
+{
+    // Stream may be reused after the failed read
+    sources.clear();
+    if (! sources.seekg(offset))
+        return false;
+
+    std::size_t length = 0;
+    if (! (sources >> length) || sources.get() != '\n')
+        return false;
+
+    text.resize(length);
+    return !length || sources.read(&text[0], length);
+}
+
+bool Image::storeImage(const std::string& fileName, bool externalSources)
+{
+    ImageWriter writer;
+    writer.setGlobals(globals).setSources(getSourcesFileName(m_fileName), externalSources);
+
+    // Image is written in the same format it was loaded from
+    if (m_mappedHeap)
+        return writer.writeNativeImage(fileName.c_str());
+    else
+        return writer.setEncoding(m_encoding).writeTo(fileName.c_str());
+}
+
+void Image::ImageWriter::writeVarint(uint64_t value)
+{
+    while (value >= 0x80) {
+        m_buffer.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    m_buffer.push_back(static_cast<uint8_t>(value));
+}
+
+void Image::ImageWriter::writeWord(uint32_t word)
 {
+    if (m_encoding == compactEncoding) {
+        writeVarint(word);
+        return;
+    }
+
     while (word >= 0xFF) {
         word -= 0xFF;
-        os << '\xFF';
+        m_buffer.push_back(0xFF);
     }
-    uint8_t byte = word & 0xFF;
-    os << byte;
+    m_buffer.push_back(static_cast<uint8_t>(word));
 }
 
 Image::TImageRecordType Image::ImageWriter::getObjectType(TObject* object) const
 {
     if ( isSmallInteger(object) ) {
+        // Compact varint record holds integers of any width
+        if (m_encoding == compactEncoding)
+            return inlineInteger;
+
+        // Keep the 32-bit record whenever possible so that images
+        // written by 64-bit VMs are still readable by 32-bit ones
+        const intptr_t value = TInteger(object);
+        if (value < std::numeric_limits<int32_t>::min() || value > std::numeric_limits<int32_t>::max())
+            return inlineLongInteger;
         return inlineInteger;
     } else {
-        std::vector<TObject*>::const_iterator iter = std::find(m_writtenObjects.begin(), m_writtenObjects.end(), object);
+        TObjectIndex::const_iterator iter = m_writtenObjects.find(object);
         if (iter != m_writtenObjects.end()) {
-            // object is found
-            int index = std::distance(m_writtenObjects.begin(), iter);
-            if (index == 0)
+            // object is found, images start with nil
+            if (iter->second == 0 && !m_graph)
                 return nilObject;
             else
                 return previousObject;
         }
+        else if (m_graph)
+            return getGraphObjectType(object);
         else if ( object->isBinary() )
             return byteObject;
         else
@@ -222,65 +769,189 @@ Image::TImageRecordType Image::ImageWriter::getObjectType(TObject* object) const
     }
 }
 
-int Image::ImageWriter::getPreviousObjectIndex(TObject* object) const
+Image::TImageRecordType Image::ImageWriter::getGraphObjectType(TObject* object) const
+{
+    if (object == m_globals.nilObject)
+        return nilObject;
+    if (object == m_globals.trueObject)
+        return trueObject;
+    if (object == m_globals.falseObject)
+        return falseObject;
+
+    TClass* const klass = object->getClass();
+    TClass* const classClass = classRegistry.get<TClass>();
+
+    // Metaclasses are instances of Class, classes are instances of metaclasses
+    if (klass == classClass || klass->getClass() == classClass) {
+        TObject* const name = static_cast<TClass*>(object)->name;
+        if (isSmallInteger(name) || name->getClass() != classRegistry.get<TSymbol>())
+            return invalidObject;
+
+        // Reader resolves the classes through globals, metaclasses are not there
+        if (m_globals.globalsObject->find(static_cast<TSymbol*>(name)) == object)
+            return globalObject;
+        if (klass == classClass && getInstanceClass(static_cast<TClass*>(object)))
+            return metaclassObject;
+        return invalidObject;
+    }
+
+    if (klass == classRegistry.get<TSymbol>())
+        return symbolObject;
+
+    // Characters of the table of MetaChar are unique
+    if (klass == classRegistry.get<TChar>() && object->getSize() == 1) {
+        TObject* const value = object->getField(0);
+        if (isSmallInteger(value) && TInteger(value) >= 0 && TInteger(value) <= 256)
+            return charObject;
+    }
+
+    if (klass == classRegistry.get<TMethod>() || klass == classRegistry.get<TContext>()
+        || klass == classRegistry.get<TBlock>() || klass == classRegistry.get<TProcess>())
+    {
+        return invalidObject;
+    }
+
+    return object->isBinary() ? byteObject : ordinaryObject;
+}
+
+// Metaclass of the global class Foo is named MetaFoo
+TClass* Image::ImageWriter::getInstanceClass(TClass* metaclass) const
 {
-    std::vector<TObject*>::const_iterator iter = std::find(m_writtenObjects.begin(), m_writtenObjects.end(), object);
+    const std::string name = metaclass->name->toString();
+    if (name.compare(0, 4, "Meta") != 0)
+        return 0;
+
+    TObject* const instance = m_globals.globalsObject->find(name.c_str() + 4);
+    if (! instance || isSmallInteger(instance) || instance->getClass() != metaclass)
+        return 0;
+    return static_cast<TClass*>(instance);
+}
+
+uint32_t Image::ImageWriter::getPreviousObjectIndex(TObject* object) const
+{
+    TObjectIndex::const_iterator iter = m_writtenObjects.find(object);
     assert(iter != m_writtenObjects.end());
-    return std::distance(m_writtenObjects.begin(), iter);
+    return iter->second;
 }
 
-void Image::ImageWriter::writeObject(std::ofstream& os, TObject* object)
+void Image::ImageWriter::writeName(const TByteObject* name)
 {
-    assert(object != 0);
-    TImageRecordType type = getObjectType(object);
-    writeWord(os, static_cast<uint32_t>(type));
+    writeVarint(name->getSize());
+    m_buffer.insert(m_buffer.end(), name->getBytes(), name->getBytes() + name->getSize());
+}
 
-    if (type == ordinaryObject || type == byteObject)
-        m_writtenObjects.push_back(object);
+bool Image::ImageWriter::writeObject(TObject* object)
+{
+    // Records are written in the same order as Image::readObject() reads them.
+    // Objects that are yet to be written are kept on the explicit stack
+    // instead of the recursion, so deep object graphs are handled as well.
+    m_pendingObjects.push_back(object);
 
-    switch (type) {
-        case inlineInteger: {
-            uint32_t integer = TInteger(object);
-            os.write(reinterpret_cast<char*>(&integer), sizeof(integer));
-        } break;
-        case byteObject: {
-            TByteObject* byteObject = static_cast<TByteObject*>(object);
-            uint32_t fieldsCount = byteObject->getSize();
-            TClass* objectClass = byteObject->getClass();
-            assert(objectClass != 0);
+    while (! m_pendingObjects.empty()) {
+        object = m_pendingObjects.back();
+        m_pendingObjects.pop_back();
 
-            writeWord(os, fieldsCount);
-            for (uint32_t i = 0; i < fieldsCount; i++)
-                writeWord(os, byteObject->getByte(i));
+        assert(object != 0);
+        TImageRecordType type = getObjectType(object);
+        writeWord(static_cast<uint32_t>(type));
 
-            writeObject(os, objectClass);
-        } break;
-        case ordinaryObject: {
-            uint32_t fieldsCount = object->getSize();
-            TClass* objectClass = object->getClass();
-            assert(objectClass != 0);
+        if (type == ordinaryObject || type == byteObject || type == globalObject
+            || type == metaclassObject || type == symbolObject || type == charObject)
+        {
+            const uint32_t index = m_writtenObjects.size();
+            m_writtenObjects[object] = index;
+        }
 
-            writeWord(os, fieldsCount);
-            writeObject(os, objectClass);
-            for (uint32_t i = 0; i < fieldsCount; i++)
-                writeObject(os, object->getField(i));
-        } break;
-        case previousObject: {
-            int index = getPreviousObjectIndex(object);
-            writeWord(os, index);
-        } break;
-        case nilObject: {
-            // type nilObject means a link to nilObject
-            // it has already been written as the first object with type ordinaryObject
-        } break;
-        default:
-            std::fprintf(stderr, "unexpected type of object: %d\n", static_cast<int>(type));
-            std::exit(1);
+        switch (type) {
+            case inlineInteger: {
+                if (m_encoding == compactEncoding) {
+                    writeVarint(zigzagEncode(TInteger(object).getValue()));
+                    break;
+                }
+
+                const uint32_t integer = static_cast<uint32_t>(TInteger(object).getValue());
+                for (int shift = 0; shift < 32; shift += 8)
+                    m_buffer.push_back(static_cast<uint8_t>((integer >> shift) & 0xFF));
+            } break;
+            case inlineLongInteger: {
+                const uint64_t integer = static_cast<uint64_t>(static_cast<int64_t>(TInteger(object).getValue()));
+                for (int shift = 0; shift < 64; shift += 8)
+                    m_buffer.push_back(static_cast<uint8_t>((integer >> shift) & 0xFF));
+            } break;
+            case byteObject: {
+                TByteObject* byteObject = static_cast<TByteObject*>(object);
+                uint32_t fieldsCount = byteObject->getSize();
+                TClass* objectClass = byteObject->getClass();
+                assert(objectClass != 0);
+
+                writeWord(fieldsCount);
+                if (m_encoding == compactEncoding) {
+                    const uint8_t* const bytes = byteObject->getBytes();
+                    m_buffer.insert(m_buffer.end(), bytes, bytes + fieldsCount);
+                } else {
+                    for (uint32_t i = 0; i < fieldsCount; i++)
+                        writeWord(byteObject->getByte(i));
+                }
+
+                m_header.pointerWords += 2;
+                m_header.binaryBytes += fieldsCount;
+                m_header.binaryObjects++;
+
+                m_pendingObjects.push_back(objectClass);
+            } break;
+            case ordinaryObject: {
+                uint32_t fieldsCount = object->getSize();
+                TClass* objectClass = object->getClass();
+                assert(objectClass != 0);
+
+                writeWord(fieldsCount);
+                m_header.pointerWords += 2 + fieldsCount;
+
+                // Class is written first, then the fields in order
+                for (uint32_t i = fieldsCount; i > 0; i--)
+                    m_pendingObjects.push_back(getField(object, i - 1));
+                m_pendingObjects.push_back(objectClass);
+            } break;
+            case previousObject: {
+                writeWord(getPreviousObjectIndex(object));
+            } break;
+            case nilObject: {
+                // type nilObject means a link to nilObject
+                // it has already been written as the first object with type ordinaryObject
+            } break;
+            case globalObject:
+                writeName(static_cast<TClass*>(object)->name);
+                break;
+            case metaclassObject:
+                writeName(getInstanceClass(static_cast<TClass*>(object))->name);
+                break;
+            case symbolObject:
+                writeName(static_cast<TSymbol*>(object));
+                break;
+            case charObject:
+                writeVarint(TInteger(object->getField(0)).getValue());
+                break;
+            case trueObject:
+            case falseObject:
+                break;
+            case invalidObject:
+                if (m_graph) {
+                    m_pendingObjects.clear();
+                    return false;
+                }
+                // fall through
+            default:
+                std::fprintf(stderr, "unexpected type of object: %d\n", static_cast<int>(type));
+                std::exit(1);
+        }
     }
+
+    return true;
 }
 
-Image::ImageWriter::ImageWriter() {
+Image::ImageWriter::ImageWriter() : m_encoding(classicEncoding), m_methodClass(0), m_externalSources(false), m_graph(false) {
    std::memset(&m_globals, 0, sizeof(m_globals));
+   std::memset(&m_header, 0, sizeof(m_header));
 }
 
 Image::ImageWriter& Image::ImageWriter::setGlobals(const TGlobals& globals)
@@ -289,29 +960,522 @@ Image::ImageWriter& Image::ImageWriter::setGlobals(const TGlobals& globals)
     return *this;
 }
 
-void Image::ImageWriter::writeTo(const char* fileName)
+Image::ImageWriter& Image::ImageWriter::setEncoding(TImageEncoding encoding)
+{
+    m_encoding = encoding;
+    return *this;
+}
+
+Image::ImageWriter& Image::ImageWriter::setSources(const std::string& inputFileName, bool externalize)
+{
+    m_sourcesInput = inputFileName;
+    m_externalSources = externalize;
+    return *this;
+}
+
+void Image::ImageWriter::beginSources()
 {
-    std::ofstream os(fileName);
+    m_sources.clear();
+    m_methodTexts.clear();
+    m_temporaryObjects.clear();
+
+    m_methodClass = m_globals.globalsObject ? m_globals.globalsObject->find<TClass>(TMethod::InstanceClassName()) : 0;
+
+    m_sourcesStream.close();
+    m_sourcesStream.clear();
+    if (! m_sourcesInput.empty())
+        m_sourcesStream.open(m_sourcesInput.c_str(), std::ifstream::binary);
+}
+
+bool Image::ImageWriter::writeSources(const char* imageFileName)
+{
+    // Sources are written first, so the image never refers to the missing records
+    if (! m_externalSources)
+        return true;
+
+    return writeFile(Image::getSourcesFileName(imageFileName).c_str(), m_sources);
+}
+
+TObject* Image::ImageWriter::getField(TObject* object, uint32_t index)
+{
+    TObject* const field = object->getField(index);
+    if (!m_methodClass || object->getClass() != m_methodClass)
+        return field;
+
+    TMethod* const method = static_cast<TMethod*>(object);
+    if (&method->getFields()[index] != reinterpret_cast<TObject**>(&method->text))
+        return field;
+
+    return getMethodText(method);
+}
 
+TObject* Image::ImageWriter::getMethodText(TMethod* method)
+{
+    TTextMap::const_iterator iText = m_methodTexts.find(method);
+    if (iText != m_methodTexts.end())
+        return iText->second;
+
+    TObject* const text = method->text;
+    TObject* result = text;
+
+    std::string source;
+    bool hasSource = false;
+    if (isSmallInteger(text))
+        hasSource = m_sourcesStream.is_open() && Image::readSource(m_sourcesStream, TInteger(text).getValue(), source);
+    else if (text != m_globals.nilObject && text->isBinary()) {
+        const TByteObject* const bytes = static_cast<const TByteObject*>(text);
+        source.assign(reinterpret_cast<const char*>(bytes->getBytes()), bytes->getSize());
+        hasSource = true;
+    }
+
+    if (hasSource && m_externalSources && m_sources.size() <= static_cast<std::size_t>(TInteger::MAX_VALUE)) {
+        result = TInteger(static_cast<intptr_t>(m_sources.size()));
+
+        char length[32];
+        std::sprintf(length, "%zu\n", source.size());
+        m_sources.insert(m_sources.end(), length, length + std::strlen(length));
+        m_sources.insert(m_sources.end(), source.begin(), source.end());
+        m_sources.push_back('\n');
+    } else if (hasSource && isSmallInteger(text)) {
+        // Text is brought back into the image as a string that lives while the writer does
+        m_temporaryObjects.push_back(std::vector<TObject*>());
+        std::vector<TObject*>& storage = m_temporaryObjects.back();
+        storage.resize(correctPadding(sizeof(TByteObject) + source.size()) / sizeof(TObject*));
+
+        TByteObject* const string = new (&storage[0]) TByteObject(source.size(), m_globals.stringClass);
+        if (! source.empty())
+            std::memcpy(string->getBytes(), source.data(), source.size());
+        result = string;
+    }
+
+    m_methodTexts[method] = result;
+    return result;
+}
+
+void Image::ImageWriter::beginImage()
+{
+    beginSources();
+    m_writtenObjects.clear();
+    m_buffer.clear();
+    std::memset(&m_header, 0, sizeof(m_header));
+
+    // Header is filled in by endImage() when the counters are known
+    if (m_encoding == compactEncoding)
+        m_buffer.resize(COMPACT_IMAGE_HEADER_SIZE);
+}
+
+void Image::ImageWriter::endImage()
+{
     m_writtenObjects.clear();
-    m_writtenObjects.reserve(8096);
-
-    writeObject(os, m_globals.nilObject);
-    writeObject(os, m_globals.trueObject);
-    writeObject(os, m_globals.falseObject);
-    writeObject(os, m_globals.globalsObject);
-    writeObject(os, m_globals.smallIntClass);
-    writeObject(os, m_globals.integerClass);
-    writeObject(os, m_globals.arrayClass);
-    writeObject(os, m_globals.blockClass);
-    writeObject(os, m_globals.contextClass);
-    writeObject(os, m_globals.stringClass);
-    writeObject(os, m_globals.initialMethod);
+
+    if (m_encoding != compactEncoding)
+        return;
+
+    std::memcpy(m_header.magic, COMPACT_IMAGE_MAGIC, sizeof(m_header.magic));
+    m_header.encoding = compactEncoding;
+    m_header.flags = m_externalSources ? externalSourcesFlag : 0;
+
+    std::memcpy(&m_buffer[0], m_header.magic, sizeof(m_header.magic));
+    m_buffer[7] = m_header.encoding;
+    writeLittleEndian(&m_buffer[8],  m_header.pointerWords);
+    writeLittleEndian(&m_buffer[16], m_header.binaryBytes);
+    writeLittleEndian(&m_buffer[24], m_header.binaryObjects);
+    writeLittleEndian(&m_buffer[32], m_header.flags);
+}
+
+void Image::ImageWriter::writeGlobals()
+{
+    writeObject(m_globals.nilObject);
+    writeObject(m_globals.trueObject);
+    writeObject(m_globals.falseObject);
+    writeObject(m_globals.globalsObject);
+    writeObject(m_globals.smallIntClass);
+    writeObject(m_globals.integerClass);
+    writeObject(m_globals.arrayClass);
+    writeObject(m_globals.blockClass);
+    writeObject(m_globals.contextClass);
+    writeObject(m_globals.stringClass);
+    writeObject(m_globals.initialMethod);
 
     for (int i = 0; i < 3; i++)
-        writeObject(os, m_globals.binaryMessages[i]);
+        writeObject(m_globals.binaryMessages[i]);
 
-    writeObject(os, m_globals.badMethodSymbol);
+    writeObject(m_globals.badMethodSymbol);
+}
+
+bool Image::ImageWriter::writeFile(const char* fileName, const std::vector<uint8_t>& buffer)
+{
+    const std::string tempFileName = std::string(fileName) + ".tmp";
+
+    const int fd = open(tempFileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::fprintf(stderr, "Could not create %s: %s\n", tempFileName.c_str(), std::strerror(errno));
+        return false;
+    }
+
+    const uint8_t* data = buffer.empty() ? 0 : &buffer[0];
+    std::size_t remaining = buffer.size();
+    while (remaining) {
+        const ssize_t written = write(fd, data, remaining);
+        if (written < 0 && errno == EINTR)
+            continue;
+
+        if (written <= 0) {
+            std::fprintf(stderr, "Could not write %s: %s\n", tempFileName.c_str(), std::strerror(errno));
+            close(fd);
+            unlink(tempFileName.c_str());
+            return false;
+        }
+
+        data += written;
+        remaining -= written;
+    }
+
+    // Data should reach the disk before the file is renamed,
+    // otherwise a crash may leave an empty file behind
+    if (fsync(fd) != 0 || close(fd) != 0 || rename(tempFileName.c_str(), fileName) != 0) {
+        std::fprintf(stderr, "Could not replace %s: %s\n", fileName, std::strerror(errno));
+        unlink(tempFileName.c_str());
+        return false;
+    }
+
+    // Making the rename itself durable
+    const std::string path(fileName);
+    const std::string::size_type slash = path.rfind('/');
+    const std::string directory = (slash == std::string::npos) ? "." : path.substr(0, slash + 1);
+
+    const int directoryFd = open(directory.c_str(), O_RDONLY);
+    if (directoryFd >= 0) {
+        fsync(directoryFd);
+        close(directoryFd);
+    }
+
+    return true;
+}
+
+bool Image::ImageWriter::writeTo(const char* fileName)
+{
+    // Classic images have no header to record the external sources in
+    if (m_externalSources)
+        m_encoding = compactEncoding;
+
+    beginImage();
+    writeGlobals();
+    endImage();
+
+    return writeSources(fileName) && writeFile(fileName, m_buffer);
+}
+
+namespace {
+
+// Collects all objects of the heap in the order of walking
+class THeapCollector : public IHeapVisitor {
+public:
+    std::vector<TObject*> objects;
+    virtual void visitObject(TObject* object) { objects.push_back(object); }
+};
+
+} // namespace
+
+bool Image::ImageWriter::writeHeapDump(const char* fileName, IMemoryManager* memoryManager)
+{
+    beginImage();
+    writeGlobals();
+
+    THeapCollector collector;
+    memoryManager->walkHeap(collector);
+
+    // Objects that are not yet written could not be reached from the
+    // globals, so they are stored as the additional roots of the dump.
+    // Objects reachable from such root are written along with it.
+    for (std::size_t i = 0; i < collector.objects.size(); i++) {
+        TObject* object = collector.objects[i];
+        if (m_writtenObjects.find(object) != m_writtenObjects.end())
+            continue;
+
+        // Each root is prefixed with a non zero word
+        writeWord(1);
+        writeObject(object);
+    }
+
+    // End of roots
+    writeWord(0);
+
+    endImage();
+    return writeSources(fileName) && writeFile(fileName, m_buffer);
+}
+
+bool Image::ImageWriter::writeNativeImage(const char* fileName, uintptr_t preferredBase)
+{
+    typedef std::tr1::unordered_map<TObject*, std::size_t> TOffsetMap;
+
+    beginSources();
+
+    // Assigning heap offsets to the objects reachable from the globals
+    TOffsetMap offsets;
+    std::vector<TObject*> objects;
+    std::vector<TObject*> pending;
+    std::size_t heapSize = 0;
+
+    for (std::size_t i = IMAGE_GLOBALS_COUNT; i > 0; i--)
+        pending.push_back(*getGlobalSlot(m_globals, i - 1));
+
+    while (! pending.empty()) {
+        TObject* const object = pending.back();
+        pending.pop_back();
+
+        if (!object || isSmallInteger(object) || offsets.find(object) != offsets.end())
+            continue;
+
+        offsets[object] = heapSize;
+        heapSize += object->getSlotSize();
+        objects.push_back(object);
+
+        if (! object->isBinary()) {
+            for (std::size_t i = object->getSize(); i > 0; i--)
+                pending.push_back(getField(object, i - 1));
+        }
+        pending.push_back(object->getClass());
+    }
+
+    if (heapSize / sizeof(TObject*) > std::numeric_limits<uint32_t>::max()) {
+        std::fprintf(stderr, "Heap is too large for the native image\n");
+        return false;
+    }
+
+    // Mapped image is not laid out again when loaded
+    orderForLocality(m_globals, objects);
+    for (std::size_t i = 0, offset = 0; i < objects.size(); i++) {
+        offsets[objects[i]] = offset;
+        offset += objects[i]->getSlotSize();
+    }
+
+    // Copying objects right into the output buffer and
+    // rewriting their pointers against the preferred base
+    m_buffer.assign(NATIVE_IMAGE_ALIGNMENT + heapSize, 0);
+    uint8_t* const heap = &m_buffer[NATIVE_IMAGE_ALIGNMENT];
+    std::vector<uint32_t> relocations;
+    relocations.reserve(heapSize / sizeof(TObject*));
+
+    for (std::size_t i = 0; i < objects.size(); i++) {
+        TObject* const object = objects[i];
+        const std::size_t offset = offsets[object];
+
+        std::memcpy(&heap[offset], object, object->getSlotSize());
+        TObject* const copy = reinterpret_cast<TObject*>(&heap[offset]);
+
+        // Class pointer follows the size field
+        copy->setClass(reinterpret_cast<TClass*>(preferredBase + offsets[object->getClass()]));
+        relocations.push_back((offset + sizeof(TSize)) / sizeof(TObject*));
+
+        if (object->isBinary())
+            continue;
+
+        // Tags of the dictionary indices are valid only in the running VM
+        copy->setHeaderHash(0);
+
+        for (std::size_t field = 0; field < object->getSize(); field++) {
+            TObject* const value = getField(object, field);
+            if (!value)
+                continue; // buffer is zeroed, so the field stays null
+
+            if (isSmallInteger(value)) {
+                copy->putField(field, value);
+                continue;
+            }
+
+            copy->putField(field, reinterpret_cast<TObject*>(preferredBase + offsets[value]));
+            relocations.push_back((offset + sizeof(TObject)) / sizeof(TObject*) + field);
+        }
+    }
+
+    TNativeImageHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, NATIVE_IMAGE_MAGIC, sizeof(header.magic));
+    header.version           = NATIVE_IMAGE_VERSION;
+    header.byteOrder         = BYTE_ORDER_MARK;
+    header.wordSize          = sizeof(TObject*);
+    header.globalsCount      = IMAGE_GLOBALS_COUNT;
+    header.preferredBase     = preferredBase;
+    header.heapOffset        = NATIVE_IMAGE_ALIGNMENT;
+    header.heapSize          = heapSize;
+    header.relocationsOffset = header.heapOffset + heapSize;
+    header.relocationsCount  = relocations.size();
+    header.flags             = m_externalSources ? externalSourcesFlag : 0;
+
+    for (std::size_t i = 0; i < IMAGE_GLOBALS_COUNT; i++)
+        header.globals[i] = offsets[*getGlobalSlot(m_globals, i)];
+
+    std::memcpy(&m_buffer[0], &header, sizeof(header));
+
+    const uint8_t* const relocationBytes = reinterpret_cast<const uint8_t*>(relocations.empty() ? 0 : &relocations[0]);
+    m_buffer.insert(m_buffer.end(), relocationBytes, relocationBytes + relocations.size() * sizeof(uint32_t));
+
+    return writeSources(fileName) && writeFile(fileName, m_buffer);
+}
+
+bool Image::ImageWriter::writeGraph(TObject* root, std::vector<uint8_t>& buffer)
+{
+    const TImageEncoding encoding = m_encoding;
+    m_encoding = compactEncoding;
+    m_graph = true;
 
     m_writtenObjects.clear();
+    m_buffer.assign(GRAPH_MAGIC, GRAPH_MAGIC + sizeof(GRAPH_MAGIC));
+    const bool isWritten = writeObject(root);
+    m_writtenObjects.clear();
+
+    m_graph = false;
+    m_encoding = encoding;
+
+    if (isWritten)
+        buffer.swap(m_buffer);
+    m_buffer.clear();
+    return isWritten;
+}
+
+bool Image::GraphReader::readVarint(uint64_t& value)
+{
+    value = 0;
+    for (int shift = 0; m_position < m_size; shift += 7) {
+        const uint8_t byte = m_data[m_position++];
+        if (shift < 64)
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (! (byte & 0x80))
+            return true;
+    }
+
+    return false;
+}
+
+bool Image::GraphReader::readRecord(TReference& reference, std::vector<TSlot>& pending)
+{
+    reference.immediate = 0;
+    reference.node = 0;
+
+    uint64_t type = 0;
+    uint64_t value = 0;
+    if (! readVarint(type))
+        return false;
+
+    switch (type) {
+        case nilObject:   reference.immediate = globals.nilObject;   return true;
+        case trueObject:  reference.immediate = globals.trueObject;  return true;
+        case falseObject: reference.immediate = globals.falseObject; return true;
+
+        case inlineInteger: {
+            if (! readVarint(value))
+                return false;
+
+            const int64_t integer = zigzagDecode(value);
+            if (integer < TInteger::MIN_VALUE || integer > TInteger::MAX_VALUE)
+                return false;
+            reference.immediate = TInteger(static_cast<intptr_t>(integer));
+            return true;
+        }
+
+        case previousObject:
+            if (! readVarint(value) || value >= m_nodes.size())
+                return false;
+            reference.node = static_cast<uint32_t>(value);
+            return true;
+
+        case ordinaryObject: {
+            // Each field takes one byte at least
+            if (! readVarint(value) || value > m_size - m_position)
+                return false;
+
+            const TNode node = { ordinaryNode, 0, static_cast<std::size_t>(value), 0, m_fields.size() };
+            reference.node = m_nodes.size();
+            m_nodes.push_back(node);
+            m_fields.resize(m_fields.size() + node.size);
+
+            // Class is read first, then the fields in order
+            for (int32_t field = static_cast<int32_t>(node.size); field > 0; ) {
+                const TSlot slot = { reference.node, --field };
+                pending.push_back(slot);
+            }
+            const TSlot classSlot = { reference.node, -1 };
+            pending.push_back(classSlot);
+            return true;
+        }
+
+        case byteObject:
+        case globalObject:
+        case metaclassObject:
+        case symbolObject: {
+            if (! readVarint(value) || value > m_size - m_position)
+                return false;
+
+            TNodeKind kind = symbolNode;
+            if (type == byteObject)
+                kind = byteNode;
+            else if (type == globalObject)
+                kind = globalNode;
+            else if (type == metaclassObject)
+                kind = metaclassNode;
+
+            const TNode node = { kind, m_position, static_cast<std::size_t>(value), 0, 0 };
+            reference.node = m_nodes.size();
+            m_nodes.push_back(node);
+            m_position += node.size;
+
+            if (kind == byteNode) {
+                const TSlot classSlot = { reference.node, -1 };
+                pending.push_back(classSlot);
+            }
+            return true;
+        }
+
+        case charObject: {
+            if (! readVarint(value) || value > 256)
+                return false;
+
+            const TNode node = { charNode, 0, static_cast<std::size_t>(value), 0, 0 };
+            reference.node = m_nodes.size();
+            m_nodes.push_back(node);
+            return true;
+        }
+
+        default:
+            return false;
+    }
+}
+
+bool Image::GraphReader::read(const uint8_t* data, std::size_t size)
+{
+    m_data = data;
+    m_size = size;
+    m_position = sizeof(GRAPH_MAGIC);
+    m_nodes.clear();
+    m_fields.clear();
+
+    if (size < sizeof(GRAPH_MAGIC) || std::memcmp(data, GRAPH_MAGIC, sizeof(GRAPH_MAGIC)) != 0)
+        return false;
+
+    const uint32_t rootNode = std::numeric_limits<uint32_t>::max();
+    const TSlot rootSlot = { rootNode, 0 };
+    std::vector<TSlot> pending(1, rootSlot);
+
+    while (! pending.empty()) {
+        const TSlot slot = pending.back();
+        pending.pop_back();
+
+        TReference reference;
+        if (! readRecord(reference, pending))
+            return false;
+
+        if (slot.node == rootNode) {
+            m_root = reference;
+        } else if (slot.field < 0) {
+            // Classes are always written by name
+            if (reference.immediate || m_nodes[reference.node].kind != globalNode)
+                return false;
+            m_nodes[slot.node].classNode = reference.node;
+        } else {
+            m_fields[m_nodes[slot.node].firstField + slot.field] = reference;
+        }
+    }
+
+    return m_position == m_size;
 }
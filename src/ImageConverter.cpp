@@ -0,0 +1,92 @@
+/*
+ *    ImageConverter.cpp
+ *
+ *    Converts the image between the classic, compact and native
+ *    formats. Native image may be mapped into memory directly.
+ *
+ *    LLST (LLVM Smalltalk or Low Level Smalltalk) version 0.4
+ *
+ *    LLST is
+ *        Copyright (C) 2012-2015 by Dmitry Kashitsyn   <korvin@deeptown.org>
+ *        Copyright (C) 2012-2015 by Roman Proskuryakov <humbug@deeptown.org>
+ *
+ *    LLST is based on the LittleSmalltalk which is
+ *        Copyright (C) 1987-2005 by Timothy A. Budd
+ *        Copyright (C) 2007 by Charles R. Childers
+ *        Copyright (C) 2005-2007 by Danny Reinhold
+ *
+ *    Original license of LittleSmalltalk may be found in the LICENSE file.
+ *
+ *
+ *    This file is part of LLST.
+ *    LLST is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    LLST is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with LLST.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <memory.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+int main(int argc, char** argv)
+{
+    const char* const format = (argc > 3) ? argv[3] : "native";
+    const bool externalSources = (argc > 4) && std::strcmp(argv[4], "external") == 0;
+    if (argc < 3 || (std::strcmp(format, "native") && std::strcmp(format, "compact") && std::strcmp(format, "classic"))) {
+        std::fprintf(stderr, "Usage: %s <source image> <target image> [native|compact|classic] [external]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // Classic images have no header to record the external sources in
+    if (externalSources && std::strcmp(format, "classic") == 0) {
+        std::fprintf(stderr, "Classic images can not have external sources\n");
+        return EXIT_FAILURE;
+    }
+
+    // Image is loaded into the static heap, dynamic heap is not used
+    NonCollectMemoryManager memoryManager;
+    memoryManager.initializeHeap(sizeof(TObject));
+
+    Image image(&memoryManager);
+
+    try {
+        if (!image.loadImage(argv[1])) {
+            std::fprintf(stderr, "Could not allocate memory for the image\n");
+            return EXIT_FAILURE;
+        }
+    } catch (const std::exception& error) {
+        std::fprintf(stderr, "Could not read image: %s\n", error.what());
+        return EXIT_FAILURE;
+    }
+
+    // Method sources are moved to the file next to the target image if requested
+    Image::ImageWriter writer;
+    writer.setGlobals(globals).setSources(Image::getSourcesFileName(argv[1]), externalSources);
+
+    bool written = false;
+    if (std::strcmp(format, "native") == 0)
+        written = writer.writeNativeImage(argv[2]);
+    else if (std::strcmp(format, "compact") == 0)
+        written = writer.setEncoding(Image::compactEncoding).writeTo(argv[2]);
+    else
+        written = writer.setEncoding(Image::classicEncoding).writeTo(argv[2]);
+
+    if (!written) {
+        std::fprintf(stderr, "Could not write %s image %s\n", format, argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,112 @@
+/*
+ *    ImageShaker.cpp
+ *
+ *    Tool which writes the minimal image for the given root classes and selectors
+ *
+ *    LLST (LLVM Smalltalk or Low Level Smalltalk) version 0.4
+ *
+ *    LLST is
+ *        Copyright (C) 2012-2015 by Dmitry Kashitsyn   <korvin@deeptown.org>
+ *        Copyright (C) 2012-2015 by Roman Proskuryakov <humbug@deeptown.org>
+ *
+ *    LLST is based on the LittleSmalltalk which is
+ *        Copyright (C) 1987-2005 by Timothy A. Budd
+ *        Copyright (C) 2007 by Charles R. Childers
+ *        Copyright (C) 2005-2007 by Danny Reinhold
+ *
+ *    Original license of LittleSmalltalk may be found in the LICENSE file.
+ *
+ *
+ *    This file is part of LLST.
+ *    LLST is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    LLST is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with LLST.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <memory.h>
+#include <TreeShaker.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+static void printUsage(const char* program)
+{
+    std::fprintf(stderr,
+        "Usage: %s [-c Class]... [-s selector]... [-v] <source image> <target image>\n"
+        "    -c Class     keep the class and methods reachable from it\n"
+        "    -s selector  keep methods with the selector in all reachable classes\n"
+        "    -v           list removed methods\n", program);
+}
+
+int main(int argc, char** argv)
+{
+    // Image is loaded into the static heap, dynamic heap is not used
+    NonCollectMemoryManager memoryManager;
+    memoryManager.initializeHeap(sizeof(TObject));
+
+    Image image(&memoryManager);
+    TreeShaker shaker(image);
+
+    bool verbose = false;
+    const char* fileNames[2] = { 0, 0 };
+    std::size_t fileNamesCount = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "-v") == 0) {
+            verbose = true;
+        } else if (std::strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            shaker.addRootClass(argv[++i]);
+        } else if (std::strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            shaker.addRootSelector(argv[++i]);
+        } else if (argv[i][0] != '-' && fileNamesCount < 2) {
+            fileNames[fileNamesCount++] = argv[i];
+        } else {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (fileNamesCount < 2) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    try {
+        if (!image.loadImage(fileNames[0])) {
+            std::fprintf(stderr, "Could not allocate memory for the image\n");
+            return EXIT_FAILURE;
+        }
+    } catch (const std::exception& error) {
+        std::fprintf(stderr, "Could not read image: %s\n", error.what());
+        return EXIT_FAILURE;
+    }
+
+    if (!shaker.shake()) {
+        std::fprintf(stderr, "Could not shake image %s\n", fileNames[0]);
+        return EXIT_FAILURE;
+    }
+
+    // Sources of the removed methods are dropped from the target sources file
+    Image::ImageWriter writer;
+    writer.setGlobals(globals).setSources(Image::getSourcesFileName(fileNames[0]), image.hasExternalSources());
+
+    if (!writer.writeTo(fileNames[1])) {
+        std::fprintf(stderr, "Could not write image %s\n", fileNames[1]);
+        return EXIT_FAILURE;
+    }
+
+    shaker.printReport(verbose);
+    return EXIT_SUCCESS;
+}
@@ -142,7 +142,7 @@ void JITRuntime::initialize(SmalltalkVM* softVM)
     // Initializing JIT module.
     // All JIT functions will be created here
     SMDiagnostic Err;
-    m_JITModule = ParseIRFile("../include/Core.ll", Err, llvmContext); // FIXME Hardcoded path
+    m_JITModule = ParseIRFile(LLST_CORE_LL, Err, llvmContext);
     if (!m_JITModule) {
         Err.print("JITRuntime.cpp", errs());
         std::exit(1);
@@ -226,7 +226,7 @@ TBlock* JITRuntime::createBlock(TContext* callingContext, uint8_t argLocation, u
 
     // Assigning creatingContext depending on the hierarchy
     // Nested blocks inherit the outer creating context
-    if (previousContext->getClass() == globals.blockClass)
+    if (previousContext->getClass() == classRegistry.get<TBlock>())
         newBlock->creatingContext = previousContext.cast<TBlock>()->creatingContext;
     else
         newBlock->creatingContext = previousContext;
@@ -236,7 +236,7 @@ TBlock* JITRuntime::createBlock(TContext* callingContext, uint8_t argLocation, u
 
 JITRuntime::TMethodFunction JITRuntime::lookupFunctionInCache(TMethod* method)
 {
-    uint32_t hash = reinterpret_cast<uint32_t>(method) ^ reinterpret_cast<uint32_t>(method->name); // ^ 0xDEADBEEF;
+    uintptr_t hash = reinterpret_cast<uintptr_t>(method) ^ reinterpret_cast<uintptr_t>(method->name); // ^ 0xDEADBEEF;
     TFunctionCacheEntry& entry = m_functionLookupCache[hash % LOOKUP_CACHE_SIZE];
 
     if (entry.method == method) {
@@ -250,7 +250,7 @@ JITRuntime::TMethodFunction JITRuntime::lookupFunctionInCache(TMethod* method)
 
 JITRuntime::TBlockFunction JITRuntime::lookupBlockFunctionInCache(TMethod* containerMethod, uint32_t blockOffset)
 {
-    uint32_t hash = reinterpret_cast<uint32_t>(containerMethod) ^ blockOffset;
+    uintptr_t hash = reinterpret_cast<uintptr_t>(containerMethod) ^ blockOffset;
     TBlockFunctionCacheEntry& entry = m_blockFunctionLookupCache[hash % LOOKUP_CACHE_SIZE];
 
     if (entry.containerMethod == containerMethod && entry.blockOffset == blockOffset) {
@@ -264,7 +264,7 @@ JITRuntime::TBlockFunction JITRuntime::lookupBlockFunctionInCache(TMethod* conta
 
 void JITRuntime::updateFunctionCache(TMethod* method, TMethodFunction function)
 {
-    uint32_t hash = reinterpret_cast<uint32_t>(method) ^ reinterpret_cast<uint32_t>(method->name); // ^ 0xDEADBEEF;
+    uintptr_t hash = reinterpret_cast<uintptr_t>(method) ^ reinterpret_cast<uintptr_t>(method->name); // ^ 0xDEADBEEF;
     TFunctionCacheEntry& entry = m_functionLookupCache[hash % LOOKUP_CACHE_SIZE];
 
     entry.method   = method;
@@ -273,7 +273,7 @@ void JITRuntime::updateFunctionCache(TMethod* method, TMethodFunction function)
 
 void JITRuntime::updateBlockFunctionCache(TMethod* containerMethod, uint32_t blockOffset, TBlockFunction function)
 {
-    uint32_t hash = reinterpret_cast<uint32_t>(containerMethod) ^ blockOffset;
+    uintptr_t hash = reinterpret_cast<uintptr_t>(containerMethod) ^ blockOffset;
     TBlockFunctionCacheEntry& entry = m_blockFunctionLookupCache[hash % LOOKUP_CACHE_SIZE];
 
     entry.containerMethod = containerMethod;
@@ -328,7 +328,15 @@ TObject* JITRuntime::invokeBlock(TBlock* block, TContext* callingContext, bool o
     }
 
     block->previousContext = callingContext->previousContext;
-    TObject* result = compiledBlockFunction(block);
+
+    TObject* result = 0;
+    if (m_softVM->isProfilingAllocations()) {
+        // Allocations made by the compiled code are attributed to the block
+        hptr<TContext> blockContext = m_softVM->newPointer(static_cast<TContext*>(block));
+        SmalltalkVM::TExecutionFrame frame(m_softVM, blockContext);
+        result = compiledBlockFunction(block);
+    } else
+        result = compiledBlockFunction(block);
 
     if (once) {
         m_executionEngine->freeMachineCodeForFunction(blockFunction);
@@ -350,7 +358,7 @@ TObject* JITRuntime::sendMessage(TContext* callingContext, TSymbol* message, TOb
         // First of all we need to find the actual method object
         if (!receiverClass) {
             TObject* receiver = messageArguments[0];
-            receiverClass = isSmallInteger(receiver) ? globals.smallIntClass : receiver->getClass();
+            receiverClass = isSmallInteger(receiver) ? classRegistry[TClassRegistry::smallIntClass] : receiver->getClass();
         }
 
         // Searching for the actual method to be called
@@ -409,6 +417,13 @@ TObject* JITRuntime::sendMessage(TContext* callingContext, TSymbol* message, TOb
     }
 
     try {
+        if (m_softVM->isProfilingAllocations()) {
+            // Allocations made by the compiled code are attributed to the new context
+            hptr<TContext> activeContext = m_softVM->newPointer(newContext);
+            SmalltalkVM::TExecutionFrame frame(m_softVM, activeContext);
+            return compiledMethodFunction(newContext);
+        }
+
         TObject* result = compiledMethodFunction(newContext);
         return result;
     } catch( ... ) {
@@ -658,17 +673,17 @@ void JITRuntime::createDirectBlocks(TPatchInfo& info, TCallSite& callSite, TDire
         // number of pointers except for the first two fields
         const uint32_t contextFieldsCount = contextSize / sizeof(TObject*) - 2;
 
-        builder.CreateCall2(setObjectSize, newContextObject, builder.getInt32(contextFieldsCount));
+        builder.CreateCall2(setObjectSize, newContextObject, ConstantInt::get(m_baseTypes.word, contextFieldsCount));
         builder.CreateCall2(setObjectClass, newContextObject, m_methodCompiler->getJitGlobals().contextClass);
 
         if (hasTemporaries) {
             const uint32_t tempsFieldsCount = tempsSize / sizeof(TObject*) - 2;
-            builder.CreateCall2(setObjectSize, newTempsObject, builder.getInt32(tempsFieldsCount));
+            builder.CreateCall2(setObjectSize, newTempsObject, ConstantInt::get(m_baseTypes.word, tempsFieldsCount));
             builder.CreateCall2(setObjectClass, newTempsObject, m_methodCompiler->getJitGlobals().arrayClass);
         }
 
         Function* setObjectField  = m_methodCompiler->getBaseFunctions().setObjectField;
-        Value* methodRawPointer   = builder.getInt32(reinterpret_cast<uint32_t>(directMethod));
+        Value* methodRawPointer   = ConstantInt::get(m_baseTypes.word, reinterpret_cast<uintptr_t>(directMethod));
         Value* directMethodObject = builder.CreateIntToPtr(methodRawPointer, m_baseTypes.object->getPointerTo());
 
         Value* previousContext = builder.CreateLoad(info.contextHolder);
@@ -841,7 +856,7 @@ void JITRuntime::patchCallSite(llvm::Function* methodFunction, llvm::Value* cont
         Function* getObjectClass = m_methodCompiler->getBaseFunctions().getObjectClass;
         Value* receiver = builder.CreateCall2(getObjectField, arguments, builder.getInt32(0));
         Value* receiverClass = builder.CreateCall(getObjectClass, receiver);
-        Value* receiverClassPtr = builder.CreatePtrToInt(receiverClass, Type::getInt32Ty(getGlobalContext()));
+        Value* receiverClassPtr = builder.CreatePtrToInt(receiverClass, m_baseTypes.word);
 
         // Genrating switch instruction to select basic block
         SwitchInst* switchInst = builder.CreateSwitch(receiverClassPtr, fallbackBlock);
@@ -869,7 +884,7 @@ void JITRuntime::patchCallSite(llvm::Function* methodFunction, llvm::Value* cont
             TClass* klass = iBlock->first;
             TDirectBlock& directBlock = iBlock->second;
 
-            ConstantInt* classAddress = builder.getInt32(reinterpret_cast<uint32_t>(klass));
+            ConstantInt* classAddress = ConstantInt::get(m_baseTypes.word, reinterpret_cast<uintptr_t>(klass));
             switchInst->addCase(classAddress, directBlock.basicBlock);
 
             replyPhi->addIncoming(directBlock.returnValue, directBlock.basicBlock);
@@ -911,14 +926,14 @@ void JITRuntime::initializeGlobals() {
     GlobalValue* gFalse = cast<GlobalValue>( m_JITModule->getOrInsertGlobal("falseObject", m_baseTypes.object) );
     m_executionEngine->addGlobalMapping(gFalse, reinterpret_cast<void*>(globals.falseObject));
 
+    // SmallInt is never instantiated, so Core.ll refers to the class object directly
     GlobalValue* gSmallIntClass = cast<GlobalValue>( m_JITModule->getOrInsertGlobal("SmallInt", m_baseTypes.klass) );
-    m_executionEngine->addGlobalMapping(gSmallIntClass, reinterpret_cast<void*>(globals.smallIntClass));
-
-    GlobalValue* gArrayClass = cast<GlobalValue>( m_JITModule->getOrInsertGlobal("Array", m_baseTypes.klass) );
-    m_executionEngine->addGlobalMapping(gArrayClass, reinterpret_cast<void*>(globals.arrayClass));
+    m_executionEngine->addGlobalMapping(gSmallIntClass, reinterpret_cast<void*>(classRegistry[TClassRegistry::smallIntClass]));
 
-    GlobalValue* gContextClass = cast<GlobalValue>( m_JITModule->getOrInsertGlobal("Context", m_baseTypes.klass) );
-    m_executionEngine->addGlobalMapping(gContextClass, reinterpret_cast<void*>(globals.contextClass));
+    // Other classes are loaded from the registry slots which are updated on redefinition
+    Type* const registryType = ArrayType::get(m_baseTypes.klass->getPointerTo(), TClassRegistry::classesCount);
+    GlobalValue* gClassRegistry = cast<GlobalValue>( m_JITModule->getOrInsertGlobal("classRegistry", registryType) );
+    m_executionEngine->addGlobalMapping(gClassRegistry, reinterpret_cast<void*>(classRegistry.classes));
 
     GlobalValue* gmessageL = cast<GlobalValue>( m_JITModule->getOrInsertGlobal("<", m_baseTypes.symbol) );
     m_executionEngine->addGlobalMapping(gmessageL, reinterpret_cast<void*>(globals.binaryMessages[0]));
@@ -978,7 +993,7 @@ void JITRuntime::initializeRuntimeAPI() {
     m_executionEngine->addGlobalMapping(m_runtimeAPI.emitBlockReturn, reinterpret_cast<void*>(& ::emitBlockReturn));
     m_executionEngine->addGlobalMapping(m_runtimeAPI.checkRoot, reinterpret_cast<void*>(& ::checkRoot));
     m_executionEngine->addGlobalMapping(m_runtimeAPI.bulkReplace, reinterpret_cast<void*>(& ::bulkReplace));
-    m_executionEngine->addGlobalMapping(m_runtimeAPI.callPrimitive, reinterpret_cast<void*>(& ::callPrimitive));
+    m_executionEngine->addGlobalMapping(m_runtimeAPI.callPrimitive, reinterpret_cast<void*>(& ::callRuntimePrimitive));
 
     //Type*  rootChainType = m_JITModule->getTypeByName("gc_stackentry")->getPointerTo();
     //GlobalValue* gRootChain    = cast<GlobalValue>( m_JITModule->getOrInsertGlobal("llvm_gc_root_chain", rootChainType) );
@@ -1070,13 +1085,13 @@ void JITRuntime::createExecuteProcessFunction() {
 
 extern "C" {
 
-TObject* newOrdinaryObject(TClass* klass, uint32_t slotSize)
+TObject* newOrdinaryObject(TClass* klass, std::size_t slotSize)
 {
     JITRuntime::Instance()->m_objectsAllocated++;
     return JITRuntime::Instance()->getVM()->newOrdinaryObject(klass, slotSize);
 }
 
-TByteObject* newBinaryObject(TClass* klass, uint32_t dataSize)
+TByteObject* newBinaryObject(TClass* klass, std::size_t dataSize)
 {
     JITRuntime::Instance()->m_objectsAllocated++;
     return JITRuntime::Instance()->getVM()->newBinaryObject(klass, dataSize);
@@ -1110,6 +1125,73 @@ void checkRoot(TObject* value, TObject** objectSlot)
     JITRuntime::Instance()->getVM()->checkRoot(value, objectSlot);
 }
 
+// Integer and Float primitives may allocate, so they are performed by the VM
+TObject* callRuntimePrimitive(uint8_t opcode, TObjectArray* args, bool& primitiveFailed)
+{
+    // Symbol table is owned by the VM
+    if (opcode == primitive::symbolIntern) {
+        TSymbol* const symbol = JITRuntime::Instance()->getVM()->findSymbol(args->getField(0));
+        primitiveFailed = (symbol == 0);
+        return symbol ? static_cast<TObject*>(symbol) : globals.nilObject;
+    }
+
+    // Compiled code could not suspend the process, so the image waits by itself
+    if (opcode == primitive::ioWait) {
+        primitiveFailed = true;
+        return globals.nilObject;
+    }
+
+    if (opcode == primitive::ioPoll)
+        return JITRuntime::Instance()->getVM()->pollDescriptors(args->getField(0), primitiveFailed);
+
+    if (opcode == primitive::ioFileClose)
+        return JITRuntime::Instance()->getVM()->closeDescriptor(args->getField(0), primitiveFailed);
+
+    // Mapped files are owned by the VM as well
+    if (opcode == primitive::ioFileMap || opcode == primitive::ioFileMapSlice || opcode == primitive::ioFileUnmap) {
+        TObject* const first  = (args->getSize() > 1) ? args->getField(1) : globals.nilObject;
+        TObject* const second = (args->getSize() > 2) ? args->getField(2) : globals.nilObject;
+        return JITRuntime::Instance()->getVM()->callMappedFilePrimitive(opcode, args->getField(0), first, second, primitiveFailed);
+    }
+
+    if (opcode == primitive::shallowCopy || opcode == primitive::deepCopy) {
+        TObject* const limit = (args->getSize() > 1) ? args->getField(1) : globals.nilObject;
+        return JITRuntime::Instance()->getVM()->copyObject(opcode, args->getField(0), limit, primitiveFailed);
+    }
+
+    if (opcode == primitive::serializeGraph)
+        return JITRuntime::Instance()->getVM()->serializeGraph(args->getField(0), primitiveFailed);
+    if (opcode == primitive::materializeGraph)
+        return JITRuntime::Instance()->getVM()->materializeGraph(args->getField(0), primitiveFailed);
+
+    if (opcode >= primitive::bufferAppend && opcode <= primitive::bufferFreeze) {
+        TObject* const argument = (args->getSize() > 1) ? args->getField(1) : globals.nilObject;
+        return JITRuntime::Instance()->getVM()->callBufferPrimitive(opcode, args->getField(0), argument, primitiveFailed);
+    }
+
+    // Result of the foreign function is copied to the heap
+    if (opcode == primitive::ffiCallString) {
+        if (args->getSize() != 3) {
+            primitiveFailed = true;
+            return globals.nilObject;
+        }
+        return JITRuntime::Instance()->getVM()->callForeignString(args->getField(0), args->getField(1), args->getField(2), primitiveFailed);
+    }
+
+    const bool isInteger = isIntegerPrimitive(opcode);
+    if (! isInteger && ! isFloatPrimitive(opcode))
+        return callPrimitive(opcode, args, primitiveFailed);
+
+    TObject* const receiver = args->getField(0);
+    TObject* const argument = (args->getSize() > 1) ? args->getField(1) : globals.nilObject;
+
+    SmalltalkVM* const vm = JITRuntime::Instance()->getVM();
+    if (isInteger)
+        return vm->callIntegerPrimitive(opcode, receiver, argument, primitiveFailed);
+    else
+        return vm->callFloatPrimitive(opcode, receiver, argument, primitiveFailed);
+}
+
 bool bulkReplace(TObject* destination,
                 TObject* destinationStartOffset,
                 TObject* destinationStopOffset,
@@ -0,0 +1,580 @@
+/*
+ *    LargeInteger.cpp
+ *
+ *    Arbitrary precision integer arithmetic
+ *
+ *    LLST (LLVM Smalltalk or Low Level Smalltalk) version 0.4
+ *
+ *    LLST is
+ *        Copyright (C) 2012-2015 by Dmitry Kashitsyn   <korvin@deeptown.org>
+ *        Copyright (C) 2012-2015 by Roman Proskuryakov <humbug@deeptown.org>
+ *
+ *    LLST is based on the LittleSmalltalk which is
+ *        Copyright (C) 1987-2005 by Timothy A. Budd
+ *        Copyright (C) 2007 by Charles R. Childers
+ *        Copyright (C) 2005-2007 by Danny Reinhold
+ *
+ *    Original license of LittleSmalltalk may be found in the LICENSE file.
+ *
+ *
+ *    This file is part of LLST.
+ *    LLST is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    LLST is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with LLST.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <LargeInteger.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+typedef LargeInteger::TDigit  TDigit;
+typedef LargeInteger::TDigits TDigits;
+
+const int DIGIT_BITS = 32;
+const uint64_t DIGIT_BASE = static_cast<uint64_t>(1) << DIGIT_BITS;
+
+void trim(TDigits& digits)
+{
+    while (!digits.empty() && digits.back() == 0)
+        digits.pop_back();
+}
+
+int compareMagnitudes(const TDigits& left, const TDigits& right)
+{
+    if (left.size() != right.size())
+        return left.size() < right.size() ? -1 : 1;
+
+    for (std::size_t i = left.size(); i > 0; i--) {
+        if (left[i-1] != right[i-1])
+            return left[i-1] < right[i-1] ? -1 : 1;
+    }
+    return 0;
+}
+
+TDigits addMagnitudes(const TDigits& left, const TDigits& right)
+{
+    const TDigits& longer  = left.size() >= right.size() ? left : right;
+    const TDigits& shorter = left.size() >= right.size() ? right : left;
+
+    TDigits result(longer.size() + 1);
+    uint64_t carry = 0;
+    for (std::size_t i = 0; i < longer.size(); i++) {
+        const uint64_t sum = static_cast<uint64_t>(longer[i]) + (i < shorter.size() ? shorter[i] : 0) + carry;
+        result[i] = static_cast<TDigit>(sum);
+        carry = sum >> DIGIT_BITS;
+    }
+    result[longer.size()] = static_cast<TDigit>(carry);
+
+    trim(result);
+    return result;
+}
+
+// Left magnitude should not be less than the right one
+TDigits subtractMagnitudes(const TDigits& left, const TDigits& right)
+{
+    TDigits result(left.size());
+    int64_t borrow = 0;
+    for (std::size_t i = 0; i < left.size(); i++) {
+        int64_t difference = static_cast<int64_t>(left[i]) - (i < right.size() ? right[i] : 0) - borrow;
+        borrow = 0;
+        if (difference < 0) {
+            difference += DIGIT_BASE;
+            borrow = 1;
+        }
+        result[i] = static_cast<TDigit>(difference);
+    }
+
+    trim(result);
+    return result;
+}
+
+// Adds addend shifted by the offset digits to the target which should be large enough
+void addShifted(TDigits& target, const TDigits& addend, std::size_t offset)
+{
+    uint64_t carry = 0;
+    std::size_t i = 0;
+    for (; i < addend.size(); i++) {
+        const uint64_t sum = static_cast<uint64_t>(target[i + offset]) + addend[i] + carry;
+        target[i + offset] = static_cast<TDigit>(sum);
+        carry = sum >> DIGIT_BITS;
+    }
+    for (; carry && i + offset < target.size(); i++) {
+        const uint64_t sum = static_cast<uint64_t>(target[i + offset]) + carry;
+        target[i + offset] = static_cast<TDigit>(sum);
+        carry = sum >> DIGIT_BITS;
+    }
+}
+
+TDigits multiplySchoolbook(const TDigits& left, const TDigits& right)
+{
+    if (left.empty() || right.empty())
+        return TDigits();
+
+    TDigits result(left.size() + right.size());
+    for (std::size_t i = 0; i < left.size(); i++) {
+        uint64_t carry = 0;
+        for (std::size_t j = 0; j < right.size(); j++) {
+            const uint64_t product = static_cast<uint64_t>(left[i]) * right[j] + result[i + j] + carry;
+            result[i + j] = static_cast<TDigit>(product);
+            carry = product >> DIGIT_BITS;
+        }
+        result[i + right.size()] = static_cast<TDigit>(carry);
+    }
+
+    trim(result);
+    return result;
+}
+
+void split(const TDigits& digits, std::size_t position, TDigits& low, TDigits& high)
+{
+    const std::size_t lowSize = std::min(position, digits.size());
+    low.assign(digits.begin(), digits.begin() + lowSize);
+    high.assign(digits.begin() + lowSize, digits.end());
+    trim(low);
+}
+
+// left * right = z2 * B^2h + z1 * B^h + z0, where
+//   z0 = l0 * r0, z2 = l1 * r1 and z1 = (l0 + l1) * (r0 + r1) - z0 - z2
+TDigits multiplyKaratsuba(const TDigits& left, const TDigits& right, std::size_t threshold)
+{
+    if (left.size() < threshold || right.size() < threshold)
+        return multiplySchoolbook(left, right);
+
+    const std::size_t half = (std::max(left.size(), right.size()) + 1) / 2;
+
+    TDigits l0, l1, r0, r1;
+    split(left,  half, l0, l1);
+    split(right, half, r0, r1);
+
+    const TDigits z0 = multiplyKaratsuba(l0, r0, threshold);
+    const TDigits z2 = multiplyKaratsuba(l1, r1, threshold);
+    const TDigits z1 = subtractMagnitudes(
+        subtractMagnitudes(multiplyKaratsuba(addMagnitudes(l0, l1), addMagnitudes(r0, r1), threshold), z0),
+        z2);
+
+    TDigits result(left.size() + right.size() + 1);
+    addShifted(result, z0, 0);
+    addShifted(result, z1, half);
+    addShifted(result, z2, 2 * half);
+
+    trim(result);
+    return result;
+}
+
+// Divides magnitude by a single digit in place, returns the remainder
+TDigit divideByDigit(TDigits& digits, TDigit divisor)
+{
+    uint64_t remainder = 0;
+    for (std::size_t i = digits.size(); i > 0; i--) {
+        const uint64_t current = (remainder << DIGIT_BITS) | digits[i-1];
+        digits[i-1] = static_cast<TDigit>(current / divisor);
+        remainder = current % divisor;
+    }
+
+    trim(digits);
+    return static_cast<TDigit>(remainder);
+}
+
+int leadingZeros(TDigit digit)
+{
+    int count = 0;
+    while (!(digit & 0x80000000u)) {
+        digit <<= 1;
+        count++;
+    }
+    return count;
+}
+
+// Knuth, TAOCP vol. 2, 4.3.1, algorithm D
+void divideMagnitudes(const TDigits& dividend, const TDigits& divisor, TDigits& quotient, TDigits& remainder)
+{
+    if (compareMagnitudes(dividend, divisor) < 0) {
+        quotient.clear();
+        remainder = dividend;
+        return;
+    }
+
+    if (divisor.size() == 1) {
+        quotient = dividend;
+        const TDigit rest = divideByDigit(quotient, divisor[0]);
+        remainder.clear();
+        if (rest)
+            remainder.push_back(rest);
+        return;
+    }
+
+    const std::size_t n = divisor.size();
+    const std::size_t m = dividend.size();
+
+    // Normalizing so the highest bit of the divisor is set
+    const int shift = leadingZeros(divisor[n-1]);
+
+    TDigits v(n);
+    for (std::size_t i = n - 1; i > 0; i--)
+        v[i] = static_cast<TDigit>((static_cast<uint64_t>(divisor[i]) << shift) | (static_cast<uint64_t>(divisor[i-1]) >> (DIGIT_BITS - shift)));
+    v[0] = divisor[0] << shift;
+
+    TDigits u(m + 1);
+    u[m] = static_cast<TDigit>(static_cast<uint64_t>(dividend[m-1]) >> (DIGIT_BITS - shift));
+    for (std::size_t i = m - 1; i > 0; i--)
+        u[i] = static_cast<TDigit>((static_cast<uint64_t>(dividend[i]) << shift) | (static_cast<uint64_t>(dividend[i-1]) >> (DIGIT_BITS - shift)));
+    u[0] = dividend[0] << shift;
+
+    quotient.assign(m - n + 1, 0);
+    for (std::size_t j = m - n + 1; j > 0; j--) {
+        const std::size_t k = j - 1;
+
+        // Estimating the quotient digit
+        const uint64_t numerator = (static_cast<uint64_t>(u[k + n]) << DIGIT_BITS) | u[k + n - 1];
+        uint64_t qhat = numerator / v[n-1];
+        uint64_t rhat = numerator % v[n-1];
+        while (qhat >= DIGIT_BASE || qhat * v[n-2] > ((rhat << DIGIT_BITS) | u[k + n - 2])) {
+            qhat--;
+            rhat += v[n-1];
+            if (rhat >= DIGIT_BASE)
+                break;
+        }
+
+        // Multiplying and subtracting
+        int64_t borrow = 0;
+        int64_t difference = 0;
+        for (std::size_t i = 0; i < n; i++) {
+            const uint64_t product = qhat * v[i];
+            difference = static_cast<int64_t>(u[i + k]) - borrow - static_cast<int64_t>(product & 0xFFFFFFFFu);
+            u[i + k] = static_cast<TDigit>(difference);
+            borrow = static_cast<int64_t>(product >> DIGIT_BITS) - (difference >> DIGIT_BITS);
+        }
+        difference = static_cast<int64_t>(u[k + n]) - borrow;
+        u[k + n] = static_cast<TDigit>(difference);
+
+        quotient[k] = static_cast<TDigit>(qhat);
+
+        // Estimation was one too large, adding back
+        if (difference < 0) {
+            quotient[k]--;
+            uint64_t carry = 0;
+            for (std::size_t i = 0; i < n; i++) {
+                const uint64_t sum = static_cast<uint64_t>(u[i + k]) + v[i] + carry;
+                u[i + k] = static_cast<TDigit>(sum);
+                carry = sum >> DIGIT_BITS;
+            }
+            u[k + n] = static_cast<TDigit>(u[k + n] + carry);
+        }
+    }
+
+    // Denormalizing the remainder
+    remainder.resize(n);
+    for (std::size_t i = 0; i < n; i++)
+        remainder[i] = static_cast<TDigit>((static_cast<uint64_t>(u[i]) >> shift) | (static_cast<uint64_t>(u[i+1]) << (DIGIT_BITS - shift)));
+
+    trim(quotient);
+    trim(remainder);
+}
+
+TDigits shiftLeft(const TDigits& digits, std::size_t count)
+{
+    if (digits.empty())
+        return TDigits();
+
+    const std::size_t digitShift = count / DIGIT_BITS;
+    const int bitShift = count % DIGIT_BITS;
+
+    TDigits result(digits.size() + digitShift + 1);
+    for (std::size_t i = 0; i < digits.size(); i++) {
+        const uint64_t shifted = static_cast<uint64_t>(digits[i]) << bitShift;
+        result[i + digitShift]     |= static_cast<TDigit>(shifted);
+        result[i + digitShift + 1] |= static_cast<TDigit>(shifted >> DIGIT_BITS);
+    }
+
+    trim(result);
+    return result;
+}
+
+TDigits shiftRight(const TDigits& digits, std::size_t count)
+{
+    const std::size_t digitShift = count / DIGIT_BITS;
+    if (digitShift >= digits.size())
+        return TDigits();
+
+    const int bitShift = count % DIGIT_BITS;
+
+    TDigits result(digits.size() - digitShift);
+    for (std::size_t i = 0; i < result.size(); i++) {
+        const uint64_t high = (i + digitShift + 1 < digits.size()) ? digits[i + digitShift + 1] : 0;
+        result[i] = static_cast<TDigit>((((high << DIGIT_BITS) | digits[i + digitShift])) >> bitShift);
+    }
+
+    trim(result);
+    return result;
+}
+
+// Converts a magnitude to the two's complement form of the given size
+TDigits toTwosComplement(const TDigits& magnitude, bool negative, std::size_t size)
+{
+    TDigits result(magnitude);
+    result.resize(size, 0);
+
+    if (negative) {
+        uint64_t carry = 1;
+        for (std::size_t i = 0; i < size; i++) {
+            const uint64_t sum = static_cast<uint64_t>(static_cast<TDigit>(~result[i])) + carry;
+            result[i] = static_cast<TDigit>(sum);
+            carry = sum >> DIGIT_BITS;
+        }
+    }
+
+    return result;
+}
+
+} // namespace
+
+LargeInteger::LargeInteger(int64_t value)
+    : m_negative(value < 0)
+{
+    uint64_t magnitude = value < 0 ? static_cast<uint64_t>(-(value + 1)) + 1 : static_cast<uint64_t>(value);
+    while (magnitude) {
+        m_digits.push_back(static_cast<TDigit>(magnitude));
+        magnitude >>= DIGIT_BITS;
+    }
+}
+
+LargeInteger::LargeInteger(const TDigits& digits, bool negative)
+    : m_digits(digits), m_negative(negative)
+{
+    normalize();
+}
+
+void LargeInteger::normalize()
+{
+    trim(m_digits);
+    if (m_digits.empty())
+        m_negative = false;
+}
+
+LargeInteger LargeInteger::fromBytes(const uint8_t* bytes, std::size_t size)
+{
+    if (!size)
+        return LargeInteger();
+
+    TDigits digits((size - 1 + sizeof(TDigit) - 1) / sizeof(TDigit));
+    for (std::size_t i = 1; i < size; i++)
+        digits[(i - 1) / sizeof(TDigit)] |= static_cast<TDigit>(bytes[i]) << (8 * ((i - 1) % sizeof(TDigit)));
+
+    return LargeInteger(digits, bytes[0] != 0);
+}
+
+std::size_t LargeInteger::getByteSize() const
+{
+    if (m_digits.empty())
+        return 1;
+
+    std::size_t size = m_digits.size() * sizeof(TDigit);
+    for (TDigit top = m_digits.back(); !(top & 0xFF000000u); top <<= 8)
+        size--;
+
+    return size + 1;
+}
+
+void LargeInteger::toBytes(uint8_t* bytes) const
+{
+    bytes[0] = m_negative ? 1 : 0;
+
+    const std::size_t size = getByteSize();
+    for (std::size_t i = 1; i < size; i++)
+        bytes[i] = static_cast<uint8_t>(m_digits[(i - 1) / sizeof(TDigit)] >> (8 * ((i - 1) % sizeof(TDigit))));
+}
+
+bool LargeInteger::toSmallInt(intptr_t& value) const
+{
+    if (m_digits.size() > 2)
+        return false;
+
+    uint64_t magnitude = 0;
+    for (std::size_t i = m_digits.size(); i > 0; i--)
+        magnitude = (magnitude << DIGIT_BITS) | m_digits[i-1];
+
+    const uint64_t limit = static_cast<uint64_t>(TInteger::MAX_VALUE) + (m_negative ? 1 : 0);
+    if (magnitude > limit)
+        return false;
+
+    value = m_negative ? -static_cast<intptr_t>(magnitude - 1) - 1 : static_cast<intptr_t>(magnitude);
+    return true;
+}
+
+uint64_t LargeInteger::truncated() const
+{
+    uint64_t result = 0;
+    for (std::size_t i = std::min<std::size_t>(m_digits.size(), 2); i > 0; i--)
+        result = (result << DIGIT_BITS) | m_digits[i-1];
+
+    return m_negative ? ~result + 1 : result;
+}
+
+double LargeInteger::toDouble() const
+{
+    double result = 0;
+    for (std::size_t i = m_digits.size(); i > 0; i--)
+        result = result * DIGIT_BASE + m_digits[i-1];
+
+    return m_negative ? -result : result;
+}
+
+bool LargeInteger::fromDouble(double value, LargeInteger& result)
+{
+    if (value != value || value - value != 0) // NaN or infinity
+        return false;
+
+    value = value < 0 ? std::ceil(value) : std::floor(value);
+
+    // Splitting into the 53 bit mantissa and the exponent
+    int exponent = 0;
+    const double mantissa = std::frexp(value, &exponent);
+    const int mantissaBits = 53;
+
+    if (exponent <= mantissaBits) {
+        result = LargeInteger(static_cast<int64_t>(value));
+        return true;
+    }
+
+    result = LargeInteger(static_cast<int64_t>(std::ldexp(mantissa, mantissaBits))).shifted(exponent - mantissaBits);
+    return true;
+}
+
+int LargeInteger::compare(const LargeInteger& other) const
+{
+    if (m_negative != other.m_negative)
+        return m_negative ? -1 : 1;
+
+    const int result = compareMagnitudes(m_digits, other.m_digits);
+    return m_negative ? -result : result;
+}
+
+LargeInteger LargeInteger::operator-() const
+{
+    return LargeInteger(m_digits, !m_negative);
+}
+
+LargeInteger LargeInteger::operator+(const LargeInteger& other) const
+{
+    if (m_negative == other.m_negative)
+        return LargeInteger(addMagnitudes(m_digits, other.m_digits), m_negative);
+
+    // Signs differ, so the smaller magnitude is subtracted from the larger one
+    if (compareMagnitudes(m_digits, other.m_digits) >= 0)
+        return LargeInteger(subtractMagnitudes(m_digits, other.m_digits), m_negative);
+    else
+        return LargeInteger(subtractMagnitudes(other.m_digits, m_digits), other.m_negative);
+}
+
+LargeInteger LargeInteger::operator-(const LargeInteger& other) const
+{
+    return *this + (-other);
+}
+
+LargeInteger LargeInteger::multiply(const LargeInteger& left, const LargeInteger& right, std::size_t karatsubaThreshold /*= KARATSUBA_THRESHOLD*/)
+{
+    // Halves of shorter operands together with the carry are as long as the operands
+    const std::size_t threshold = std::max<std::size_t>(karatsubaThreshold, 4);
+    return LargeInteger(multiplyKaratsuba(left.m_digits, right.m_digits, threshold), left.m_negative != right.m_negative);
+}
+
+bool LargeInteger::divMod(const LargeInteger& dividend, const LargeInteger& divisor, LargeInteger& quotient, LargeInteger& remainder)
+{
+    if (divisor.isZero())
+        return false;
+
+    TDigits quotientDigits;
+    TDigits remainderDigits;
+    divideMagnitudes(dividend.m_digits, divisor.m_digits, quotientDigits, remainderDigits);
+
+    quotient  = LargeInteger(quotientDigits, dividend.m_negative != divisor.m_negative);
+    remainder = LargeInteger(remainderDigits, dividend.m_negative);
+    return true;
+}
+
+LargeInteger LargeInteger::bitOperation(const LargeInteger& other, TBitOperation operation) const
+{
+    // One extra digit holds the sign
+    const std::size_t size = std::max(m_digits.size(), other.m_digits.size()) + 1;
+
+    TDigits result = toTwosComplement(m_digits, m_negative, size);
+    const TDigits operand = toTwosComplement(other.m_digits, other.m_negative, size);
+
+    for (std::size_t i = 0; i < size; i++) {
+        switch (operation) {
+            case bitOperationAnd: result[i] &= operand[i]; break;
+            case bitOperationOr:  result[i] |= operand[i]; break;
+            case bitOperationXor: result[i] ^= operand[i]; break;
+        }
+    }
+
+    // Negation is an involution in the two's complement arithmetic
+    const bool negative = result.back() & 0x80000000u;
+    return LargeInteger(toTwosComplement(result, negative, size), negative);
+}
+
+LargeInteger LargeInteger::bitAnd(const LargeInteger& other) const { return bitOperation(other, bitOperationAnd); }
+LargeInteger LargeInteger::bitOr(const LargeInteger& other) const  { return bitOperation(other, bitOperationOr);  }
+LargeInteger LargeInteger::bitXor(const LargeInteger& other) const { return bitOperation(other, bitOperationXor); }
+
+LargeInteger LargeInteger::shifted(intptr_t count) const
+{
+    if (count >= 0)
+        return LargeInteger(shiftLeft(m_digits, count), m_negative);
+
+    const std::size_t rightCount = static_cast<std::size_t>(-(count + 1)) + 1;
+    if (!m_negative)
+        return LargeInteger(shiftRight(m_digits, rightCount), false);
+
+    // Rounding towards negative infinity: -x >> n == -((x - 1) >> n) - 1
+    const LargeInteger one(1);
+    const TDigits decremented = subtractMagnitudes(m_digits, one.m_digits);
+    return LargeInteger(addMagnitudes(shiftRight(decremented, rightCount), one.m_digits), true);
+}
+
+std::string LargeInteger::toString(unsigned base /*= 10*/) const
+{
+    static const char digitChars[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+    if (m_digits.empty())
+        return "0";
+
+    // Dividing by the largest power of the base that fits into a digit
+    // yields several characters per division
+    TDigit chunkBase = base;
+    int chunkLength = 1;
+    while (static_cast<uint64_t>(chunkBase) * base < DIGIT_BASE) {
+        chunkBase *= base;
+        chunkLength++;
+    }
+
+    std::string result;
+    TDigits value(m_digits);
+    while (!value.empty()) {
+        TDigit chunk = divideByDigit(value, chunkBase);
+        for (int i = 0; i < chunkLength && (chunk || !value.empty()); i++) {
+            result.push_back(digitChars[chunk % base]);
+            chunk /= base;
+        }
+    }
+
+    if (m_negative)
+        result.push_back('-');
+
+    std::reverse(result.begin(), result.end());
+    return result;
+}
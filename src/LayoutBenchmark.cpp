@@ -0,0 +1,247 @@
+/*
+ *    LayoutBenchmark.cpp
+ *
+ *    Measures cache misses of the method lookup for the serial and clustered object layouts
+ *
+ *    LLST (LLVM Smalltalk or Low Level Smalltalk) version 0.4
+ *
+ *    LLST is
+ *        Copyright (C) 2012-2015 by Dmitry Kashitsyn   <korvin@deeptown.org>
+ *        Copyright (C) 2012-2015 by Roman Proskuryakov <humbug@deeptown.org>
+ *
+ *    LLST is based on the LittleSmalltalk which is
+ *        Copyright (C) 1987-2005 by Timothy A. Budd
+ *        Copyright (C) 2007 by Charles R. Childers
+ *        Copyright (C) 2005-2007 by Danny Reinhold
+ *
+ *    Original license of LittleSmalltalk may be found in the LICENSE file.
+ *
+ *
+ *    This file is part of LLST.
+ *    LLST is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    LLST is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with LLST.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <memory.h>
+#include <Timer.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+namespace {
+
+// Hardware counter of the calling thread. Counters may be
+// unavailable, e.g. in containers or virtual machines.
+class TPerfCounter {
+public:
+    TPerfCounter(uint32_t type, uint64_t config) : m_fd(-1) {
+        perf_event_attr attributes;
+        std::memset(&attributes, 0, sizeof(attributes));
+        attributes.size = sizeof(attributes);
+        attributes.type = type;
+        attributes.config = config;
+        attributes.disabled = 1;
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+        m_fd = syscall(__NR_perf_event_open, &attributes, 0, -1, -1, 0);
+    }
+    ~TPerfCounter() { if (m_fd >= 0) close(m_fd); }
+
+    bool isAvailable() const { return m_fd >= 0; }
+    void start() {
+        if (m_fd < 0)
+            return;
+        ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    uint64_t stop() {
+        uint64_t value = 0;
+        if (m_fd < 0)
+            return value;
+        ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(m_fd, &value, sizeof(value)) != sizeof(value))
+            value = 0;
+        return value;
+    }
+private:
+    int m_fd;
+};
+
+const uint64_t L1D_READ_MISS = PERF_COUNT_HW_CACHE_L1D
+    | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+const uint64_t DTLB_READ_MISS = PERF_COUNT_HW_CACHE_DTLB
+    | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+struct TSend {
+    TClass*  receiverClass;
+    TSymbol* selector;
+};
+
+// Each class of the image receives each selector defined anywhere in the image,
+// in a pseudo random order. Most lookups walk the hierarchy up to the root.
+std::vector<TSend> collectSends(TClass* classClass)
+{
+    std::vector<TClass*>  classes;
+    std::vector<TSymbol*> selectors;
+
+    TDictionary* const dictionary = globals.globalsObject;
+    for (std::size_t i = 0; i < dictionary->values->getSize(); i++) {
+        TObject* const value = dictionary->values->getField(i);
+        if (isSmallInteger(value) || value->isBinary() || value->getClass()->getClass() != classClass)
+            continue;
+
+        TClass* const klass = static_cast<TClass*>(value);
+        classes.push_back(klass);
+        classes.push_back(klass->getClass());
+
+        TSymbolArray* const keys = klass->methods->keys;
+        for (std::size_t j = 0; j < keys->getSize(); j++)
+            selectors.push_back(keys->getField(j));
+    }
+
+    std::vector<TSend> sends;
+    sends.reserve(classes.size() * selectors.size());
+    for (std::size_t i = 0; i < classes.size(); i++) {
+        for (std::size_t j = 0; j < selectors.size(); j++) {
+            const TSend send = { classes[i], selectors[j] };
+            sends.push_back(send);
+        }
+    }
+
+    uint32_t seed = 1;
+    for (std::size_t i = sends.size(); i > 1; i--) {
+        seed = seed * 1103515245 + 12345;
+        std::swap(sends[i - 1], sends[(seed >> 8) % i]);
+    }
+
+    return sends;
+}
+
+// Lookup as done by the VM on the cache miss, followed
+// by the access to the bytecodes and literals of the method
+uint32_t dispatch(const std::vector<TSend>& sends)
+{
+    uint32_t checksum = 0;
+    for (std::size_t i = 0; i < sends.size(); i++) {
+        const uint32_t hash = sends[i].selector->getHash();
+        for (TClass* klass = sends[i].receiverClass; klass != globals.nilObject; klass = klass->parentClass) {
+            TMethod* const method = klass->methods->find<TMethod>(sends[i].selector, hash);
+            if (! method)
+                continue;
+
+            checksum += method->byteCodes->getByte(0);
+            if (method->literals != globals.nilObject)
+                checksum += method->literals->getSize();
+            break;
+        }
+    }
+    return checksum;
+}
+
+void evictCaches()
+{
+    static std::vector<uint8_t> buffer(64 * 1024 * 1024);
+    for (std::size_t i = 0; i < buffer.size(); i += 64)
+        buffer[i]++;
+}
+
+bool runBenchmark(const char* fileName, bool localityLayout, int passes)
+{
+    NonCollectMemoryManager memoryManager;
+    memoryManager.initializeHeap(sizeof(TObject));
+
+    Image image(&memoryManager);
+    image.setLocalityLayout(localityLayout);
+
+    try {
+        if (!image.loadImage(fileName))
+            return false;
+    } catch (const std::exception& error) {
+        std::fprintf(stderr, "Could not read image: %s\n", error.what());
+        return false;
+    }
+
+    TClass* const classClass = image.getGlobal<TClass>(TClass::InstanceClassName());
+    if (!classClass)
+        return false;
+
+    const std::vector<TSend> sends = collectSends(classClass);
+
+    TPerfCounter l1Misses(PERF_TYPE_HW_CACHE, L1D_READ_MISS);
+    TPerfCounter tlbMisses(PERF_TYPE_HW_CACHE, DTLB_READ_MISS);
+    TPerfCounter cacheMisses(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+
+    uint64_t l1 = 0, tlb = 0, llc = 0;
+    uint32_t checksum = 0;
+    double elapsed = 0;
+
+    for (int pass = 0; pass < passes; pass++) {
+        evictCaches();
+
+        Timer timer;
+        l1Misses.start();
+        tlbMisses.start();
+        cacheMisses.start();
+
+        checksum += dispatch(sends);
+
+        l1  += l1Misses.stop();
+        tlb += tlbMisses.stop();
+        llc += cacheMisses.stop();
+        elapsed += timer.get<TMillisec>().toDouble();
+    }
+
+    std::printf("%-10s %9zu sends %10.2f ms", localityLayout ? "clustered" : "serial", sends.size(), elapsed / passes);
+    if (l1Misses.isAvailable())
+        std::printf(" %12llu L1D", static_cast<unsigned long long>(l1 / passes));
+    if (tlbMisses.isAvailable())
+        std::printf(" %10llu dTLB", static_cast<unsigned long long>(tlb / passes));
+    if (cacheMisses.isAvailable())
+        std::printf(" %10llu LLC", static_cast<unsigned long long>(llc / passes));
+    if (!l1Misses.isAvailable() && !cacheMisses.isAvailable())
+        std::printf("  (hardware counters are not available)");
+    std::printf("  checksum %u\n", checksum);
+
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        std::fprintf(stderr, "Usage: %s <image> [passes]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const int passes = (argc > 2) ? std::atoi(argv[2]) : 10;
+    if (passes <= 0) {
+        std::fprintf(stderr, "Invalid number of passes %s\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    // Misses are per pass, caches are evicted before each one
+    if (!runBenchmark(argv[1], false, passes) || !runBenchmark(argv[1], true, passes))
+        return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,187 @@
+/*
+ *    MappedFile.cpp
+ *
+ *    Memory mapped files exposed as binary objects
+ *
+ *    LLST (LLVM Smalltalk or Low Level Smalltalk) version 0.4
+ *
+ *    LLST is
+ *        Copyright (C) 2012-2015 by Dmitry Kashitsyn   <korvin@deeptown.org>
+ *        Copyright (C) 2012-2015 by Roman Proskuryakov <humbug@deeptown.org>
+ *
+ *    LLST is based on the LittleSmalltalk which is
+ *        Copyright (C) 1987-2005 by Timothy A. Budd
+ *        Copyright (C) 2007 by Charles R. Childers
+ *        Copyright (C) 2005-2007 by Danny Reinhold
+ *
+ *    Original license of LittleSmalltalk may be found in the LICENSE file.
+ *
+ *
+ *    This file is part of LLST.
+ *    LLST is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    LLST is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with LLST.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <MappedFile.h>
+#include <new>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+
+// Size of the binary object is limited by the header
+const std::size_t MAX_MAPPED_SIZE = (static_cast<std::size_t>(1) << 30) - 1;
+
+std::size_t getPageSize()
+{
+    static const std::size_t pageSize = sysconf(_SC_PAGESIZE);
+    return pageSize;
+}
+
+}
+
+MappedFiles::~MappedFiles()
+{
+    TMappings::iterator iMapping = m_mappings.begin();
+    for (; iMapping != m_mappings.end(); ++iMapping) {
+        m_memoryManager->unregisterExternalObject(iMapping->first);
+        unmap(iMapping->second);
+    }
+}
+
+TByteObject* MappedFiles::map(const std::string& fileName, TClass* klass)
+{
+    const int fileID = open(fileName.c_str(), O_RDONLY);
+    if (fileID < 0)
+        return 0;
+
+    struct stat fileStat;
+    if (fstat(fileID, &fileStat) < 0 || ! S_ISREG(fileStat.st_mode)) {
+        ::close(fileID);
+        return 0;
+    }
+
+    TByteObject* const object = mapRange(fileID, 0, fileStat.st_size, klass);
+    if (! object)
+        ::close(fileID);
+
+    return object;
+}
+
+TByteObject* MappedFiles::slice(const TByteObject* object, std::size_t start, std::size_t size)
+{
+    TMappings::const_iterator iMapping = m_mappings.find(const_cast<TByteObject*>(object));
+    if (iMapping == m_mappings.end() || iMapping->second.fileID < 0)
+        return 0;
+
+    if (start + size > object->getSize())
+        return 0;
+
+    const off_t offset = iMapping->second.offset + start;
+    if (offset % sizeof(TObject*))
+        return 0;
+
+    // Every mapping owns the descriptor, so the slice outlives the original
+    const int fileID = dup(iMapping->second.fileID);
+    if (fileID < 0)
+        return 0;
+
+    TByteObject* const result = mapRange(fileID, offset, size, object->getClass());
+    if (! result)
+        ::close(fileID);
+
+    return result;
+}
+
+TByteObject* MappedFiles::mapRange(int fileID, off_t offset, std::size_t size, TClass* klass)
+{
+    if (size > MAX_MAPPED_SIZE || ! m_memoryManager->isInStaticHeap(klass))
+        return 0;
+
+    // The first page is reserved for the header of the object
+    const std::size_t pageSize  = getPageSize();
+    const std::size_t delta     = offset % pageSize;
+    const std::size_t fileBytes = delta + size;
+    const std::size_t length    = pageSize + (fileBytes + pageSize - 1) / pageSize * pageSize;
+
+    void* const region = mmap(0, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED)
+        return 0;
+
+    uint8_t* const base = static_cast<uint8_t*>(region);
+    if (fileBytes > 0) {
+        void* const contents = mmap(base + pageSize, fileBytes, PROT_READ | PROT_WRITE,
+                                    MAP_PRIVATE | MAP_FIXED, fileID, offset - delta);
+        if (contents == MAP_FAILED) {
+            munmap(base, length);
+            return 0;
+        }
+    }
+
+    uint8_t* const bytes = base + pageSize + delta;
+    TByteObject* const object = new (bytes - sizeof(TByteObject)) TByteObject(size, klass);
+
+    TMapping mapping;
+    mapping.base   = base;
+    mapping.length = length;
+    mapping.fileID = fileID;
+    mapping.offset = offset;
+    m_mappings[object] = mapping;
+
+    m_memoryManager->registerExternalObject(object, this);
+    return object;
+}
+
+bool MappedFiles::close(TByteObject* object)
+{
+    TMappings::iterator iMapping = m_mappings.find(object);
+    if (iMapping == m_mappings.end())
+        return false;
+
+    TMapping& mapping = iMapping->second;
+    if (mapping.fileID < 0)
+        return true;
+
+    // Pages of the file are replaced, but the header stays where it was
+    TClass* const klass = object->getClass();
+    void* const region = mmap(mapping.base, mapping.length, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    if (region == MAP_FAILED)
+        return false;
+
+    new (object) TByteObject(0, klass);
+
+    ::close(mapping.fileID);
+    mapping.fileID = -1;
+    return true;
+}
+
+void MappedFiles::releaseObject(TObject* object)
+{
+    TMappings::iterator iMapping = m_mappings.find(object);
+    if (iMapping == m_mappings.end())
+        return;
+
+    unmap(iMapping->second);
+    m_mappings.erase(iMapping);
+}
+
+void MappedFiles::unmap(const TMapping& mapping)
+{
+    munmap(mapping.base, mapping.length);
+    if (mapping.fileID >= 0)
+        ::close(mapping.fileID);
+}
@@ -42,6 +42,7 @@
 #include <iostream>
 #include <sstream>
 #include <opcodes.h>
+#include <PrimitiveRegistry.h>
 #include <analysis.h>
 #include <visualization.h>
 
@@ -368,6 +369,12 @@ void MethodCompiler::scanForBranches(TJITContext& jit, st::ParsedBytecode* sourc
     visitor.run();
 }
 
+Value* MethodCompiler::getKnownClass(TJITContext& jit, TClassRegistry::TIndex index)
+{
+    Value* const slot = jit.builder->CreateConstGEP2_32(m_globals.classRegistry, 0, index);
+    return jit.builder->CreateLoad(slot, TClassRegistry::names[index]);
+}
+
 TObjectAndSize MethodCompiler::createArray(TJITContext& jit, uint32_t elementsCount)
 {
     TStackObject array = allocateStackObject(*jit.builder, sizeof(TObjectArray), elementsCount);
@@ -383,8 +390,8 @@ TObjectAndSize MethodCompiler::createArray(TJITContext& jit, uint32_t elementsCo
 
     Value* arrayObject = jit.builder->CreateBitCast(array.objectSlot, m_baseTypes.object->getPointerTo());
 
-    jit.builder->CreateCall2(m_baseFunctions.setObjectSize, arrayObject, jit.builder->getInt32(elementsCount));
-    jit.builder->CreateCall2(m_baseFunctions.setObjectClass, arrayObject, m_globals.arrayClass);
+    jit.builder->CreateCall2(m_baseFunctions.setObjectSize, arrayObject, ConstantInt::get(m_baseTypes.word, elementsCount));
+    jit.builder->CreateCall2(m_baseFunctions.setObjectClass, arrayObject, getKnownClass(jit, TClassRegistry::arrayClass));
 
     return std::make_pair(arrayObject, arraySize);
 }
@@ -623,7 +630,7 @@ void MethodCompiler::doPushLiteral(TJITContext& jit)
     Value* result = 0;
 
     if (isSmallInteger(literal)) {
-        Value* const integerValue = jit.builder->getInt32( TInteger(literal).rawValue() );
+        Value* const integerValue = ConstantInt::get(m_baseTypes.word, TInteger(literal).rawValue(), true);
         result = jit.builder->CreateIntToPtr(integerValue, m_baseTypes.object->getPointerTo());
 
         std::ostringstream ss;
@@ -654,7 +661,7 @@ void MethodCompiler::doPushConstant(TJITContext& jit)
         case 7:
         case 8:
         case 9: {
-            Value* const integerValue = jit.builder->getInt32( TInteger(constant).rawValue() );
+            Value* const integerValue = ConstantInt::get(m_baseTypes.word, TInteger(constant).rawValue(), true);
             constantValue = jit.builder->CreateIntToPtr(integerValue, m_baseTypes.object->getPointerTo());
 
             std::ostringstream ss;
@@ -1078,7 +1085,7 @@ bool MethodCompiler::doSendMessageToLiteral(TJITContext& jit, st::InstructionNod
         }
 
         assert(literalReceiver);
-        receiverClass = isSmallInteger(literalReceiver) ? globals.smallIntClass : literalReceiver->getClass();
+        receiverClass = isSmallInteger(literalReceiver) ? classRegistry[TClassRegistry::smallIntClass] : literalReceiver->getClass();
     }
 
     assert(receiverClass);
@@ -1150,17 +1157,17 @@ bool MethodCompiler::doSendMessageToLiteral(TJITContext& jit, st::InstructionNod
     // number of pointers except for the first two fields
     const uint32_t contextFieldsCount = contextSize / sizeof(TObject*) - 2;
 
-    jit.builder->CreateCall2(setObjectSize, newContextObject, jit.builder->getInt32(contextFieldsCount));
-    jit.builder->CreateCall2(setObjectClass, newContextObject, getJitGlobals().contextClass);
+    jit.builder->CreateCall2(setObjectSize, newContextObject, ConstantInt::get(m_baseTypes.word, contextFieldsCount));
+    jit.builder->CreateCall2(setObjectClass, newContextObject, getKnownClass(jit, TClassRegistry::contextClass));
 
     if (hasTemporaries) {
         const uint32_t tempsFieldsCount = tempsSize / sizeof(TObject*) - 2;
-        jit.builder->CreateCall2(setObjectSize, newTempsObject, jit.builder->getInt32(tempsFieldsCount));
-        jit.builder->CreateCall2(setObjectClass, newTempsObject, getJitGlobals().arrayClass);
+        jit.builder->CreateCall2(setObjectSize, newTempsObject, ConstantInt::get(m_baseTypes.word, tempsFieldsCount));
+        jit.builder->CreateCall2(setObjectClass, newTempsObject, getKnownClass(jit, TClassRegistry::arrayClass));
     }
 
     Function* setObjectField  = getBaseFunctions().setObjectField;
-    Value* methodRawPointer   = jit.builder->getInt32(reinterpret_cast<uint32_t>(directMethod));
+    Value* methodRawPointer   = ConstantInt::get(m_baseTypes.word, reinterpret_cast<uintptr_t>(directMethod));
     Value* directMethodObject = jit.builder->CreateIntToPtr(methodRawPointer, m_baseTypes.object->getPointerTo());
 
     Value* previousContext = jit.getCurrentContext(); // jit.builder->CreateLoad(info.contextHolder);
@@ -1494,7 +1501,7 @@ void MethodCompiler::compilePrimitive(TJITContext& jit,
             jit.builder->CreateCondBr(objectIsSmallInt, asSmallInt, asObject);
 
             jit.builder->SetInsertPoint(asSmallInt);
-            Value* const result = jit.builder->CreateCall(m_baseFunctions.newInteger, jit.builder->getInt32(0));
+            Value* const result = jit.builder->CreateCall(m_baseFunctions.newInteger, ConstantInt::get(m_baseTypes.word, 0));
             jit.builder->CreateRet(result);
 
             jit.builder->SetInsertPoint(asObject);
@@ -1510,7 +1517,8 @@ void MethodCompiler::compilePrimitive(TJITContext& jit,
             Function* const executeProcess = m_JITModule->getFunction("executeProcess");
             Value*    const processResult  = jit.builder->CreateCall(executeProcess, process);
 
-            primitiveResult = jit.builder->CreateCall(m_baseFunctions.newInteger, processResult);
+            Value*    const resultValue    = jit.builder->CreateIntCast(processResult, m_baseTypes.word, true);
+            primitiveResult = jit.builder->CreateCall(m_baseFunctions.newInteger, resultValue);
         } break;
 
         case primitive::allocateObject: { // 7
@@ -1562,7 +1570,7 @@ void MethodCompiler::compilePrimitive(TJITContext& jit,
                 jit.builder->getFalse()   // not volatile
             };
 
-            Type* const memcpyType[] = {jit.builder->getInt8PtrTy(), jit.builder->getInt8PtrTy(), jit.builder->getInt32Ty() };
+            Type* const memcpyType[] = {jit.builder->getInt8PtrTy(), jit.builder->getInt8PtrTy(), m_baseTypes.word };
             Function* const memcpyIntrinsic = getDeclaration(m_JITModule, Intrinsic::memcpy, memcpyType);
 
             jit.builder->CreateCall(memcpyIntrinsic, copyArgs);
@@ -1594,7 +1602,7 @@ void MethodCompiler::compilePrimitive(TJITContext& jit,
 
             //Checking the passed temps size TODO unroll stack
             Value* const blockAcceptsArgCount = jit.builder->CreateSub(tempsSize, argumentLocation, "blockAcceptsArgCount.");
-            Value* const tempSizeOk = jit.builder->CreateICmpSLE(jit.builder->getInt32(argCount), blockAcceptsArgCount, "tempSizeOk.");
+            Value* const tempSizeOk = jit.builder->CreateICmpSLE(ConstantInt::get(m_baseTypes.word, argCount), blockAcceptsArgCount, "tempSizeOk.");
             jit.builder->CreateCondBr(tempSizeOk, tempsChecked, primitiveFailedBB);
             jit.builder->SetInsertPoint(tempsChecked);
 
@@ -1602,7 +1610,8 @@ void MethodCompiler::compilePrimitive(TJITContext& jit,
             for (uint32_t index = argCount - 1, count = argCount; count > 0; index--, count--)
             {
                 // (*blockTemps)[argumentLocation + index] = stack[--ec.stackTop];
-                Value* const fieldIndex = jit.builder->CreateAdd(argumentLocation, jit.builder->getInt32(index), "fieldIndex.");
+                Value* const fieldOffset = jit.builder->CreateAdd(argumentLocation, ConstantInt::get(m_baseTypes.word, index));
+                Value* const fieldIndex  = jit.builder->CreateIntCast(fieldOffset, jit.builder->getInt32Ty(), false, "fieldIndex.");
                 Value* const argument   = getArgument(jit, index + 1); // jit.popValue();
                 argument->setName("argument.");
                 jit.builder->CreateCall3(m_baseFunctions.setObjectField, blockTemps, fieldIndex, argument);
@@ -1619,7 +1628,7 @@ void MethodCompiler::compilePrimitive(TJITContext& jit,
             //after calling cxa_throw. But! Someone may add Smalltalk code after <19>
             //Thats why we have to create unconditional br to 'primitiveFailed'
             //to catch any generated code into that BB
-            Value* const contextPtr2Size = jit.builder->CreateTrunc(ConstantExpr::getSizeOf(m_baseTypes.context->getPointerTo()->getPointerTo()), jit.builder->getInt32Ty());
+            Value* const contextPtr2Size = jit.builder->CreateIntCast(ConstantExpr::getSizeOf(m_baseTypes.context->getPointerTo()->getPointerTo()), m_baseTypes.word, false);
             Value* const expnBuffer      = jit.builder->CreateCall(m_exceptionAPI.cxa_allocate_exception, contextPtr2Size);
             Value* const expnTypedBuffer = jit.builder->CreateBitCast(expnBuffer, m_baseTypes.context->getPointerTo()->getPointerTo());
             jit.builder->CreateStore(jit.getCurrentContext(), expnTypedBuffer);
@@ -1647,11 +1656,11 @@ void MethodCompiler::compilePrimitive(TJITContext& jit,
             Value* const indexIsSmallInt = jit.builder->CreateCall(m_baseFunctions.isSmallInteger, indexObject);
 
             Value* const index       = jit.builder->CreateCall(m_baseFunctions.getIntegerValue, indexObject);
-            Value* const actualIndex = jit.builder->CreateSub(index, jit.builder->getInt32(1));
+            Value* const actualIndex = jit.builder->CreateSub(index, ConstantInt::get(m_baseTypes.word, 1));
 
             //Checking boundaries
             Value* const arraySize   = jit.builder->CreateCall(m_baseFunctions.getObjectSize, arrayObject);
-            Value* const indexGEZero = jit.builder->CreateICmpSGE(actualIndex, jit.builder->getInt32(0));
+            Value* const indexGEZero = jit.builder->CreateICmpSGE(actualIndex, ConstantInt::get(m_baseTypes.word, 0));
             Value* const indexLTSize = jit.builder->CreateICmpSLT(actualIndex, arraySize);
             Value* const boundaryOk  = jit.builder->CreateAnd(indexGEZero, indexLTSize);
 
@@ -1659,14 +1668,17 @@ void MethodCompiler::compilePrimitive(TJITContext& jit,
             jit.builder->CreateCondBr(indexOk, indexChecked, primitiveFailedBB);
             jit.builder->SetInsertPoint(indexChecked);
 
+            // Boundaries are checked, so the index safely fits into the field index type
+            Value* const fieldIndex = jit.builder->CreateIntCast(actualIndex, jit.builder->getInt32Ty(), false);
+
             if (opcode == primitive::arrayAtPut) {
-                Value* const fieldPointer = jit.builder->CreateCall2(m_baseFunctions.getObjectFieldPtr, arrayObject, actualIndex);
+                Value* const fieldPointer = jit.builder->CreateCall2(m_baseFunctions.getObjectFieldPtr, arrayObject, fieldIndex);
                 jit.builder->CreateCall2(m_runtimeAPI.checkRoot, valueObejct, fieldPointer);
                 jit.builder->CreateStore(valueObejct, fieldPointer);
 
                 primitiveResult = arrayObject;
             } else {
-                primitiveResult = jit.builder->CreateCall2(m_baseFunctions.getObjectField, arrayObject, actualIndex);
+                primitiveResult = jit.builder->CreateCall2(m_baseFunctions.getObjectField, arrayObject, fieldIndex);
             }
         } break;
 
@@ -1685,11 +1697,11 @@ void MethodCompiler::compilePrimitive(TJITContext& jit,
 
             // Acquiring integer value of the index (from the smalltalk's TInteger)
             Value* const index       = jit.builder->CreateCall(m_baseFunctions.getIntegerValue, indexObject);
-            Value* const actualIndex = jit.builder->CreateSub(index, jit.builder->getInt32(1));
+            Value* const actualIndex = jit.builder->CreateSub(index, ConstantInt::get(m_baseTypes.word, 1));
 
             //Checking boundaries
             Value* const stringSize  = jit.builder->CreateCall(m_baseFunctions.getObjectSize, stringObject);
-            Value* const indexGEZero = jit.builder->CreateICmpSGE(actualIndex, jit.builder->getInt32(0));
+            Value* const indexGEZero = jit.builder->CreateICmpSGE(actualIndex, ConstantInt::get(m_baseTypes.word, 0));
             Value* const indexLTSize = jit.builder->CreateICmpSLT(actualIndex, stringSize);
             Value* const boundaryOk  = jit.builder->CreateAnd(indexGEZero, indexLTSize);
 
@@ -1712,11 +1724,11 @@ void MethodCompiler::compilePrimitive(TJITContext& jit,
                 primitiveResult = stringObject;
             } else {
                 // Loading string byte pointed by the pointer,
-                // expanding it to the 4 byte integer and returning
+                // expanding it to the machine word integer and returning
                 // as TInteger value
 
                 Value* const byte = jit.builder->CreateLoad(bytePtr);
-                Value* const expandedByte = jit.builder->CreateZExt(byte, jit.builder->getInt32Ty());
+                Value* const expandedByte = jit.builder->CreateZExt(byte, m_baseTypes.word);
                 primitiveResult = jit.builder->CreateCall(m_baseFunctions.newInteger, expandedByte);
             }
         } break;
@@ -1737,6 +1749,17 @@ void MethodCompiler::compilePrimitive(TJITContext& jit,
             compileSmallIntPrimitive(jit, opcode, leftObject, rightObject, primitiveResult, primitiveFailedBB);
         } break;
 
+        case primitive::floatAdd:           // 50
+        case primitive::floatSub:           // 51
+        case primitive::floatMul:           // 52
+        case primitive::floatDiv:           // 53
+        case primitive::floatLess:          // 54
+        case primitive::floatEqual: {       // 55
+            Value* const rightObject = getArgument(jit, 1); // jit.popValue();
+            Value* const leftObject  = getArgument(jit, 0); // jit.popValue();
+            compileFloatPrimitive(jit, opcode, leftObject, rightObject, primitiveResult, primitiveFailedBB);
+        } break;
+
         case primitive::bulkReplace: {
             Value* const destination            = getArgument(jit, 4); // jit.popValue();
             Value* const sourceStartOffset      = getArgument(jit, 3); // jit.popValue();
@@ -1784,11 +1807,19 @@ void MethodCompiler::compilePrimitive(TJITContext& jit,
 
         case primitive::ioGetChar:          // 9
         case primitive::ioFileOpen:         // 100
-        case primitive::ioFileClose:        // 103
         case primitive::ioFileSetStatIntoArray:   // 105
         case primitive::ioFileReadIntoByteArray:  // 106
         case primitive::ioFileWriteFromByteArray: // 107
         case primitive::ioFileSeek:         // 108
+        case primitive::ioFileWriteRange:   // 114
+        case primitive::ioFileReadLine:     // 115
+        case primitive::ioFileFlush:        // 116
+        case primitive::ioWaitBlocking:     // 122
+        case primitive::socketListen:       // 123
+        case primitive::socketAccept:       // 124
+        case primitive::socketConnect:      // 125
+        case primitive::socketError:        // 126
+        case primitive::socketPort:         // 127
 
         case primitive::getSystemTicks:     //253
 
@@ -1811,7 +1842,18 @@ void MethodCompiler::compilePrimitive(TJITContext& jit,
             Value* const primitiveFailedPtr = jit.builder->CreateAlloca(jit.builder->getInt1Ty(), 0, "primitiveFailedPtr");
             jit.builder->CreateStore(jit.builder->getFalse(), primitiveFailedPtr);
 
-            primitiveResult = jit.builder->CreateCall3(m_runtimeAPI.callPrimitive, jit.builder->getInt8(opcode), argumentsArray, primitiveFailedPtr);
+            // Native primitives are called directly, bypassing the runtime dispatch.
+            // Those that do not collect are also known to the GC detectors through
+            // TSmalltalkInstruction::mayCauseGC(), so the values living across
+            // the call are not protected by the holders.
+            Value* primitiveFunction = m_runtimeAPI.callPrimitive;
+            const TPrimitiveDescriptor& descriptor = primitiveRegistry[opcode];
+            if (descriptor.function && descriptor.acceptsArguments(argumentsCount)) {
+                Value* const functionAddress = ConstantInt::get(m_baseTypes.word, reinterpret_cast<uintptr_t>(descriptor.function));
+                primitiveFunction = jit.builder->CreateIntToPtr(functionAddress, m_runtimeAPI.callPrimitive->getType());
+            }
+
+            primitiveResult = jit.builder->CreateCall3(primitiveFunction, jit.builder->getInt8(opcode), argumentsArray, primitiveFailedPtr);
             primitiveFailed = jit.builder->CreateLoad(primitiveFailedPtr);
         }
     }
@@ -1842,7 +1884,7 @@ void MethodCompiler::compileSmallIntPrimitive(TJITContext& jit,
             primitiveResult  = jit.builder->CreateCall(m_baseFunctions.newInteger, intResult);
         } break;
         case primitive::smallIntDiv: {
-            Value* const isZero = jit.builder->CreateICmpEQ(rightOperand, jit.builder->getInt32(0));
+            Value* const isZero = jit.builder->CreateICmpEQ(rightOperand, ConstantInt::get(m_baseTypes.word, 0));
             BasicBlock*  divBB  = BasicBlock::Create(m_JITModule->getContext(), "div", jit.function);
             jit.builder->CreateCondBr(isZero, primitiveFailedBB, divBB);
 
@@ -1851,7 +1893,7 @@ void MethodCompiler::compileSmallIntPrimitive(TJITContext& jit,
             primitiveResult  = jit.builder->CreateCall(m_baseFunctions.newInteger, intResult);
         } break;
         case primitive::smallIntMod: {
-            Value* const isZero = jit.builder->CreateICmpEQ(rightOperand, jit.builder->getInt32(0));
+            Value* const isZero = jit.builder->CreateICmpEQ(rightOperand, ConstantInt::get(m_baseTypes.word, 0));
             BasicBlock*  modBB  = BasicBlock::Create(m_JITModule->getContext(), "mod", jit.function);
             jit.builder->CreateCondBr(isZero, primitiveFailedBB, modBB);
 
@@ -1889,7 +1931,7 @@ void MethodCompiler::compileSmallIntPrimitive(TJITContext& jit,
             BasicBlock* shiftLeftBB   = BasicBlock::Create(m_JITModule->getContext(), "<<", jit.function);
             BasicBlock* shiftResultBB = BasicBlock::Create(m_JITModule->getContext(), "shiftResult", jit.function);
 
-            Value* const rightIsNeg = jit.builder->CreateICmpSLT(rightOperand, jit.builder->getInt32(0));
+            Value* const rightIsNeg = jit.builder->CreateICmpSLT(rightOperand, ConstantInt::get(m_baseTypes.word, 0));
             jit.builder->CreateCondBr(rightIsNeg, shiftRightBB, shiftLeftBB);
 
             jit.builder->SetInsertPoint(shiftRightBB);
@@ -1903,7 +1945,7 @@ void MethodCompiler::compileSmallIntPrimitive(TJITContext& jit,
             jit.builder->CreateCondBr(shiftLeftFailed, primitiveFailedBB, shiftResultBB);
 
             jit.builder->SetInsertPoint(shiftResultBB);
-            PHINode* const phi = jit.builder->CreatePHI(jit.builder->getInt32Ty(), 2);
+            PHINode* const phi = jit.builder->CreatePHI(m_baseTypes.word, 2);
             phi->addIncoming(shiftRightResult, shiftRightBB);
             phi->addIncoming(shiftLeftResult, shiftLeftBB);
 
@@ -1912,6 +1954,72 @@ void MethodCompiler::compileSmallIntPrimitive(TJITContext& jit,
     }
 }
 
+void MethodCompiler::compileFloatPrimitive(TJITContext& jit,
+                                         uint8_t opcode,
+                                         Value* leftObject,
+                                         Value* rightObject,
+                                         Value*& primitiveResult,
+                                         BasicBlock* primitiveFailedBB)
+{
+    // Only Float operands are handled here. Method body converts the rest.
+    Value* const floatClass = getKnownClass(jit, TClassRegistry::floatClass);
+
+    Value* const leftClass    = jit.builder->CreateCall(m_baseFunctions.getObjectClass, leftObject);
+    Value* const rightClass   = jit.builder->CreateCall(m_baseFunctions.getObjectClass, rightObject);
+    Value* const leftIsFloat  = jit.builder->CreateICmpEQ(leftClass, floatClass);
+    Value* const rightIsFloat = jit.builder->CreateICmpEQ(rightClass, floatClass);
+
+    BasicBlock* areFloatsBB = BasicBlock::Create(m_JITModule->getContext(), "areFloats", jit.function);
+    jit.builder->CreateCondBr(jit.builder->CreateAnd(leftIsFloat, rightIsFloat), areFloatsBB, primitiveFailedBB);
+
+    jit.builder->SetInsertPoint(areFloatsBB);
+    Type* const doubleType = jit.builder->getDoubleTy();
+
+    // Objects are aligned to the word only
+    Value* const leftFields  = jit.builder->CreateCall(m_baseFunctions.getObjectFields, leftObject);
+    Value* const rightFields = jit.builder->CreateCall(m_baseFunctions.getObjectFields, rightObject);
+    LoadInst* const leftOperand  = jit.builder->CreateLoad(jit.builder->CreateBitCast(leftFields, doubleType->getPointerTo()));
+    LoadInst* const rightOperand = jit.builder->CreateLoad(jit.builder->CreateBitCast(rightFields, doubleType->getPointerTo()));
+    leftOperand->setAlignment(sizeof(TObject*));
+    rightOperand->setAlignment(sizeof(TObject*));
+
+    Value* floatResult = 0;
+    switch(opcode) {
+        case primitive::floatAdd: floatResult = jit.builder->CreateFAdd(leftOperand, rightOperand); break;
+        case primitive::floatSub: floatResult = jit.builder->CreateFSub(leftOperand, rightOperand); break;
+        case primitive::floatMul: floatResult = jit.builder->CreateFMul(leftOperand, rightOperand); break;
+
+        case primitive::floatDiv: {
+            Value* const isZero = jit.builder->CreateFCmpOEQ(rightOperand, ConstantFP::get(doubleType, 0.0));
+            BasicBlock*  divBB  = BasicBlock::Create(m_JITModule->getContext(), "fdiv", jit.function);
+            jit.builder->CreateCondBr(isZero, primitiveFailedBB, divBB);
+
+            jit.builder->SetInsertPoint(divBB);
+            floatResult = jit.builder->CreateFDiv(leftOperand, rightOperand);
+        } break;
+
+        case primitive::floatLess: {
+            Value* const condition = jit.builder->CreateFCmpOLT(leftOperand, rightOperand);
+            primitiveResult = jit.builder->CreateSelect(condition, m_globals.trueObject, m_globals.falseObject);
+        } return;
+        case primitive::floatEqual: {
+            Value* const condition = jit.builder->CreateFCmpOEQ(leftOperand, rightOperand);
+            primitiveResult = jit.builder->CreateSelect(condition, m_globals.trueObject, m_globals.falseObject);
+        } return;
+    }
+
+    // Boxing the result. Operands are not used after the allocation, so GC can't harm them.
+    Value* const dataSize   = ConstantInt::get(m_baseTypes.word, sizeof(double));
+    Value* const newFloat   = jit.builder->CreateCall2(m_runtimeAPI.newBinaryObject, floatClass, dataSize, "float.");
+    Value* const floatObject = jit.builder->CreateBitCast(newFloat, m_baseTypes.object->getPointerTo());
+    Value* const floatFields = jit.builder->CreateCall(m_baseFunctions.getObjectFields, floatObject);
+
+    StoreInst* const store = jit.builder->CreateStore(floatResult, jit.builder->CreateBitCast(floatFields, doubleType->getPointerTo()));
+    store->setAlignment(sizeof(TObject*));
+
+    primitiveResult = floatObject;
+}
+
 MethodCompiler::TStackObject MethodCompiler::allocateStackObject(llvm::IRBuilder<>& builder, uint32_t baseSize, uint32_t fieldsCount)
 {
     // Storing current edit location
@@ -1925,7 +2033,7 @@ MethodCompiler::TStackObject MethodCompiler::allocateStackObject(llvm::IRBuilder
     // Allocating the object slot
     const uint32_t  holderSize = baseSize + sizeof(TObject*) * fieldsCount;
     AllocaInst* const objectSlot = builder.CreateAlloca(builder.getInt8Ty(), builder.getInt32(holderSize));
-    objectSlot->setAlignment(4);
+    objectSlot->setAlignment(sizeof(TObject*));
 
     // Allocating object holder in the preamble
     AllocaInst* objectHolder = builder.CreateAlloca(m_baseTypes.object->getPointerTo(), 0, "stackHolder.");
@@ -46,12 +46,13 @@
 
 NonCollectMemoryManager::NonCollectMemoryManager() :
     m_memoryInfo(), m_heapSize(0), m_heapBase(0), m_heapPointer(0),
-    m_staticHeapSize(0), m_staticHeapBase(0), m_staticHeapPointer(0)
+    m_staticHeapSize(0), m_staticHeapBase(0), m_staticHeapPointer(0), m_staticHeapOwned(true)
 {}
 
 NonCollectMemoryManager::~NonCollectMemoryManager()
 {
-    free(m_staticHeapBase);
+    if (m_staticHeapOwned)
+        free(m_staticHeapBase);
     for(std::size_t i = 0; i < m_usedHeaps.size(); i++)
         free( m_usedHeaps[i] );
 }
@@ -68,7 +69,7 @@ bool NonCollectMemoryManager::initializeStaticHeap(size_t staticHeapSize)
 
     m_staticHeapBase = heap;
     m_staticHeapPointer = heap + staticHeapSize;
-    m_heapSize = staticHeapSize;
+    m_staticHeapSize = staticHeapSize;
 
     return true;
 }
@@ -106,6 +107,9 @@ void NonCollectMemoryManager::growHeap()
 
     std::memset(heap, 0, m_heapSize);
 
+    // Remembering where the objects of the filled heap start
+    m_usedHeapPointers.push_back(m_heapPointer);
+
     m_heapBase = heap;
     m_heapPointer = heap + m_heapSize;
 
@@ -138,12 +142,23 @@ void* NonCollectMemoryManager::allocate(size_t requestedSize, bool* gcOccured /*
     return m_heapPointer;
 }
 
+void NonCollectMemoryManager::adoptStaticHeap(void* heap, size_t heapSize, size_t usedSize)
+{
+    if (m_staticHeapOwned)
+        free(m_staticHeapBase);
+
+    m_staticHeapBase = static_cast<uint8_t*>(heap);
+    m_staticHeapPointer = m_staticHeapBase + heapSize - usedSize;
+    m_staticHeapSize = heapSize;
+    m_staticHeapOwned = false;
+}
+
 void* NonCollectMemoryManager::staticAllocate(size_t requestedSize)
 {
     uint8_t* newPointer = m_staticHeapPointer - requestedSize;
     if (newPointer < m_staticHeapBase)
     {
-        std::fprintf(stderr, "Could not allocate %u bytes in static heaps\n", requestedSize);
+        std::fprintf(stderr, "Could not allocate %zu bytes in static heaps\n", requestedSize);
         return 0;
     }
     m_staticHeapPointer = newPointer;
@@ -160,3 +175,15 @@ TMemoryManagerInfo NonCollectMemoryManager::getStat() {
 
 }
 
+void NonCollectMemoryManager::walkHeap(IHeapVisitor& visitor)
+{
+    walkRegion(visitor, m_staticHeapPointer, m_staticHeapBase + m_staticHeapSize);
+
+    for (std::size_t i = 0; i < m_usedHeapPointers.size(); i++) {
+        uint8_t* heapBase = static_cast<uint8_t*>(m_usedHeaps[i]);
+        walkRegion(visitor, m_usedHeapPointers[i], heapBase + m_heapSize);
+    }
+
+    walkRegion(visitor, m_heapPointer, m_heapBase + m_heapSize);
+}
+
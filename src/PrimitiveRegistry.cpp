@@ -0,0 +1,229 @@
+/*
+ *    PrimitiveRegistry.cpp
+ *
+ *    Table of the primitives with their properties and loadable native modules
+ *
+ *    LLST (LLVM Smalltalk or Low Level Smalltalk) version 0.4
+ *
+ *    LLST is
+ *        Copyright (C) 2012-2015 by Dmitry Kashitsyn   <korvin@deeptown.org>
+ *        Copyright (C) 2012-2015 by Roman Proskuryakov <humbug@deeptown.org>
+ *
+ *    LLST is based on the LittleSmalltalk which is
+ *        Copyright (C) 1987-2005 by Timothy A. Budd
+ *        Copyright (C) 2007 by Charles R. Childers
+ *        Copyright (C) 2005-2007 by Danny Reinhold
+ *
+ *    Original license of LittleSmalltalk may be found in the LICENSE file.
+ *
+ *
+ *    This file is part of LLST.
+ *    LLST is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    LLST is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with LLST.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <PrimitiveRegistry.h>
+#include <opcodes.h>
+
+#include <cstdio>
+#include <dlfcn.h>
+
+PrimitiveRegistry primitiveRegistry;
+
+const char* const PrimitiveRegistry::MODULE_ENTRY_POINT = "llstRegisterPrimitives";
+
+PrimitiveRegistry::PrimitiveRegistry()
+{
+    const TPrimitiveDescriptor undefined = { 0, 0, -1, TPrimitiveDescriptor::mayCollect };
+    for (std::size_t opcode = 0; opcode < TABLE_SIZE; opcode++)
+        m_table[opcode] = undefined;
+
+    const uint8_t inline_   = TPrimitiveDescriptor::isInlineable;
+    const uint8_t allocates = TPrimitiveDescriptor::mayCollect;
+
+    // Primitives performed by SmalltalkVM::performPrimitive and the JIT runtime
+    addVMOwned(primitive::inAtPut,           "Array>>at:put:",   3, inline_);
+    addVMOwned(primitive::arrayAt,           "Array>>at:",       2, inline_ | TPrimitiveDescriptor::isPure);
+    addVMOwned(primitive::startNewProcess,   "startNewProcess",  2, inline_ | allocates);
+    addVMOwned(primitive::allocateObject,    "allocateObject",   2, inline_ | allocates);
+    addVMOwned(primitive::blockInvoke,       "Block>>value",    -1, inline_ | allocates);
+    addVMOwned(primitive::throwError,        "throwError",       0, inline_);
+    addVMOwned(primitive::allocateByteArray, "allocateBytes",    2, inline_ | allocates);
+    addVMOwned(primitive::cloneByteObject,   "cloneBytes",       2, inline_ | allocates);
+    addVMOwned(primitive::flushCache,        "flushCache",       0, 0);
+    addVMOwned(primitive::bulkReplace,       "bulkReplace",     -1, inline_);
+    addVMOwned(primitive::shallowCopy,       "shallowCopy",      1, allocates);
+    addVMOwned(primitive::deepCopy,          "deepCopy",         2, allocates);
+    addVMOwned(primitive::serializeGraph,    "serialize",        1, allocates);
+    addVMOwned(primitive::materializeGraph,  "materialize",      1, allocates);
+    addVMOwned(primitive::bufferAppend,      "bufferAppend",     2, allocates);
+    addVMOwned(primitive::bufferAppendByte,  "bufferAppendByte", 2, allocates);
+    addVMOwned(primitive::bufferAppendInt,   "bufferAppendInt",  2, allocates);
+    addVMOwned(primitive::bufferFreeze,      "bufferFreeze",     1, allocates);
+
+    const uint8_t integerOpcodes[] = {
+        primitive::integerDiv, primitive::integerMod, primitive::integerAdd, primitive::integerMul,
+        primitive::integerSub, primitive::integerLess, primitive::integerEqual,
+        primitive::integerAsSmallInt, primitive::integerTruncSmallInt, primitive::integerPrintString
+    };
+    for (std::size_t i = 0; i < sizeof(integerOpcodes); i++)
+        addVMOwned(integerOpcodes[i], "Integer", -1, allocates | TPrimitiveDescriptor::isPure);
+    // JIT returns the argument as is
+    addVMOwned(primitive::integerNew, "Integer new", 1, inline_ | allocates | TPrimitiveDescriptor::isPure);
+
+    for (uint8_t opcode = primitive::floatAdd; opcode <= primitive::floatParse; opcode++) {
+        const uint8_t inlined = (opcode <= primitive::floatEqual) ? inline_ : 0;
+        addVMOwned(opcode, "Float", -1, inlined | allocates | TPrimitiveDescriptor::isPure);
+    }
+
+    addVMOwned(primitive::symbolIntern,      "Symbol intern",    1, allocates);
+    addVMOwned(primitive::heapCensus,        "heapCensus",       0, allocates);
+    addVMOwned(primitive::heapDump,          "heapDump",         1, allocates);
+    addVMOwned(primitive::saveImage,         "saveImage",        2, allocates);
+    addVMOwned(primitive::methodSource,      "methodSource",     1, allocates);
+
+    // Mapped files live outside of the heap
+    addVMOwned(primitive::ioFileMap,         "File map",         2, 0);
+    addVMOwned(primitive::ioFileMapSlice,    "File mapSlice",    3, 0);
+    addVMOwned(primitive::ioFileUnmap,       "File unmap",       1, 0);
+    // Result of the foreign function is copied to the new string
+    addVMOwned(primitive::ffiCallString,     "FFI callString",   3, allocates);
+    // Waiting switches to another process
+    addVMOwned(primitive::ioWait,            "File wait",        2, allocates);
+    addVMOwned(primitive::ioPoll,            "File poll",        1, allocates);
+    // Closing forgets the waiting processes
+    addVMOwned(primitive::ioFileClose,       "File close",       1, 0);
+
+    // FIXME opcodes 247-255 are not standard
+    addVMOwned(247,                          "jitOnce",          1, allocates);
+    addVMOwned(248,                          "jitStatistics",    0, 0);
+    addVMOwned(249,                          "printMethod",      1, 0);
+    addVMOwned(250,                          "patchHotMethods",  0, allocates);
+    addVMOwned(251,                          "readline",         1, allocates);
+    addVMOwned(primitive::LLVMsendMessage,   "sendMessage",      2, inline_ | allocates);
+    addVMOwned(254,                          "collectGarbage",   0, allocates);
+    addVMOwned(255,                          "debugTrap",        0, 0);
+
+    registerStandardPrimitives(*this);
+}
+
+void PrimitiveRegistry::addVMOwned(uint8_t opcode, const char* name, int8_t arity, uint8_t flags)
+{
+    add(opcode, name, 0, arity, flags | TPrimitiveDescriptor::isVMOwned);
+}
+
+bool PrimitiveRegistry::add(uint8_t opcode, const char* name, TPrimitiveFunction function, int8_t arity, uint8_t flags)
+{
+    TPrimitiveDescriptor& descriptor = m_table[opcode];
+    if (descriptor.isDefined() || !name)
+        return false;
+
+    descriptor.name     = name;
+    descriptor.function = function;
+    descriptor.arity    = arity;
+    descriptor.flags    = flags;
+    return true;
+}
+
+bool PrimitiveRegistry::addNamed(const std::string& name, TPrimitiveFunction function, int8_t arity, uint8_t flags /*= 0*/)
+{
+    if (name.empty() || !function || m_named.find(name) != m_named.end())
+        return false;
+
+    // Native modules have no access to the heap
+    if (flags & (TPrimitiveDescriptor::mayCollect | TPrimitiveDescriptor::isVMOwned))
+        return false;
+
+    TNamedPrimitive& primitive = m_named[name];
+    primitive.name = name;
+
+    const TPrimitiveDescriptor descriptor = { primitive.name.c_str(), function, arity, flags };
+    primitive.descriptor = descriptor;
+    return true;
+}
+
+const TPrimitiveDescriptor* PrimitiveRegistry::findNamed(const std::string& name) const
+{
+    TNamedPrimitives::const_iterator iPrimitive = m_named.find(name);
+    return (iPrimitive != m_named.end()) ? &iPrimitive->second.descriptor : 0;
+}
+
+bool PrimitiveRegistry::loadModule(const std::string& path)
+{
+    void* const handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        std::fprintf(stderr, "Could not load the native module: %s\n", dlerror());
+        return false;
+    }
+
+    // ISO C++ forbids the direct cast of the object pointer to the function pointer
+    TModuleEntryPoint entryPoint = 0;
+    void* const symbol = dlsym(handle, MODULE_ENTRY_POINT);
+    std::memcpy(&entryPoint, &symbol, sizeof(entryPoint));
+
+    if (!entryPoint) {
+        std::fprintf(stderr, "Native module %s does not export %s\n", path.c_str(), MODULE_ENTRY_POINT);
+        dlclose(handle);
+        return false;
+    }
+
+    entryPoint(*this);
+    m_modules.push_back(handle);
+    return true;
+}
+
+TObject* PrimitiveRegistry::call(uint8_t opcode, TObjectArray& args, bool& primitiveFailed) const
+{
+    const TPrimitiveDescriptor& descriptor = m_table[opcode];
+
+    if (!descriptor.function) {
+        primitiveFailed = true;
+        if (!descriptor.isDefined())
+            std::fprintf(stderr, "Unimplemented or invalid primitive %d\n", opcode);
+        return globals.nilObject;
+    }
+
+    if (!descriptor.acceptsArguments(args.getSize())) {
+        primitiveFailed = true;
+        return globals.nilObject;
+    }
+
+    return descriptor.function(opcode, args, primitiveFailed);
+}
+
+TObject* PrimitiveRegistry::callNamed(TObjectArray& args, bool& primitiveFailed) const
+{
+    // Name of the primitive is followed by the arguments
+    const std::size_t argumentsCount = args.getSize() - 1;
+    TObject* const name = args[0];
+
+    if (isSmallInteger(name) || !name->isBinary() || argumentsCount > TStackArguments::MAX_COUNT) {
+        primitiveFailed = true;
+        return globals.nilObject;
+    }
+
+    const std::string key(reinterpret_cast<const char*>(static_cast<TByteObject*>(name)->getBytes()), name->getSize());
+    const TPrimitiveDescriptor* const descriptor = findNamed(key);
+    if (!descriptor || !descriptor->acceptsArguments(argumentsCount)) {
+        primitiveFailed = true;
+        return globals.nilObject;
+    }
+
+    // Named primitives do not collect garbage, so the arguments may stay on the stack
+    TStackArguments arguments(argumentsCount);
+    for (std::size_t index = 0; index < argumentsCount; index++)
+        arguments[index] = args[index + 1];
+
+    return descriptor->function(primitive::callNamed, *arguments, primitiveFailed);
+}
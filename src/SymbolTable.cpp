@@ -0,0 +1,153 @@
+/*
+ *    SymbolTable.cpp
+ *
+ *    Native table of the interned symbols
+ *
+ *    LLST (LLVM Smalltalk or Low Level Smalltalk) version 0.4
+ *
+ *    LLST is
+ *        Copyright (C) 2012-2015 by Dmitry Kashitsyn   <korvin@deeptown.org>
+ *        Copyright (C) 2012-2015 by Roman Proskuryakov <humbug@deeptown.org>
+ *
+ *    LLST is based on the LittleSmalltalk which is
+ *        Copyright (C) 1987-2005 by Timothy A. Budd
+ *        Copyright (C) 2007 by Charles R. Childers
+ *        Copyright (C) 2005-2007 by Danny Reinhold
+ *
+ *    Original license of LittleSmalltalk may be found in the LICENSE file.
+ *
+ *
+ *    This file is part of LLST.
+ *    LLST is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    LLST is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with LLST.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <SymbolTable.h>
+#include <memory.h>
+#include <cstring>
+
+namespace {
+
+// Symbol table is the class variable of Symbol. Metaclass lists only
+// its own variables which follow the ones inherited from Class.
+TObject* getSymbolsTree(TClass* symbolClass)
+{
+    TSymbolArray* const variables = symbolClass->getClass()->variables;
+    if (isSmallInteger(variables) || variables == globals.nilObject || variables->getSize() > symbolClass->getSize())
+        return 0;
+
+    const std::size_t firstVariable = symbolClass->getSize() - variables->getSize();
+    for (std::size_t i = 0; i < variables->getSize(); i++) {
+        if (variables->getField(i)->toString() == "symbols")
+            return symbolClass->getField(firstVariable + i);
+    }
+
+    return 0;
+}
+
+} // namespace
+
+bool SymbolTable::build(TClass* symbolClass)
+{
+    clear();
+
+    TObject* const tree = symbolClass ? getSymbolsTree(symbolClass) : 0;
+    if (!tree || isSmallInteger(tree) || tree->isBinary() || tree->getSize() < 1)
+        return false;
+
+    // Symbols are added to the tree in order, so it may be as deep as it is large
+    std::vector<TNode*> path;
+    TNode* node = static_cast<TNode*>(tree->getField(0));
+    while (node != globals.nilObject || !path.empty()) {
+        if (node != globals.nilObject) {
+            path.push_back(node);
+            node = node->left;
+            continue;
+        }
+
+        node = path.back();
+        path.pop_back();
+        if (!isSmallInteger(node->value) && node->value->getClass() == symbolClass)
+            insert(static_cast<TSymbol*>(node->value));
+        node = node->right;
+    }
+
+    m_built = true;
+    return true;
+}
+
+void SymbolTable::clear()
+{
+    for (std::size_t i = 0; i < m_symbols.size(); i++) {
+        if (m_symbols[i].isRoot)
+            m_memoryManager->removeStaticRoot(&m_symbols[i].symbol);
+    }
+
+    m_symbols.clear();
+    m_slots.clear();
+    m_mask = 0;
+    m_built = false;
+}
+
+TSymbol* SymbolTable::find(const uint8_t* bytes, std::size_t size) const
+{
+    if (m_slots.empty())
+        return 0;
+
+    const uint32_t hash = TSymbol::getHash(bytes, size);
+    for (uint32_t slot = hash & m_mask; m_slots[slot].position; slot = (slot + 1) & m_mask) {
+        if (m_slots[slot].hash != hash)
+            continue;
+
+        TSymbol* const symbol = static_cast<TSymbol*>(m_symbols[m_slots[slot].position - 1].symbol);
+        if (symbol->getSize() == size && std::memcmp(symbol->getBytes(), bytes, size) == 0)
+            return symbol;
+    }
+
+    return 0;
+}
+
+void SymbolTable::insert(TSymbol* symbol)
+{
+    // Table is at most half full, so probe sequences are short
+    if ((m_symbols.size() + 1) * 2 > m_slots.size())
+        rehash(m_slots.empty() ? 1024 : m_slots.size() * 2);
+
+    const TEntry entry = { symbol, !m_memoryManager->isInStaticHeap(symbol) };
+    m_symbols.push_back(entry);
+    if (entry.isRoot)
+        m_memoryManager->addStaticRoot(&m_symbols.back().symbol);
+
+    addSlot(symbol->getHash(), m_symbols.size());
+}
+
+void SymbolTable::addSlot(uint32_t hash, uint32_t position)
+{
+    uint32_t slot = hash & m_mask;
+    while (m_slots[slot].position)
+        slot = (slot + 1) & m_mask;
+
+    m_slots[slot].hash = hash;
+    m_slots[slot].position = position;
+}
+
+void SymbolTable::rehash(std::size_t capacity)
+{
+    const TSlot empty = { 0, 0 };
+    m_slots.assign(capacity, empty);
+    m_mask = capacity - 1;
+
+    for (std::size_t i = 0; i < m_symbols.size(); i++)
+        addSlot(static_cast<TSymbol*>(m_symbols[i].symbol)->getHash(), i + 1);
+}
@@ -34,6 +34,135 @@
 
 #include <types.h>
 #include <algorithm>
+#include <vector>
+
+#if __SIZEOF_POINTER__ > 4
+
+namespace {
+
+// Open addressing table over the keys array of a dictionary. Each slot holds
+// the hash of the key and its position plus one. Zero position marks an empty
+// slot. Table is at most half full, so probe sequences are short.
+struct TDictionaryIndex {
+    struct TSlot {
+        uint32_t hash;
+        uint32_t position;
+    };
+
+    std::size_t         keysCount;
+    uint32_t            mask;
+    std::vector<TSlot>  slots;
+
+    TDictionaryIndex() : keysCount(0), mask(0) { }
+
+    void build(const TSymbolArray* keys);
+};
+
+void TDictionaryIndex::build(const TSymbolArray* keys)
+{
+    keysCount = keys->getSize();
+
+    std::size_t capacity = 8;
+    while (capacity < keysCount * 2)
+        capacity *= 2;
+
+    const TSlot empty = { 0, 0 };
+    slots.assign(capacity, empty);
+    mask = capacity - 1;
+
+    for (std::size_t position = 0; position < keysCount; position++) {
+        // Only symbols are looked up from the VM
+        TSymbol* const key = const_cast<TSymbolArray*>(keys)->getField(position);
+        if (isSmallInteger(key) || !key->isBinary())
+            continue;
+
+        const uint32_t hash = key->getHash();
+        uint32_t slot = hash & mask;
+        while (slots[slot].position)
+            slot = (slot + 1) & mask;
+
+        slots[slot].hash = hash;
+        slots[slot].position = position + 1;
+    }
+}
+
+// Index belongs to the keys array, because dictionaries replace the array
+// whenever a key is added or removed. The header of the keys array holds
+// the tag of its index. Header moves with the object, so indices survive
+// the GC. Tags are not reused after the flush, so the stale ones are
+// recognized as such.
+std::vector<TDictionaryIndex> dictionaryIndices;
+uint32_t firstIndexTag = 1;
+
+const TDictionaryIndex& getIndex(const TDictionary* dictionary)
+{
+    TSymbolArray* const keys = dictionary->keys;
+
+    const uint32_t tag = keys->getHeaderHash();
+    if (tag >= firstIndexTag && tag - firstIndexTag < dictionaryIndices.size()) {
+        const TDictionaryIndex& index = dictionaryIndices[tag - firstIndexTag];
+        if (index.keysCount == keys->getSize())
+            return index;
+    }
+
+    dictionaryIndices.push_back(TDictionaryIndex());
+    dictionaryIndices.back().build(keys);
+    keys->setHeaderHash(firstIndexTag + dictionaryIndices.size() - 1);
+
+    return dictionaryIndices.back();
+}
+
+inline uint32_t getKeyHash(const TSymbol* key) { return key->getHash(); }
+inline uint32_t getKeyHash(const char* key) { return TSymbol::getHash(key); }
+
+// Symbols are unique, so comparing the contents is rarely needed
+inline bool isEqual(const TSymbol* symbol, const TSymbol* key)
+{
+    return symbol == key
+        || (symbol->getSize() == key->getSize() && std::memcmp(symbol->getBytes(), key->getBytes(), key->getSize()) == 0);
+}
+
+inline bool isEqual(const TSymbol* symbol, const char* key)
+{
+    return std::strncmp(reinterpret_cast<const char*>(symbol->getBytes()), key, symbol->getSize()) == 0
+        && key[symbol->getSize()] == 0;
+}
+
+} // namespace
+
+template<typename K>
+TObject* TDictionary::find(const K* key) const
+{
+    return find(key, getKeyHash(key));
+}
+
+template<typename K>
+TObject* TDictionary::find(const K* key, uint32_t hash) const
+{
+    const TDictionaryIndex& index = getIndex(this);
+
+    for (uint32_t slot = hash & index.mask; index.slots[slot].position; slot = (slot + 1) & index.mask) {
+        if (index.slots[slot].hash != hash)
+            continue;
+
+        const uint32_t position = index.slots[slot].position - 1;
+        if (isEqual(keys->getField(position), key))
+            return values->getField(position);
+    }
+
+    return 0; // key not found
+}
+
+void TDictionary::flushIndices()
+{
+    firstIndexTag += dictionaryIndices.size();
+    dictionaryIndices.clear();
+}
+
+#else
+
+// There is no room for the tag in the header, so dictionaries are searched
+// in the order of the keys
 
 template<typename K>
 TObject* TDictionary::find(const K* key) const
@@ -54,5 +183,17 @@ TObject* TDictionary::find(const K* key) const
         return 0; // key not found
 }
 
+template<typename K>
+TObject* TDictionary::find(const K* key, uint32_t /*hash*/) const
+{
+    return find(key);
+}
+
+void TDictionary::flushIndices() { }
+
+#endif
+
 template TObject* TDictionary::find<char>(const char* key) const;
 template TObject* TDictionary::find<TSymbol>(const TSymbol* key) const;
+template TObject* TDictionary::find<char>(const char* key, uint32_t hash) const;
+template TObject* TDictionary::find<TSymbol>(const TSymbol* key, uint32_t hash) const;
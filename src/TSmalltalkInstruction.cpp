@@ -1,4 +1,5 @@
 #include <instructions.h>
+#include <PrimitiveRegistry.h>
 #include <stdexcept>
 
 bool st::TSmalltalkInstruction::isTerminator() const
@@ -95,9 +96,12 @@ bool st::TSmalltalkInstruction::mayCauseGC() const {
 //         case opcode::sendUnary:
         case opcode::sendBinary:
         case opcode::sendMessage:
-        case opcode::doPrimitive:
             return true;
 
+        case opcode::doPrimitive:
+            // Unknown primitives are expected to collect
+            return primitiveRegistry[static_cast<uint8_t>(m_extra)].mayCollectGarbage();
+
         case opcode::doSpecial:
             // The only special that may cause GC
             return m_argument == special::sendToSuper;
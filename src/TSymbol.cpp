@@ -62,3 +62,45 @@ bool TSymbol::TCompareFunctor::operator() (const char* left, const TSymbol* righ
 
     return std::lexicographical_compare(left, left + std::strlen(left), rightBase, rightEnd);
 }
+
+namespace {
+
+const uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+
+inline uint64_t rotateLeft(uint64_t value, int bits) { return (value << bits) | (value >> (64 - bits)); }
+
+// Text is not aligned, memcpy is turned into a single load
+inline uint64_t readWord(const uint8_t* text)
+{
+    uint64_t word;
+    std::memcpy(&word, text, sizeof(word));
+    return word;
+}
+
+} // namespace
+
+uint32_t TSymbol::getHash(const uint8_t* text, std::size_t size)
+{
+    // Word at a time mixing in the manner of xxHash64
+    uint64_t hash = PRIME3 + size * PRIME1;
+
+    const uint8_t* const end = text + size;
+    for (; text + sizeof(uint64_t) <= end; text += sizeof(uint64_t))
+        hash = rotateLeft(hash ^ rotateLeft(readWord(text) * PRIME2, 31) * PRIME1, 27) * PRIME1 + PRIME3;
+
+    for (; text < end; text++)
+        hash = rotateLeft(hash ^ (*text * PRIME3), 11) * PRIME1;
+
+    // Final avalanche, so every input bit affects the low bits used by the tables
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    hash ^= hash >> 32;
+
+    // Zero is reserved for the unknown hash in the object header
+    const uint32_t result = static_cast<uint32_t>(hash);
+    return result ? result : 1;
+}
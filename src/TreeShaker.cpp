@@ -0,0 +1,363 @@
+/*
+ *    TreeShaker.cpp
+ *
+ *    Removes classes, methods and symbols that are not reachable
+ *    from the given roots, so that a minimal image may be written
+ *
+ *    LLST (LLVM Smalltalk or Low Level Smalltalk) version 0.4
+ *
+ *    LLST is
+ *        Copyright (C) 2012-2015 by Dmitry Kashitsyn   <korvin@deeptown.org>
+ *        Copyright (C) 2012-2015 by Roman Proskuryakov <humbug@deeptown.org>
+ *
+ *    LLST is based on the LittleSmalltalk which is
+ *        Copyright (C) 1987-2005 by Timothy A. Budd
+ *        Copyright (C) 2007 by Charles R. Childers
+ *        Copyright (C) 2005-2007 by Danny Reinhold
+ *
+ *    Original license of LittleSmalltalk may be found in the LICENSE file.
+ *
+ *
+ *    This file is part of LLST.
+ *    LLST is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    LLST is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with LLST.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <TreeShaker.h>
+
+#include <cstdio>
+#include <algorithm>
+
+TreeShaker::TreeShaker(const Image& image)
+    : m_image(image), m_classClass(0), m_symbolClass(0), m_symbolTable(0), m_symbolTableIndex(0)
+{ }
+
+bool TreeShaker::isClass(TObject* object) const
+{
+    if (!object || isSmallInteger(object) || object->isBinary())
+        return false;
+
+    // Metaclasses are instances of Class, classes are instances of metaclasses
+    TClass* const klass = object->getClass();
+    return klass == m_classClass || klass->getClass() == m_classClass;
+}
+
+bool TreeShaker::isLiveSelector(TSymbol* selector) const
+{
+    return m_liveSelectors.find(selector) != m_liveSelectors.end()
+        || m_rootSelectors.find(selector->toString()) != m_rootSelectors.end();
+}
+
+void TreeShaker::mark(TObject* object)
+{
+    if (object && !isSmallInteger(object))
+        m_pending.push_back(object);
+}
+
+void TreeShaker::markPending()
+{
+    while (! m_pending.empty()) {
+        TObject* const object = m_pending.back();
+        m_pending.pop_back();
+
+        if (! m_marked.insert(object).second)
+            continue;
+
+        mark(object->getClass());
+
+        // Any reachable symbol may be sent as a message, e.g. via perform:
+        if (object->getClass() == m_symbolClass)
+            m_liveSelectors.insert(object);
+
+        if (object->isBinary())
+            continue;
+
+        // Classes stored in the globals are not roots by themselves.
+        // Keys are marked when the dictionary is filtered.
+        if (object == globals.globalsObject) {
+            TDictionary* const dictionary = globals.globalsObject;
+            m_marked.insert(dictionary->keys);
+            m_marked.insert(dictionary->values);
+
+            for (std::size_t i = 0; i < dictionary->values->getSize(); i++) {
+                TObject* const value = dictionary->values->getField(i);
+                if (! isClass(value))
+                    mark(value);
+            }
+            continue;
+        }
+
+        // Methods of the class are marked by selectors, see markMethods()
+        TObject** skippedField = 0;
+        if (isClass(object)) {
+            TClass* const klass = static_cast<TClass*>(object);
+            m_liveClasses.push_back(klass);
+            skippedField = reinterpret_cast<TObject**>(&klass->methods);
+        }
+
+        for (std::size_t i = 0; i < object->getSize(); i++) {
+            if (&object->getFields()[i] == skippedField)
+                continue;
+
+            if (object == m_symbolClass && m_symbolTable && i == m_symbolTableIndex)
+                continue;
+
+            mark(object->getField(i));
+        }
+    }
+}
+
+bool TreeShaker::markMethods()
+{
+    bool marked = false;
+
+    for (std::size_t i = 0; i < m_liveClasses.size(); i++) {
+        TDictionary* const methods = m_liveClasses[i]->methods;
+        if (isSmallInteger(methods) || methods == globals.nilObject)
+            continue;
+
+        for (std::size_t j = 0; j < methods->keys->getSize(); j++) {
+            TObject* const method = methods->values->getField(j);
+            if (m_marked.find(method) != m_marked.end())
+                continue;
+
+            if (isLiveSelector(static_cast<TSymbol*>(methods->keys->getField(j)))) {
+                mark(method);
+                marked = true;
+            }
+        }
+    }
+
+    return marked;
+}
+
+TObject* TreeShaker::newObject(TClass* klass, std::size_t fieldsCount)
+{
+    m_objects.push_back(std::vector<TObject*>(sizeof(TObject) / sizeof(TObject*) + fieldsCount));
+
+    TObject* const object = new (&m_objects.back()[0]) TObject(fieldsCount, klass);
+    for (std::size_t i = 0; i < fieldsCount; i++)
+        object->putField(i, globals.nilObject);
+
+    return object;
+}
+
+TDictionary* TreeShaker::filterDictionary(TDictionary* dictionary, const std::vector<bool>& keep)
+{
+    const std::size_t keptCount = std::count(keep.begin(), keep.end(), true);
+    if (keptCount == keep.size())
+        return dictionary;
+
+    // Keys stay sorted, so binary search still works
+    TObject* const keys   = newObject(dictionary->keys->getClass(), keptCount);
+    TObject* const values = newObject(dictionary->values->getClass(), keptCount);
+
+    for (std::size_t i = 0, kept = 0; i < keep.size(); i++) {
+        if (! keep[i])
+            continue;
+
+        keys->putField(kept, dictionary->keys->getField(i));
+        values->putField(kept, dictionary->values->getField(i));
+        kept++;
+    }
+
+    TDictionary* const result = static_cast<TDictionary*>(newObject(dictionary->getClass(), dictionary->getSize()));
+    for (std::size_t i = 0; i < dictionary->getSize(); i++)
+        result->putField(i, dictionary->getField(i));
+
+    result->keys   = static_cast<TSymbolArray*>(keys);
+    result->values = static_cast<TObjectArray*>(values);
+    return result;
+}
+
+void TreeShaker::shakeMethods()
+{
+    for (std::size_t i = 0; i < m_liveClasses.size(); i++) {
+        TClass* const klass = m_liveClasses[i];
+        TDictionary* const methods = klass->methods;
+        if (isSmallInteger(methods) || methods == globals.nilObject)
+            continue;
+
+        std::vector<bool> keep(methods->keys->getSize());
+        for (std::size_t j = 0; j < keep.size(); j++) {
+            TObject* const selector = methods->keys->getField(j);
+            keep[j] = m_marked.find(methods->values->getField(j)) != m_marked.end();
+
+            if (keep[j])
+                m_marked.insert(selector);
+            else
+                m_report.removedMethods.push_back(klass->name->toString() + ">>" + static_cast<TSymbol*>(selector)->toString());
+        }
+
+        klass->methods = filterDictionary(methods, keep);
+    }
+}
+
+void TreeShaker::shakeGlobals()
+{
+    TDictionary* const dictionary = globals.globalsObject;
+
+    std::vector<bool> keep(dictionary->keys->getSize());
+    for (std::size_t i = 0; i < keep.size(); i++) {
+        TObject* const value = dictionary->values->getField(i);
+        keep[i] = !isClass(value) || m_marked.find(value) != m_marked.end();
+
+        if (keep[i])
+            m_marked.insert(dictionary->keys->getField(i));
+        else
+            m_report.removedClasses.push_back(static_cast<TSymbol*>(dictionary->keys->getField(i))->toString());
+    }
+
+    globals.globalsObject = filterDictionary(dictionary, keep);
+}
+
+void TreeShaker::collectSymbols(TObject* root, std::vector<TObject*>& symbols)
+{
+    // Symbols are added to the tree in order, so it may be as deep as it is large
+    std::vector<TNode*> path;
+    TNode* node = static_cast<TNode*>(root);
+
+    while (node != globals.nilObject || !path.empty()) {
+        if (node != globals.nilObject) {
+            path.push_back(node);
+            node = node->left;
+            continue;
+        }
+
+        node = path.back();
+        path.pop_back();
+        symbols.push_back(node->value);
+        node = node->right;
+    }
+}
+
+TObject* TreeShaker::buildTree(TClass* nodeClass, const std::vector<TObject*>& symbols, std::size_t first, std::size_t last)
+{
+    if (first >= last)
+        return globals.nilObject;
+
+    const std::size_t middle = first + (last - first) / 2;
+
+    TNode* const node = static_cast<TNode*>(newObject(nodeClass, 3));
+    node->value = symbols[middle];
+    node->left  = static_cast<TNode*>(buildTree(nodeClass, symbols, first, middle));
+    node->right = static_cast<TNode*>(buildTree(nodeClass, symbols, middle + 1, last));
+    return node;
+}
+
+void TreeShaker::shakeSymbols()
+{
+    if (! m_symbolTable)
+        return;
+
+    TObject* const root = m_symbolTable->getField(0);
+    if (root == globals.nilObject)
+        return;
+
+    std::vector<TObject*> symbols;
+    collectSymbols(root, symbols);
+
+    // Tree stays sorted and becomes balanced
+    std::vector<TObject*> liveSymbols;
+    for (std::size_t i = 0; i < symbols.size(); i++) {
+        if (m_marked.find(symbols[i]) != m_marked.end())
+            liveSymbols.push_back(symbols[i]);
+    }
+
+    m_report.keptSymbols = liveSymbols.size();
+    m_report.removedSymbols = symbols.size() - liveSymbols.size();
+    m_symbolTable->putField(0, buildTree(root->getClass(), liveSymbols, 0, liveSymbols.size()));
+}
+
+bool TreeShaker::shake()
+{
+    m_classClass  = m_image.getGlobal<TClass>(TClass::InstanceClassName());
+    m_symbolClass = m_image.getGlobal<TClass>(TSymbol::InstanceClassName());
+    if (!m_classClass || !m_symbolClass)
+        return false;
+
+    // Symbol table is the class variable of Symbol. Metaclass lists only
+    // its own variables which follow the ones inherited from Class.
+    TSymbolArray* const variables = m_symbolClass->getClass()->variables;
+    if (!isSmallInteger(variables) && variables != globals.nilObject && variables->getSize() <= m_symbolClass->getSize()) {
+        const std::size_t firstVariable = m_symbolClass->getSize() - variables->getSize();
+        for (std::size_t i = 0; i < variables->getSize(); i++) {
+            if (static_cast<TSymbol*>(variables->getField(i))->toString() == "symbols") {
+                m_symbolTableIndex = firstVariable + i;
+                m_symbolTable = m_symbolClass->getField(m_symbolTableIndex);
+            }
+        }
+    }
+
+    if (m_symbolTable) {
+        if (isSmallInteger(m_symbolTable) || m_symbolTable->isBinary() || m_symbolTable->getSize() < 1)
+            return false;
+
+        // Table itself is kept, its nodes are rebuilt by shakeSymbols()
+        m_marked.insert(m_symbolTable);
+        mark(m_symbolTable->getClass());
+    }
+
+    // VM roots, well-known classes are taken from the registry
+    mark(globals.nilObject);
+    mark(globals.trueObject);
+    mark(globals.falseObject);
+    mark(globals.globalsObject);
+    mark(globals.initialMethod);
+    for (int i = 0; i < 3; i++)
+        mark(globals.binaryMessages[i]);
+    mark(globals.badMethodSymbol);
+
+    for (std::size_t i = 0; i < TClassRegistry::classesCount; i++)
+        mark(classRegistry.classes[i]);
+
+    // User roots
+    for (std::set<std::string>::const_iterator iName = m_rootClasses.begin(); iName != m_rootClasses.end(); ++iName) {
+        TObject* const klass = m_image.getGlobal(iName->c_str());
+        if (! isClass(klass)) {
+            std::fprintf(stderr, "Root class %s is not found\n", iName->c_str());
+            return false;
+        }
+        mark(klass);
+    }
+
+    // Methods are reachable by selectors which are reachable by methods
+    do {
+        markPending();
+    } while (markMethods());
+
+    shakeMethods();
+    shakeGlobals();
+    shakeSymbols();
+
+    std::sort(m_report.removedClasses.begin(), m_report.removedClasses.end());
+    std::sort(m_report.removedMethods.begin(), m_report.removedMethods.end());
+    return true;
+}
+
+void TreeShaker::printReport(bool verbose) const
+{
+    std::printf("Removed %zu classes:", m_report.removedClasses.size());
+    for (std::size_t i = 0; i < m_report.removedClasses.size(); i++)
+        std::printf(" %s", m_report.removedClasses[i].c_str());
+    std::printf("\n");
+
+    std::printf("Removed %zu methods\n", m_report.removedMethods.size());
+    if (verbose) {
+        for (std::size_t i = 0; i < m_report.removedMethods.size(); i++)
+            std::printf("    %s\n", m_report.removedMethods[i].c_str());
+    }
+
+    std::printf("Removed %zu symbols, %zu symbols left\n", m_report.removedSymbols, m_report.keptSymbols);
+}
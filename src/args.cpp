@@ -47,6 +47,8 @@ void args::parse(int argc, char **argv)
         heap_max = 'H',
         heap = 'h',
         mm_type = 'm',
+        alloc_profile = 'a',
+        alloc_profile_chains = 'c',
 
         getopt_set_arg = 0,
         getopt_err = '?',
@@ -59,6 +61,8 @@ void args::parse(int argc, char **argv)
         {"heap",       required_argument, 0, heap},
         {"image",      required_argument, 0, image},
         {"mm_type",    required_argument, 0, mm_type},
+        {"alloc_profile",        required_argument, 0, alloc_profile},
+        {"alloc_profile_chains", no_argument,       0, alloc_profile_chains},
         {"help",       no_argument,       0, help},
         {"version",    no_argument,       0, version},
         {0, 0, 0, 0}
@@ -83,7 +87,7 @@ void args::parse(int argc, char **argv)
                 memoryManagerType = optarg;
             } break;
             case heap: {
-                bool good_number = std::istringstream( optarg ) >> heapSize;
+                bool good_number = !(std::istringstream( optarg ) >> heapSize).fail();
                 if (!good_number)
                 {
                     std::cerr << "A malformed number is given for argument heap_size" << std::endl;
@@ -91,13 +95,24 @@ void args::parse(int argc, char **argv)
                 }
             } break;
             case heap_max: {
-                bool good_number = std::istringstream( optarg ) >> maxHeapSize;
+                bool good_number = !(std::istringstream( optarg ) >> maxHeapSize).fail();
                 if (!good_number)
                 {
                     std::cerr << "A malformed number is given for argument max_heap_size" << std::endl;
                     std::exit(1);
                 }
             } break;
+            case alloc_profile: {
+                bool good_number = !(std::istringstream( optarg ) >> allocationProfileInterval).fail();
+                if (!good_number || !allocationProfileInterval)
+                {
+                    std::cerr << "A malformed number is given for argument alloc_profile" << std::endl;
+                    std::exit(1);
+                }
+            } break;
+            case alloc_profile_chains: {
+                allocationProfileChains = true;
+            } break;
             case help: {
                 showHelp = true;
             } break;
@@ -123,6 +138,8 @@ std::string args::getHelp()
         "  -H, --heap_max <number>          Maximum allowed heap size\n"
         "  -i, --image <path>               Path to image\n"
         "      --mm_type arg (=copy)        Choose memory manager. nc - NonCollect, copy - Stop-and-Copy\n"
+        "      --alloc_profile <number>     Sample allocations once per <number> bytes and report at exit\n"
+        "      --alloc_profile_chains       Record whole context chains of the sampled allocations\n"
         "  -V, --version                    Display the version number and copyrights of the invoked LLST\n"
         "      --help                       Display this information and quit";
 }
@@ -37,9 +37,11 @@
 #include <memory>
 #include <tr1/memory>
 #include <cstdlib>
+#include <csignal>
 
 #include <vm.h>
 #include <args.h>
+#include <AllocationProfiler.h>
 
 #include <CompletionEngine.h>
 
@@ -49,6 +51,15 @@
 
 #include <visualization.h>
 
+// Heap census is performed by VM when it is safe to walk the heap
+static void onHeapCensusSignal(int /*signal*/) {
+    SmalltalkVM::requestHeapCensus();
+}
+
+static void onImageSaveSignal(int /*signal*/) {
+    SmalltalkVM::requestImageSave();
+}
+
 int main(int argc, char **argv) {
     args llstArgs;
 
@@ -94,6 +105,17 @@ int main(int argc, char **argv) {
 
     SmalltalkVM vm(smalltalkImage.get(), memoryManager.get());
 
+    // kill -USR1 <pid> prints the class histogram of the live objects
+    std::signal(SIGUSR1, onHeapCensusSignal);
+    // kill -USR2 <pid> saves the snapshot over the loaded image
+    std::signal(SIGUSR2, onImageSaveSignal);
+
+    std::auto_ptr<AllocationProfiler> allocationProfiler;
+    if (llstArgs.allocationProfileInterval) {
+        allocationProfiler.reset(new AllocationProfiler(llstArgs.allocationProfileInterval, llstArgs.allocationProfileChains));
+        vm.setAllocationProfiler(allocationProfiler.get());
+    }
+
     // Creating completion database and filling it with info
     CompletionEngine* completionEngine = CompletionEngine::Instance();
     completionEngine->initialize(globals.globalsObject);
@@ -169,6 +191,9 @@ int main(int argc, char **argv) {
 
     vm.printVMStat();
 
+    if (allocationProfiler.get())
+        allocationProfiler->printReport();
+
 #if defined(LLVM)
     runtime.printStat();
 #endif
@@ -33,20 +33,32 @@
  */
 
 #include <primitives.h>
+#include <PrimitiveRegistry.h>
+#include <ForeignFunctions.h>
 
 #include <memory.h>
 #include <opcodes.h>
 #include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
 #include <sys/time.h>
 #include <ctime>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
 
 TObject* callPrimitive(uint8_t opcode, TObjectArray* arguments, bool& primitiveFailed) {
     primitiveFailed = false;
-    TObjectArray& args = *arguments;
+    return primitiveRegistry.call(opcode, *arguments, primitiveFailed);
+}
 
+static TObject* callObjectPrimitive(uint8_t opcode, TObjectArray& args, bool& /*primitiveFailed*/) {
     switch (opcode)
     {
         case primitive::objectsAreEqual: { // 1
@@ -61,7 +73,7 @@ TObject* callPrimitive(uint8_t opcode, TObjectArray* arguments, bool& primitiveF
 
         case primitive::getClass: { // 2
             TObject* object = args[0];
-            return isSmallInteger(object) ? globals.smallIntClass : object->getClass();
+            return isSmallInteger(object) ? classRegistry[TClassRegistry::smallIntClass] : object->getClass();
         } break;
 
         case primitive::getSize: { // 4
@@ -69,116 +81,175 @@ TObject* callPrimitive(uint8_t opcode, TObjectArray* arguments, bool& primitiveF
             TInteger objectSize = isSmallInteger(object) ? 0 : object->getSize();
             return objectSize;
         } break;
+    }
+    return globals.nilObject;
+}
 
-        case primitive::stringAt:      // 21
-        case primitive::stringAtPut: { // 22
-            TObject* indexObject = 0;
-            TString* string      = 0;
-            TObject* valueObject = 0;
-
-            // If the method is String:at:put then pop a value from the stack
-            if (opcode == primitive::stringAtPut) {
-                indexObject = args[2];
-                string      = args.getField<TString>(1);
-                valueObject = args[0];
-            } else { // String:at:put
-                indexObject = args[1];
-                string      = args.getField<TString>(0);
-                //valueObject is not used in primitive stringAtPut
-            }
-
-            if ( !isSmallInteger(indexObject) || isSmallInteger(string) ) {
-                primitiveFailed = true;
-                break;
-            }
+static TObject* callStringAccessPrimitive(uint8_t opcode, TObjectArray& args, bool& primitiveFailed) {
+    TObject* indexObject = 0;
+    TString* string      = 0;
+    TObject* valueObject = 0;
+
+    // If the method is String:at:put then pop a value from the stack
+    if (opcode == primitive::stringAtPut) {
+        indexObject = args[2];
+        string      = args.getField<TString>(1);
+        valueObject = args[0];
+    } else { // String:at:put
+        indexObject = args[1];
+        string      = args.getField<TString>(0);
+        //valueObject is not used in primitive stringAtPut
+    }
 
-            // Smalltalk indexes arrays starting from 1, not from 0
-            // So we need to recalculate the actual array index before
-            uint32_t actualIndex = TInteger(indexObject) - 1;
+    if ( !isSmallInteger(indexObject) || isSmallInteger(string) ) {
+        primitiveFailed = true;
+        return globals.nilObject;
+    }
 
-            // Checking boundaries
-            if (actualIndex >= string->getSize()) {
-                primitiveFailed = true;
-                break;
-            }
+    // Smalltalk indexes arrays starting from 1, not from 0
+    // So we need to recalculate the actual array index before
+    uint32_t actualIndex = TInteger(indexObject) - 1;
 
-            if (opcode == primitive::stringAt)
-                // String:at
-                return TInteger( string->getByte(actualIndex) );
-            else {
-                // String:at:put
-                TInteger value = TInteger(valueObject);
-                string->putByte(actualIndex, value);
-                return static_cast<TObject*>(string);
-            }
-        } break;
+    // Checking boundaries
+    if (actualIndex >= string->getSize()) {
+        primitiveFailed = true;
+        return globals.nilObject;
+    }
 
-        case primitive::ioGetChar:          // 9
-        case primitive::ioPutChar:          // 3
-        case primitive::ioFileOpen:         // 100
-        case primitive::ioFileClose:        // 103
-        case primitive::ioFileSetStatIntoArray:   // 105
-        case primitive::ioFileReadIntoByteArray:  // 106
-        case primitive::ioFileWriteFromByteArray: // 107
-        case primitive::ioFileSeek: {        // 108
+    if (opcode == primitive::stringAt)
+        // String:at
+        return TInteger( string->getByte(actualIndex) );
+    else {
+        // String:at:put
+        TInteger value = TInteger(valueObject);
+        string->putByte(actualIndex, value);
+        return static_cast<TObject*>(string);
+    }
+}
 
-            return callIOPrimitive(opcode, args, primitiveFailed);
+static TObject* callSmallIntPrimitive(uint8_t opcode, TObjectArray& args, bool& primitiveFailed) {
+    // Loading operand objects
+    TObject* rightObject = args[1];
+    TObject* leftObject  = args[0];
+    if ( !isSmallInteger(leftObject) || !isSmallInteger(rightObject) ) {
+        primitiveFailed = true;
+        return globals.nilObject;
+    }
 
-        } break;
+    // Extracting values
+    intptr_t leftOperand  = TInteger(leftObject);
+    intptr_t rightOperand = TInteger(rightObject);
 
-        case primitive::smallIntAdd:        // 10
-        case primitive::smallIntDiv:        // 11
-        case primitive::smallIntMod:        // 12
-        case primitive::smallIntLess:       // 13
-        case primitive::smallIntEqual:      // 14
-        case primitive::smallIntMul:        // 15
-        case primitive::smallIntSub:        // 16
-        case primitive::smallIntBitOr:      // 36
-        case primitive::smallIntBitAnd:     // 37
-        case primitive::smallIntBitShift: { // 39
-            // Loading operand objects
-            TObject* rightObject = args[1];
-            TObject* leftObject  = args[0];
-            if ( !isSmallInteger(leftObject) || !isSmallInteger(rightObject) ) {
-                primitiveFailed = true;
-                break;
-            }
+    // Performing an operation
+    return callSmallIntPrimitive(opcode, leftOperand, rightOperand, primitiveFailed);
+}
 
-            // Extracting values
-            int32_t leftOperand  = TInteger(leftObject);
-            int32_t rightOperand = TInteger(rightObject);
+static TObject* callStringPrimitive(uint8_t opcode, TObjectArray& args, bool& primitiveFailed) {
+    TObject* const argument = (args.getSize() > 1) ? args[1] : globals.nilObject;
+    return callStringPrimitive(opcode, args[0], argument, primitiveFailed);
+}
 
-            // Performing an operation
-            return callSmallIntPrimitive(opcode, leftOperand, rightOperand, primitiveFailed);
-        } break;
+static TObject* getSystemTicks(uint8_t /*opcode*/, TObjectArray& /*args*/, bool& /*primitiveFailed*/) {
+    timeval tv;
+    gettimeofday(&tv, NULL);
+    return TInteger( (tv.tv_sec*1000000 + tv.tv_usec) / 1000 );
+}
 
-        // FIXME opcodes 253-255 are not standard
-        case primitive::getSystemTicks: { //253
-            timeval tv;
-            gettimeofday(&tv, NULL);
-            return TInteger( (tv.tv_sec*1000000 + tv.tv_usec) / 1000 );
-        } break;
+static TObject* callNamedPrimitive(uint8_t /*opcode*/, TObjectArray& args, bool& primitiveFailed) {
+    return primitiveRegistry.callNamed(args, primitiveFailed);
+}
 
-        default: {
-            primitiveFailed = true;
-            std::fprintf(stderr, "Unimplemented or invalid primitive %d\n", opcode);
-            //exit(1);
-        }
+static TObject* loadNativeModule(uint8_t /*opcode*/, TObjectArray& args, bool& primitiveFailed) {
+    TObject* const path = args[0];
+    if (isSmallInteger(path) || path->getClass() != classRegistry.get<TString>()) {
+        primitiveFailed = true;
+        return globals.nilObject;
     }
+
+    const std::string fileName(reinterpret_cast<const char*>(static_cast<TString*>(path)->getBytes()), path->getSize());
+    if (! primitiveRegistry.loadModule(fileName))
+        primitiveFailed = true;
+
     return globals.nilObject;
 }
 
-TObject* callSmallIntPrimitive(uint8_t opcode, int32_t leftOperand, int32_t rightOperand, bool& primitiveFailed) {
+void registerStandardPrimitives(PrimitiveRegistry& registry) {
+    const uint8_t pure    = TPrimitiveDescriptor::isPure;
+    const uint8_t inline_ = TPrimitiveDescriptor::isInlineable;
+
+    registry.add(primitive::objectsAreEqual, "==",    callObjectPrimitive, 2, pure | inline_);
+    registry.add(primitive::getClass,        "class", callObjectPrimitive, 1, pure | inline_);
+    registry.add(primitive::getSize,         "size",  callObjectPrimitive, 1, pure | inline_);
+
+    registry.add(primitive::stringAt,    "String>>at:",     callStringAccessPrimitive, 2, pure | inline_);
+    registry.add(primitive::stringAtPut, "String>>at:put:", callStringAccessPrimitive, 3, inline_);
+
+    const uint8_t smallIntOpcodes[] = {
+        primitive::smallIntAdd, primitive::smallIntDiv, primitive::smallIntMod, primitive::smallIntLess,
+        primitive::smallIntEqual, primitive::smallIntMul, primitive::smallIntSub,
+        primitive::smallIntBitOr, primitive::smallIntBitAnd, primitive::smallIntBitShift
+    };
+    for (std::size_t i = 0; i < sizeof(smallIntOpcodes); i++)
+        registry.add(smallIntOpcodes[i], "SmallInt", callSmallIntPrimitive, 2, pure | inline_);
+    registry.add(primitive::smallIntBitXor, "SmallInt", callSmallIntPrimitive, 2, pure);
+
+    for (uint8_t opcode = primitive::symbolHash; opcode <= primitive::stringOccurrencesOf; opcode++)
+        registry.add(opcode, "String", callStringPrimitive, 1, pure);
+
+    registry.add(primitive::ioPutChar,                "putChar",    callIOPrimitive, 1, inline_);
+    registry.add(primitive::ioGetChar,                "getChar",    callIOPrimitive, 0, 0);
+    registry.add(primitive::ioFileOpen,               "open",       callIOPrimitive, 2, 0);
+    registry.add(primitive::ioFileSetStatIntoArray,   "stat",       callIOPrimitive, 2, 0);
+    registry.add(primitive::ioFileReadIntoByteArray,  "read",       callIOPrimitive, 3, 0);
+    registry.add(primitive::ioFileWriteFromByteArray, "write",      callIOPrimitive, 3, 0);
+    registry.add(primitive::ioFileSeek,               "seek",       callIOPrimitive, 2, 0);
+    registry.add(primitive::ioFileWriteRange,         "writeRange", callIOPrimitive, 4, 0);
+    registry.add(primitive::ioFileReadLine,           "readLine",   callIOPrimitive, 2, 0);
+    registry.add(primitive::ioFileFlush,              "flush",      callIOPrimitive, 1, 0);
+    registry.add(primitive::ioWaitBlocking,           "waitFor",    callIOPrimitive, 2, 0);
+    registry.add(primitive::socketListen,             "listen",     callIOPrimitive, 2, 0);
+    registry.add(primitive::socketAccept,             "accept",     callIOPrimitive, 1, 0);
+    registry.add(primitive::socketConnect,            "connect",    callIOPrimitive, 2, 0);
+    registry.add(primitive::socketError,              "error",      callIOPrimitive, 1, 0);
+    registry.add(primitive::socketPort,               "port",       callIOPrimitive, 1, 0);
+
+    registry.add(primitive::ffiOpen,    "FFI open",    callFFIPrimitive, 1, 0);
+    registry.add(primitive::ffiClose,   "FFI close",   callFFIPrimitive, 1, 0);
+    registry.add(primitive::ffiResolve, "FFI resolve", callFFIPrimitive, 2, 0);
+    registry.add(primitive::ffiCall,    "FFI call",    callFFIPrimitive, 3, 0);
+    registry.add(primitive::ffiCallInt, "FFI callInt", callFFIPrimitive, 3, 0);
+    registry.add(primitive::ffiGetInt,  "FFI getInt",  callFFIPrimitive, 2, 0);
+    registry.add(primitive::ffiSetInt,  "FFI setInt",  callFFIPrimitive, 3, 0);
+
+    registry.add(primitive::arraySort, "Array sort", sortArray, 2, 0);
+
+    registry.add(primitive::callNamed,      "callNamed",      callNamedPrimitive, 1, 0);
+    registry.add(primitive::loadModule,     "loadModule",     loadNativeModule,   1, 0);
+    registry.add(primitive::getSystemTicks, "getSystemTicks", getSystemTicks,     0, 0);
+}
+
+// Results that do not fit into the SmallInteger range fail the primitive
+// so the Smalltalk side may handle the overflow by itself
+static TObject* smallIntResult(intptr_t value, bool& primitiveFailed) {
+    if (! TInteger::isValid(value)) {
+        primitiveFailed = true;
+        return globals.nilObject;
+    }
+    return TInteger(value);
+}
+
+TObject* callSmallIntPrimitive(uint8_t opcode, intptr_t leftOperand, intptr_t rightOperand, bool& primitiveFailed) {
     switch (opcode) {
         case primitive::smallIntAdd:
-            return TInteger( leftOperand + rightOperand ); //FIXME possible overflow
+            // Operands are one bit narrower than the word, so the sum can't overflow intptr_t
+            return smallIntResult( leftOperand + rightOperand, primitiveFailed );
 
         case primitive::smallIntDiv:
             if (rightOperand == 0) {
                 primitiveFailed = true;
                 return globals.nilObject;
             }
-            return TInteger( leftOperand / rightOperand );
+            return smallIntResult( leftOperand / rightOperand, primitiveFailed );
 
         case primitive::smallIntMod:
             if (rightOperand == 0) {
@@ -199,11 +270,21 @@ TObject* callSmallIntPrimitive(uint8_t opcode, int32_t leftOperand, int32_t righ
             else
                 return globals.falseObject;
 
-        case primitive::smallIntMul:
-            return TInteger( leftOperand * rightOperand ); //FIXME possible overflow
+        case primitive::smallIntMul: {
+            if (leftOperand == 0)
+                return TInteger(0);
+
+            // Operands fit into the word, so the check may be done by division
+            const intptr_t result = static_cast<intptr_t>(static_cast<uintptr_t>(leftOperand) * static_cast<uintptr_t>(rightOperand));
+            if (result / leftOperand != rightOperand) {
+                primitiveFailed = true;
+                return globals.nilObject;
+            }
+            return smallIntResult(result, primitiveFailed);
+        }
 
         case primitive::smallIntSub:
-            return TInteger( leftOperand - rightOperand ); //FIXME possible overflow
+            return smallIntResult( leftOperand - rightOperand, primitiveFailed );
 
         case primitive::smallIntBitOr:
             return TInteger( leftOperand | rightOperand );
@@ -211,24 +292,36 @@ TObject* callSmallIntPrimitive(uint8_t opcode, int32_t leftOperand, int32_t righ
         case primitive::smallIntBitAnd:
             return TInteger( leftOperand & rightOperand );
 
+        case primitive::smallIntBitXor:
+            return TInteger( leftOperand ^ rightOperand );
+
         case primitive::smallIntBitShift: {
             // operator << if rightOperand < 0, operator >> if rightOperand >= 0
 
-            int32_t result = 0;
+            const intptr_t wordBits = sizeof(intptr_t) * 8;
+            intptr_t result = 0;
 
             if (rightOperand < 0) {
                 //shift right
-                result = leftOperand >> -rightOperand;
+                result = (-rightOperand < wordBits) ? (leftOperand >> -rightOperand) : (leftOperand < 0 ? -1 : 0);
             } else {
                 // shift left ; catch overflow
-                result = leftOperand << rightOperand;
-                if (leftOperand > result) {
+                if (rightOperand >= wordBits) {
+                    if (leftOperand != 0) {
+                        primitiveFailed = true;
+                        return globals.nilObject;
+                    }
+                    return TInteger(0);
+                }
+
+                result = static_cast<intptr_t>(static_cast<uintptr_t>(leftOperand) << rightOperand);
+                if ((result >> rightOperand) != leftOperand) {
                     primitiveFailed = true;
                     return globals.nilObject;
                 }
             }
 
-            return TInteger(result);
+            return smallIntResult(result, primitiveFailed);
         }
 
         default:
@@ -237,6 +330,169 @@ TObject* callSmallIntPrimitive(uint8_t opcode, int32_t leftOperand, int32_t righ
     }
 }
 
+bool isIntegerPrimitive(uint8_t opcode) {
+    switch (opcode) {
+        case primitive::smallIntAdd:          // 10
+        case primitive::smallIntDiv:          // 11
+        case primitive::smallIntMod:          // 12
+        case primitive::smallIntLess:         // 13
+        case primitive::smallIntEqual:        // 14
+        case primitive::smallIntMul:          // 15
+        case primitive::smallIntSub:          // 16
+        case primitive::smallIntBitOr:        // 36
+        case primitive::smallIntBitAnd:       // 37
+        case primitive::smallIntBitShift:     // 39
+        case primitive::smallIntBitXor:       // 41
+
+        case primitive::integerDiv:           // 25
+        case primitive::integerMod:           // 26
+        case primitive::integerAdd:           // 27
+        case primitive::integerMul:           // 28
+        case primitive::integerSub:           // 29
+        case primitive::integerLess:          // 30
+        case primitive::integerEqual:         // 31
+        case primitive::integerNew:           // 32
+        case primitive::integerAsSmallInt:    // 33
+        case primitive::integerTruncSmallInt: // 40
+        case primitive::integerPrintString:   // 42
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+bool isFloatPrimitive(uint8_t opcode) {
+    return opcode >= primitive::floatAdd && opcode <= primitive::floatParse;
+}
+
+// Standard descriptors are shared with getchar() and putchar() and with the
+// output of the VM itself, so they go through the stdio buffers to keep the order
+static FILE* getStandardStream(int32_t fileID)
+{
+    switch (fileID) {
+        case STDIN_FILENO:  return stdin;
+        case STDOUT_FILENO: return stdout;
+        case STDERR_FILENO: return stderr;
+        default:            return 0;
+    }
+}
+
+static bool wouldBlock()
+{
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+// Returns the number of bytes written which is less than the size
+// only if the descriptor is non-blocking, or -1 on error
+static ssize_t writeBytes(int32_t fileID, const uint8_t* bytes, std::size_t size)
+{
+    if (FILE* stream = getStandardStream(fileID))
+        return (std::fwrite(bytes, 1, size, stream) == size) ? static_cast<ssize_t>(size) : -1;
+
+    std::size_t total = 0;
+    while (total < size) {
+        const ssize_t written = write(fileID, bytes + total, size - total);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            if (wouldBlock())
+                break;
+            return -1;
+        }
+
+        total += written;
+    }
+
+    return total;
+}
+
+// Socket address is either the IPv4 address and the port
+// or the path of the unix domain socket if the port is nil
+static bool getSocketAddress(TObject* address, TObject* port, sockaddr_storage& storage, socklen_t& length)
+{
+    if (isSmallInteger(address) || address->getClass() != classRegistry.get<TString>())
+        return false;
+
+    const TString* const name = static_cast<TString*>(address);
+    const std::string host(reinterpret_cast<const char*>(name->getBytes()), name->getSize());
+    std::memset(&storage, 0, sizeof(storage));
+
+    if (port == globals.nilObject) {
+        sockaddr_un& local = reinterpret_cast<sockaddr_un&>(storage);
+        if (host.empty() || host.size() >= sizeof(local.sun_path))
+            return false;
+
+        local.sun_family = AF_UNIX;
+        std::memcpy(local.sun_path, host.c_str(), host.size() + 1);
+        length = sizeof(local);
+        return true;
+    }
+
+    if (! isSmallInteger(port) || TInteger(port) < 0 || TInteger(port) > 65535)
+        return false;
+
+    sockaddr_in& inet = reinterpret_cast<sockaddr_in&>(storage);
+    inet.sin_family = AF_INET;
+    inet.sin_port   = htons(TInteger(port));
+    if (inet_pton(AF_INET, host.c_str(), &inet.sin_addr) != 1)
+        return false;
+
+    length = sizeof(inet);
+    return true;
+}
+
+static int32_t openSocket(int family)
+{
+    return socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+}
+
+// Reads bytes up to and including the newline, returns the number of bytes stored.
+// Seekable files are read by chunks and then positioned right after the newline.
+static int32_t readLine(int32_t fileID, uint8_t* buffer, std::size_t size)
+{
+    if (FILE* stream = getStandardStream(fileID)) {
+        std::size_t count = 0;
+        while (count < size) {
+            const int input = std::getc(stream);
+            if (input == EOF)
+                break;
+
+            buffer[count++] = static_cast<uint8_t>(input);
+            if (input == '\n')
+                break;
+        }
+        return std::ferror(stream) ? -1 : static_cast<int32_t>(count);
+    }
+
+    if (lseek(fileID, 0, SEEK_CUR) < 0) {
+        // Pipes and terminals could not be rewound
+        std::size_t count = 0;
+        while (count < size) {
+            const ssize_t bytesRead = read(fileID, buffer + count, 1);
+            if (bytesRead < 0)
+                return -1;
+            if (bytesRead == 0 || buffer[count++] == '\n')
+                break;
+        }
+        return static_cast<int32_t>(count);
+    }
+
+    const ssize_t bytesRead = read(fileID, buffer, size);
+    if (bytesRead <= 0)
+        return bytesRead;
+
+    const uint8_t* newline = static_cast<const uint8_t*>(std::memchr(buffer, '\n', bytesRead));
+    if (! newline)
+        return bytesRead;
+
+    const ssize_t count = newline - buffer + 1;
+    if (count < bytesRead && lseek(fileID, count - bytesRead, SEEK_CUR) < 0)
+        return -1;
+
+    return count;
+}
+
 TObject* callIOPrimitive(uint8_t opcode, TObjectArray& args, bool& primitiveFailed) {
     switch (opcode) {
 
@@ -270,15 +526,6 @@ TObject* callIOPrimitive(uint8_t opcode, TObjectArray& args, bool& primitiveFail
             }
         } break;
 
-        case primitive::ioFileClose: { // 103
-            int32_t fileID = TInteger( args[0] );
-
-            int32_t result = close(fileID);
-            if (result < 0) {
-                primitiveFailed = true;
-            }
-        } break;
-
         case primitive::ioFileSetStatIntoArray: { // 105
             int32_t fileID = TInteger( args[0] );
             TObjectArray* array = args.getField<TObjectArray>(1);
@@ -318,7 +565,9 @@ TObject* callIOPrimitive(uint8_t opcode, TObjectArray& args, bool& primitiveFail
             }
 
             if (involvedItems < 0) {
-                primitiveFailed = true;
+                // Non-blocking descriptor is not ready
+                if (! wouldBlock())
+                    primitiveFailed = true;
             } else {
                 return TInteger(involvedItems);
             }
@@ -335,6 +584,145 @@ TObject* callIOPrimitive(uint8_t opcode, TObjectArray& args, bool& primitiveFail
             }
         } break;
 
+        case primitive::ioFileWriteRange: { // 114
+            int32_t fileID = TInteger( args[0] );
+            TObject* buffer = args[1];
+            int32_t start = TInteger( args[2] );
+            int32_t stop  = TInteger( args[3] );
+
+            if (isSmallInteger(buffer) || ! buffer->isBinary()
+                || start < 1 || stop < start - 1 || static_cast<uint32_t>(stop) > buffer->getSize())
+            {
+                primitiveFailed = true;
+                break;
+            }
+
+            const uint8_t* bytes = static_cast<TByteObject*>(buffer)->getBytes() + start - 1;
+            const ssize_t written = writeBytes(fileID, bytes, stop - start + 1);
+
+            if (written < 0) {
+                primitiveFailed = true;
+            } else {
+                return TInteger(static_cast<intptr_t>(written));
+            }
+        } break;
+
+        case primitive::ioFileReadLine: { // 115
+            int32_t fileID = TInteger( args[0] );
+            TObject* buffer = args[1];
+
+            if (isSmallInteger(buffer) || ! buffer->isBinary()) {
+                primitiveFailed = true;
+                break;
+            }
+
+            TByteObject* line = static_cast<TByteObject*>(buffer);
+            int32_t bytesRead = readLine(fileID, line->getBytes(), line->getSize());
+            if (bytesRead < 0) {
+                primitiveFailed = true;
+            } else {
+                return TInteger(bytesRead);
+            }
+        } break;
+
+        case primitive::ioFileFlush: { // 116
+            int32_t fileID = TInteger( args[0] );
+
+            FILE* stream = getStandardStream(fileID);
+            if (stream && std::fflush(stream) != 0)
+                primitiveFailed = true;
+            else
+                return args[0];
+        } break;
+
+        case primitive::ioWaitBlocking: { // 122
+            pollfd descriptor = pollfd();
+            descriptor.fd     = TInteger( args[0] );
+            descriptor.events = TInteger( args[1] );
+
+            int result;
+            while ((result = poll(&descriptor, 1, -1)) < 0 && errno == EINTR)
+                ;
+
+            if (result < 0)
+                primitiveFailed = true;
+            else
+                return TInteger(descriptor.revents);
+        } break;
+
+        case primitive::socketListen: { // 123
+            sockaddr_storage address;
+            socklen_t length;
+            if (! getSocketAddress(args[0], args[1], address, length)) {
+                primitiveFailed = true;
+                break;
+            }
+
+            const int32_t fileID = openSocket(address.ss_family);
+            const int reuse = 1;
+            if (fileID < 0
+                || setsockopt(fileID, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0
+                || bind(fileID, reinterpret_cast<sockaddr*>(&address), length) < 0
+                || listen(fileID, SOMAXCONN) < 0)
+            {
+                if (fileID >= 0)
+                    close(fileID);
+                primitiveFailed = true;
+                break;
+            }
+            return TInteger(fileID);
+        } break;
+
+        case primitive::socketAccept: { // 124
+            const int32_t fileID = accept4(TInteger( args[0] ), 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fileID < 0) {
+                if (! wouldBlock())
+                    primitiveFailed = true;
+                break;
+            }
+            return TInteger(fileID);
+        } break;
+
+        case primitive::socketConnect: { // 125
+            sockaddr_storage address;
+            socklen_t length;
+            if (! getSocketAddress(args[0], args[1], address, length)) {
+                primitiveFailed = true;
+                break;
+            }
+
+            // Connection is established in background, see socketError
+            const int32_t fileID = openSocket(address.ss_family);
+            if (fileID < 0 || (connect(fileID, reinterpret_cast<sockaddr*>(&address), length) < 0 && errno != EINPROGRESS)) {
+                if (fileID >= 0)
+                    close(fileID);
+                primitiveFailed = true;
+                break;
+            }
+            return TInteger(fileID);
+        } break;
+
+        case primitive::socketError: { // 126
+            int error = 0;
+            socklen_t length = sizeof(error);
+            if (getsockopt(TInteger( args[0] ), SOL_SOCKET, SO_ERROR, &error, &length) < 0)
+                primitiveFailed = true;
+            else
+                return TInteger(error);
+        } break;
+
+        case primitive::socketPort: { // 127
+            sockaddr_in address;
+            socklen_t length = sizeof(address);
+            if (getsockname(TInteger( args[0] ), reinterpret_cast<sockaddr*>(&address), &length) < 0
+                || address.sin_family != AF_INET)
+            {
+                primitiveFailed = true;
+                break;
+            }
+            return TInteger(ntohs(address.sin_port));
+        } break;
+
         default:
             std::fprintf(stderr, "Invalid IO opcode %d\n", opcode);
             std::exit(1);
@@ -342,3 +730,268 @@ TObject* callIOPrimitive(uint8_t opcode, TObjectArray& args, bool& primitiveFail
     }
     return globals.nilObject;
 }
+
+// Strings and symbols are interchangeable, byte arrays are compared with byte arrays only
+enum TBytesKind { notBytes, textBytes, binaryBytes };
+
+static TBytesKind getBytesKind(TObject* object)
+{
+    if (isSmallInteger(object) || ! object->isBinary())
+        return notBytes;
+
+    TClass* const klass = object->getClass();
+    if (klass == classRegistry.get<TString>() || klass == classRegistry.get<TSymbol>())
+        return textBytes;
+    if (klass == classRegistry.get<TByteArray>())
+        return binaryBytes;
+
+    return notBytes;
+}
+
+// Element of a string is a character, element of a byte array is a small integer
+static bool getElementByte(TBytesKind kind, TObject* element, uint8_t& byte)
+{
+    intptr_t value = -1;
+    if (kind == binaryBytes && isSmallInteger(element))
+        value = TInteger(element);
+    else if (kind == textBytes && !isSmallInteger(element) && element->getClass() == classRegistry.get<TChar>())
+        value = static_cast<TChar*>(element)->value.getValue();
+
+    if (value < 0 || value > 255)
+        return false;
+
+    byte = static_cast<uint8_t>(value);
+    return true;
+}
+
+TObject* callStringPrimitive(uint8_t opcode, TObject* receiver, TObject* argument, bool& primitiveFailed) {
+    const TBytesKind kind = getBytesKind(receiver);
+    if (kind == notBytes) {
+        primitiveFailed = true;
+        return globals.nilObject;
+    }
+
+    const TByteObject* const self = static_cast<TByteObject*>(receiver);
+    const uint8_t* const bytes = self->getBytes();
+    const std::size_t size = self->getSize();
+
+    switch (opcode) {
+        case primitive::symbolHash:   // 61
+        case primitive::stringHash: { // 64
+            // Symbols keep the hash of the same function in the header
+            const uint32_t hash = (receiver->getClass() == classRegistry.get<TSymbol>())
+                ? static_cast<const TSymbol*>(self)->getHash()
+                : TSymbol::getHash(bytes, size);
+
+            // Fits into SmallInt on every platform
+            return TInteger(static_cast<intptr_t>(hash & 0x3FFFFFFF));
+        }
+
+        case primitive::stringIndexOf:        // 67
+        case primitive::stringOccurrencesOf: { // 68
+            uint8_t byte;
+            if (getElementByte(kind, argument, byte)) {
+                const uint8_t* found = static_cast<const uint8_t*>(std::memchr(bytes, byte, size));
+                if (opcode == primitive::stringIndexOf)
+                    return found ? static_cast<TObject*>(TInteger(static_cast<intptr_t>(found - bytes + 1))) : globals.nilObject;
+
+                int32_t count = 0;
+                for (; found; found = static_cast<const uint8_t*>(std::memchr(found + 1, byte, bytes + size - found - 1)))
+                    count++;
+                return TInteger(count);
+            }
+
+            // Substring search, the empty pattern is left to the image
+            if (opcode == primitive::stringIndexOf && getBytesKind(argument) == kind) {
+                const TByteObject* const pattern = static_cast<TByteObject*>(argument);
+                if (pattern->getSize() > 0) {
+                    const void* const found = memmem(bytes, size, pattern->getBytes(), pattern->getSize());
+                    if (! found)
+                        return globals.nilObject;
+                    return TInteger(static_cast<intptr_t>(static_cast<const uint8_t*>(found) - bytes + 1));
+                }
+            }
+
+            primitiveFailed = true;
+            return globals.nilObject;
+        }
+    }
+
+    if (getBytesKind(argument) != kind) {
+        primitiveFailed = true;
+        return globals.nilObject;
+    }
+
+    const TByteObject* const other = static_cast<TByteObject*>(argument);
+    const std::size_t otherSize = other->getSize();
+
+    switch (opcode) {
+        case primitive::symbolEqual:   // 62
+        case primitive::stringEqual: { // 65
+            const bool isEqual = (self == other)
+                || (size == otherSize && std::memcmp(bytes, other->getBytes(), size) == 0);
+            return isEqual ? globals.trueObject : globals.falseObject;
+        }
+
+        case primitive::symbolLess:   // 63
+        case primitive::stringLess: { // 66
+            // Characters are compared by value, shorter prefix goes first
+            const int order = std::memcmp(bytes, other->getBytes(), std::min(size, otherSize));
+            const bool isLess = order < 0 || (order == 0 && size < otherSize);
+            return isLess ? globals.trueObject : globals.falseObject;
+        }
+
+        default:
+            std::fprintf(stderr, "Invalid string opcode %d\n", opcode);
+            std::exit(1);
+    }
+
+    return globals.nilObject;
+}
+
+// Orders are the same as of SmallInteger>>< and String>><
+struct TSmallIntLess {
+    // Tagged words keep the order of the values
+    bool operator()(TObject* left, TObject* right) const {
+        return reinterpret_cast<intptr_t>(left) < reinterpret_cast<intptr_t>(right);
+    }
+};
+
+struct TTextLess {
+    bool operator()(TObject* left, TObject* right) const {
+        const TByteObject* const leftText  = static_cast<TByteObject*>(left);
+        const TByteObject* const rightText = static_cast<TByteObject*>(right);
+        const std::size_t leftSize  = leftText->getSize();
+        const std::size_t rightSize = rightText->getSize();
+
+        const int order = std::memcmp(leftText->getBytes(), rightText->getBytes(), std::min(leftSize, rightSize));
+        return order < 0 || (order == 0 && leftSize < rightSize);
+    }
+};
+
+template <typename TLess>
+static void sortElements(TObject** begin, TObject** end, bool isStable) {
+    if (isStable)
+        std::stable_sort(begin, end, TLess());
+    else
+        std::sort(begin, end, TLess());
+}
+
+// Arrays holding only SmallIntegers or only strings and symbols are sorted
+// in place. Other arrays fail the primitive and are sorted by the image.
+TObject* sortArray(uint8_t /*opcode*/, TObjectArray& args, bool& primitiveFailed) {
+    TObject* const object = args[0];
+    TObject* const stable = args[1];
+    if (isSmallInteger(object) || object->getClass() != classRegistry.get<TObjectArray>()
+        || (stable != globals.trueObject && stable != globals.falseObject))
+    {
+        primitiveFailed = true;
+        return globals.nilObject;
+    }
+
+    TObjectArray& array = *static_cast<TObjectArray*>(object);
+    const std::size_t size = array.getSize();
+    if (size < 2)
+        return object;
+
+    TClass* const stringClass = classRegistry.get<TString>();
+    TClass* const symbolClass = classRegistry.get<TSymbol>();
+    const bool isIntegers = isSmallInteger(array[0]);
+
+    for (std::size_t index = 0; index < size; index++) {
+        TObject* const element = array[index];
+        const bool isText = !isSmallInteger(element)
+            && (element->getClass() == stringClass || element->getClass() == symbolClass);
+
+        if (isIntegers ? !isSmallInteger(element) : !isText) {
+            primitiveFailed = true;
+            return globals.nilObject;
+        }
+    }
+
+    TObject** const begin = &array[0];
+    if (isIntegers)
+        sortElements<TSmallIntLess>(begin, begin + size, stable == globals.trueObject);
+    else
+        sortElements<TTextLess>(begin, begin + size, stable == globals.trueObject);
+
+    return object;
+}
+
+// Names of the libraries and symbols are passed as strings or symbols
+static bool getForeignName(TObject* object, std::string& name) {
+    if (isSmallInteger(object) || !object->isBinary())
+        return false;
+
+    const TByteObject* const text = static_cast<TByteObject*>(object);
+    name.assign(reinterpret_cast<const char*>(text->getBytes()), text->getSize());
+    return !name.empty();
+}
+
+TObject* callFFIPrimitive(uint8_t opcode, TObjectArray& args, bool& primitiveFailed) {
+    switch (opcode) {
+        case primitive::ffiOpen: { // 230
+            std::string name;
+            const int32_t library = getForeignName(args[0], name) ? foreignFunctions.open(name) : -1;
+            if (library < 0)
+                break;
+            return TInteger(library);
+        }
+
+        case primitive::ffiClose: // 231
+            if (!isSmallInteger(args[0]) || !foreignFunctions.close(TInteger(args[0])))
+                break;
+            return globals.nilObject;
+
+        case primitive::ffiResolve: { // 233
+            std::string name;
+            if (!isSmallInteger(args[0]) || !getForeignName(args[1], name))
+                break;
+
+            const int32_t symbol = foreignFunctions.resolve(TInteger(args[0]), name);
+            if (symbol < 0)
+                break;
+            return TInteger(symbol);
+        }
+
+        case primitive::ffiCall:      // 234
+        case primitive::ffiCallInt: { // 235
+            if (!isSmallInteger(args[0]) || !isSmallInteger(args[1]))
+                break;
+
+            intptr_t result = 0;
+            if (!foreignFunctions.call(TInteger(args[0]), TInteger(args[1]), args[2], result))
+                break;
+
+            // Only the lower half of the register holds the C int
+            if (opcode == primitive::ffiCallInt)
+                return smallIntResult(static_cast<int32_t>(result), primitiveFailed);
+            return globals.nilObject;
+        }
+
+        case primitive::ffiGetInt:   // 240
+        case primitive::ffiSetInt: { // 241
+            if (!isSmallInteger(args[0]) || !isSmallInteger(args[1]))
+                break;
+
+            int* const variable = static_cast<int*>(foreignFunctions.getAddress(TInteger(args[0]), TInteger(args[1])));
+            if (!variable)
+                break;
+
+            if (opcode == primitive::ffiGetInt)
+                return smallIntResult(*variable, primitiveFailed);
+
+            if (!isSmallInteger(args[2]))
+                break;
+            *variable = TInteger(args[2]).getValue();
+            return args[2];
+        }
+
+        default:
+            std::fprintf(stderr, "Invalid FFI opcode %d\n", opcode);
+            std::exit(1);
+    }
+
+    primitiveFailed = true;
+    return globals.nilObject;
+}
@@ -38,15 +38,28 @@
 #include <iostream>
 #include <cassert>
 #include <cstring>
+#include <cctype>
+#include <vector>
+#include <algorithm>
+#include <tr1/unordered_map>
+#include <tr1/unordered_set>
+#include <unistd.h>
 
 #include <primitives.h>
+#include <PrimitiveRegistry.h>
+#include <ForeignFunctions.h>
 #include <vm.h>
 #include <CompletionEngine.h>
+#include <AllocationProfiler.h>
+#include <LargeInteger.h>
 
 #if defined(LLVM)
     #include <jit.h>
 #endif
 
+volatile std::sig_atomic_t SmalltalkVM::s_heapCensusRequested = 0;
+volatile std::sig_atomic_t SmalltalkVM::s_imageSaveRequested = 0;
+
 TObject* SmalltalkVM::newOrdinaryObject(TClass* klass, std::size_t slotSize)
 {
     // Class may be moved during GC in allocation,
@@ -55,7 +68,7 @@ TObject* SmalltalkVM::newOrdinaryObject(TClass* klass, std::size_t slotSize)
 
     void* objectSlot = m_memoryManager->allocate(correctPadding(slotSize), &m_lastGCOccured);
     if (!objectSlot) {
-        std::fprintf(stderr, "VM: memory manager failed to allocate %u bytes\n", slotSize);
+        std::fprintf(stderr, "VM: memory manager failed to allocate %zu bytes\n", slotSize);
         return globals.nilObject;
     }
 
@@ -73,6 +86,11 @@ TObject* SmalltalkVM::newOrdinaryObject(TClass* klass, std::size_t slotSize)
     for (uint32_t index = 0; index < fieldsCount; index++)
         instance->putField(index, globals.nilObject);
 
+    if (m_allocationProfiler) {
+        if (const uint32_t weight = m_allocationProfiler->shouldSample(correctPadding(slotSize)))
+            sampleAllocation(pClass, correctPadding(slotSize), weight);
+    }
+
     return instance;
 }
 
@@ -84,11 +102,11 @@ TByteObject* SmalltalkVM::newBinaryObject(TClass* klass, std::size_t dataSize)
 
     // All binary objects are descendants of ByteObject
     // They could not have ordinary fields, so we may use it
-    uint32_t slotSize = sizeof(TByteObject) + dataSize;
+    std::size_t slotSize = sizeof(TByteObject) + dataSize;
 
     void* objectSlot = m_memoryManager->allocate(correctPadding(slotSize), &m_lastGCOccured);
     if (!objectSlot) {
-        std::fprintf(stderr, "VM: memory manager failed to allocate %d bytes\n", slotSize);
+        std::fprintf(stderr, "VM: memory manager failed to allocate %zu bytes\n", slotSize);
         return static_cast<TByteObject*>(globals.nilObject);
     }
 
@@ -99,33 +117,49 @@ TByteObject* SmalltalkVM::newBinaryObject(TClass* klass, std::size_t dataSize)
 
     TByteObject* instance = new (objectSlot) TByteObject(dataSize, pClass);
 
+    if (m_allocationProfiler) {
+        if (const uint32_t weight = m_allocationProfiler->shouldSample(correctPadding(slotSize)))
+            sampleAllocation(pClass, correctPadding(slotSize), weight);
+    }
+
     return instance;
 }
 
+void SmalltalkVM::sampleAllocation(TClass* klass, std::size_t size, uint32_t weight)
+{
+    if (!m_topFrame) {
+        m_allocationProfiler->recordSample(klass, size, weight, 0, -1);
+        return;
+    }
+
+    const int bytePointer = m_topFrame->bytePointer ? *m_topFrame->bytePointer : -1;
+    m_allocationProfiler->recordSample(klass, size, weight, m_topFrame->context, bytePointer);
+}
+
 template<> hptr<TObjectArray> SmalltalkVM::newObject<TObjectArray>(std::size_t dataSize, bool registerPointer)
 {
-    TClass* klass = globals.arrayClass;
+    TClass* klass = classRegistry.get<TObjectArray>();
     TObjectArray* instance = static_cast<TObjectArray*>( newOrdinaryObject(klass, sizeof(TObjectArray) + dataSize * sizeof(TObject*)) );
     return hptr<TObjectArray>(instance, m_memoryManager, registerPointer);
 }
 
 template<> hptr<TSymbolArray> SmalltalkVM::newObject<TSymbolArray>(std::size_t dataSize, bool registerPointer)
 {
-    TClass* klass = globals.arrayClass;
+    TClass* klass = classRegistry.get<TSymbolArray>();
     TSymbolArray* instance = static_cast<TSymbolArray*>( newOrdinaryObject(klass, sizeof(TSymbolArray) + dataSize * sizeof(TObject*)) );
     return hptr<TSymbolArray>(instance, m_memoryManager, registerPointer);
 }
 
 template<> hptr<TContext> SmalltalkVM::newObject<TContext>(std::size_t /*dataSize*/, bool registerPointer)
 {
-    TClass* klass = globals.contextClass;
+    TClass* klass = classRegistry.get<TContext>();
     TContext* instance = static_cast<TContext*>( newOrdinaryObject(klass, sizeof(TContext)) );
     return hptr<TContext>(instance, m_memoryManager, registerPointer);
 }
 
 template<> hptr<TBlock> SmalltalkVM::newObject<TBlock>(std::size_t /*dataSize*/, bool registerPointer)
 {
-    TClass* klass = globals.blockClass;
+    TClass* klass = classRegistry.get<TBlock>();
     TBlock* instance = static_cast<TBlock*>( newOrdinaryObject(klass, sizeof(TBlock)) );
     return hptr<TBlock>(instance, m_memoryManager, registerPointer);
 }
@@ -161,7 +195,7 @@ bool SmalltalkVM::checkRoot(TObject* value, TObject** objectSlot)
 
 TMethod* SmalltalkVM::lookupMethodInCache(TSymbol* selector, TClass* klass)
 {
-    uint32_t hash = reinterpret_cast<uint32_t>(selector) ^ reinterpret_cast<uint32_t>(klass);
+    uintptr_t hash = reinterpret_cast<uintptr_t>(selector) ^ reinterpret_cast<uintptr_t>(klass);
     TMethodCacheEntry& entry = m_lookupCache[hash % LOOKUP_CACHE_SIZE];
 
     if (entry.methodName == selector && entry.receiverClass == klass) {
@@ -175,7 +209,7 @@ TMethod* SmalltalkVM::lookupMethodInCache(TSymbol* selector, TClass* klass)
 
 void SmalltalkVM::updateMethodCache(TSymbol* selector, TClass* klass, TMethod* method)
 {
-    uint32_t hash = reinterpret_cast<uint32_t>(selector) ^ reinterpret_cast<uint32_t>(klass);
+    uintptr_t hash = reinterpret_cast<uintptr_t>(selector) ^ reinterpret_cast<uintptr_t>(klass);
     TMethodCacheEntry& entry = m_lookupCache[hash % LOOKUP_CACHE_SIZE];
 
     entry.methodName    = selector;
@@ -193,12 +227,21 @@ TMethod* SmalltalkVM::lookupMethod(TSymbol* selector, TClass* klass)
     if (method)
         return method; // We're lucky!
 
+    // Frequently missed classes have the flattened table of all methods
+    const uint32_t selectorHash = selector->getHash();
+    if (const DispatchTable* table = m_dispatchTables.get(klass, m_memoryManager)) {
+        method = table->find(selector, selectorHash);
+        if (method)
+            updateMethodCache(selector, klass, method);
+        return method;
+    }
+
     // Well, maybe we'll be luckier next time. For now we need to do the full search.
     // Scanning through the class hierarchy from the klass up to the Object
     for (TClass* currentClass = klass; currentClass != globals.nilObject; currentClass = currentClass->parentClass) {
         assert(currentClass != 0);
         TDictionary* methods = currentClass->methods;
-        method = methods->find<TMethod>(selector);
+        method = methods->find<TMethod>(selector, selectorHash);
         if (method) {
             // Storing result in cache
             updateMethodCache(selector, klass, method);
@@ -209,10 +252,45 @@ TMethod* SmalltalkVM::lookupMethod(TSymbol* selector, TClass* klass)
     return 0;
 }
 
-void SmalltalkVM::flushMethodCache()
+void SmalltalkVM::flushMethodCache(bool methodsChanged /*= true*/)
 {
     for (std::size_t i = 0; i < LOOKUP_CACHE_SIZE; i++)
         m_lookupCache[i].methodName = 0;
+
+    if (methodsChanged) {
+        m_dispatchTables.flush();
+
+        // Indices of the method dictionaries survive the GC
+        TDictionary::flushIndices();
+
+        // Class>>subclass: flushes the cache after the class is defined
+        resolveClasses();
+    } else
+        m_dispatchTables.flushMovable();
+}
+
+void SmalltalkVM::resolveClasses()
+{
+    releaseClassRoots();
+    classRegistry.resolve(globals.globalsObject);
+
+    // Registry slots are updated by the GC when the classes are moved
+    TObject** const slots = reinterpret_cast<TObject**>(classRegistry.classes);
+    for (std::size_t i = 0; i < TClassRegistry::classesCount; i++) {
+        m_classRoots[i] = slots[i] && !m_memoryManager->isInStaticHeap(slots[i]);
+        if (m_classRoots[i])
+            m_memoryManager->addStaticRoot(&slots[i]);
+    }
+}
+
+void SmalltalkVM::releaseClassRoots()
+{
+    TObject** const slots = reinterpret_cast<TObject**>(classRegistry.classes);
+    for (std::size_t i = 0; i < TClassRegistry::classesCount; i++) {
+        if (m_classRoots[i])
+            m_memoryManager->removeStaticRoot(&slots[i]);
+        m_classRoots[i] = false;
+    }
 }
 
 SmalltalkVM::TExecuteResult SmalltalkVM::execute(TProcess* p, uint32_t ticks)
@@ -226,10 +304,23 @@ SmalltalkVM::TExecuteResult SmalltalkVM::execute(TProcess* p, uint32_t ticks)
     // Initializing an execution context
     TVMExecutionContext ec(m_memoryManager, this);
     ec.currentContext = currentProcess->context;
+    ec.isTimeSliced   = (ticks != 0);
     ec.loadPointers(); // Loads bytePointer & stackTop
 
+    TExecutionFrame frame(this, ec.currentContext, &ec.bytePointer);
+
     while (true)
     {
+        if (s_heapCensusRequested) {
+            s_heapCensusRequested = 0;
+            printHeapCensus();
+        }
+
+        if (s_imageSaveRequested) {
+            s_imageSaveRequested = 0;
+            saveImage(m_image->getFileName(), m_image->hasExternalSources());
+        }
+
         assert(ec.currentContext != 0);
         assert(ec.currentContext->method != 0);
         assert(ec.currentContext->stack != 0);
@@ -335,7 +426,7 @@ void SmalltalkVM::doPushBlock(TVMExecutionContext& ec)
 
     // Assigning creatingContext depending on the hierarchy
     // Nested blocks inherit the outer creating context
-    if (ec.currentContext->getClass() == globals.blockClass)
+    if (ec.currentContext->getClass() == classRegistry.get<TBlock>())
         newBlock->creatingContext = ec.currentContext.cast<TBlock>()->creatingContext;
     else
         newBlock->creatingContext = ec.currentContext;
@@ -372,7 +463,7 @@ void SmalltalkVM::doSendMessage(TVMExecutionContext& ec, TSymbol* selector, TObj
     if (!receiverClass) {
         TObject* receiver = messageArguments[0];
         assert(receiver != 0);
-        receiverClass = isSmallInteger(receiver) ? globals.smallIntClass : receiver->getClass();
+        receiverClass = isSmallInteger(receiver) ? classRegistry[TClassRegistry::smallIntClass] : receiver->getClass();
         assert(receiverClass != 0);
     }
 
@@ -415,7 +506,7 @@ void SmalltalkVM::doSendMessage(TVMExecutionContext& ec, TSymbol* selector, TObj
         // Optimizing stack return
         newContext->previousContext = ec.currentContext->previousContext;
     } else if (nextInstruction == (opcode::doSpecial * 16 + special::blockReturn) &&
-              (ec.currentContext->getClass() == globals.blockClass))
+              (ec.currentContext->getClass() == classRegistry.get<TBlock>()))
     {
         // Optimizing block return
         newContext->previousContext = ec.currentContext.cast<TBlock>()->creatingContext->previousContext;
@@ -492,9 +583,9 @@ void SmalltalkVM::doSendBinary(TVMExecutionContext& ec)
     // If operands are both small integers, we may handle it ourselves
     if (isSmallInteger(leftObject) && isSmallInteger(rightObject)) {
         // Loading actual operand values
-        int32_t rightOperand = TInteger(rightObject);
-        int32_t leftOperand  = TInteger(leftObject);
-        bool unusedCondition;
+        intptr_t rightOperand = TInteger(rightObject);
+        intptr_t leftOperand  = TInteger(leftObject);
+        bool primitiveFailed = false;
 
         // Performing an operation
         switch ( static_cast<binaryBuiltIns::Operator>(ec.instruction.getArgument()) ) {
@@ -507,7 +598,7 @@ void SmalltalkVM::doSendBinary(TVMExecutionContext& ec)
                 break;
 
             case binaryBuiltIns::operatorPlus:
-                ec.returnedValue = callSmallIntPrimitive(primitive::smallIntAdd, leftOperand, rightOperand, unusedCondition);
+                ec.returnedValue = callSmallIntPrimitive(primitive::smallIntAdd, leftOperand, rightOperand, primitiveFailed);
                 break;
 
             default:
@@ -515,23 +606,27 @@ void SmalltalkVM::doSendBinary(TVMExecutionContext& ec)
                 std::exit(1);
         }
 
-        ec.stackPush( ec.returnedValue );
-        m_messagesSent++;
-    } else {
-        // This binary operator is performed on an ordinary object.
-        // We do not know how to handle it, thus send the message to the receiver
+        // Result does not fit into SmallInteger, so the receiver should handle it
+        if (!primitiveFailed) {
+            ec.stackPush( ec.returnedValue );
+            m_messagesSent++;
+            return;
+        }
+    }
 
-        // Protecting pointers in case if GC occurs
-        hptr<TObject> pRightObject = newPointer(rightObject);
-        hptr<TObject> pLeftObject  = newPointer(leftObject);
+    // This binary operator is performed on an ordinary object.
+    // We do not know how to handle it, thus send the message to the receiver
 
-        hptr<TObjectArray> messageArguments = newObject<TObjectArray>(2/*, false*/);
-        messageArguments[1] = pRightObject;
-        messageArguments[0] = pLeftObject;
+    // Protecting pointers in case if GC occurs
+    hptr<TObject> pRightObject = newPointer(rightObject);
+    hptr<TObject> pLeftObject  = newPointer(leftObject);
 
-        TSymbol* messageSelector = static_cast<TSymbol*>( globals.binaryMessages[ec.instruction.getArgument()] );
-        doSendMessage(ec, messageSelector, messageArguments);
-    }
+    hptr<TObjectArray> messageArguments = newObject<TObjectArray>(2/*, false*/);
+    messageArguments[1] = pRightObject;
+    messageArguments[0] = pLeftObject;
+
+    TSymbol* messageSelector = static_cast<TSymbol*>( globals.binaryMessages[ec.instruction.getArgument()] );
+    doSendMessage(ec, messageSelector, messageArguments);
 }
 
 SmalltalkVM::TExecuteResult SmalltalkVM::doSpecial(hptr<TProcess>& process, TVMExecutionContext& ec)
@@ -719,6 +814,15 @@ SmalltalkVM::TExecuteResult SmalltalkVM::doPrimitive(hptr<TProcess>& process, TV
             ec.bytePointer = ec.currentContext->bytePointer;
     }
 
+    // Process waits for the descriptor. Result of the primitive is already
+    // pushed, so the process continues after the call when it is resumed.
+    if (opcode == primitive::ioWait) {
+        ec.storePointers();
+        process->context = ec.currentContext;
+        process->result  = ec.returnedValue;
+        return returnWaiting;
+    }
+
     return returnNoReturn;
 }
 
@@ -787,7 +891,7 @@ TObject* SmalltalkVM::performPrimitive(uint8_t opcode, hptr<TProcess>& process,
                 if ( !input.empty() )
                     CompletionEngine::Instance()->addHistory(input);
 
-                TString* result = static_cast<TString*>( newBinaryObject(globals.stringClass, input.size()) );
+                TString* result = static_cast<TString*>( newBinaryObject(classRegistry.get<TString>(), input.size()) );
                 std::memcpy(result->getBytes(), input.c_str(), input.size());
                 return result;
             } else
@@ -927,33 +1031,249 @@ TObject* SmalltalkVM::performPrimitive(uint8_t opcode, hptr<TProcess>& process,
 
             // Cloning data
             std::memcpy(clone->getBytes(), original->getBytes(), dataSize);
+
+            // Symbols are interned this way
+            if (klass == classRegistry.get<TSymbol>()) {
+                TSymbol* const symbol = static_cast<TSymbol*>(static_cast<TObject*>(clone));
+                symbol->updateHash();
+                if (m_symbolTable.isBuilt())
+                    m_symbolTable.insert(symbol);
+            }
+
             return static_cast<TObject*>(clone);
         } break;
 
-        //         case primitive::integerDiv:   // Integer /
-        //         case primitive::integerMod:   // Integer %
-        //         case primitive::integerAdd:   // Integer +
-        //         case primitive::integerMul:   // Integer *
-        //         case primitive::integerSub:   // Integer -
-        //         case primitive::integerLess:  // Integer <
-        //         case primitive::integerEqual: // Integer ==
-        //             //TODO integer operations
-        //             break;
-
-        case primitive::integerNew: { // 32
-            TObject* object = ec.stackPop();
-            if (! isSmallInteger(object)) {
+        case primitive::shallowCopy: // 131
+        case primitive::deepCopy: {  // 132
+            const uint32_t argCount = (opcode == primitive::deepCopy) ? 2 : 1;
+            if (ec.instruction.getArgument() != argCount) {
                 failed = true;
-                break;
+                return globals.nilObject;
+            }
+
+            TObject* const limit    = (argCount > 1) ? ec.stackPop() : globals.nilObject;
+            TObject* const original = ec.stackPop();
+            return copyObject(opcode, original, limit, failed);
+        }
+
+        case primitive::serializeGraph:     // 133
+        case primitive::materializeGraph: { // 134
+            if (ec.instruction.getArgument() != 1) {
+                failed = true;
+                return globals.nilObject;
+            }
+
+            TObject* const argument = ec.stackPop();
+            if (opcode == primitive::serializeGraph)
+                return serializeGraph(argument, failed);
+            else
+                return materializeGraph(argument, failed);
+        }
+
+        case primitive::bufferAppend:     // 135
+        case primitive::bufferAppendByte: // 136
+        case primitive::bufferAppendInt:  // 137
+        case primitive::bufferFreeze: {   // 138
+            const uint32_t argCount = (opcode == primitive::bufferFreeze) ? 1 : 2;
+            if (ec.instruction.getArgument() != argCount) {
+                failed = true;
+                return globals.nilObject;
+            }
+
+            TObject* const argument = (argCount > 1) ? ec.stackPop() : globals.nilObject;
+            TObject* const buffer   = ec.stackPop();
+            return callBufferPrimitive(opcode, buffer, argument, failed);
+        }
+
+        case primitive::smallIntAdd:          // 10
+        case primitive::smallIntDiv:          // 11
+        case primitive::smallIntMod:          // 12
+        case primitive::smallIntLess:         // 13
+        case primitive::smallIntEqual:        // 14
+        case primitive::smallIntMul:          // 15
+        case primitive::smallIntSub:          // 16
+        case primitive::smallIntBitOr:        // 36
+        case primitive::smallIntBitAnd:       // 37
+        case primitive::smallIntBitShift:     // 39
+        case primitive::smallIntBitXor:       // 41
+
+        case primitive::integerDiv:           // 25
+        case primitive::integerMod:           // 26
+        case primitive::integerAdd:           // 27
+        case primitive::integerMul:           // 28
+        case primitive::integerSub:           // 29
+        case primitive::integerLess:          // 30
+        case primitive::integerEqual:         // 31
+        case primitive::integerNew:           // 32
+        case primitive::integerAsSmallInt:    // 33
+        case primitive::integerTruncSmallInt: // 40
+        case primitive::integerPrintString: { // 42
+            // Unary primitives get nil as the argument
+            TObject* argument = (ec.instruction.getArgument() > 1) ? ec.stackPop() : globals.nilObject;
+            TObject* receiver = ec.stackPop();
+
+            return callIntegerPrimitive(opcode, receiver, argument, failed);
+        } break;
+
+        case primitive::floatAdd:         // 50
+        case primitive::floatSub:         // 51
+        case primitive::floatMul:         // 52
+        case primitive::floatDiv:         // 53
+        case primitive::floatLess:        // 54
+        case primitive::floatEqual:       // 55
+        case primitive::floatTruncated:   // 56
+        case primitive::floatNew:         // 57
+        case primitive::floatPrintString: // 58
+        case primitive::floatParse: {     // 59
+            TObject* argument = (ec.instruction.getArgument() > 1) ? ec.stackPop() : globals.nilObject;
+            TObject* receiver = ec.stackPop();
+
+            return callFloatPrimitive(opcode, receiver, argument, failed);
+        } break;
+
+        case primitive::symbolIntern: { // 60
+            // New symbols are added to the symbols tree by the image
+            TSymbol* const symbol = findSymbol(ec.stackPop());
+            if (! symbol) {
+                failed = true;
+                return globals.nilObject;
+            }
+            return symbol;
+        } break;
+
+        case primitive::ioWait: { // 120
+            TObject* events = ec.stackPop();
+            TObject* fileID = ec.stackPop();
+
+            // Only the scheduler is able to resume the process later
+            if (! ec.isTimeSliced || ! isSmallInteger(fileID) || ! isSmallInteger(events)
+                || ! m_ioPoller.watch(TInteger(fileID), TInteger(events)))
+            {
+                failed = true;
+                return globals.nilObject;
+            }
+            return fileID;
+        } break;
+
+        case primitive::ioPoll: // 121
+            return pollDescriptors(ec.stackPop(), failed);
+
+        case primitive::ioFileClose: // 103
+            return closeDescriptor(ec.stackPop(), failed);
+
+        case primitive::ioFileMap:      // 117
+        case primitive::ioFileMapSlice: // 118
+        case primitive::ioFileUnmap: {  // 119
+            const uint32_t argCount = ec.instruction.getArgument();
+            TObject* args[3] = { globals.nilObject, globals.nilObject, globals.nilObject };
+            if (argCount < 1 || argCount > 3) {
+                failed = true;
+                return globals.nilObject;
+            }
+
+            for (uint32_t i = argCount; i > 0; )
+                args[--i] = ec.stackPop();
+
+            return callMappedFilePrimitive(opcode, args[0], args[1], args[2], failed);
+        } break;
+
+        case primitive::ffiCallString: { // 236
+            if (ec.instruction.getArgument() != 3) {
+                failed = true;
+                return globals.nilObject;
             }
 
-            return object; // FIXME long integer
+            TObject* const arguments = ec.stackPop();
+            TObject* const function  = ec.stackPop();
+            TObject* const library   = ec.stackPop();
+            return callForeignString(library, function, arguments, failed);
+        }
+
+        case primitive::symbolHash:          // 61
+        case primitive::symbolEqual:         // 62
+        case primitive::symbolLess:          // 63
+        case primitive::stringHash:          // 64
+        case primitive::stringEqual:         // 65
+        case primitive::stringLess:          // 66
+        case primitive::stringIndexOf:       // 67
+        case primitive::stringOccurrencesOf: { // 68
+            TObject* argument = (ec.instruction.getArgument() > 1) ? ec.stackPop() : globals.nilObject;
+            TObject* receiver = ec.stackPop();
+
+            return callStringPrimitive(opcode, receiver, argument, failed);
         } break;
 
         case primitive::flushCache: // 34
             flushMethodCache();
             break;
 
+        case primitive::heapCensus: // 110
+            printHeapCensus();
+            break;
+
+        case primitive::heapDump: { // 111
+            TString* fileName = ec.stackPop<TString>();
+            if (isSmallInteger(fileName) || fileName->getClass() != classRegistry.get<TString>()) {
+                failed = true;
+                break;
+            }
+
+            const std::string name(reinterpret_cast<const char*>(fileName->getBytes()), fileName->getSize());
+            dumpHeap(name.c_str());
+        } break;
+
+        case primitive::saveImage: { // 112
+            // nil stands for the image VM was started with and
+            // for the sources mode of that image respectively
+            TObject* externalSources = ec.stackPop();
+            TString* fileName = ec.stackPop<TString>();
+            std::string name = m_image->getFileName();
+
+            bool external = m_image->hasExternalSources();
+            if (externalSources == globals.trueObject)
+                external = true;
+            else if (externalSources == globals.falseObject)
+                external = false;
+            else if (externalSources != globals.nilObject) {
+                failed = true;
+                break;
+            }
+
+            if (fileName != globals.nilObject) {
+                if (isSmallInteger(fileName) || fileName->getClass() != classRegistry.get<TString>()) {
+                    failed = true;
+                    break;
+                }
+                name.assign(reinterpret_cast<const char*>(fileName->getBytes()), fileName->getSize());
+            }
+
+            if (!saveImage(name, external))
+                failed = true;
+        } break;
+
+        case primitive::methodSource: { // 113
+            TMethod* method = ec.stackPop<TMethod>();
+            if (isSmallInteger(method) || method->getClass() != classRegistry.get<TMethod>()) {
+                failed = true;
+                break;
+            }
+
+            // Text is either resident or the offset in the sources file
+            if (! isSmallInteger(method->text))
+                return method->text;
+
+            std::string source;
+            if (! m_image->readSource(TInteger(method->text).getValue(), source)) {
+                failed = true;
+                break;
+            }
+
+            TString* text = static_cast<TString*>( newBinaryObject(classRegistry.get<TString>(), source.size()) );
+            if (! source.empty())
+                std::memcpy(text->getBytes(), source.data(), source.size());
+            return text;
+        }
+
         case primitive::bulkReplace: { // 38
             //Implementation of replaceFrom:to:with:startingAt: as a primitive
 
@@ -982,7 +1302,7 @@ TObject* SmalltalkVM::performPrimitive(uint8_t opcode, hptr<TProcess>& process,
             return destination;
         } break;
 
-        // TODO cases 33, 35, 40
+        // TODO case 35
         // TODO case 18 // turn on debugging
 
         case primitive::objectsAreEqual:    // 1
@@ -992,30 +1312,42 @@ TObject* SmalltalkVM::performPrimitive(uint8_t opcode, hptr<TProcess>& process,
         case primitive::ioGetChar:          // 9
         case primitive::ioPutChar:          // 3
         case primitive::ioFileOpen:         // 100
-        case primitive::ioFileClose:        // 103
         case primitive::ioFileSetStatIntoArray:   // 105
         case primitive::ioFileReadIntoByteArray:  // 106
         case primitive::ioFileWriteFromByteArray: // 107
         case primitive::ioFileSeek:         // 108
+        case primitive::ioFileWriteRange:   // 114
+        case primitive::ioFileReadLine:     // 115
+        case primitive::ioFileFlush:        // 116
+        case primitive::ioWaitBlocking:     // 122
+        case primitive::socketListen:       // 123
+        case primitive::socketAccept:       // 124
+        case primitive::socketConnect:      // 125
+        case primitive::socketError:        // 126
+        case primitive::socketPort:         // 127
 
         case primitive::stringAt:           // 21
         case primitive::stringAtPut:        // 22
 
-        case primitive::smallIntAdd:        // 10
-        case primitive::smallIntDiv:        // 11
-        case primitive::smallIntMod:        // 12
-        case primitive::smallIntLess:       // 13
-        case primitive::smallIntEqual:      // 14
-        case primitive::smallIntMul:        // 15
-        case primitive::smallIntSub:        // 16
-        case primitive::smallIntBitOr:      // 36
-        case primitive::smallIntBitAnd:     // 37
-        case primitive::smallIntBitShift:   // 39
-
         case primitive::getSystemTicks:     //253
 
         default: {
             uint32_t argCount = ec.instruction.getArgument();
+
+            // Arguments of the primitives that do not collect garbage
+            // are passed without allocating the array in the heap
+            const TPrimitiveDescriptor& descriptor = primitiveRegistry[opcode];
+            if (! descriptor.mayCollectGarbage() && argCount <= TStackArguments::MAX_COUNT) {
+                TStackArguments args(argCount);
+
+                uint32_t i = argCount;
+                while (i > 0)
+                    args[--i] = ec.stackPop();
+
+                failed = false;
+                return primitiveRegistry.call(opcode, *args, failed);
+            }
+
             hptr<TObjectArray> args = newObject<TObjectArray>(argCount);
 
             uint32_t i = argCount;
@@ -1030,79 +1362,1019 @@ TObject* SmalltalkVM::performPrimitive(uint8_t opcode, hptr<TProcess>& process,
     return globals.nilObject;
 }
 
-void SmalltalkVM::onCollectionOccured()
+TSymbol* SmalltalkVM::findSymbol(TObject* name)
 {
-    // Here we need to handle the GC collection event
-    //printf("VM: GC had just occured. Flushing the method cache.\n");
-    flushMethodCache();
+    if (isSmallInteger(name) || ! name->isBinary())
+        return 0;
+
+    TClass* const symbolClass = classRegistry.get<TSymbol>();
+    if (name->getClass() == symbolClass)
+        return static_cast<TSymbol*>(name);
+    if (name->getClass() != classRegistry.get<TString>())
+        return 0;
+
+    // Table is filled from the symbols tree when it is needed for the first time
+    if (! m_symbolTable.isBuilt() && ! m_symbolTable.build(symbolClass))
+        return 0;
+
+    return m_symbolTable.find(static_cast<TByteObject*>(name));
 }
 
-bool SmalltalkVM::doBulkReplace( TObject* destination, TObject* destinationStartOffset, TObject* destinationStopOffset, TObject* source, TObject* sourceStartOffset) {
+TObject* SmalltalkVM::callMappedFilePrimitive(uint8_t opcode, TObject* receiver, TObject* first, TObject* second, bool& primitiveFailed)
+{
+    switch (opcode) {
+        case primitive::ioFileMap: { // 117
+            // Receiver is the class of the mapped object
+            if (isSmallInteger(receiver) || isSmallInteger(first) || first->getClass() != classRegistry.get<TString>())
+                break;
 
-    if ( ! isSmallInteger(sourceStartOffset) ||
-         ! isSmallInteger(destinationStartOffset) ||
-         ! isSmallInteger(destinationStopOffset) )
-    {
-        return false;
+            TString* const name = static_cast<TString*>(first);
+            const std::string fileName(reinterpret_cast<const char*>(name->getBytes()), name->getSize());
+
+            if (TByteObject* const object = m_mappedFiles.map(fileName, static_cast<TClass*>(receiver)))
+                return object;
+        } break;
+
+        case primitive::ioFileMapSlice: { // 118
+            if (! m_mappedFiles.isMapped(receiver) || ! isSmallInteger(first) || ! isSmallInteger(second))
+                break;
+
+            const intptr_t start = TInteger(first);
+            const intptr_t stop  = TInteger(second);
+            if (start < 1 || stop < start - 1)
+                break;
+
+            if (TByteObject* const object = m_mappedFiles.slice(static_cast<TByteObject*>(receiver), start - 1, stop - start + 1))
+                return object;
+        } break;
+
+        case primitive::ioFileUnmap: // 119
+            if (m_mappedFiles.isMapped(receiver) && m_mappedFiles.close(static_cast<TByteObject*>(receiver)))
+                return globals.nilObject;
+            break;
+
+        default:
+            std::fprintf(stderr, "Invalid mapped file opcode %d\n", opcode);
+            std::exit(1);
     }
 
-    // Smalltalk indexes are counted starting from 1.
-    // We need to decrement all values to get the zero based index:
-    int32_t iSourceStartOffset      = TInteger(sourceStartOffset) - 1;
-    int32_t iDestinationStartOffset = TInteger(destinationStartOffset) - 1;
-    int32_t iDestinationStopOffset  = TInteger(destinationStopOffset) - 1;
-    int32_t iCount                  = iDestinationStopOffset - iDestinationStartOffset + 1;
+    primitiveFailed = true;
+    return globals.nilObject;
+}
 
-    if ( iSourceStartOffset      < 0 ||
-         iDestinationStartOffset < 0 ||
-         iDestinationStopOffset  < 0 ||
-         iCount < 1 )
+TObject* SmalltalkVM::callForeignString(TObject* library, TObject* function, TObject* arguments, bool& primitiveFailed)
+{
+    intptr_t result = 0;
+    std::string text;
+    if (! isSmallInteger(library) || ! isSmallInteger(function)
+        || ! foreignFunctions.call(TInteger(library), TInteger(function), arguments, result, &text))
     {
-        return false;
+        primitiveFailed = true;
+        return globals.nilObject;
     }
 
-    if (destination->getSize() < static_cast<uint32_t>(iDestinationStopOffset) ||
-        source->getSize() < static_cast<uint32_t>(iSourceStartOffset + iCount) )
-    {
-        return false;
+    if (! result)
+        return globals.nilObject;
+
+    // The result is already copied out of the arguments, so the allocation may move them
+    TString* const string = static_cast<TString*>( newBinaryObject(classRegistry.get<TString>(), text.size()) );
+    if (string == globals.nilObject)
+        return globals.nilObject;
+
+    std::memcpy(string->getBytes(), text.data(), text.size());
+    return string;
+}
+
+TObject* SmalltalkVM::pollDescriptors(TObject* timeout, bool& primitiveFailed)
+{
+    std::vector<int> ready;
+    if (! isSmallInteger(timeout) || ! m_ioPoller.wait(TInteger(timeout), ready)) {
+        primitiveFailed = true;
+        return globals.nilObject;
     }
 
-    if ( source->isBinary() && destination->isBinary() ) {
-        // Interpreting pointer array as raw byte sequence
-        uint8_t* sourceBytes      = static_cast<TByteObject*>(source)->getBytes();
-        uint8_t* destinationBytes = static_cast<TByteObject*>(destination)->getBytes();
+    hptr<TObjectArray> result = newObject<TObjectArray>(ready.size());
+    for (std::size_t i = 0; i < ready.size(); i++)
+        result[i] = TInteger(ready[i]);
 
-        // Primitive may be called on the same object, so memory overlapping may occur.
-        // memmove() works much like the ordinary memcpy() except that it correctly
-        // handles the case with overlapping memory areas
-        std::memmove( & destinationBytes[iDestinationStartOffset], & sourceBytes[iSourceStartOffset], iCount );
+    return result;
+}
+
+TObject* SmalltalkVM::closeDescriptor(TObject* fileID, bool& primitiveFailed)
+{
+    if (! isSmallInteger(fileID)) {
+        primitiveFailed = true;
+        return globals.nilObject;
+    }
+
+    // Epoll would forget the closed descriptor, but the processes would still wait for it
+    m_ioPoller.unwatch(TInteger(fileID));
+    if (close(TInteger(fileID)) < 0)
+        primitiveFailed = true;
+
+    return globals.nilObject;
+}
+
+// Objects that are never copied, even by the shallow copy
+static bool isUniqueObject(TObject* object)
+{
+    return isSmallInteger(object) || object == globals.nilObject
+        || object == globals.trueObject || object == globals.falseObject
+        || object->getClass() == classRegistry.get<TSymbol>();
+}
+
+// Objects that are referenced by the deep copy as is. Classes and methods
+// are shared by the whole image, execution state is never copied.
+static bool isSharedOnCopy(TObject* object)
+{
+    if (isUniqueObject(object))
         return true;
+
+    TClass* const klass = object->getClass();
+    TClass* const classClass = classRegistry.get<TClass>();
+
+    // Metaclasses are instances of Class, classes are instances of metaclasses
+    return klass == classClass || klass->getClass() == classClass
+        || klass == classRegistry.get<TMethod>()
+        || klass == classRegistry.get<TContext>()
+        || klass == classRegistry.get<TBlock>()
+        || klass == classRegistry.get<TProcess>();
+}
+
+// Collects the distinct objects reachable from the root in the order of
+// the depth first traversal, so the root is always the first one.
+// Returns false if the graph has more than limit objects to copy.
+static bool collectCopiedObjects(TObject* root, std::size_t limit, std::vector<TObject*>& objects)
+{
+    std::tr1::unordered_set<TObject*> visited;
+    std::vector<TObject*> pending(1, root);
+
+    while (! pending.empty()) {
+        TObject* const object = pending.back();
+        pending.pop_back();
+
+        if (isSharedOnCopy(object) || ! visited.insert(object).second)
+            continue;
+
+        if (objects.size() == limit)
+            return false;
+
+        objects.push_back(object);
+        if (object->isBinary())
+            continue;
+
+        for (std::size_t index = object->getSize(); index > 0; )
+            pending.push_back(object->getField(--index));
     }
 
-    // If we're moving objects between static and dynamic memory,
-    // let the VM hadle it because pointer checking is required. See checkRoot()
-    if (m_memoryManager->isInStaticHeap(source) != m_memoryManager->isInStaticHeap(destination))
-    {
-        return false;
+    return true;
+}
+
+TObject* SmalltalkVM::cloneObject(TObject* object)
+{
+    hptr<TObject> original = newPointer(object);
+
+    if (original->isBinary()) {
+        const std::size_t dataSize = original->getSize();
+        TByteObject* const clone = newBinaryObject(original->getClass(), dataSize);
+        if (clone == globals.nilObject)
+            return 0;
+        std::memcpy(clone->getBytes(), original.cast<TByteObject>()->getBytes(), dataSize);
+        return clone;
     }
 
-    if ( ! source->isBinary() && ! destination->isBinary() ) {
-        TObject** sourceFields      = source->getFields();
-        TObject** destinationFields = destination->getFields();
+    // Clone is allocated in the dynamic heap, so its slots never
+    // need to be registered as roots whatever they refer to
+    TObject* const clone = newOrdinaryObject(original->getClass(), original->getSlotSize());
+    if (clone == globals.nilObject)
+        return 0;
+    std::memcpy(clone->getFields(), original->getFields(), original->getSize() * sizeof(TObject*));
+    return clone;
+}
 
-        // Primitive may be called on the same object, so memory overlapping may occur.
-        // memmove() works much like the ordinary memcpy() except that it correctly
-        // handles the case with overlapping memory areas
-        std::memmove( & destinationFields[iDestinationStartOffset], & sourceFields[iSourceStartOffset], iCount * sizeof(TObject*) );
-        return true;
+TObject* SmalltalkVM::copyObject(uint8_t opcode, TObject* original, TObject* limit, bool& primitiveFailed)
+{
+    switch (opcode) {
+        case primitive::shallowCopy: // 131
+            if (isUniqueObject(original))
+                return original;
+            if (TObject* const clone = cloneObject(original))
+                return clone;
+            break;
+
+        case primitive::deepCopy: { // 132
+            if (! isSmallInteger(limit) || TInteger(limit) < 1)
+                break;
+
+            hptr<TObject> root = newPointer(original);
+            std::vector<TObject*> objects;
+            if (! collectCopiedObjects(root, TInteger(limit), objects))
+                break;
+            const std::size_t count = objects.size();
+            if (! count)
+                return root;
+
+            hptr<TObjectArray> originals = newObject<TObjectArray>(count);
+            if (originals == globals.nilObject)
+                break;
+
+            // Allocation may have moved the graph, so it is traversed again
+            if (m_lastGCOccured) {
+                objects.clear();
+                collectCopiedObjects(root, count, objects);
+            }
+            for (std::size_t i = 0; i < count; i++)
+                originals->putField(i, objects[i]);
+
+            hptr<TObjectArray> copies = newObject<TObjectArray>(count);
+            if (copies == globals.nilObject)
+                break;
+
+            std::size_t cloned = 0;
+            for (; cloned < count; cloned++) {
+                TObject* const clone = cloneObject(originals->getField(cloned));
+                if (! clone)
+                    break;
+                copies->putField(cloned, clone);
+            }
+            if (cloned < count)
+                break;
+
+            // Nothing is allocated from now on, so the addresses are stable
+            typedef std::tr1::unordered_map<TObject*, TObject*> TCopiesMap;
+            TCopiesMap copyOf;
+            for (std::size_t i = 0; i < count; i++)
+                copyOf[originals->getField(i)] = copies->getField(i);
+
+            for (std::size_t i = 0; i < count; i++) {
+                TObject* const copy = copies->getField(i);
+                if (copy->isBinary())
+                    continue;
+
+                for (std::size_t field = 0; field < copy->getSize(); field++) {
+                    TCopiesMap::const_iterator iCopy = copyOf.find(copy->getField(field));
+                    if (iCopy != copyOf.end())
+                        copy->putField(field, iCopy->second);
+                }
+            }
+
+            return copies->getField(0);
+        }
+
+        default:
+            std::fprintf(stderr, "Invalid copy opcode %d\n", opcode);
+            std::exit(1);
     }
 
-    return false;
+    primitiveFailed = true;
+    return globals.nilObject;
 }
 
-void SmalltalkVM::printVMStat()
+TObject* SmalltalkVM::serializeGraph(TObject* root, bool& primitiveFailed)
 {
-    float hitRatio = 100.0 * m_cacheHits / (m_cacheHits + m_cacheMisses);
-    std::printf("%d messages sent, cache hits: %d, misses: %d, hit ratio %.2f %%\n",
-        m_messagesSent, m_cacheHits, m_cacheMisses, hitRatio);
+    Image::ImageWriter writer;
+    writer.setGlobals(globals);
+
+    std::vector<uint8_t> graph;
+    TClass* const byteArrayClass = classRegistry.get<TByteArray>();
+    if (! byteArrayClass || ! writer.writeGraph(root, graph)) {
+        primitiveFailed = true;
+        return globals.nilObject;
+    }
+
+    // Root is not used anymore, so the allocation may move it
+    TByteObject* const result = newBinaryObject(byteArrayClass, graph.size());
+    if (result == globals.nilObject) {
+        primitiveFailed = true;
+        return globals.nilObject;
+    }
+
+    std::memcpy(result->getBytes(), &graph[0], graph.size());
+    return result;
+}
+
+// Characters below 257 are unique, see MetaChar>>new:
+static TObject* findCharacter(std::size_t value)
+{
+    TClass* const charClass = classRegistry.get<TChar>();
+    if (! charClass)
+        return 0;
+
+    // Table is the first variable of MetaChar following the ones of Class
+    const std::size_t tableField = (sizeof(TClass) - sizeof(TObject)) / sizeof(TObject*);
+    if (charClass->getSize() <= tableField)
+        return 0;
+
+    TObject* const table = charClass->getField(tableField);
+    if (isSmallInteger(table) || table->getClass() != classRegistry.get<TObjectArray>() || table->getSize() <= value)
+        return 0;
+
+    return table->getField(value);
+}
+
+TObject* SmalltalkVM::materializeGraph(TObject* data, bool& primitiveFailed)
+{
+    if (isSmallInteger(data) || ! data->isBinary()) {
+        primitiveFailed = true;
+        return globals.nilObject;
+    }
+
+    // Data is copied because the allocations may move it
+    const TByteObject* const bytes = static_cast<TByteObject*>(data);
+    const std::vector<uint8_t> graph(bytes->getBytes(), bytes->getBytes() + bytes->getSize());
+
+    Image::GraphReader reader;
+    if (graph.empty() || ! reader.read(&graph[0], graph.size())) {
+        primitiveFailed = true;
+        return globals.nilObject;
+    }
+
+    typedef Image::GraphReader::TNode TNode;
+    const std::vector<TNode>& nodes = reader.getNodes();
+    if (nodes.empty())
+        return reader.getRoot().immediate;
+
+    hptr<TObjectArray> objects = newObject<TObjectArray>(nodes.size());
+    if (objects == globals.nilObject) {
+        primitiveFailed = true;
+        return globals.nilObject;
+    }
+
+    // Existing objects are kept in the array, so the allocations below may move them
+    for (std::size_t i = 0; i < nodes.size(); i++) {
+        const TNode& node = nodes[i];
+        TObject* object = 0;
+
+        switch (node.kind) {
+            case Image::GraphReader::globalNode: {
+                const std::string name(reinterpret_cast<const char*>(reader.getData(node)), node.size);
+                object = globals.globalsObject->find(name.c_str());
+            } break;
+
+            case Image::GraphReader::metaclassNode: {
+                // Global should be a class, the metaclass is its class
+                const std::string name(reinterpret_cast<const char*>(reader.getData(node)), node.size);
+                TObject* const instance = globals.globalsObject->find(name.c_str());
+                if (instance && ! isSmallInteger(instance) && instance->getClass()->getClass() == classRegistry.get<TClass>())
+                    object = instance->getClass();
+            } break;
+
+            case Image::GraphReader::symbolNode:
+                if (m_symbolTable.isBuilt() || m_symbolTable.build(classRegistry.get<TSymbol>()))
+                    object = m_symbolTable.find(reader.getData(node), node.size);
+                break;
+
+            case Image::GraphReader::charNode:
+                object = findCharacter(node.size);
+                break;
+
+            default:
+                continue;
+        }
+
+        if (! object) {
+            primitiveFailed = true;
+            return globals.nilObject;
+        }
+        objects->putField(i, object);
+    }
+
+    TClass* const classClass = classRegistry.get<TClass>();
+    for (std::size_t i = 0; i < nodes.size(); i++) {
+        const TNode& node = nodes[i];
+        if (node.kind != Image::GraphReader::ordinaryNode && node.kind != Image::GraphReader::byteNode)
+            continue;
+
+        // Global resolved by the name of the class may be anything else
+        TClass* const klass = objects->getField<TClass>(node.classNode);
+        if (isSmallInteger(klass) || (klass->getClass() != classClass && klass->getClass()->getClass() != classClass)) {
+            primitiveFailed = true;
+            return globals.nilObject;
+        }
+
+        TObject* object = 0;
+        if (node.kind == Image::GraphReader::byteNode) {
+            TByteObject* const byteObject = newBinaryObject(klass, node.size);
+            if (byteObject != globals.nilObject && node.size)
+                std::memcpy(byteObject->getBytes(), reader.getData(node), node.size);
+            object = byteObject;
+        } else {
+            object = newOrdinaryObject(klass, sizeof(TObject) + node.size * sizeof(TObject*));
+        }
+
+        if (object == globals.nilObject) {
+            primitiveFailed = true;
+            return globals.nilObject;
+        }
+        objects->putField(i, object);
+    }
+
+    // Nothing is allocated from now on. Objects are created in the
+    // dynamic heap, so their slots need not to be registered as roots.
+    for (std::size_t i = 0; i < nodes.size(); i++) {
+        const TNode& node = nodes[i];
+        if (node.kind != Image::GraphReader::ordinaryNode)
+            continue;
+
+        TObject* const object = objects->getField(i);
+        for (std::size_t field = 0; field < node.size; field++) {
+            const Image::GraphReader::TReference& reference = reader.getField(node, field);
+            object->putField(field, reference.immediate ? reference.immediate : objects->getField(reference.node));
+        }
+    }
+
+    const Image::GraphReader::TReference& root = reader.getRoot();
+    return root.immediate ? root.immediate : objects->getField(root.node);
+}
+
+// Receiver should be a StringBuffer or an instance of its subclass like WriteStream.
+// Fields are checked as well, because the image is free to store anything there.
+static bool isStringBuffer(TObject* object)
+{
+    TClass* const bufferClass = classRegistry.get<TStringBuffer>();
+    if (! bufferClass || isSmallInteger(object) || object->isBinary() || object->getSize() < 2)
+        return false;
+
+    TClass* klass = object->getClass();
+    while (klass != bufferClass && klass != globals.nilObject)
+        klass = klass->parentClass;
+    if (klass != bufferClass)
+        return false;
+
+    TObject* const bytes = object->getField(0);
+    TObject* const size  = object->getField(1);
+    if (! isSmallInteger(size) || TInteger(size) < 0)
+        return false;
+
+    if (bytes == globals.nilObject)
+        return TInteger(size) == 0;
+
+    return ! isSmallInteger(bytes) && bytes->getClass() == classRegistry.get<TString>()
+        && static_cast<std::size_t>(TInteger(size)) <= bytes->getSize();
+}
+
+TString* SmalltalkVM::reserveBuffer(hptr<TStringBuffer>& buffer, std::size_t count)
+{
+    const std::size_t size = TInteger(buffer->size);
+    const std::size_t capacity = (buffer->bytes == globals.nilObject) ? 0 : buffer->bytes->getSize();
+    if (size + count <= capacity)
+        return buffer->bytes;
+
+    // Capacity is doubled, so appending is linear in total
+    std::size_t newCapacity = std::max<std::size_t>(capacity * 2, 16);
+    while (newCapacity < size + count)
+        newCapacity *= 2;
+
+    TString* const grown = static_cast<TString*>( newBinaryObject(classRegistry.get<TString>(), newCapacity) );
+    if (grown == globals.nilObject)
+        return 0;
+
+    if (size)
+        std::memcpy(grown->getBytes(), buffer->bytes->getBytes(), size);
+
+    // Buffer may reside in the static heap
+    checkRoot(grown, reinterpret_cast<TObject**>(&buffer->bytes));
+    buffer->bytes = grown;
+    return grown;
+}
+
+TObject* SmalltalkVM::callBufferPrimitive(uint8_t opcode, TObject* receiver, TObject* argument, bool& primitiveFailed)
+{
+    if (! isStringBuffer(receiver)) {
+        primitiveFailed = true;
+        return globals.nilObject;
+    }
+
+    hptr<TStringBuffer> buffer = newPointer(static_cast<TStringBuffer*>(receiver));
+    const std::size_t size = TInteger(buffer->size);
+
+    switch (opcode) {
+        case primitive::bufferAppend: { // 135
+            if (isSmallInteger(argument) || ! argument->isBinary())
+                break;
+
+            // Argument may be moved by the growth
+            hptr<TByteObject> source = newPointer(static_cast<TByteObject*>(argument));
+            const std::size_t count = source->getSize();
+            TString* const bytes = reserveBuffer(buffer, count);
+            if (! bytes)
+                break;
+
+            if (count)
+                std::memcpy(bytes->getBytes() + size, source->getBytes(), count);
+            buffer->size = TInteger(size + count);
+            return buffer;
+        }
+
+        case primitive::bufferAppendByte: { // 136
+            TObject* value = argument;
+            if (! isSmallInteger(value) && value->getClass() == classRegistry.get<TChar>())
+                value = static_cast<TChar*>(value)->value;
+            if (! isSmallInteger(value) || TInteger(value) < 0 || TInteger(value) > 255)
+                break;
+
+            TString* const bytes = reserveBuffer(buffer, 1);
+            if (! bytes)
+                break;
+
+            bytes->getBytes()[size] = static_cast<uint8_t>(TInteger(value));
+            buffer->size = TInteger(size + 1);
+            return buffer;
+        }
+
+        case primitive::bufferAppendInt: { // 137
+            if (! isSmallInteger(argument))
+                break;
+
+            char digits[32];
+            const int count = std::sprintf(digits, "%lld", static_cast<long long>(TInteger(argument).getValue()));
+            TString* const bytes = reserveBuffer(buffer, count);
+            if (! bytes)
+                break;
+
+            std::memcpy(bytes->getBytes() + size, digits, count);
+            buffer->size = TInteger(size + count);
+            return buffer;
+        }
+
+        case primitive::bufferFreeze: { // 138
+            // Full backing string is handed over as is, the buffer starts from scratch
+            if (buffer->bytes != globals.nilObject && size == buffer->bytes->getSize()) {
+                TString* const result = buffer->bytes;
+                checkRoot(globals.nilObject, reinterpret_cast<TObject**>(&buffer->bytes));
+                buffer->bytes = static_cast<TString*>(globals.nilObject);
+                buffer->size = TInteger(0);
+                return result;
+            }
+
+            // Otherwise the contents are copied and the capacity is kept for reuse
+            TString* const result = static_cast<TString*>( newBinaryObject(classRegistry.get<TString>(), size) );
+            if (result == globals.nilObject)
+                break;
+
+            if (size)
+                std::memcpy(result->getBytes(), buffer->bytes->getBytes(), size);
+            buffer->size = TInteger(0);
+            return result;
+        }
+
+        default:
+            std::fprintf(stderr, "Invalid buffer opcode %d\n", opcode);
+            std::exit(1);
+    }
+
+    primitiveFailed = true;
+    return globals.nilObject;
+}
+
+void SmalltalkVM::onCollectionOccured()
+{
+    // Here we need to handle the GC collection event
+    //printf("VM: GC had just occured. Flushing the method cache.\n");
+    flushMethodCache(false);
+}
+
+bool SmalltalkVM::doBulkReplace( TObject* destination, TObject* destinationStartOffset, TObject* destinationStopOffset, TObject* source, TObject* sourceStartOffset) {
+
+    if ( ! isSmallInteger(sourceStartOffset) ||
+         ! isSmallInteger(destinationStartOffset) ||
+         ! isSmallInteger(destinationStopOffset) )
+    {
+        return false;
+    }
+
+    // Smalltalk indexes are counted starting from 1.
+    // We need to decrement all values to get the zero based index:
+    intptr_t iSourceStartOffset      = TInteger(sourceStartOffset) - 1;
+    intptr_t iDestinationStartOffset = TInteger(destinationStartOffset) - 1;
+    intptr_t iDestinationStopOffset  = TInteger(destinationStopOffset) - 1;
+    intptr_t iCount                  = iDestinationStopOffset - iDestinationStartOffset + 1;
+
+    if ( iSourceStartOffset      < 0 ||
+         iDestinationStartOffset < 0 ||
+         iDestinationStopOffset  < 0 ||
+         iCount < 1 )
+    {
+        return false;
+    }
+
+    if (destination->getSize() < static_cast<std::size_t>(iDestinationStopOffset) ||
+        source->getSize() < static_cast<std::size_t>(iSourceStartOffset + iCount) )
+    {
+        return false;
+    }
+
+    if ( source->isBinary() && destination->isBinary() ) {
+        // Interpreting pointer array as raw byte sequence
+        uint8_t* sourceBytes      = static_cast<TByteObject*>(source)->getBytes();
+        uint8_t* destinationBytes = static_cast<TByteObject*>(destination)->getBytes();
+
+        // Primitive may be called on the same object, so memory overlapping may occur.
+        // memmove() works much like the ordinary memcpy() except that it correctly
+        // handles the case with overlapping memory areas
+        std::memmove( & destinationBytes[iDestinationStartOffset], & sourceBytes[iSourceStartOffset], iCount );
+        return true;
+    }
+
+    // If we're moving objects between static and dynamic memory,
+    // let the VM hadle it because pointer checking is required. See checkRoot()
+    if (m_memoryManager->isInStaticHeap(source) != m_memoryManager->isInStaticHeap(destination))
+    {
+        return false;
+    }
+
+    if ( ! source->isBinary() && ! destination->isBinary() ) {
+        TObject** sourceFields      = source->getFields();
+        TObject** destinationFields = destination->getFields();
+
+        // Primitive may be called on the same object, so memory overlapping may occur.
+        // memmove() works much like the ordinary memcpy() except that it correctly
+        // handles the case with overlapping memory areas
+        std::memmove( & destinationFields[iDestinationStartOffset], & sourceFields[iSourceStartOffset], iCount * sizeof(TObject*) );
+        return true;
+    }
+
+    return false;
+}
+
+// Integer primitives share the implementation with the SmallInt ones
+static uint8_t toSmallIntOpcode(uint8_t opcode)
+{
+    switch (opcode) {
+        case primitive::integerDiv:   return primitive::smallIntDiv;
+        case primitive::integerMod:   return primitive::smallIntMod;
+        case primitive::integerAdd:   return primitive::smallIntAdd;
+        case primitive::integerMul:   return primitive::smallIntMul;
+        case primitive::integerSub:   return primitive::smallIntSub;
+        case primitive::integerLess:  return primitive::smallIntLess;
+        case primitive::integerEqual: return primitive::smallIntEqual;
+        default:                      return opcode;
+    }
+}
+
+// Shifting by more bits would exhaust the memory anyway
+static const intptr_t MAX_LARGE_INTEGER_SHIFT = 1 << 24;
+
+static bool toLargeInteger(TObject* object, LargeInteger& value)
+{
+    if (isSmallInteger(object)) {
+        value = LargeInteger(TInteger(object).getValue());
+        return true;
+    }
+
+    if (object->getClass() != classRegistry[TClassRegistry::integerClass])
+        return false;
+
+    const TByteObject* integer = static_cast<TByteObject*>(object);
+    value = LargeInteger::fromBytes(integer->getBytes(), integer->getSize());
+    return true;
+}
+
+TObject* SmalltalkVM::newIntegerObject(const LargeInteger& value)
+{
+    intptr_t smallValue;
+    if (value.toSmallInt(smallValue))
+        return TInteger(smallValue);
+
+    TByteObject* integer = newBinaryObject(classRegistry[TClassRegistry::integerClass], value.getByteSize());
+    value.toBytes(integer->getBytes());
+    return integer;
+}
+
+TObject* SmalltalkVM::callIntegerPrimitive(uint8_t opcode, TObject* receiver, TObject* argument, bool& failed)
+{
+    // Operands are converted first. Allocation of the result is the
+    // last action, so GC can't move them while they are in use.
+    switch (opcode) {
+        case primitive::integerNew:           // 32
+        case primitive::integerAsSmallInt:    // 33
+        case primitive::integerTruncSmallInt: { // 40
+            LargeInteger value;
+            if (! toLargeInteger(receiver, value)) {
+                failed = true;
+                return globals.nilObject;
+            }
+
+            if (opcode == primitive::integerNew)
+                return newIntegerObject(value);
+
+            intptr_t smallValue;
+            if (opcode == primitive::integerAsSmallInt) {
+                if (! value.toSmallInt(smallValue)) {
+                    failed = true;
+                    return globals.nilObject;
+                }
+                return TInteger(smallValue);
+            }
+
+            // Keeping the lowest bits that fit into SmallInt
+            const uintptr_t lowBits = static_cast<uintptr_t>(value.truncated());
+            return TInteger(static_cast<intptr_t>(lowBits << 1) >> 1);
+        }
+
+        case primitive::integerPrintString: { // 42
+            LargeInteger value;
+            if (! toLargeInteger(receiver, value) || ! isSmallInteger(argument)) {
+                failed = true;
+                return globals.nilObject;
+            }
+
+            const intptr_t base = TInteger(argument);
+            if (base < 2 || base > 36) {
+                failed = true;
+                return globals.nilObject;
+            }
+
+            const std::string digits = value.toString(base);
+            TString* result = static_cast<TString*>( newBinaryObject(classRegistry.get<TString>(), digits.size()) );
+            std::memcpy(result->getBytes(), digits.data(), digits.size());
+            return result;
+        }
+    }
+
+    const uint8_t smallIntOpcode = toSmallIntOpcode(opcode);
+
+    // Most of the time both operands are small and so is the result
+    if (isSmallInteger(receiver) && isSmallInteger(argument)) {
+        TObject* result = callSmallIntPrimitive(smallIntOpcode, TInteger(receiver), TInteger(argument), failed);
+        if (! failed)
+            return result;
+
+        // Overflow. Division by zero is detected once again below.
+        failed = false;
+    }
+
+    LargeInteger left;
+    LargeInteger right;
+    if (! toLargeInteger(receiver, left) || ! toLargeInteger(argument, right)) {
+        failed = true;
+        return globals.nilObject;
+    }
+
+    switch (smallIntOpcode) {
+        case primitive::smallIntAdd: return newIntegerObject(left + right);
+        case primitive::smallIntSub: return newIntegerObject(left - right);
+        case primitive::smallIntMul: return newIntegerObject(left * right);
+
+        case primitive::smallIntDiv:
+        case primitive::smallIntMod: {
+            LargeInteger quotient;
+            LargeInteger remainder;
+            if (! LargeInteger::divMod(left, right, quotient, remainder)) {
+                failed = true;
+                return globals.nilObject;
+            }
+            return newIntegerObject(smallIntOpcode == primitive::smallIntDiv ? quotient : remainder);
+        }
+
+        case primitive::smallIntLess:
+            return (left.compare(right) < 0) ? globals.trueObject : globals.falseObject;
+        case primitive::smallIntEqual:
+            return (left.compare(right) == 0) ? globals.trueObject : globals.falseObject;
+
+        case primitive::smallIntBitOr:  return newIntegerObject(left.bitOr(right));
+        case primitive::smallIntBitAnd: return newIntegerObject(left.bitAnd(right));
+        case primitive::smallIntBitXor: return newIntegerObject(left.bitXor(right));
+
+        case primitive::smallIntBitShift: {
+            intptr_t count;
+            if (! right.toSmallInt(count) || count > MAX_LARGE_INTEGER_SHIFT) {
+                failed = true;
+                return globals.nilObject;
+            }
+            return newIntegerObject(left.shifted(count));
+        }
+
+        default:
+            std::fprintf(stderr, "Invalid integer opcode %d\n", opcode);
+            std::exit(1);
+    }
+}
+
+// Any number may be converted to double
+static bool toDouble(TObject* object, double& value)
+{
+    if (isSmallInteger(object)) {
+        value = TInteger(object).getValue();
+        return true;
+    }
+
+    TClass* const klass = object->getClass();
+    TClass* const floatClass = classRegistry.get<TFloat>();
+    if (floatClass && klass == floatClass) {
+        value = static_cast<TFloat*>(object)->getValue();
+        return true;
+    }
+
+    if (klass == classRegistry[TClassRegistry::integerClass]) {
+        const TByteObject* integer = static_cast<TByteObject*>(object);
+        value = LargeInteger::fromBytes(integer->getBytes(), integer->getSize()).toDouble();
+        return true;
+    }
+
+    return false;
+}
+
+// Shortest representation that is read back to the same value
+static std::string printFloat(double value)
+{
+    if (value != value)
+        return "nan";
+    if (value - value != 0)
+        return value < 0 ? "-inf" : "inf";
+
+    char buffer[32];
+    for (int precision = 1; precision <= 17; precision++) {
+        std::snprintf(buffer, sizeof(buffer), "%.*g", precision, value);
+        if (std::strtod(buffer, 0) == value)
+            break;
+    }
+
+    // Exponent is written as in the literals, so 1e+20 becomes 1e20
+    std::string result(buffer);
+    const std::size_t plus = result.find('+');
+    if (plus != std::string::npos)
+        result.erase(plus, 1);
+
+    // Floats should be distinguishable from integers
+    if (result.find_first_of(".e") == std::string::npos)
+        result += ".0";
+    return result;
+}
+
+static std::size_t skipDigits(const std::string& text, std::size_t position)
+{
+    while (position < text.size() && std::isdigit(static_cast<unsigned char>(text[position])))
+        position++;
+    return position;
+}
+
+// Number literal of the form [-]digits[.digits][e[-]digits]. Unlike strtod()
+// it does not allow the surrounding whitespace, hex numbers, inf and nan.
+static bool isFloatLiteral(const std::string& text)
+{
+    std::size_t position = (! text.empty() && text[0] == '-') ? 1 : 0;
+    std::size_t next = skipDigits(text, position);
+    if (next == position)
+        return false;
+    position = next;
+
+    if (position < text.size() && text[position] == '.') {
+        next = skipDigits(text, ++position);
+        if (next == position)
+            return false;
+        position = next;
+    }
+
+    if (position < text.size() && text[position] == 'e') {
+        if (++position < text.size() && text[position] == '-')
+            position++;
+        next = skipDigits(text, position);
+        if (next == position)
+            return false;
+        position = next;
+    }
+
+    return position == text.size();
+}
+
+TObject* SmalltalkVM::newFloatObject(double value)
+{
+    TFloat* const result = static_cast<TFloat*>( newBinaryObject(classRegistry.get<TFloat>(), sizeof(double)) );
+    if (result != globals.nilObject)
+        result->setValue(value);
+    return result;
+}
+
+TObject* SmalltalkVM::callFloatPrimitive(uint8_t opcode, TObject* receiver, TObject* argument, bool& failed)
+{
+    // Image does not define the Float class
+    if (! classRegistry.get<TFloat>()) {
+        failed = true;
+        return globals.nilObject;
+    }
+
+    switch (opcode) {
+        case primitive::floatTruncated: { // 56
+            double value;
+            LargeInteger integer;
+            if (! toDouble(receiver, value) || ! LargeInteger::fromDouble(value, integer)) {
+                failed = true;
+                return globals.nilObject;
+            }
+            return newIntegerObject(integer);
+        }
+
+        case primitive::floatNew: { // 57
+            double value;
+            if (! toDouble(receiver, value)) {
+                failed = true;
+                return globals.nilObject;
+            }
+            return newFloatObject(value);
+        }
+
+        case primitive::floatPrintString: { // 58
+            double value;
+            if (! toDouble(receiver, value)) {
+                failed = true;
+                return globals.nilObject;
+            }
+
+            const std::string text = printFloat(value);
+            TString* result = static_cast<TString*>( newBinaryObject(classRegistry.get<TString>(), text.size()) );
+            if (result == globals.nilObject) {
+                failed = true;
+                return globals.nilObject;
+            }
+            std::memcpy(result->getBytes(), text.data(), text.size());
+            return result;
+        }
+
+        case primitive::floatParse: { // 59
+            if (isSmallInteger(receiver) || receiver->getClass() != classRegistry.get<TString>()) {
+                failed = true;
+                return globals.nilObject;
+            }
+
+            const TString* string = static_cast<TString*>(receiver);
+            const std::string text(reinterpret_cast<const char*>(string->getBytes()), string->getSize());
+
+            // Literals too large for the double are rejected as well
+            const bool isLiteral = isFloatLiteral(text);
+            const double value = isLiteral ? std::strtod(text.c_str(), 0) : 0;
+            if (! isLiteral || value - value != 0) {
+                failed = true;
+                return globals.nilObject;
+            }
+            return newFloatObject(value);
+        }
+    }
+
+    double left;
+    double right;
+    if (! toDouble(receiver, left) || ! toDouble(argument, right)) {
+        failed = true;
+        return globals.nilObject;
+    }
+
+    switch (opcode) {
+        case primitive::floatAdd: return newFloatObject(left + right);
+        case primitive::floatSub: return newFloatObject(left - right);
+        case primitive::floatMul: return newFloatObject(left * right);
+
+        case primitive::floatDiv:
+            if (right == 0) {
+                failed = true;
+                return globals.nilObject;
+            }
+            return newFloatObject(left / right);
+
+        case primitive::floatLess:
+            return (left < right) ? globals.trueObject : globals.falseObject;
+        case primitive::floatEqual:
+            return (left == right) ? globals.trueObject : globals.falseObject;
+
+        default:
+            std::fprintf(stderr, "Invalid float opcode %d\n", opcode);
+            std::exit(1);
+    }
+}
+
+void SmalltalkVM::printVMStat()
+{
+    float hitRatio = 100.0 * m_cacheHits / (m_cacheHits + m_cacheMisses);
+    std::printf("%d messages sent, cache hits: %d, misses: %d, hit ratio %.2f %%\n",
+        m_messagesSent, m_cacheHits, m_cacheMisses, hitRatio);
+    std::printf("%u dispatch tables built\n", m_dispatchTables.getTablesBuilt());
+}
+
+void SmalltalkVM::printHeapCensus()
+{
+    // Only live objects should be counted
+    m_memoryManager->collectGarbage();
+    onCollectionOccured();
+
+    HeapCensus census;
+    m_memoryManager->walkHeap(census);
+    census.printHistogram();
+}
+
+void SmalltalkVM::dumpHeap(const char* fileName)
+{
+    m_memoryManager->collectGarbage();
+    onCollectionOccured();
+
+    if (Image::ImageWriter().setGlobals(globals).writeHeapDump(fileName, m_memoryManager))
+        std::printf("Heap dump is written to %s\n", fileName);
+}
+
+bool SmalltalkVM::saveImage(const std::string& fileName, bool externalSources)
+{
+    // Writer does not allocate, so objects stay in place while being written
+    if (!m_image->storeImage(fileName, externalSources))
+        return false;
+
+    std::printf("Image is saved to %s\n", fileName.c_str());
+    return true;
 }
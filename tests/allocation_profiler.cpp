@@ -0,0 +1,85 @@
+#include <gtest/gtest.h>
+#include <AllocationProfiler.h>
+#include <memory.h>
+#include <vm.h>
+
+TEST(AllocationProfiler, shouldSample)
+{
+    {
+        SCOPED_TRACE("one sample per interval");
+        AllocationProfiler profiler(100);
+        int samples = 0;
+        for (int i = 0; i < 100; i++)
+            samples += profiler.shouldSample(10);
+        EXPECT_EQ(10, samples);
+    }
+    {
+        SCOPED_TRACE("large allocation is sampled once with the weight of crossed boundaries");
+        AllocationProfiler profiler(100);
+        EXPECT_EQ(10u, profiler.shouldSample(1000));
+        EXPECT_EQ(0u, profiler.shouldSample(10));
+        EXPECT_EQ(2u, profiler.shouldSample(200));
+        EXPECT_EQ(0u, profiler.shouldSample(79));
+        EXPECT_EQ(1u, profiler.shouldSample(11));
+    }
+    {
+        SCOPED_TRACE("first sample is taken after the interval");
+        AllocationProfiler profiler(64);
+        EXPECT_FALSE(profiler.shouldSample(32));
+        EXPECT_FALSE(profiler.shouldSample(24));
+        EXPECT_TRUE(profiler.shouldSample(8));
+    }
+}
+
+class AllocationProfilerVM : public ::testing::Test
+{
+protected:
+    NonCollectMemoryManager m_memoryManager;
+    Image m_image;
+
+    AllocationProfilerVM() : m_image(&m_memoryManager) {}
+
+    virtual void SetUp() {
+        m_memoryManager.initializeHeap(1024*1024);
+        ASSERT_TRUE(m_image.loadImage(TESTS_DIR "./data/DecodeAllMethods.image"));
+    }
+};
+
+TEST_F(AllocationProfilerVM, attributesSampleToFrame)
+{
+    SmalltalkVM vm(&m_image, &m_memoryManager);
+    AllocationProfiler profiler(1); // every allocation is sampled with the weight of its size
+    vm.setAllocationProfiler(&profiler);
+
+    const uint32_t arraySize   = sizeof(TObject) + 3 * sizeof(TObject*);
+    const uint32_t contextSize = sizeof(TContext);
+
+    TClass* const objectClass = m_image.getGlobal<TClass>("Object");
+    TMethod* const method = objectClass->methods->find<TMethod>("printString");
+    ASSERT_TRUE(method != 0);
+
+    hptr<TContext> context = vm.newObject<TContext>();
+    context->method = method;
+    {
+        SCOPED_TRACE("interpreter frame");
+        const uint16_t bytePointer = 7;
+        SmalltalkVM::TExecutionFrame frame(&vm, context, &bytePointer);
+        vm.newObject<TObjectArray>(3);
+        EXPECT_EQ(arraySize, profiler.getSiteSamples("Object>>printString", 7, "Array"));
+        {
+            SCOPED_TRACE("innermost frame without byte pointer");
+            SmalltalkVM::TExecutionFrame jitFrame(&vm, context);
+            vm.newObject<TObjectArray>(3);
+            EXPECT_EQ(arraySize, profiler.getSiteSamples("Object>>printString", -1, "Array"));
+            EXPECT_EQ(arraySize, profiler.getSiteSamples("Object>>printString", 7, "Array"));
+        }
+    }
+    {
+        SCOPED_TRACE("no frame");
+        vm.newObject<TObjectArray>(3);
+        EXPECT_EQ(arraySize, profiler.getSiteSamples("<native>", -1, "Array"));
+        EXPECT_EQ(contextSize, profiler.getSiteSamples("<native>", -1, "Context"));
+    }
+
+    vm.setAllocationProfiler(0);
+}
@@ -0,0 +1,66 @@
+#include <gtest/gtest.h>
+#include <memory.h>
+
+#include <vector>
+#include <cstring>
+
+class ClassRegistry : public ::testing::Test
+{
+protected:
+    NonCollectMemoryManager m_memoryManager;
+    Image m_image;
+
+    ClassRegistry() : m_image(&m_memoryManager) {}
+
+    virtual void SetUp() {
+        m_memoryManager.initializeHeap(sizeof(TObject));
+        ASSERT_TRUE(m_image.loadImage(TESTS_DIR "./data/DecodeAllMethods.image"));
+    }
+};
+
+TEST_F(ClassRegistry, ResolvedOnLoad)
+{
+    for (std::size_t i = 0; i < TClassRegistry::classesCount; i++) {
+        const TClassRegistry::TIndex index = static_cast<TClassRegistry::TIndex>(i);
+        EXPECT_EQ(m_image.getGlobal(TClassRegistry::names[i]), classRegistry[index]) << TClassRegistry::names[i];
+    }
+
+    EXPECT_EQ(globals.arrayClass,    classRegistry.get<TObjectArray>());
+    EXPECT_EQ(globals.arrayClass,    classRegistry.get<TSymbolArray>());
+    EXPECT_EQ(globals.blockClass,    classRegistry.get<TBlock>());
+    EXPECT_EQ(globals.contextClass,  classRegistry.get<TContext>());
+    EXPECT_EQ(globals.stringClass,   classRegistry.get<TString>());
+    EXPECT_EQ(globals.smallIntClass, classRegistry[TClassRegistry::smallIntClass]);
+    EXPECT_EQ(globals.integerClass,  classRegistry[TClassRegistry::integerClass]);
+    EXPECT_EQ(globals.badMethodSymbol->getClass(), classRegistry.get<TSymbol>());
+    EXPECT_EQ(globals.initialMethod->getClass(),   classRegistry.get<TMethod>());
+    EXPECT_EQ(globals.globalsObject->getClass(),   classRegistry.get<TDictionary>());
+}
+
+TEST_F(ClassRegistry, RefreshedOnRedefinition)
+{
+    TDictionary* const dictionary = globals.globalsObject;
+    TClass* const processClass = classRegistry.get<TProcess>();
+    ASSERT_TRUE(processClass != 0);
+
+    std::size_t position = 0;
+    while (dictionary->keys->getField(position)->toString() != "Process")
+        position++;
+
+    // Class>>subclass: stores the new class to the existing key
+    std::vector<uint8_t> storage(processClass->getSlotSize());
+    std::memcpy(&storage[0], processClass, storage.size());
+    TClass* const redefined = reinterpret_cast<TClass*>(&storage[0]);
+    dictionary->values->putField(position, redefined);
+
+    classRegistry.resolve(dictionary);
+    EXPECT_EQ(redefined, classRegistry.get<TProcess>());
+
+    dictionary->values->putField(position, processClass);
+    classRegistry.resolve(dictionary);
+    EXPECT_EQ(processClass, classRegistry.get<TProcess>());
+
+    classRegistry.resolve(0);
+    EXPECT_TRUE(classRegistry.get<TProcess>() == 0);
+    classRegistry.resolve(dictionary);
+}
@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+#include <memory.h>
+
+#include <vector>
+#include <cstring>
+
+class DictionaryIndex : public ::testing::Test
+{
+protected:
+    NonCollectMemoryManager m_memoryManager;
+    Image m_image;
+
+    DictionaryIndex() : m_image(&m_memoryManager) {}
+
+    virtual void SetUp() {
+        m_memoryManager.initializeHeap(sizeof(TObject));
+        ASSERT_TRUE(m_image.loadImage(TESTS_DIR "./data/DecodeAllMethods.image"));
+    }
+};
+
+TEST_F(DictionaryIndex, FindsEveryKey)
+{
+    TDictionary* const dictionary = globals.globalsObject;
+    for (std::size_t i = 0; i < dictionary->keys->getSize(); i++) {
+        TSymbol* const name = dictionary->keys->getField(i);
+        EXPECT_EQ(name->getHash(), TSymbol::getHash(name->toString().c_str()));
+        ASSERT_EQ(dictionary->values->getField(i), dictionary->find(name));
+        ASSERT_EQ(dictionary->values->getField(i), dictionary->find(name->toString().c_str()));
+
+        TClass* const klass = dictionary->values->getField<TClass>(i);
+        if (isSmallInteger(klass) || klass->isBinary() || klass->getClass()->getClass() != m_image.getGlobal("Class"))
+            continue;
+
+        TDictionary* const methods = klass->methods;
+        for (std::size_t j = 0; j < methods->keys->getSize(); j++) {
+            TSymbol* const selector = methods->keys->getField(j);
+            ASSERT_EQ(methods->values->getField(j), methods->find(selector, selector->getHash()));
+        }
+    }
+
+    EXPECT_TRUE(dictionary->find("NoSuchGlobal") == 0);
+    EXPECT_TRUE(dictionary->find("Objec") == 0);
+    EXPECT_TRUE(dictionary->find("Object ") == 0);
+}
+
+TEST_F(DictionaryIndex, RebuiltWhenKeysReplaced)
+{
+    TClass* const objectClass = m_image.getGlobal<TClass>("Object");
+    ASSERT_TRUE(objectClass != 0);
+    TDictionary* const methods = objectClass->methods;
+    ASSERT_TRUE(methods->find("printString") != 0);
+
+    // Dictionary>>at:put: and removeKey: replace the arrays
+    const std::size_t keysCount = methods->keys->getSize() - 1;
+    const std::size_t arrayWords = sizeof(TObject) / sizeof(TObject*) + keysCount;
+    std::vector<TObject*> keysStorage(arrayWords);
+    std::vector<TObject*> valuesStorage(arrayWords);
+
+    TObject* const keys   = new (&keysStorage[0]) TObject(keysCount, methods->keys->getClass());
+    TObject* const values = new (&valuesStorage[0]) TObject(keysCount, methods->values->getClass());
+    for (std::size_t i = 0, position = 0; i <= keysCount; i++) {
+        if (methods->keys->getField(i)->toString() == "printString")
+            continue;
+
+        keys->putField(position, methods->keys->getField(i));
+        values->putField(position, methods->values->getField(i));
+        position++;
+    }
+
+    TSymbolArray* const originalKeys = methods->keys;
+    TObjectArray* const originalValues = methods->values;
+    methods->keys = static_cast<TSymbolArray*>(keys);
+    methods->values = static_cast<TObjectArray*>(values);
+
+    EXPECT_TRUE(methods->find("printString") == 0);
+    for (std::size_t i = 0; i < keysCount; i++)
+        EXPECT_EQ(values->getField(i), methods->find(static_cast<TSymbol*>(keys->getField(i))));
+
+    methods->keys = originalKeys;
+    methods->values = originalValues;
+    EXPECT_TRUE(methods->find("printString") != 0);
+}
+
+TEST_F(DictionaryIndex, SurvivesRelocation)
+{
+    TClass* const objectClass = m_image.getGlobal<TClass>("Object");
+    ASSERT_TRUE(objectClass != 0);
+    TDictionary* const methods = objectClass->methods;
+    ASSERT_TRUE(methods->find("printString") != 0);
+    const uint32_t tag = methods->keys->getHeaderHash();
+
+    // GC copies the object along with the header
+    TSymbolArray* const originalKeys = methods->keys;
+    std::vector<TObject*> keysStorage(originalKeys->getSlotSize() / sizeof(TObject*));
+    std::memcpy(&keysStorage[0], originalKeys, originalKeys->getSlotSize());
+    methods->keys = reinterpret_cast<TSymbolArray*>(&keysStorage[0]);
+
+    EXPECT_TRUE(methods->find("printString") != 0);
+    EXPECT_EQ(tag, methods->keys->getHeaderHash());
+
+    // Tags are not reused once indices are dropped
+    TDictionary::flushIndices();
+    EXPECT_TRUE(methods->find("printString") != 0);
+    if (tag) {
+        EXPECT_NE(tag, methods->keys->getHeaderHash());
+    }
+
+    methods->keys = originalKeys;
+    EXPECT_TRUE(methods->find("printString") != 0);
+}
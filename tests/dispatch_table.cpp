@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+#include <memory.h>
+#include <DispatchTable.h>
+
+class DispatchTableTest : public ::testing::Test
+{
+protected:
+    NonCollectMemoryManager m_memoryManager;
+    Image m_image;
+
+    DispatchTableTest() : m_image(&m_memoryManager) {}
+
+    virtual void SetUp() {
+        m_memoryManager.initializeHeap(sizeof(TObject));
+        ASSERT_TRUE(m_image.loadImage(TESTS_DIR "./data/DecodeAllMethods.image"));
+    }
+
+    // Reference lookup walking through the hierarchy
+    static TMethod* lookup(TClass* klass, TSymbol* selector) {
+        for (TClass* current = klass; current != globals.nilObject; current = current->parentClass) {
+            if (TMethod* const method = current->methods->find<TMethod>(selector))
+                return method;
+        }
+        return 0;
+    }
+};
+
+TEST_F(DispatchTableTest, MatchesHierarchyLookup)
+{
+    TDictionary* const dictionary = globals.globalsObject;
+    TClass* const classClass = classRegistry.get<TClass>();
+    TSymbol* const unknown = globals.badMethodSymbol;
+
+    for (std::size_t i = 0; i < dictionary->values->getSize(); i++) {
+        TClass* const klass = dictionary->values->getField<TClass>(i);
+        if (isSmallInteger(klass) || klass->isBinary() || klass->getClass()->getClass() != classClass)
+            continue;
+
+        DispatchTable table;
+        table.build(klass, &m_memoryManager);
+
+        std::size_t selectorsCount = 0;
+        for (TClass* current = klass; current != globals.nilObject; current = current->parentClass) {
+            TSymbolArray* const selectors = current->methods->keys;
+            for (std::size_t j = 0; j < selectors->getSize(); j++) {
+                TSymbol* const selector = selectors->getField(j);
+                ASSERT_EQ(lookup(klass, selector), table.find(selector, selector->getHash()))
+                    << klass->name->toString() << ">>" << selector->toString();
+                if (lookup(klass, selector)->klass == current)
+                    selectorsCount++;
+            }
+        }
+
+        EXPECT_EQ(selectorsCount, table.getSize()) << klass->name->toString();
+        EXPECT_EQ(lookup(klass, unknown), table.find(unknown, unknown->getHash()));
+    }
+}
+
+TEST_F(DispatchTableTest, BuiltAfterThreshold)
+{
+    TClass* const stringClass = classRegistry.get<TString>();
+    DispatchTables tables;
+
+    for (uint32_t i = 1; i < DispatchTables::MISSES_THRESHOLD; i++)
+        EXPECT_TRUE(tables.get(stringClass, &m_memoryManager) == 0);
+
+    const DispatchTable* const table = tables.get(stringClass, &m_memoryManager);
+    ASSERT_TRUE(table != 0);
+    EXPECT_EQ(1u, tables.getTablesBuilt());
+    EXPECT_EQ(table, tables.get(stringClass, &m_memoryManager));
+
+    tables.flush();
+    EXPECT_TRUE(tables.get(stringClass, &m_memoryManager) == 0);
+}
@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+#include "patterns/InitVMImage.h"
+#include <ForeignFunctions.h>
+#include <primitives.h>
+#include <opcodes.h>
+
+INSTANTIATE_TEST_CASE_P(_, P_InitVM_Image, ::testing::Values(std::string("VMPrimitives")) );
+
+TEST(ForeignFunctions, LibrariesAndSymbols)
+{
+    ForeignFunctions functions;
+    EXPECT_EQ(-1, functions.open("/nonexistent/library.so"));
+
+    const int32_t library = functions.open("libc.so.6");
+    ASSERT_LE(0, library);
+    EXPECT_EQ(-1, functions.resolve(library, "no_such_function_in_libc"));
+    EXPECT_EQ(-1, functions.resolve(library + 1, "strlen"));
+
+    const int32_t strlenSymbol = functions.resolve(library, "strlen");
+    ASSERT_LE(0, strlenSymbol);
+    void* const address = functions.getAddress(library, strlenSymbol);
+    ASSERT_TRUE(address != 0);
+    EXPECT_TRUE(functions.getAddress(library + 1, strlenSymbol) == 0);
+
+    const intptr_t text = reinterpret_cast<intptr_t>("foreign");
+    EXPECT_EQ(7, ForeignFunctions::invoke(address, &text, 1));
+
+    EXPECT_TRUE(functions.close(library));
+    EXPECT_FALSE(functions.close(library));
+    EXPECT_TRUE(functions.getAddress(library, strlenSymbol) == 0);
+}
+
+TEST_P(P_InitVM_Image, foreignCalls)
+{
+    bool primitiveFailed = false;
+    TObjectArray* args = m_image->newArray(3);
+
+    args->putField(0, m_image->newString("libc.so.6"));
+    const TInteger library = callPrimitive(primitive::ffiOpen, args, primitiveFailed);
+    ASSERT_FALSE(primitiveFailed);
+
+    args->putField(0, library);
+    args->putField(1, m_image->newString("strlen"));
+    const TInteger strlenSymbol = callPrimitive(primitive::ffiResolve, args, primitiveFailed);
+    ASSERT_FALSE(primitiveFailed);
+
+    args->putField(1, m_image->newString("memset"));
+    const TInteger memsetSymbol = callPrimitive(primitive::ffiResolve, args, primitiveFailed);
+    ASSERT_FALSE(primitiveFailed);
+
+    {
+        SCOPED_TRACE("string is passed as the zero terminated copy");
+        TObjectArray* arguments = m_image->newArray(1);
+        arguments->putField(0, m_image->newString("hello"));
+
+        args->putField(1, strlenSymbol);
+        args->putField(2, arguments);
+        ASSERT_EQ(5, TInteger(callPrimitive(primitive::ffiCallInt, args, primitiveFailed)).getValue());
+        ASSERT_FALSE(primitiveFailed);
+
+        // Result is not converted
+        ASSERT_EQ(globals.nilObject, callPrimitive(primitive::ffiCall, args, primitiveFailed));
+        ASSERT_FALSE(primitiveFailed);
+    }
+    {
+        SCOPED_TRACE("bytes of the binary object are passed by pointer");
+        TString* buffer = m_image->newString("abcdef");
+        TObjectArray* arguments = m_image->newArray(3);
+        arguments->putField(0, buffer);
+        arguments->putField(1, TInteger('z'));
+        arguments->putField(2, TInteger(3));
+
+        // Strings are copied, so only the byte arrays may be written
+        buffer->setClass(classRegistry.get<TByteArray>());
+
+        args->putField(1, memsetSymbol);
+        args->putField(2, arguments);
+        callPrimitive(primitive::ffiCall, args, primitiveFailed);
+        ASSERT_FALSE(primitiveFailed);
+        ASSERT_EQ("zzzdef", std::string(reinterpret_cast<const char*>(buffer->getBytes()), buffer->getSize()));
+    }
+    {
+        SCOPED_TRACE("string result pointing into the argument is copied");
+        args->putField(1, m_image->newString("strchr"));
+        const TInteger strchrSymbol = callPrimitive(primitive::ffiResolve, args, primitiveFailed);
+        ASSERT_FALSE(primitiveFailed);
+
+        TObjectArray* arguments = m_image->newArray(2);
+        arguments->putField(0, m_image->newString("hello"));
+        arguments->putField(1, TInteger('l'));
+
+        intptr_t result = 0;
+        std::string text;
+        ASSERT_TRUE(foreignFunctions.call(library, strchrSymbol, arguments, result, &text));
+        ASSERT_EQ("llo", text);
+
+        arguments->putField(1, TInteger('z'));
+        text.clear();
+        ASSERT_TRUE(foreignFunctions.call(library, strchrSymbol, arguments, result, &text));
+        ASSERT_EQ(0, result);
+        ASSERT_TRUE(text.empty());
+    }
+    {
+        SCOPED_TRACE("invalid arguments");
+        TObjectArray* arguments = m_image->newArray(1);
+        arguments->putField(0, m_image->newArray(1));
+        args->putField(1, strlenSymbol);
+        args->putField(2, arguments);
+        callPrimitive(primitive::ffiCallInt, args, primitiveFailed);
+        ASSERT_TRUE(primitiveFailed);
+
+        args->putField(2, m_image->newArray(ForeignFunctions::MAX_ARGUMENTS + 1));
+        callPrimitive(primitive::ffiCallInt, args, primitiveFailed);
+        ASSERT_TRUE(primitiveFailed);
+    }
+
+    args->putField(1, m_image->newString("opterr"));
+    const TInteger variable = callPrimitive(primitive::ffiResolve, args, primitiveFailed);
+    ASSERT_FALSE(primitiveFailed);
+    args->putField(1, variable);
+    args->putField(2, TInteger(0));
+    callPrimitive(primitive::ffiSetInt, args, primitiveFailed);
+    ASSERT_FALSE(primitiveFailed);
+    ASSERT_EQ(0, TInteger(callPrimitive(primitive::ffiGetInt, args, primitiveFailed)).getValue());
+    args->putField(2, TInteger(1));
+    callPrimitive(primitive::ffiSetInt, args, primitiveFailed);
+    ASSERT_EQ(1, TInteger(callPrimitive(primitive::ffiGetInt, args, primitiveFailed)).getValue());
+
+    callPrimitive(primitive::ffiClose, args, primitiveFailed);
+    ASSERT_FALSE(primitiveFailed);
+    args->putField(1, strlenSymbol);
+    callPrimitive(primitive::ffiCallInt, args, primitiveFailed);
+    ASSERT_TRUE(primitiveFailed);
+}
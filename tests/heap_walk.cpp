@@ -0,0 +1,169 @@
+#include <gtest/gtest.h>
+#include <memory.h>
+#include <HeapGraph.h>
+
+// Objects are created directly in the memory manager's heaps.
+// Fake classes are binary objects so that they are easy to tell apart.
+class HeapWalk : public ::testing::Test
+{
+protected:
+    TClass* newClass(IMemoryManager& mm) {
+        void* slot = mm.staticAllocate(correctPadding(sizeof(TByteObject)));
+        return static_cast<TClass*>( static_cast<TObject*>(new (slot) TByteObject(0, 0)) );
+    }
+
+    TObject* newObject(IMemoryManager& mm, TClass* klass, uint32_t fieldsCount) {
+        void* slot = mm.allocate(sizeof(TObject) + fieldsCount * sizeof(TObject*));
+        return new (slot) TObject(fieldsCount, klass);
+    }
+
+    TByteObject* newByteObject(IMemoryManager& mm, TClass* klass, uint32_t dataSize) {
+        void* slot = mm.allocate(correctPadding(sizeof(TByteObject) + dataSize));
+        return new (slot) TByteObject(dataSize, klass);
+    }
+
+    const HeapCensus::TClassInfo* findClass(const std::vector<HeapCensus::TClassInfo>& histogram, TClass* klass) {
+        for (std::size_t i = 0; i < histogram.size(); i++)
+            if (histogram[i].klass == klass)
+                return &histogram[i];
+        return 0;
+    }
+
+    void checkCensus(IMemoryManager& mm, uint32_t objectsCount) {
+        TClass* ordinaryClass = newClass(mm);
+        TClass* binaryClass = newClass(mm);
+
+        for (uint32_t i = 0; i < objectsCount; i++) {
+            newObject(mm, ordinaryClass, 3);
+            newByteObject(mm, binaryClass, 5);
+        }
+
+        HeapCensus census;
+        mm.walkHeap(census);
+        const std::vector<HeapCensus::TClassInfo> histogram = census.getHistogram();
+
+        const HeapCensus::TClassInfo* ordinary = findClass(histogram, ordinaryClass);
+        ASSERT_TRUE(ordinary != 0);
+        EXPECT_EQ(objectsCount, ordinary->instances);
+        EXPECT_EQ(objectsCount * (sizeof(TObject) + 3 * sizeof(TObject*)), ordinary->bytes);
+
+        const HeapCensus::TClassInfo* binary = findClass(histogram, binaryClass);
+        ASSERT_TRUE(binary != 0);
+        EXPECT_EQ(objectsCount, binary->instances);
+        EXPECT_EQ(objectsCount * correctPadding(sizeof(TByteObject) + 5), binary->bytes);
+
+        // Classes themselves reside in the static heap
+        const HeapCensus::TClassInfo* classes = findClass(histogram, 0);
+        ASSERT_TRUE(classes != 0);
+        EXPECT_EQ(2u, classes->instances);
+
+        // Histogram is sorted by the occupied space
+        for (std::size_t i = 1; i < histogram.size(); i++)
+            EXPECT_GE(histogram[i-1].bytes, histogram[i].bytes);
+    }
+};
+
+TEST_F(HeapWalk, BakerMemoryManager)
+{
+    BakerMemoryManager mm;
+    mm.initializeHeap(64 * 1024, 64 * 1024);
+    mm.initializeStaticHeap(1024);
+
+    checkCensus(mm, 100);
+}
+
+TEST_F(HeapWalk, NonCollectMemoryManager)
+{
+    NonCollectMemoryManager mm;
+    mm.initializeHeap(1024);
+    mm.initializeStaticHeap(1024);
+
+    // Objects do not fit into the single heap, so walk should go through all of them
+    checkCensus(mm, 100);
+}
+
+// Graph with the known dominator tree:
+//
+//   root -> left  -> shared
+//        -> right -> shared
+//           left  -> own
+//   garbage -> left
+//
+// Shared object is dominated by the root, own object by the left one.
+// Garbage is not reachable, so it counts in the census but retains nothing.
+TEST_F(HeapWalk, RetainedSizes)
+{
+    NonCollectMemoryManager mm;
+    mm.initializeHeap(1024);
+    mm.initializeStaticHeap(1024);
+
+    TClass* ordinaryClass = newClass(mm);
+    TClass* binaryClass = newClass(mm);
+
+    TObject* root    = newObject(mm, ordinaryClass, 2);
+    TObject* left    = newObject(mm, ordinaryClass, 2);
+    TObject* right   = newObject(mm, ordinaryClass, 2);
+    TObject* garbage = newObject(mm, ordinaryClass, 2);
+    TObject* shared  = newByteObject(mm, binaryClass, 5);
+    TObject* own     = newByteObject(mm, binaryClass, 9);
+
+    root->putField(0, left);
+    root->putField(1, right);
+    left->putField(0, shared);
+    left->putField(1, own);
+    right->putField(0, shared);
+    right->putField(1, 0);
+    garbage->putField(0, left);
+    garbage->putField(1, 0);
+
+    HeapCensus census;
+    mm.walkHeap(census);
+    const std::vector<HeapCensus::TClassInfo> histogram = census.getHistogram();
+    const HeapCensus::TClassInfo* ordinary = findClass(histogram, ordinaryClass);
+    ASSERT_TRUE(ordinary != 0);
+    EXPECT_EQ(4u, ordinary->instances);
+    EXPECT_EQ(4 * root->getSlotSize(), ordinary->bytes);
+
+    HeapGraph graph;
+    graph.build(mm, std::vector<TObject*>(1, root));
+    graph.calculateDominators();
+    graph.calculateRetainedSizes();
+
+    const HeapGraph::TNodeIndex rootNode    = graph.findNode(root);
+    const HeapGraph::TNodeIndex leftNode    = graph.findNode(left);
+    const HeapGraph::TNodeIndex rightNode   = graph.findNode(right);
+    const HeapGraph::TNodeIndex garbageNode = graph.findNode(garbage);
+    const HeapGraph::TNodeIndex sharedNode  = graph.findNode(shared);
+    const HeapGraph::TNodeIndex ownNode     = graph.findNode(own);
+    ASSERT_EQ(8u, graph.objects.size() - 1);
+    ASSERT_NE(HeapGraph::invalidNode, garbageNode);
+
+    EXPECT_FALSE(graph.isReachable(garbageNode));
+    EXPECT_EQ(0u, graph.immediateDominator[rootNode]);
+    EXPECT_EQ(rootNode, graph.immediateDominator[leftNode]);
+    EXPECT_EQ(rootNode, graph.immediateDominator[rightNode]);
+    EXPECT_EQ(rootNode, graph.immediateDominator[sharedNode]);
+    EXPECT_EQ(leftNode, graph.immediateDominator[ownNode]);
+    EXPECT_EQ(rootNode, graph.immediateDominator[graph.findNode(binaryClass)]);
+
+    const uint32_t ordinarySize = root->getSlotSize();
+    const uint32_t classSize = ordinaryClass->getSlotSize();
+    EXPECT_EQ(shared->getSlotSize(), graph.retainedSize[sharedNode]);
+    EXPECT_EQ(ordinarySize, graph.retainedSize[rightNode]);
+    EXPECT_EQ(ordinarySize + own->getSlotSize(), graph.retainedSize[leftNode]);
+    EXPECT_EQ(3 * ordinarySize + shared->getSlotSize() + own->getSlotSize() + 2 * classSize,
+        graph.retainedSize[rootNode]);
+
+    // Instances dominated by the instance of the same class are not summed twice
+    const std::vector<HeapGraph::TClassRecord> classes = graph.getClassTable();
+    ASSERT_EQ(3u, classes.size());
+    EXPECT_EQ(ordinaryClass, classes[0].klass);
+    EXPECT_EQ(3u, classes[0].instances);
+    EXPECT_EQ(3 * ordinarySize, classes[0].shallowSize);
+    EXPECT_EQ(graph.retainedSize[rootNode], classes[0].retainedSize);
+
+    const HeapGraph::TClassRecord& binary = (classes[1].klass == binaryClass) ? classes[1] : classes[2];
+    EXPECT_EQ(binaryClass, binary.klass);
+    EXPECT_EQ(2u, binary.instances);
+    EXPECT_EQ(shared->getSlotSize() + own->getSlotSize(), binary.retainedSize);
+}
@@ -22,6 +22,9 @@ public:
     TString* newString(const std::string& str);
     template<class T> void deleteObject(T* object);
 private:
+    // String primitives are tested on objects of arbitrary classes
+    friend class P_InitVM_Image_string_Test;
+
     TObject* newOrdinaryObject(TClass* klass, std::size_t slotSize);
     TByteObject* newBinaryObject(TClass* klass, std::size_t dataSize);
 };
@@ -0,0 +1,356 @@
+#include <gtest/gtest.h>
+#include <memory.h>
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+// Image is written back and loaded again by a separate memory manager
+class ImageWriter : public ::testing::Test
+{
+protected:
+    class TCounter : public IHeapVisitor {
+    public:
+        std::size_t objects;
+        std::size_t bytes;
+        TCounter() : objects(0), bytes(0) {}
+        virtual void visitObject(TObject* object) {
+            objects++;
+            bytes += object->getSlotSize();
+        }
+    };
+
+    virtual void TearDown() {
+        std::remove("ImageWriter.image");
+        std::remove("ImageWriter2.image");
+        std::remove("ImageWriter3.image");
+        std::remove("ImageWriter.sources");
+        std::remove("ImageWriter2.sources");
+    }
+
+    std::string readFile(const char* fileName) {
+        std::ifstream stream(fileName, std::ifstream::binary);
+        return std::string(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    }
+};
+
+TEST_F(ImageWriter, RoundTrip)
+{
+    NonCollectMemoryManager sourceManager;
+    sourceManager.initializeHeap(sizeof(TObject));
+    Image sourceImage(&sourceManager);
+    ASSERT_TRUE(sourceImage.loadImage(TESTS_DIR "./data/DecodeAllMethods.image"));
+
+    TCounter sourceCounter;
+    sourceManager.walkHeap(sourceCounter);
+
+    ASSERT_TRUE(sourceImage.storeImage("ImageWriter.image", false));
+
+    // Temporary file is renamed over the target
+    EXPECT_FALSE(std::ifstream("ImageWriter.image.tmp").is_open());
+
+    NonCollectMemoryManager savedManager;
+    savedManager.initializeHeap(sizeof(TObject));
+    Image savedImage(&savedManager);
+    ASSERT_TRUE(savedImage.loadImage("ImageWriter.image"));
+
+    TCounter savedCounter;
+    savedManager.walkHeap(savedCounter);
+
+    EXPECT_EQ(sourceCounter.objects, savedCounter.objects);
+    EXPECT_EQ(sourceCounter.bytes, savedCounter.bytes);
+
+    TClass* const objectClass = savedImage.getGlobal<TClass>("Object");
+    ASSERT_TRUE(objectClass != 0);
+    EXPECT_EQ("Object", objectClass->name->toString());
+
+    // Writing the loaded image again produces the same file
+    ASSERT_TRUE(savedImage.storeImage("ImageWriter2.image", false));
+    const std::string first = readFile("ImageWriter.image");
+    EXPECT_FALSE(first.empty());
+    EXPECT_TRUE(first == readFile("ImageWriter2.image"));
+}
+
+TEST_F(ImageWriter, DeepObjectGraph)
+{
+    NonCollectMemoryManager sourceManager;
+    sourceManager.initializeHeap(sizeof(TObject));
+    Image sourceImage(&sourceManager);
+    ASSERT_TRUE(sourceImage.loadImage(TESTS_DIR "./data/DecodeAllMethods.image"));
+
+    // Long chain of arrays would overflow the stack of the recursive writer
+    const uint32_t chainLength = 1000000;
+    const std::size_t linkWords = (sizeof(TObject) + sizeof(TObject*)) / sizeof(TObject*);
+    std::vector<TObject*> storage(chainLength * linkWords);
+
+    TObject* chain = globals.nilObject;
+    for (uint32_t i = 0; i < chainLength; i++) {
+        TObject* link = new (&storage[i * linkWords]) TObject(1, globals.arrayClass);
+        link->putField(0, chain);
+        chain = link;
+    }
+    globals.binaryMessages[0] = chain;
+
+    ASSERT_TRUE(Image::ImageWriter().setGlobals(globals).writeTo("ImageWriter.image"));
+}
+
+TEST_F(ImageWriter, CompactEncoding)
+{
+    NonCollectMemoryManager sourceManager;
+    sourceManager.initializeHeap(sizeof(TObject));
+    Image sourceImage(&sourceManager);
+    ASSERT_TRUE(sourceImage.loadImage(TESTS_DIR "./data/DecodeAllMethods.image"));
+
+    // Integers of all widths should survive the zigzag encoding
+    const intptr_t minValue = TInteger::MIN_VALUE;
+    const intptr_t maxValue = TInteger::MAX_VALUE;
+    const intptr_t values[] = { 0, -1, 1, 63, -64, 64, minValue, maxValue };
+    const uint32_t valuesCount = sizeof(values) / sizeof(values[0]);
+
+    std::vector<TObject*> storage(sizeof(TObject) / sizeof(TObject*) + valuesCount);
+    TObject* array = new (&storage[0]) TObject(valuesCount, globals.arrayClass);
+    for (uint32_t i = 0; i < valuesCount; i++)
+        array->putField(i, TInteger(values[i]));
+    globals.binaryMessages[0] = array;
+
+    ASSERT_TRUE(Image::ImageWriter().setGlobals(globals).writeTo("ImageWriter.image"));
+    ASSERT_TRUE(Image::ImageWriter().setGlobals(globals).setEncoding(Image::compactEncoding).writeTo("ImageWriter2.image"));
+
+    const std::string classic = readFile("ImageWriter.image");
+    const std::string compact = readFile("ImageWriter2.image");
+    EXPECT_LT(compact.size(), classic.size());
+
+    TCounter sourceCounter;
+    sourceManager.walkHeap(sourceCounter);
+
+    NonCollectMemoryManager compactManager;
+    compactManager.initializeHeap(sizeof(TObject));
+    Image compactImage(&compactManager);
+    ASSERT_TRUE(compactImage.loadImage("ImageWriter2.image"));
+
+    // Array was not in the static heap of the source image
+    TCounter compactCounter;
+    compactManager.walkHeap(compactCounter);
+    EXPECT_EQ(sourceCounter.objects + 1, compactCounter.objects);
+    EXPECT_EQ(sourceCounter.bytes + array->getSlotSize(), compactCounter.bytes);
+
+    TObject* loadedArray = globals.binaryMessages[0];
+    ASSERT_EQ(valuesCount, loadedArray->getSize());
+    for (uint32_t i = 0; i < valuesCount; i++) {
+        ASSERT_TRUE(isSmallInteger(loadedArray->getField(i)));
+        EXPECT_EQ(values[i], TInteger(loadedArray->getField(i)).getValue());
+    }
+
+    TClass* const objectClass = compactImage.getGlobal<TClass>("Object");
+    ASSERT_TRUE(objectClass != 0);
+    EXPECT_EQ("Object", objectClass->name->toString());
+
+    // Image is stored back in the encoding it was loaded with
+    ASSERT_TRUE(compactImage.storeImage("ImageWriter3.image", false));
+    EXPECT_TRUE(compact == readFile("ImageWriter3.image"));
+
+    // Varint that never ends fails the load instead of spinning
+    {
+        std::ofstream malformed("ImageWriter3.image", std::ofstream::binary);
+        malformed << compact.substr(0, 40) << std::string(11, '\xFF');
+    }
+    NonCollectMemoryManager malformedManager;
+    malformedManager.initializeHeap(sizeof(TObject));
+    Image malformedImage(&malformedManager);
+    EXPECT_THROW(malformedImage.loadImage("ImageWriter3.image"), std::runtime_error);
+}
+
+TEST_F(ImageWriter, ExternalSources)
+{
+    NonCollectMemoryManager sourceManager;
+    sourceManager.initializeHeap(sizeof(TObject));
+    Image sourceImage(&sourceManager);
+    ASSERT_TRUE(sourceImage.loadImage(TESTS_DIR "./data/DecodeAllMethods.image"));
+
+    TCounter sourceCounter;
+    sourceManager.walkHeap(sourceCounter);
+
+    TClass* objectClass = sourceImage.getGlobal<TClass>("Object");
+    ASSERT_TRUE(objectClass != 0);
+    TMethod* method = objectClass->methods->find<TMethod>("printString");
+    ASSERT_TRUE(method != 0);
+    ASSERT_FALSE(isSmallInteger(method->text));
+    const std::string text(reinterpret_cast<const char*>(method->text->getBytes()), method->text->getSize());
+    EXPECT_FALSE(text.empty());
+
+    ASSERT_TRUE(sourceImage.storeImage("ImageWriter.image", true));
+    EXPECT_EQ("ImageWriter.sources", Image::getSourcesFileName("ImageWriter.image"));
+
+    // Method texts are replaced by the offsets in the sources file
+    {
+        NonCollectMemoryManager externalManager;
+        externalManager.initializeHeap(sizeof(TObject));
+        Image externalImage(&externalManager);
+        ASSERT_TRUE(externalImage.loadImage("ImageWriter.image"));
+        EXPECT_TRUE(externalImage.hasExternalSources());
+
+        TCounter externalCounter;
+        externalManager.walkHeap(externalCounter);
+        EXPECT_LT(externalCounter.objects, sourceCounter.objects);
+        EXPECT_LT(externalCounter.bytes, sourceCounter.bytes);
+
+        objectClass = externalImage.getGlobal<TClass>("Object");
+        method = objectClass->methods->find<TMethod>("printString");
+        ASSERT_TRUE(isSmallInteger(method->text));
+
+        std::string externalText;
+        ASSERT_TRUE(externalImage.readSource(TInteger(method->text).getValue(), externalText));
+        EXPECT_EQ(text, externalText);
+
+        // Texts are brought back when sources are not external
+        ASSERT_TRUE(externalImage.storeImage("ImageWriter2.image", false));
+    }
+
+    // Mode is taken from the image header, not from the files around it
+    {
+        std::ofstream staleSources("ImageWriter2.sources");
+        staleSources << "0\n";
+    }
+
+    NonCollectMemoryManager residentManager;
+    residentManager.initializeHeap(sizeof(TObject));
+    Image residentImage(&residentManager);
+    ASSERT_TRUE(residentImage.loadImage("ImageWriter2.image"));
+    EXPECT_FALSE(residentImage.hasExternalSources());
+
+    TCounter residentCounter;
+    residentManager.walkHeap(residentCounter);
+    EXPECT_EQ(sourceCounter.objects, residentCounter.objects);
+
+    objectClass = residentImage.getGlobal<TClass>("Object");
+    method = objectClass->methods->find<TMethod>("printString");
+    ASSERT_FALSE(isSmallInteger(method->text));
+    EXPECT_EQ(text, std::string(reinterpret_cast<const char*>(method->text->getBytes()), method->text->getSize()));
+}
+
+TEST_F(ImageWriter, LocalityLayout)
+{
+    class TSymbolRuns : public IHeapVisitor {
+    public:
+        TClass* symbolClass;
+        std::size_t runs;
+        bool inRun;
+        TSymbolRuns(TClass* symbolClass) : symbolClass(symbolClass), runs(0), inRun(false) {}
+        virtual void visitObject(TObject* object) {
+            const bool isSymbol = object->getClass() == symbolClass;
+            if (isSymbol && !inRun)
+                runs++;
+            inRun = isSymbol;
+        }
+    };
+
+    NonCollectMemoryManager serialManager;
+    serialManager.initializeHeap(sizeof(TObject));
+    Image serialImage(&serialManager);
+    serialImage.setLocalityLayout(false);
+    ASSERT_TRUE(serialImage.loadImage(TESTS_DIR "./data/DecodeAllMethods.image"));
+    ASSERT_TRUE(serialImage.storeImage("ImageWriter.image", false));
+
+    TSymbolRuns serialRuns(serialImage.getGlobal<TClass>("Symbol"));
+    serialManager.walkHeap(serialRuns);
+    EXPECT_GT(serialRuns.runs, 1u);
+
+    NonCollectMemoryManager clusteredManager;
+    clusteredManager.initializeHeap(sizeof(TObject));
+    Image clusteredImage(&clusteredManager);
+    ASSERT_TRUE(clusteredImage.loadImage(TESTS_DIR "./data/DecodeAllMethods.image"));
+
+    // Symbols are packed together
+    TSymbolRuns clusteredRuns(clusteredImage.getGlobal<TClass>("Symbol"));
+    clusteredManager.walkHeap(clusteredRuns);
+    EXPECT_EQ(1u, clusteredRuns.runs);
+
+    // Method dictionary and each method are followed by their parts
+    TClass* const objectClass = clusteredImage.getGlobal<TClass>("Object");
+    ASSERT_TRUE(objectClass != 0);
+    TDictionary* const methods = objectClass->methods;
+    const uint8_t* const methodsSlot = reinterpret_cast<const uint8_t*>(methods);
+    EXPECT_EQ(methodsSlot + methods->getSlotSize(), reinterpret_cast<const uint8_t*>(methods->keys));
+    EXPECT_EQ(methodsSlot + methods->getSlotSize() + methods->keys->getSlotSize(), reinterpret_cast<const uint8_t*>(methods->values));
+
+    TMethod* const method = methods->find<TMethod>("printString");
+    ASSERT_TRUE(method != 0);
+    const uint8_t* const methodSlot = reinterpret_cast<const uint8_t*>(method);
+    EXPECT_EQ(methodSlot + method->getSlotSize(), reinterpret_cast<const uint8_t*>(method->byteCodes));
+
+    // Layout does not change the object graph
+    ASSERT_TRUE(clusteredImage.storeImage("ImageWriter2.image", false));
+    const std::string serial = readFile("ImageWriter.image");
+    EXPECT_FALSE(serial.empty());
+    EXPECT_TRUE(serial == readFile("ImageWriter2.image"));
+}
+
+TEST_F(ImageWriter, SerializedGraph)
+{
+    NonCollectMemoryManager sourceManager;
+    sourceManager.initializeHeap(sizeof(TObject));
+    Image sourceImage(&sourceManager);
+    ASSERT_TRUE(sourceImage.loadImage(TESTS_DIR "./data/DecodeAllMethods.image"));
+
+    typedef Image::GraphReader::TReference TReference;
+    typedef Image::GraphReader::TNode TNode;
+
+    // Array of the string, itself, the symbol, the class, true and the integer
+    std::vector<TObject*> stringStorage(sizeof(TByteObject) / sizeof(TObject*) + 1);
+    TByteObject* const string = new (&stringStorage[0]) TByteObject(3, globals.stringClass);
+    std::memcpy(string->getBytes(), "abc", 3);
+
+    std::vector<TObject*> storage(sizeof(TObject) / sizeof(TObject*) + 6);
+    TObject* const array = new (&storage[0]) TObject(6, globals.arrayClass);
+    array->putField(0, string);
+    array->putField(1, array);
+    array->putField(2, globals.badMethodSymbol);
+    array->putField(3, globals.stringClass);
+    array->putField(4, globals.trueObject);
+    array->putField(5, TInteger(-42));
+
+    std::vector<uint8_t> graph;
+    ASSERT_TRUE(Image::ImageWriter().setGlobals(globals).writeGraph(array, graph));
+
+    Image::GraphReader reader;
+    ASSERT_TRUE(reader.read(&graph[0], graph.size()));
+
+    // Array, Array class, string, String class, symbol
+    const std::vector<TNode>& nodes = reader.getNodes();
+    ASSERT_EQ(5u, nodes.size());
+    ASSERT_EQ(0u, reader.getRoot().node);
+    EXPECT_TRUE(reader.getRoot().immediate == 0);
+
+    const TNode& root = nodes[0];
+    ASSERT_EQ(Image::GraphReader::ordinaryNode, root.kind);
+    ASSERT_EQ(6u, root.size);
+    EXPECT_EQ(Image::GraphReader::globalNode, nodes[root.classNode].kind);
+    EXPECT_EQ("Array", std::string(reinterpret_cast<const char*>(reader.getData(nodes[root.classNode])), nodes[root.classNode].size));
+
+    const TReference& stringReference = reader.getField(root, 0);
+    ASSERT_TRUE(stringReference.immediate == 0);
+    const TNode& stringNode = nodes[stringReference.node];
+    EXPECT_EQ(Image::GraphReader::byteNode, stringNode.kind);
+    EXPECT_EQ("abc", std::string(reinterpret_cast<const char*>(reader.getData(stringNode)), stringNode.size));
+
+    EXPECT_EQ(0u, reader.getField(root, 1).node);
+    EXPECT_TRUE(reader.getField(root, 1).immediate == 0);
+
+    const TNode& symbolNode = nodes[reader.getField(root, 2).node];
+    EXPECT_EQ(Image::GraphReader::symbolNode, symbolNode.kind);
+    EXPECT_EQ(globals.badMethodSymbol->toString(), std::string(reinterpret_cast<const char*>(reader.getData(symbolNode)), symbolNode.size));
+
+    // Class is written once and referred to afterwards
+    EXPECT_EQ(stringNode.classNode, reader.getField(root, 3).node);
+    EXPECT_EQ(globals.trueObject, reader.getField(root, 4).immediate);
+    EXPECT_EQ(TInteger(-42), reader.getField(root, 5).immediate);
+
+    // Truncated and extended graphs are rejected
+    EXPECT_FALSE(reader.read(&graph[0], graph.size() - 1));
+    graph.push_back(0);
+    EXPECT_FALSE(reader.read(&graph[0], graph.size()));
+
+    // Methods are not serialized
+    array->putField(1, globals.initialMethod);
+    EXPECT_FALSE(Image::ImageWriter().setGlobals(globals).writeGraph(array, graph));
+}
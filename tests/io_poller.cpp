@@ -0,0 +1,126 @@
+#include <gtest/gtest.h>
+#include <IOPoller.h>
+
+#include <cstdio>
+#include <unistd.h>
+#include <sys/socket.h>
+
+TEST(IOPoller, ReportsReadyDescriptorsOnce)
+{
+    int channel[2];
+    ASSERT_EQ(0, pipe(channel));
+
+    IOPoller poller;
+    std::vector<int> ready;
+
+    EXPECT_TRUE(poller.wait(-1, ready)) << "nothing to wait for";
+    EXPECT_TRUE(ready.empty());
+
+    ASSERT_TRUE(poller.watch(channel[0], IOPoller::readable));
+    ASSERT_TRUE(poller.watch(channel[1], IOPoller::writable));
+    EXPECT_EQ(2u, poller.getWatchedCount());
+
+    // Only the write end is ready
+    ASSERT_TRUE(poller.wait(0, ready));
+    ASSERT_EQ(1u, ready.size());
+    EXPECT_EQ(channel[1], ready[0]);
+    EXPECT_EQ(1u, poller.getWatchedCount());
+
+    ASSERT_EQ(1, write(channel[1], "x", 1));
+    ASSERT_TRUE(poller.wait(-1, ready));
+    ASSERT_EQ(1u, ready.size());
+    EXPECT_EQ(channel[0], ready[0]);
+    EXPECT_EQ(0u, poller.getWatchedCount());
+
+    // Descriptor may be watched again after it was reported
+    ASSERT_TRUE(poller.watch(channel[0], IOPoller::readable));
+    ASSERT_TRUE(poller.wait(0, ready));
+    EXPECT_EQ(1u, ready.size());
+
+    close(channel[0]);
+    close(channel[1]);
+}
+
+TEST(IOPoller, CombinesEventsOfDescriptor)
+{
+    int channel[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, channel));
+
+    IOPoller poller;
+    std::vector<int> ready;
+
+    // Reader does not replace the writer waiting for the same descriptor
+    ASSERT_TRUE(poller.watch(channel[0], IOPoller::writable));
+    ASSERT_TRUE(poller.watch(channel[0], IOPoller::readable));
+    EXPECT_EQ(1u, poller.getWatchedCount());
+
+    ASSERT_TRUE(poller.wait(0, ready));
+    ASSERT_EQ(1u, ready.size());
+    EXPECT_EQ(channel[0], ready[0]);
+    EXPECT_EQ(0u, poller.getWatchedCount());
+
+    // Events are forgotten once reported
+    ASSERT_TRUE(poller.watch(channel[0], IOPoller::readable));
+    ASSERT_TRUE(poller.wait(0, ready));
+    EXPECT_TRUE(ready.empty());
+
+    close(channel[0]);
+    close(channel[1]);
+}
+
+TEST(IOPoller, RejectsRegularFiles)
+{
+    FILE* file = tmpfile();
+    ASSERT_TRUE(file != 0);
+
+    IOPoller poller;
+    EXPECT_FALSE(poller.watch(fileno(file), IOPoller::readable));
+    EXPECT_EQ(0u, poller.getWatchedCount());
+
+    fclose(file);
+}
+
+TEST(IOPoller, ReportsUnwatchedDescriptors)
+{
+    int channel[2];
+    ASSERT_EQ(0, pipe(channel));
+
+    IOPoller poller;
+    std::vector<int> ready;
+
+    // Waiting process is resumed when the descriptor is closed by the image
+    ASSERT_TRUE(poller.watch(channel[0], IOPoller::readable));
+    poller.unwatch(channel[0]);
+    EXPECT_EQ(0u, poller.getWatchedCount());
+    close(channel[0]);
+
+    ASSERT_TRUE(poller.wait(-1, ready));
+    ASSERT_EQ(1u, ready.size());
+    EXPECT_EQ(channel[0], ready[0]);
+
+    ASSERT_TRUE(poller.wait(0, ready));
+    EXPECT_TRUE(ready.empty()) << "reported once";
+
+    close(channel[1]);
+}
+
+TEST(IOPoller, ReportsClosedDescriptors)
+{
+    int channel[2];
+    ASSERT_EQ(0, pipe(channel));
+
+    IOPoller poller;
+    std::vector<int> ready;
+
+    // Descriptor closed without unwatching is dropped by epoll,
+    // blocking wait should report it instead of waiting forever
+    ASSERT_TRUE(poller.watch(channel[0], IOPoller::readable));
+    close(channel[0]);
+
+    ASSERT_TRUE(poller.wait(-1, ready));
+    ASSERT_EQ(1u, ready.size());
+    EXPECT_EQ(channel[0], ready[0]);
+    EXPECT_EQ(0u, poller.getWatchedCount());
+
+    close(channel[1]);
+}
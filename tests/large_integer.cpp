@@ -0,0 +1,216 @@
+#include <gtest/gtest.h>
+#include <LargeInteger.h>
+
+#include <limits>
+
+static LargeInteger power(int64_t base, int exponent)
+{
+    LargeInteger result(1);
+    for (int i = 0; i < exponent; i++)
+        result = result * LargeInteger(base);
+    return result;
+}
+
+static LargeInteger factorial(int n)
+{
+    LargeInteger result(1);
+    for (int i = 2; i <= n; i++)
+        result = result * LargeInteger(i);
+    return result;
+}
+
+TEST(LargeInteger, toString)
+{
+    EXPECT_EQ("0", LargeInteger().toString());
+    EXPECT_EQ("0", LargeInteger(0).toString());
+    EXPECT_EQ("42", LargeInteger(42).toString());
+    EXPECT_EQ("-42", LargeInteger(-42).toString());
+    EXPECT_EQ("4294967296", LargeInteger(4294967296LL).toString());
+    EXPECT_EQ("-9223372036854775808", LargeInteger(std::numeric_limits<int64_t>::min()).toString());
+    EXPECT_EQ("100000000000000000000000000000000000000000000000000", power(10, 50).toString());
+    EXPECT_EQ("30414093201713378043612608166064768844377641568960512000000000000", factorial(50).toString());
+
+    EXPECT_EQ("FF", LargeInteger(255).toString(16));
+    EXPECT_EQ("-101", LargeInteger(-5).toString(2));
+    EXPECT_EQ("1" + std::string(64, '0'), power(2, 64).toString(2));
+}
+
+TEST(LargeInteger, addSub)
+{
+    const LargeInteger big = power(2, 100);
+
+    EXPECT_EQ("1267650600228229401496703205377", (big + LargeInteger(1)).toString());
+    EXPECT_EQ("1267650600228229401496703205375", (big - LargeInteger(1)).toString());
+    EXPECT_EQ("-1267650600228229401496703205375", (LargeInteger(1) - big).toString());
+    EXPECT_EQ("0", (big - big).toString());
+    EXPECT_FALSE((big - big).isNegative());
+    EXPECT_EQ("2535301200456458802993406410752", (big + big).toString());
+    EXPECT_EQ("-2535301200456458802993406410752", (-big - big).toString());
+
+    // Carry propagation through all digits
+    EXPECT_EQ(power(2, 128).toString(), ((power(2, 128) - LargeInteger(1)) + LargeInteger(1)).toString());
+}
+
+TEST(LargeInteger, compare)
+{
+    const LargeInteger big = power(3, 80);
+
+    EXPECT_EQ(0, big.compare(power(3, 80)));
+    EXPECT_LT(LargeInteger(5).compare(big), 0);
+    EXPECT_GT(big.compare(LargeInteger(5)), 0);
+    EXPECT_LT((-big).compare(LargeInteger(-5)), 0);
+    EXPECT_GT(LargeInteger(-5).compare(-big), 0);
+    EXPECT_LT(LargeInteger(-1).compare(LargeInteger(0)), 0);
+}
+
+TEST(LargeInteger, multiply)
+{
+    EXPECT_EQ("1152921502459363329", (LargeInteger(1073741823) * LargeInteger(1073741823)).toString());
+    EXPECT_EQ("-6", (LargeInteger(2) * LargeInteger(-3)).toString());
+    EXPECT_EQ("0", (LargeInteger(-2) * LargeInteger(0)).toString());
+    EXPECT_FALSE((LargeInteger(-2) * LargeInteger(0)).isNegative());
+
+    {
+        SCOPED_TRACE("karatsuba matches schoolbook");
+        const LargeInteger left  = factorial(300) + LargeInteger(12345);
+        const LargeInteger right = -(power(7, 250) - LargeInteger(1));
+        const std::size_t noKaratsuba = std::numeric_limits<std::size_t>::max();
+
+        const LargeInteger schoolbook = LargeInteger::multiply(left, right, noKaratsuba);
+        EXPECT_EQ(schoolbook.toString(), LargeInteger::multiply(left, right, 4).toString());
+        EXPECT_EQ(schoolbook.toString(), LargeInteger::multiply(left, right, 7).toString());
+        EXPECT_EQ(schoolbook.toString(), LargeInteger::multiply(right, left, 5).toString());
+
+        // Unbalanced operands
+        const LargeInteger small = power(2, 200) - LargeInteger(1);
+        EXPECT_EQ(LargeInteger::multiply(left, small, noKaratsuba).toString(), LargeInteger::multiply(left, small, 4).toString());
+    }
+}
+
+TEST(LargeInteger, divMod)
+{
+    LargeInteger quotient;
+    LargeInteger remainder;
+
+    EXPECT_FALSE(LargeInteger::divMod(LargeInteger(1), LargeInteger(0), quotient, remainder));
+
+    {
+        SCOPED_TRACE("truncating division");
+        ASSERT_TRUE(LargeInteger::divMod(LargeInteger(7), LargeInteger(2), quotient, remainder));
+        EXPECT_EQ("3", quotient.toString());
+        EXPECT_EQ("1", remainder.toString());
+
+        ASSERT_TRUE(LargeInteger::divMod(LargeInteger(-7), LargeInteger(2), quotient, remainder));
+        EXPECT_EQ("-3", quotient.toString());
+        EXPECT_EQ("-1", remainder.toString());
+
+        ASSERT_TRUE(LargeInteger::divMod(LargeInteger(7), LargeInteger(-2), quotient, remainder));
+        EXPECT_EQ("-3", quotient.toString());
+        EXPECT_EQ("1", remainder.toString());
+    }
+    {
+        SCOPED_TRACE("multi digit divisor");
+        const LargeInteger dividend = factorial(100);
+        const LargeInteger divisor  = power(10, 30) + LargeInteger(7);
+
+        ASSERT_TRUE(LargeInteger::divMod(dividend, divisor, quotient, remainder));
+        EXPECT_LT(remainder.compare(divisor), 0);
+        EXPECT_FALSE(remainder.isNegative());
+        EXPECT_EQ(dividend.toString(), (quotient * divisor + remainder).toString());
+
+        ASSERT_TRUE(LargeInteger::divMod(factorial(60), factorial(58), quotient, remainder));
+        EXPECT_EQ("3540", quotient.toString());
+        EXPECT_TRUE(remainder.isZero());
+    }
+    {
+        SCOPED_TRACE("quotient digit correction");
+        // Divisor with the high digit set forces the add back step
+        const LargeInteger divisor  = power(2, 64) - LargeInteger(1);
+        const LargeInteger dividend = power(2, 128) - LargeInteger(1);
+
+        ASSERT_TRUE(LargeInteger::divMod(dividend, divisor, quotient, remainder));
+        EXPECT_EQ((power(2, 64) + LargeInteger(1)).toString(), quotient.toString());
+        EXPECT_TRUE(remainder.isZero());
+    }
+}
+
+TEST(LargeInteger, bitOperations)
+{
+    const LargeInteger big = power(2, 70);
+
+    EXPECT_EQ("12", LargeInteger(12).bitAnd(LargeInteger(-4)).toString());
+    EXPECT_EQ("-3", LargeInteger(-4).bitOr(LargeInteger(1)).toString());
+    EXPECT_EQ("-1", LargeInteger(5).bitXor(LargeInteger(-6)).toString());
+    EXPECT_EQ(big.toString(), big.bitAnd(LargeInteger(-1)).toString());
+    EXPECT_EQ("0", big.bitAnd(LargeInteger(0xFFFFFFFF)).toString());
+    EXPECT_EQ((big + LargeInteger(3)).toString(), big.bitOr(LargeInteger(3)).toString());
+    EXPECT_EQ((-big).toString(), (-big).bitAnd(-big).toString());
+    EXPECT_EQ("0", big.bitXor(big).toString());
+}
+
+TEST(LargeInteger, shifted)
+{
+    EXPECT_EQ(power(2, 70).toString(), LargeInteger(1).shifted(70).toString());
+    EXPECT_EQ("-" + power(2, 65).toString(), LargeInteger(-2).shifted(64).toString());
+    EXPECT_EQ("1", power(2, 70).shifted(-70).toString());
+    EXPECT_EQ("0", power(2, 70).shifted(-71).toString());
+    EXPECT_EQ("-1", LargeInteger(-1).shifted(-100).toString());
+    EXPECT_EQ("-3", LargeInteger(-5).shifted(-1).toString());
+    EXPECT_EQ("-" + power(2, 30).toString(), (-power(2, 70)).shifted(-40).toString());
+    EXPECT_EQ("-" + (power(2, 30) + LargeInteger(1)).toString(), (-power(2, 70) - LargeInteger(1)).shifted(-40).toString());
+}
+
+TEST(LargeInteger, conversions)
+{
+    const intptr_t maxValue = TInteger::MAX_VALUE;
+    const intptr_t minValue = TInteger::MIN_VALUE;
+    intptr_t value = 0;
+
+    EXPECT_TRUE(LargeInteger(maxValue).toSmallInt(value));
+    EXPECT_EQ(maxValue, value);
+    EXPECT_TRUE(LargeInteger(minValue).toSmallInt(value));
+    EXPECT_EQ(minValue, value);
+    EXPECT_FALSE((LargeInteger(maxValue) + LargeInteger(1)).toSmallInt(value));
+    EXPECT_FALSE((LargeInteger(minValue) - LargeInteger(1)).toSmallInt(value));
+    EXPECT_FALSE(power(2, 100).toSmallInt(value));
+
+    EXPECT_EQ(static_cast<uint64_t>(-5), LargeInteger(-5).truncated());
+    EXPECT_EQ(static_cast<uint64_t>(3), (power(2, 64) + LargeInteger(3)).truncated());
+
+    {
+        SCOPED_TRACE("object representation");
+        const LargeInteger values[] = { LargeInteger(), LargeInteger(255), LargeInteger(-256), -factorial(40), power(2, 95) };
+        for (std::size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+            std::vector<uint8_t> bytes(values[i].getByteSize());
+            values[i].toBytes(&bytes[0]);
+            EXPECT_EQ(values[i].isNegative() ? 1 : 0, bytes[0]);
+            EXPECT_NE(0, bytes.size() == 1 ? 1 : bytes.back());
+            EXPECT_EQ(values[i].toString(), LargeInteger::fromBytes(&bytes[0], bytes.size()).toString());
+        }
+
+        EXPECT_EQ(static_cast<std::size_t>(13), power(2, 95).getByteSize());
+    }
+}
+
+TEST(LargeInteger, doubleConversions)
+{
+    LargeInteger value;
+
+    EXPECT_EQ(0.0, LargeInteger().toDouble());
+    EXPECT_EQ(-42.0, LargeInteger(-42).toDouble());
+    EXPECT_EQ(1267650600228229401496703205376.0, power(2, 100).toDouble());
+    EXPECT_EQ(-1e30, (-power(10, 30)).toDouble());
+
+    ASSERT_TRUE(LargeInteger::fromDouble(3.75, value));
+    EXPECT_EQ("3", value.toString());
+    ASSERT_TRUE(LargeInteger::fromDouble(-3.75, value));
+    EXPECT_EQ("-3", value.toString());
+    ASSERT_TRUE(LargeInteger::fromDouble(1267650600228229401496703205376.0, value));
+    EXPECT_EQ(power(2, 100).toString(), value.toString());
+    ASSERT_TRUE(LargeInteger::fromDouble(-1e20, value));
+    EXPECT_EQ("-100000000000000000000", value.toString());
+
+    const double zero = 0;
+    EXPECT_FALSE(LargeInteger::fromDouble(1 / zero, value));
+    EXPECT_FALSE(LargeInteger::fromDouble(zero / zero, value));
+}
@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+#include <memory.h>
+#include <MappedFile.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+
+class MappedFileTest : public ::testing::Test
+{
+protected:
+    BakerMemoryManager m_memoryManager;
+    Image m_image;
+    std::string m_fileName;
+
+    MappedFileTest() : m_image(&m_memoryManager) {}
+
+    virtual void SetUp() {
+        m_memoryManager.initializeHeap(1024*1024, 1024*1024);
+        ASSERT_TRUE(m_image.loadImage(TESTS_DIR "./data/DecodeAllMethods.image"));
+
+        char fileName[] = "/tmp/llst_mapped_XXXXXX";
+        const int fileID = mkstemp(fileName);
+        ASSERT_LE(0, fileID);
+        m_fileName = fileName;
+
+        const char contents[] = "0123456789abcdef0123456789ABCDEF";
+        ASSERT_EQ(32, write(fileID, contents, 32));
+        close(fileID);
+    }
+
+    virtual void TearDown() {
+        unlink(m_fileName.c_str());
+    }
+};
+
+TEST_F(MappedFileTest, ContentsAndSlices)
+{
+    MappedFiles files(&m_memoryManager);
+    TClass* const byteArrayClass = classRegistry.get<TByteArray>();
+
+    TByteObject* const object = files.map(m_fileName, byteArrayClass);
+    ASSERT_TRUE(object != 0);
+    EXPECT_EQ(32u, object->getSize());
+    EXPECT_EQ(byteArrayClass, object->getClass());
+    EXPECT_FALSE(isSmallInteger(object));
+    EXPECT_EQ(0, std::memcmp(object->getBytes(), "0123456789abcdef", 16));
+
+    // Writes are not stored to the file
+    object->putByte(0, 'x');
+    EXPECT_EQ('x', object->getByte(0));
+
+    TByteObject* const slice = files.slice(object, 16, 16);
+    ASSERT_TRUE(slice != 0);
+    EXPECT_EQ(16u, slice->getSize());
+    EXPECT_EQ(0, std::memcmp(slice->getBytes(), "0123456789ABCDEF", 16));
+    EXPECT_EQ(2u, files.getCount());
+
+    EXPECT_TRUE(files.slice(object, 3, 4) == 0) << "unaligned slice";
+    EXPECT_TRUE(files.slice(object, 16, 17) == 0) << "slice beyond the end";
+
+    EXPECT_TRUE(files.close(object));
+    EXPECT_EQ(0u, object->getSize());
+    EXPECT_EQ(byteArrayClass, object->getClass());
+    EXPECT_EQ('0', slice->getByte(0));
+
+    EXPECT_TRUE(files.map("/nonexistent/file", byteArrayClass) == 0);
+}
+
+TEST_F(MappedFileTest, ReleasedWhenUnreachable)
+{
+    MappedFiles files(&m_memoryManager);
+
+    TByteObject* const reachable = files.map(m_fileName, classRegistry.get<TByteArray>());
+    TByteObject* const unreachable = files.map(m_fileName, classRegistry.get<TByteArray>());
+    ASSERT_TRUE(reachable != 0 && unreachable != 0);
+
+    {
+        hptr<TByteObject> pointer(reachable, &m_memoryManager);
+        m_memoryManager.collectGarbage();
+
+        EXPECT_TRUE(files.isMapped(reachable));
+        EXPECT_FALSE(files.isMapped(unreachable));
+        EXPECT_EQ('0', pointer[0]);
+    }
+
+    m_memoryManager.collectGarbage();
+    EXPECT_EQ(0u, files.getCount());
+}
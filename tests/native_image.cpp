@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+#include <memory.h>
+
+#include <cstdio>
+
+// Classic image is converted into the native one which is then
+// loaded by a separate memory manager and compared to the original.
+class NativeImage : public ::testing::Test
+{
+protected:
+    class TCounter : public IHeapVisitor {
+    public:
+        std::size_t objects;
+        std::size_t bytes;
+        TCounter() : objects(0), bytes(0) {}
+        virtual void visitObject(TObject* object) {
+            objects++;
+            bytes += object->getSlotSize();
+        }
+    };
+
+    std::string m_nativeImageName;
+
+    virtual void SetUp() { m_nativeImageName = "NativeImage.image"; }
+    virtual void TearDown() { std::remove(m_nativeImageName.c_str()); }
+
+    void checkRoundTrip(uintptr_t preferredBase) {
+        NonCollectMemoryManager classicManager;
+        classicManager.initializeHeap(sizeof(TObject));
+        Image classicImage(&classicManager);
+        ASSERT_TRUE(classicImage.loadImage(TESTS_DIR "./data/DecodeAllMethods.image"));
+
+        TCounter classicCounter;
+        classicManager.walkHeap(classicCounter);
+
+        ASSERT_TRUE(Image::ImageWriter().setGlobals(globals).writeNativeImage(m_nativeImageName.c_str(), preferredBase));
+
+        NonCollectMemoryManager nativeManager;
+        nativeManager.initializeHeap(sizeof(TObject));
+        Image nativeImage(&nativeManager);
+        ASSERT_TRUE(nativeImage.loadImage(m_nativeImageName));
+
+        TCounter nativeCounter;
+        nativeManager.walkHeap(nativeCounter);
+
+        EXPECT_EQ(classicCounter.objects, nativeCounter.objects);
+        EXPECT_EQ(classicCounter.bytes, nativeCounter.bytes);
+
+        // Globals and pointers between the objects should be valid
+        EXPECT_TRUE(nativeManager.isInStaticHeap(globals.nilObject));
+        EXPECT_TRUE(nativeManager.isInStaticHeap(globals.initialMethod));
+        EXPECT_TRUE(nativeManager.isInStaticHeap(globals.badMethodSymbol));
+        EXPECT_EQ("doesNotUnderstand:", globals.badMethodSymbol->toString());
+        EXPECT_EQ("Undefined", globals.nilObject->getClass()->name->toString());
+        EXPECT_EQ("Array", globals.arrayClass->name->toString());
+
+        TClass* const objectClass = nativeImage.getGlobal<TClass>("Object");
+        ASSERT_TRUE(objectClass != 0);
+        EXPECT_TRUE(nativeManager.isInStaticHeap(objectClass));
+        EXPECT_EQ("Object", objectClass->name->toString());
+        EXPECT_TRUE(objectClass->methods->find("printString") != 0);
+
+        // Static heap has the room for new objects
+        void* const slot = nativeManager.staticAllocate(sizeof(TObject));
+        ASSERT_TRUE(slot != 0);
+        EXPECT_TRUE(nativeManager.isInStaticHeap(slot));
+    }
+};
+
+TEST_F(NativeImage, PreferredBase)
+{
+    checkRoundTrip(Image::NATIVE_IMAGE_BASE);
+}
+
+TEST_F(NativeImage, Relocated)
+{
+    // Low addresses are never given to mmap, so each pointer is fixed up
+    checkRoundTrip(0x1000);
+}
+
+TEST_F(NativeImage, NullFields)
+{
+    NonCollectMemoryManager classicManager;
+    classicManager.initializeHeap(sizeof(TObject));
+    Image classicImage(&classicManager);
+    ASSERT_TRUE(classicImage.loadImage(TESTS_DIR "./data/DecodeAllMethods.image"));
+
+    TClass* const objectClass = classicImage.getGlobal<TClass>("Object");
+    ASSERT_TRUE(objectClass != 0);
+    TSymbolArray* const variables = objectClass->variables;
+    objectClass->variables = 0;
+    const bool isWritten = Image::ImageWriter().setGlobals(globals).writeNativeImage(m_nativeImageName.c_str(), 0x1000);
+    objectClass->variables = variables;
+    ASSERT_TRUE(isWritten);
+
+    NonCollectMemoryManager nativeManager;
+    nativeManager.initializeHeap(sizeof(TObject));
+    Image nativeImage(&nativeManager);
+    ASSERT_TRUE(nativeImage.loadImage(m_nativeImageName));
+
+    TClass* const nativeObjectClass = nativeImage.getGlobal<TClass>("Object");
+    ASSERT_TRUE(nativeObjectClass != 0);
+    EXPECT_TRUE(nativeObjectClass->variables == 0);
+}
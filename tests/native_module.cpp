@@ -0,0 +1,18 @@
+#include <PrimitiveRegistry.h>
+
+// Native module loaded by the PrimitiveRegistry test
+
+static TObject* sum(uint8_t /*opcode*/, TObjectArray& args, bool& primitiveFailed)
+{
+    if (!isSmallInteger(args[0]) || !isSmallInteger(args[1])) {
+        primitiveFailed = true;
+        return args[0];
+    }
+
+    return TInteger(TInteger(args[0]).getValue() + TInteger(args[1]).getValue());
+}
+
+extern "C" void llstRegisterPrimitives(PrimitiveRegistry& registry)
+{
+    registry.addNamed("test.sum", sum, 2, TPrimitiveDescriptor::isPure);
+}
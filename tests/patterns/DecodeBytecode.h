@@ -2,6 +2,7 @@
 #define LLST_PATTERN_DECODE_BYTECODE_INCLUDED
 
 #include <gtest/gtest.h>
+#include <tr1/tuple>
 #include <instructions.h>
 #include <analysis.h>
 
@@ -0,0 +1,122 @@
+#include <gtest/gtest.h>
+#include "patterns/InitVMImage.h"
+#include <PrimitiveRegistry.h>
+#include <instructions.h>
+#include <primitives.h>
+#include <opcodes.h>
+
+INSTANTIATE_TEST_CASE_P(_, P_InitVM_Image, ::testing::Values(std::string("VMPrimitives")) );
+
+static TObject* negate(uint8_t /*opcode*/, TObjectArray& args, bool& /*primitiveFailed*/)
+{
+    return TInteger(-TInteger(args[0]).getValue());
+}
+
+TEST(PrimitiveRegistry, Descriptors)
+{
+    {
+        SCOPED_TRACE("native");
+        const TPrimitiveDescriptor& descriptor = primitiveRegistry[primitive::smallIntAdd];
+        ASSERT_TRUE(descriptor.isDefined());
+        EXPECT_TRUE(descriptor.function != 0);
+        EXPECT_EQ(2, descriptor.arity);
+        EXPECT_FALSE(descriptor.mayCollectGarbage());
+        EXPECT_TRUE(descriptor.isPureFunction());
+        EXPECT_TRUE(descriptor.isInlinedByJIT());
+        EXPECT_FALSE(descriptor.isOwnedByVM());
+    }
+    {
+        SCOPED_TRACE("owned by VM");
+        const TPrimitiveDescriptor& descriptor = primitiveRegistry[primitive::allocateObject];
+        ASSERT_TRUE(descriptor.isDefined());
+        EXPECT_TRUE(descriptor.function == 0);
+        EXPECT_TRUE(descriptor.mayCollectGarbage());
+        EXPECT_TRUE(descriptor.isOwnedByVM());
+        EXPECT_FALSE(primitiveRegistry[primitive::ioFileMap].mayCollectGarbage());
+    }
+    {
+        SCOPED_TRACE("undefined");
+        const TPrimitiveDescriptor& descriptor = primitiveRegistry[200];
+        EXPECT_FALSE(descriptor.isDefined());
+        EXPECT_TRUE(descriptor.mayCollectGarbage());
+    }
+
+    EXPECT_FALSE(st::TSmalltalkInstruction(opcode::doPrimitive, 2, primitive::objectsAreEqual).mayCauseGC());
+    EXPECT_FALSE(st::TSmalltalkInstruction(opcode::doPrimitive, 4, primitive::ioFileWriteRange).mayCauseGC());
+    EXPECT_TRUE(st::TSmalltalkInstruction(opcode::doPrimitive, 2, primitive::integerAdd).mayCauseGC());
+
+    PrimitiveRegistry registry;
+    EXPECT_FALSE(registry.add(primitive::smallIntAdd, "again", negate, 1, 0));
+    EXPECT_TRUE(registry.add(200, "negate", negate, 1, TPrimitiveDescriptor::isPure));
+    EXPECT_FALSE(registry.addNamed("allocates", negate, 1, TPrimitiveDescriptor::mayCollect));
+}
+
+TEST_P(P_InitVM_Image, registryCall)
+{
+    PrimitiveRegistry registry;
+    ASSERT_TRUE(registry.add(200, "negate", negate, 1, TPrimitiveDescriptor::isPure));
+
+    TStackArguments args(1);
+    args[0] = TInteger(42);
+
+    bool primitiveFailed = false;
+    ASSERT_EQ(-42, TInteger(registry.call(200, *args, primitiveFailed)).getValue());
+    ASSERT_FALSE(primitiveFailed);
+
+    // Primitive reads more arguments than given
+    TStackArguments none(0);
+    registry.call(200, *none, primitiveFailed);
+    ASSERT_TRUE(primitiveFailed);
+
+    // Owned by VM
+    primitiveFailed = false;
+    registry.call(primitive::symbolIntern, *args, primitiveFailed);
+    ASSERT_TRUE(primitiveFailed);
+}
+
+TEST_P(P_InitVM_Image, namedPrimitives)
+{
+    TObjectArray* args = m_image->newArray(3);
+    args->putField(0, m_image->newString("test.sum"));
+    args->putField(1, TInteger(40));
+    args->putField(2, TInteger(2));
+
+    bool primitiveFailed = false;
+    callPrimitive(primitive::callNamed, args, primitiveFailed);
+    ASSERT_TRUE(primitiveFailed) << "not loaded yet";
+
+    const std::size_t modulesCount = primitiveRegistry.getModulesCount();
+    {
+        TObjectArray* path = m_image->newArray(1);
+        path->putField(0, m_image->newString("/nonexistent/module.so"));
+        callPrimitive(primitive::loadModule, path, primitiveFailed);
+        ASSERT_TRUE(primitiveFailed);
+
+        path->putField(0, m_image->newString(NATIVE_MODULE));
+        callPrimitive(primitive::loadModule, path, primitiveFailed);
+        ASSERT_FALSE(primitiveFailed);
+        ASSERT_EQ(modulesCount + 1, primitiveRegistry.getModulesCount());
+    }
+
+    const TPrimitiveDescriptor* const descriptor = primitiveRegistry.findNamed("test.sum");
+    ASSERT_TRUE(descriptor != 0);
+    EXPECT_EQ(2, descriptor->arity);
+    EXPECT_TRUE(descriptor->isPureFunction());
+
+    ASSERT_EQ(42, TInteger(callPrimitive(primitive::callNamed, args, primitiveFailed)).getValue());
+    ASSERT_FALSE(primitiveFailed);
+
+    args->putField(2, globals.nilObject);
+    callPrimitive(primitive::callNamed, args, primitiveFailed);
+    ASSERT_TRUE(primitiveFailed);
+
+    TObjectArray* tooFew = m_image->newArray(2);
+    tooFew->putField(0, args->getField(0));
+    tooFew->putField(1, TInteger(1));
+    callPrimitive(primitive::callNamed, tooFew, primitiveFailed);
+    ASSERT_TRUE(primitiveFailed);
+
+    args->putField(0, m_image->newString("test.unknown"));
+    callPrimitive(primitive::callNamed, args, primitiveFailed);
+    ASSERT_TRUE(primitiveFailed);
+}
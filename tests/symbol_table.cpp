@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+#include <memory.h>
+#include <SymbolTable.h>
+
+#include <vector>
+#include <cstring>
+
+class SymbolTableTest : public ::testing::Test
+{
+protected:
+    NonCollectMemoryManager m_memoryManager;
+    Image m_image;
+
+    SymbolTableTest() : m_image(&m_memoryManager) {}
+
+    virtual void SetUp() {
+        m_memoryManager.initializeHeap(sizeof(TObject));
+        ASSERT_TRUE(m_image.loadImage(TESTS_DIR "./data/DecodeAllMethods.image"));
+    }
+};
+
+TEST_F(SymbolTableTest, FindsImageSymbols)
+{
+    SymbolTable table(&m_memoryManager);
+    ASSERT_TRUE(table.build(classRegistry.get<TSymbol>()));
+    EXPECT_GT(table.getSize(), 500u);
+
+    // Image builder does not put every symbol to the tree,
+    // but the ones that are found should be the same objects
+    std::size_t found = 0;
+    TClass* const objectClass = m_image.getGlobal<TClass>("Object");
+    TSymbolArray* const selectors = objectClass->methods->keys;
+    for (std::size_t i = 0; i < selectors->getSize(); i++) {
+        TSymbol* const selector = selectors->getField(i);
+        TSymbol* const symbol = table.find(selector);
+        if (symbol) {
+            ASSERT_EQ(selector, symbol) << selector->toString();
+            found++;
+        }
+    }
+    EXPECT_GT(found, selectors->getSize() / 2);
+
+    TSymbol* const selector = globals.badMethodSymbol;
+    EXPECT_EQ(selector, table.find(reinterpret_cast<const uint8_t*>("doesNotUnderstand:"), 18));
+    EXPECT_TRUE(table.find(reinterpret_cast<const uint8_t*>("doesNotUnderstand"), 17) == 0);
+    EXPECT_TRUE(table.find(reinterpret_cast<const uint8_t*>("noSuchSelector:"), 15) == 0);
+}
+
+TEST_F(SymbolTableTest, InsertsNewSymbols)
+{
+    SymbolTable table(&m_memoryManager);
+    ASSERT_TRUE(table.build(classRegistry.get<TSymbol>()));
+    const std::size_t initialSize = table.getSize();
+
+    // Enough symbols to grow the table a few times
+    const std::size_t count = initialSize * 4;
+    std::vector< std::vector<TObject*> > storage(count);
+    for (std::size_t i = 0; i < count; i++) {
+        char name[32];
+        const int size = std::sprintf(name, "generated%zu", i);
+        storage[i].resize(sizeof(TByteObject) / sizeof(TObject*) + size / sizeof(TObject*) + 1);
+
+        TSymbol* const symbol = static_cast<TSymbol*>(new (&storage[i][0]) TByteObject(size, classRegistry.get<TSymbol>()));
+        std::memcpy(symbol->getBytes(), name, size);
+        symbol->updateHash();
+        table.insert(symbol);
+    }
+
+    EXPECT_EQ(initialSize + count, table.getSize());
+    for (std::size_t i = 0; i < count; i++) {
+        TSymbol* const symbol = reinterpret_cast<TSymbol*>(&storage[i][0]);
+        ASSERT_EQ(symbol, table.find(symbol));
+    }
+    EXPECT_EQ(globals.badMethodSymbol, table.find(globals.badMethodSymbol));
+
+    table.clear();
+    EXPECT_FALSE(table.isBuilt());
+    EXPECT_TRUE(table.find(globals.badMethodSymbol) == 0);
+}
@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+#include <memory.h>
+#include <TreeShaker.h>
+
+#include <cstdio>
+#include <algorithm>
+#include <tr1/unordered_set>
+
+// Shaken image is written and loaded again by a separate memory manager
+class TreeShakerTest : public ::testing::Test
+{
+protected:
+    class TCounter : public IHeapVisitor {
+    public:
+        std::size_t objects;
+        TCounter() : objects(0) {}
+        virtual void visitObject(TObject*) { objects++; }
+    };
+
+    virtual void TearDown() {
+        std::remove("TreeShaker.image");
+    }
+
+    typedef std::tr1::unordered_set<TObject*> TObjectSet;
+
+    // Returns the depth of the symbol tree
+    static std::size_t collectSymbols(TObject* node, TObjectSet& symbols)
+    {
+        if (node == globals.nilObject)
+            return 0;
+
+        TNode* const treeNode = static_cast<TNode*>(node);
+        symbols.insert(treeNode->value);
+        return 1 + std::max(collectSymbols(treeNode->left, symbols), collectSymbols(treeNode->right, symbols));
+    }
+};
+
+TEST_F(TreeShakerTest, RemovesUnreachable)
+{
+    NonCollectMemoryManager sourceManager;
+    sourceManager.initializeHeap(sizeof(TObject));
+    Image sourceImage(&sourceManager);
+    ASSERT_TRUE(sourceImage.loadImage(TESTS_DIR "./data/DecodeAllMethods.image"));
+
+    TCounter sourceCounter;
+    sourceManager.walkHeap(sourceCounter);
+
+    TreeShaker shaker(sourceImage);
+    shaker.addRootClass("Object");
+    shaker.addRootSelector("printString");
+    ASSERT_TRUE(shaker.shake());
+
+    // Test classes are not referenced by anything
+    const TreeShaker::TReport& report = shaker.getReport();
+    EXPECT_TRUE(std::find(report.removedClasses.begin(), report.removedClasses.end(), "JitTest") != report.removedClasses.end());
+    EXPECT_TRUE(std::find(report.removedClasses.begin(), report.removedClasses.end(), "Object") == report.removedClasses.end());
+    ASSERT_FALSE(report.removedMethods.empty());
+    EXPECT_GT(report.removedSymbols, 0u);
+
+    ASSERT_TRUE(Image::ImageWriter().setGlobals(globals).writeTo("TreeShaker.image"));
+
+    NonCollectMemoryManager shakenManager;
+    shakenManager.initializeHeap(sizeof(TObject));
+    Image shakenImage(&shakenManager);
+    ASSERT_TRUE(shakenImage.loadImage("TreeShaker.image"));
+
+    TCounter shakenCounter;
+    shakenManager.walkHeap(shakenCounter);
+    EXPECT_LT(shakenCounter.objects, sourceCounter.objects);
+
+    EXPECT_TRUE(shakenImage.getGlobal("JitTest") == 0);
+
+    TClass* const objectClass = shakenImage.getGlobal<TClass>("Object");
+    ASSERT_TRUE(objectClass != 0);
+    EXPECT_TRUE(objectClass->methods->find<TMethod>("printString") != 0);
+
+    // Removed method is not found in the class which is still alive
+    const std::string& removedMethod = report.removedMethods.front();
+    const std::size_t separator = removedMethod.find(">>");
+    ASSERT_NE(std::string::npos, separator);
+    TClass* const removedMethodClass = shakenImage.getGlobal<TClass>(removedMethod.substr(0, separator).c_str());
+    if (removedMethodClass) {
+        const std::string selector = removedMethod.substr(separator + 2);
+        EXPECT_TRUE(removedMethodClass->methods->find<TMethod>(selector.c_str()) == 0);
+    }
+
+    // Selectors of the kept methods are still interned
+    TClass* const symbolClass = shakenImage.getGlobal<TClass>("Symbol");
+    ASSERT_TRUE(symbolClass != 0);
+    TObject* const symbolTable = symbolClass->getField(symbolClass->getSize() - 1);
+
+    TObjectSet symbols;
+    const std::size_t depth = collectSymbols(symbolTable->getField(0), symbols);
+    EXPECT_EQ(report.keptSymbols, symbols.size());
+
+    TSymbolArray* const selectors = objectClass->methods->keys;
+    for (std::size_t i = 0; i < selectors->getSize(); i++)
+        EXPECT_TRUE(symbols.find(selectors->getField(i)) != symbols.end());
+
+    // Symbol tree is rebuilt balanced
+    std::size_t minimalDepth = 0;
+    while ((std::size_t(1) << minimalDepth) <= symbols.size())
+        minimalDepth++;
+    EXPECT_EQ(minimalDepth, depth);
+}
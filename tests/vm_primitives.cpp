@@ -3,6 +3,11 @@
 #include "patterns/InitVMImage.h"
 #include <primitives.h>
 #include <opcodes.h>
+#include <IOPoller.h>
+#include <vm.h>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
 
 INSTANTIATE_TEST_CASE_P(_, P_InitVM_Image, ::testing::Values(std::string("VMPrimitives")) );
 
@@ -143,13 +148,45 @@ TEST_P(P_InitVM_Image, smallint)
         ASSERT_EQ(10, result.getValue());
     }
     {
-        SCOPED_TRACE("1<<31");
+        SCOPED_TRACE("1<<(wordBits-1)");
         args->putField(0, TInteger(1) );
-        args->putField(1, TInteger(31) );
+        args->putField(1, TInteger(sizeof(void*) * 8 - 1) );
         bool primitiveFailed;
         callPrimitive(primitive::smallIntBitShift, args, primitiveFailed);
         ASSERT_TRUE(primitiveFailed);
     }
+    {
+        SCOPED_TRACE("MAX_VALUE+1");
+        args->putField(0, TInteger(TInteger::MAX_VALUE) );
+        args->putField(1, TInteger(1) );
+        bool primitiveFailed;
+        callPrimitive(primitive::smallIntAdd, args, primitiveFailed);
+        ASSERT_TRUE(primitiveFailed);
+    }
+    {
+        SCOPED_TRACE("MIN_VALUE-1");
+        args->putField(0, TInteger(TInteger::MIN_VALUE) );
+        args->putField(1, TInteger(1) );
+        bool primitiveFailed;
+        callPrimitive(primitive::smallIntSub, args, primitiveFailed);
+        ASSERT_TRUE(primitiveFailed);
+    }
+    {
+        SCOPED_TRACE("MAX_VALUE*2");
+        args->putField(0, TInteger(TInteger::MAX_VALUE) );
+        args->putField(1, TInteger(2) );
+        bool primitiveFailed;
+        callPrimitive(primitive::smallIntMul, args, primitiveFailed);
+        ASSERT_TRUE(primitiveFailed);
+    }
+    {
+        SCOPED_TRACE("MIN_VALUE/-1");
+        args->putField(0, TInteger(TInteger::MIN_VALUE) );
+        args->putField(1, TInteger(-1) );
+        bool primitiveFailed;
+        callPrimitive(primitive::smallIntDiv, args, primitiveFailed);
+        ASSERT_TRUE(primitiveFailed);
+    }
     m_image->deleteObject(args);
 }
 
@@ -318,3 +355,667 @@ TEST_P(P_InitVM_Image, stringAtPut)
         m_image->deleteObject(str);
     }
 }
+
+TEST_P(P_InitVM_Image, symbol)
+{
+    TSymbol* const selector = globals.badMethodSymbol; // #doesNotUnderstand:
+    TString* const same = m_image->newString("doesNotUnderstand:");
+    TString* const other = m_image->newString("doesNotUnderstand");
+    TObjectArray* args = m_image->newArray(2);
+    bool primitiveFailed;
+    {
+        SCOPED_TRACE("hash is the same as for the string");
+        args->putField(0, selector);
+        TInteger result = callPrimitive(primitive::symbolHash, args, primitiveFailed);
+        ASSERT_FALSE(primitiveFailed);
+        args->putField(0, same);
+        TInteger stringHash = callPrimitive(primitive::stringHash, args, primitiveFailed);
+        ASSERT_FALSE(primitiveFailed);
+        ASSERT_EQ(stringHash.getValue(), result.getValue());
+    }
+    {
+        SCOPED_TRACE("equal to the string with the same contents");
+        args->putField(0, selector);
+        args->putField(1, same);
+        ASSERT_EQ(globals.trueObject, callPrimitive(primitive::symbolEqual, args, primitiveFailed));
+        ASSERT_FALSE(primitiveFailed);
+        args->putField(1, other);
+        ASSERT_EQ(globals.falseObject, callPrimitive(primitive::symbolEqual, args, primitiveFailed));
+    }
+    {
+        SCOPED_TRACE("shorter prefix is less");
+        args->putField(0, other);
+        args->putField(1, selector);
+        ASSERT_EQ(globals.trueObject, callPrimitive(primitive::symbolLess, args, primitiveFailed));
+        ASSERT_FALSE(primitiveFailed);
+        args->putField(0, selector);
+        args->putField(1, other);
+        ASSERT_EQ(globals.falseObject, callPrimitive(primitive::symbolLess, args, primitiveFailed));
+        args->putField(1, selector);
+        ASSERT_EQ(globals.falseObject, callPrimitive(primitive::symbolLess, args, primitiveFailed));
+    }
+    {
+        SCOPED_TRACE("non string argument fails");
+        args->putField(0, selector);
+        args->putField(1, TInteger(1));
+        callPrimitive(primitive::symbolEqual, args, primitiveFailed);
+        ASSERT_TRUE(primitiveFailed);
+    }
+    m_image->deleteObject(args);
+    m_image->deleteObject(other);
+    m_image->deleteObject(same);
+}
+
+TEST_P(P_InitVM_Image, string)
+{
+    TString* const text = m_image->newString("foobarfoo");
+    TString* const copy = m_image->newString("foobarfoo");
+    TString* const pattern = m_image->newString("bar");
+    TByteObject* const bytes = m_image->newBinaryObject(classRegistry.get<TByteArray>(), 4);
+    TObject* const letter = m_image->newOrdinaryObject(classRegistry.get<TChar>(), sizeof(TChar));
+    letter->putField(0, TInteger('o'));
+    std::memcpy(bytes->getBytes(), "\x01\x02\x01\x03", 4);
+
+    TObjectArray* args = m_image->newArray(2);
+    bool primitiveFailed;
+    {
+        SCOPED_TRACE("same contents have the same hash");
+        args->putField(0, text);
+        TInteger textHash = callPrimitive(primitive::stringHash, args, primitiveFailed);
+        ASSERT_FALSE(primitiveFailed);
+        args->putField(0, copy);
+        TInteger copyHash = callPrimitive(primitive::stringHash, args, primitiveFailed);
+        ASSERT_EQ(textHash.getValue(), copyHash.getValue());
+        args->putField(0, pattern);
+        TInteger patternHash = callPrimitive(primitive::stringHash, args, primitiveFailed);
+        ASSERT_NE(textHash.getValue(), patternHash.getValue());
+    }
+    {
+        SCOPED_TRACE("equality and ordering");
+        args->putField(0, text);
+        args->putField(1, copy);
+        ASSERT_EQ(globals.trueObject, callPrimitive(primitive::stringEqual, args, primitiveFailed));
+        ASSERT_EQ(globals.falseObject, callPrimitive(primitive::stringLess, args, primitiveFailed));
+        args->putField(1, pattern);
+        ASSERT_EQ(globals.falseObject, callPrimitive(primitive::stringEqual, args, primitiveFailed));
+        ASSERT_EQ(globals.falseObject, callPrimitive(primitive::stringLess, args, primitiveFailed));
+        args->putField(0, pattern);
+        args->putField(1, text);
+        ASSERT_EQ(globals.trueObject, callPrimitive(primitive::stringLess, args, primitiveFailed));
+        ASSERT_FALSE(primitiveFailed);
+        args->putField(1, bytes);
+        callPrimitive(primitive::stringEqual, args, primitiveFailed);
+        ASSERT_TRUE(primitiveFailed);
+    }
+    {
+        SCOPED_TRACE("search for characters and substrings");
+        args->putField(0, text);
+        args->putField(1, letter);
+        ASSERT_EQ(2, TInteger(callPrimitive(primitive::stringIndexOf, args, primitiveFailed)).getValue());
+        ASSERT_EQ(4, TInteger(callPrimitive(primitive::stringOccurrencesOf, args, primitiveFailed)).getValue());
+        args->putField(1, pattern);
+        ASSERT_EQ(4, TInteger(callPrimitive(primitive::stringIndexOf, args, primitiveFailed)).getValue());
+        args->putField(0, pattern);
+        args->putField(1, text);
+        ASSERT_EQ(globals.nilObject, callPrimitive(primitive::stringIndexOf, args, primitiveFailed));
+        ASSERT_FALSE(primitiveFailed);
+    }
+    {
+        SCOPED_TRACE("byte arrays are searched for small integers");
+        args->putField(0, bytes);
+        args->putField(1, TInteger(1));
+        ASSERT_EQ(1, TInteger(callPrimitive(primitive::stringIndexOf, args, primitiveFailed)).getValue());
+        ASSERT_EQ(2, TInteger(callPrimitive(primitive::stringOccurrencesOf, args, primitiveFailed)).getValue());
+        args->putField(1, TInteger(3));
+        ASSERT_EQ(4, TInteger(callPrimitive(primitive::stringIndexOf, args, primitiveFailed)).getValue());
+        args->putField(1, TInteger(7));
+        ASSERT_EQ(globals.nilObject, callPrimitive(primitive::stringIndexOf, args, primitiveFailed));
+        ASSERT_FALSE(primitiveFailed);
+        args->putField(1, letter);
+        callPrimitive(primitive::stringIndexOf, args, primitiveFailed);
+        ASSERT_TRUE(primitiveFailed);
+    }
+    m_image->deleteObject(args);
+    m_image->deleteObject(letter);
+    m_image->deleteObject(bytes);
+    m_image->deleteObject(pattern);
+    m_image->deleteObject(copy);
+    m_image->deleteObject(text);
+}
+
+TEST_P(P_InitVM_Image, fileLines)
+{
+    char fileName[] = "/tmp/llst_lines_XXXXXX";
+    const int fileID = mkstemp(fileName);
+    ASSERT_LE(0, fileID);
+    unlink(fileName);
+
+    TString* const text = m_image->newString("first\nsecond");
+    TString* const buffer = m_image->newString(16);
+    TObjectArray* args = m_image->newArray(4);
+    bool primitiveFailed;
+    {
+        SCOPED_TRACE("range is written at once");
+        args->putField(0, TInteger(fileID));
+        args->putField(1, text);
+        args->putField(2, TInteger(1));
+        args->putField(3, TInteger(12));
+        ASSERT_EQ(12, TInteger(callPrimitive(primitive::ioFileWriteRange, args, primitiveFailed)).getValue());
+        ASSERT_FALSE(primitiveFailed);
+        args->putField(3, TInteger(13));
+        callPrimitive(primitive::ioFileWriteRange, args, primitiveFailed);
+        ASSERT_TRUE(primitiveFailed);
+        ASSERT_EQ(0, lseek(fileID, 0, SEEK_SET));
+    }
+    {
+        SCOPED_TRACE("lines are read up to the newline");
+        args->putField(1, buffer);
+        ASSERT_EQ(6, TInteger(callPrimitive(primitive::ioFileReadLine, args, primitiveFailed)).getValue());
+        ASSERT_EQ("first\n", std::string(reinterpret_cast<char*>(buffer->getBytes()), 6));
+        ASSERT_EQ(6, lseek(fileID, 0, SEEK_CUR));
+        ASSERT_EQ(6, TInteger(callPrimitive(primitive::ioFileReadLine, args, primitiveFailed)).getValue());
+        ASSERT_EQ("second", std::string(reinterpret_cast<char*>(buffer->getBytes()), 6));
+        ASSERT_EQ(0, TInteger(callPrimitive(primitive::ioFileReadLine, args, primitiveFailed)).getValue());
+        ASSERT_FALSE(primitiveFailed);
+    }
+    {
+        SCOPED_TRACE("flush answers the descriptor");
+        TObjectArray* const flushArgs = m_image->newArray(1);
+        flushArgs->putField(0, TInteger(fileID));
+        EXPECT_EQ(TInteger(fileID), callPrimitive(primitive::ioFileFlush, flushArgs, primitiveFailed));
+        EXPECT_FALSE(primitiveFailed);
+        m_image->deleteObject(flushArgs);
+    }
+    close(fileID);
+    m_image->deleteObject(args);
+    m_image->deleteObject(buffer);
+    m_image->deleteObject(text);
+}
+
+TEST_P(P_InitVM_Image, sockets)
+{
+    TString* const address = m_image->newString("127.0.0.1");
+    TString* const message = m_image->newString("ping");
+    TString* const buffer  = m_image->newString(16);
+    TObjectArray* args = m_image->newArray(3);
+    bool primitiveFailed;
+
+    args->putField(0, address);
+    args->putField(1, TInteger(0));
+    const int32_t server = TInteger(callPrimitive(primitive::socketListen, args, primitiveFailed));
+    ASSERT_FALSE(primitiveFailed);
+
+    args->putField(0, TInteger(server));
+    const int32_t port = TInteger(callPrimitive(primitive::socketPort, args, primitiveFailed));
+    ASSERT_FALSE(primitiveFailed);
+    ASSERT_LT(0, port);
+
+    args->putField(0, address);
+    args->putField(1, TInteger(port));
+    const int32_t client = TInteger(callPrimitive(primitive::socketConnect, args, primitiveFailed));
+    ASSERT_FALSE(primitiveFailed);
+    {
+        SCOPED_TRACE("connection is accepted when the server is readable");
+        args->putField(0, TInteger(server));
+        args->putField(1, TInteger(IOPoller::readable));
+        callPrimitive(primitive::ioWaitBlocking, args, primitiveFailed);
+        ASSERT_FALSE(primitiveFailed);
+    }
+    const int32_t connection = TInteger(callPrimitive(primitive::socketAccept, args, primitiveFailed));
+    ASSERT_FALSE(primitiveFailed);
+    {
+        SCOPED_TRACE("connected socket has no error");
+        args->putField(0, TInteger(client));
+        ASSERT_EQ(0, TInteger(callPrimitive(primitive::socketError, args, primitiveFailed)).getValue());
+    }
+    {
+        SCOPED_TRACE("read that would block returns nil");
+        args->putField(0, TInteger(connection));
+        args->putField(1, buffer);
+        args->putField(2, TInteger(4));
+        ASSERT_EQ(globals.nilObject, callPrimitive(primitive::ioFileReadIntoByteArray, args, primitiveFailed));
+        ASSERT_FALSE(primitiveFailed);
+    }
+    {
+        SCOPED_TRACE("data is delivered over the loopback");
+        args->putField(0, TInteger(client));
+        args->putField(1, message);
+        args->putField(2, TInteger(4));
+        ASSERT_EQ(4, TInteger(callPrimitive(primitive::ioFileWriteFromByteArray, args, primitiveFailed)).getValue());
+
+        args->putField(0, TInteger(connection));
+        args->putField(1, TInteger(IOPoller::readable));
+        callPrimitive(primitive::ioWaitBlocking, args, primitiveFailed);
+
+        args->putField(1, buffer);
+        ASSERT_EQ(4, TInteger(callPrimitive(primitive::ioFileReadIntoByteArray, args, primitiveFailed)).getValue());
+        ASSERT_EQ("ping", std::string(reinterpret_cast<char*>(buffer->getBytes()), 4));
+    }
+    close(connection);
+    close(client);
+    close(server);
+    m_image->deleteObject(args);
+    m_image->deleteObject(buffer);
+    m_image->deleteObject(message);
+    m_image->deleteObject(address);
+}
+
+TEST_P(P_InitVM_Image, sort)
+{
+    TObjectArray* args = m_image->newArray(2);
+    bool primitiveFailed = false;
+
+    {
+        SCOPED_TRACE("small integers");
+        const int values[] = { 5, -3, 42, 0, 7, -3, 1000000, 8 };
+        const std::size_t count = sizeof(values) / sizeof(values[0]);
+        TObjectArray* array = m_image->newArray(count);
+        for (std::size_t i = 0; i < count; i++)
+            array->putField(i, TInteger(values[i]));
+
+        args->putField(0, array);
+        args->putField(1, globals.falseObject);
+        ASSERT_EQ(array, callPrimitive(primitive::arraySort, args, primitiveFailed));
+        ASSERT_FALSE(primitiveFailed);
+        for (std::size_t i = 1; i < count; i++)
+            ASSERT_LE(TInteger(array->getField(i - 1)).getValue(), TInteger(array->getField(i)).getValue());
+        m_image->deleteObject(array);
+    }
+    {
+        SCOPED_TRACE("equal strings keep their order in the stable sort");
+        const char* values[] = { "pear", "apple", "fig", "apple", "applesauce", "", "fig" };
+        const std::size_t count = sizeof(values) / sizeof(values[0]);
+        TObjectArray* array = m_image->newArray(count);
+        for (std::size_t i = 0; i < count; i++)
+            array->putField(i, m_image->newString(values[i]));
+        TObject* const firstApple = array->getField(1);
+        TObject* const secondApple = array->getField(3);
+
+        args->putField(0, array);
+        args->putField(1, globals.trueObject);
+        callPrimitive(primitive::arraySort, args, primitiveFailed);
+        ASSERT_FALSE(primitiveFailed);
+
+        const char* sorted[] = { "", "apple", "apple", "applesauce", "fig", "fig", "pear" };
+        for (std::size_t i = 0; i < count; i++)
+            ASSERT_EQ(sorted[i], std::string(reinterpret_cast<char*>(array->getField<TString>(i)->getBytes()), array->getField(i)->getSize()));
+        ASSERT_EQ(firstApple, array->getField(1));
+        ASSERT_EQ(secondApple, array->getField(2));
+
+        for (std::size_t i = 0; i < count; i++)
+            m_image->deleteObject(array->getField(i));
+        m_image->deleteObject(array);
+    }
+    {
+        SCOPED_TRACE("mixed elements are left to the image");
+        TObjectArray* array = m_image->newArray(3);
+        TString* string = m_image->newString("3");
+        array->putField(0, TInteger(2));
+        array->putField(1, string);
+        array->putField(2, TInteger(1));
+
+        args->putField(0, array);
+        args->putField(1, globals.falseObject);
+        callPrimitive(primitive::arraySort, args, primitiveFailed);
+        ASSERT_TRUE(primitiveFailed);
+        ASSERT_EQ(2, TInteger(array->getField(0)).getValue());
+
+        primitiveFailed = false;
+        array->putField(1, globals.nilObject);
+        callPrimitive(primitive::arraySort, args, primitiveFailed);
+        ASSERT_TRUE(primitiveFailed);
+
+        m_image->deleteObject(string);
+        m_image->deleteObject(array);
+    }
+    m_image->deleteObject(args);
+}
+
+// Primitives owned by the VM are called on the VM instance directly.
+// Heap is small, so collections happen while the tests allocate.
+class VMOwnedPrimitives : public ::testing::Test
+{
+protected:
+    BakerMemoryManager m_memoryManager;
+    Image m_image;
+    std::auto_ptr<SmalltalkVM> m_vm;
+    std::vector<uint8_t> m_classes[2];
+
+    VMOwnedPrimitives() : m_image(&m_memoryManager) {}
+
+    virtual void SetUp() {
+        m_memoryManager.initializeHeap(64 * 1024, 64 * 1024);
+        ASSERT_TRUE(m_image.loadImage(TESTS_DIR "./data/VMPrimitives.image"));
+        m_vm.reset(new SmalltalkVM(&m_image, &m_memoryManager));
+    }
+
+    // Test image lacks some of the well-known classes, so copies of Object
+    // stand for them. Registry is resolved again when the next image is loaded.
+    TClass* defineClass(std::size_t slot, TClass* parentClass) {
+        TClass* const objectClass = m_image.getGlobal<TClass>("Object");
+        const uint8_t* const original = reinterpret_cast<const uint8_t*>(objectClass);
+        m_classes[slot].assign(original, original + objectClass->getSlotSize());
+
+        TClass* const klass = reinterpret_cast<TClass*>(&m_classes[slot][0]);
+        klass->parentClass = parentClass;
+        return klass;
+    }
+
+    hptr<TString> newString(const std::string& text) {
+        hptr<TString> string = m_vm->newObject<TString>(text.size());
+        std::memcpy(string->getBytes(), text.data(), text.size());
+        return string;
+    }
+
+    static std::string toString(TObject* bytes, std::size_t size) {
+        return std::string(reinterpret_cast<const char*>(static_cast<TByteObject*>(bytes)->getBytes()), size);
+    }
+
+    // Array holding a string twice, itself and a symbol: (shared self shared #symbol).
+    // Handles are released in the reverse order, so only the returned one outlives the call.
+    hptr<TObjectArray> newGraph() {
+        hptr<TObjectArray> root = m_vm->newObject<TObjectArray>(4);
+        TString* const shared = newString("shared");
+        root->putField(0, shared);
+        root->putField(1, root);
+        root->putField(2, shared);
+        root->putField(3, globals.badMethodSymbol);
+        return root;
+    }
+
+    void checkGraphCopy(TObject* original, TObject* copy) {
+        ASSERT_NE(original, copy);
+        ASSERT_EQ(4u, copy->getSize());
+        EXPECT_EQ(copy, copy->getField(1)) << "cycle leads to the copy";
+        EXPECT_NE(original->getField(0), copy->getField(0)) << "string is copied";
+        EXPECT_EQ(copy->getField(0), copy->getField(2)) << "string is copied once";
+        EXPECT_EQ("shared", toString(copy->getField(0), 6));
+        EXPECT_EQ(static_cast<TObject*>(globals.badMethodSymbol), copy->getField(3)) << "symbol is shared";
+    }
+};
+
+TEST_F(VMOwnedPrimitives, stringBuffer)
+{
+    TClass* const bufferClass = defineClass(0, m_image.getGlobal<TClass>("Object"));
+    classRegistry.classes[TClassRegistry::stringBufferClass] = bufferClass;
+
+    hptr<TStringBuffer> buffer = m_vm->newObject<TStringBuffer>();
+    buffer->size = TInteger(0);
+    bool primitiveFailed = false;
+    {
+        SCOPED_TRACE("backing string grows past 16 bytes");
+        hptr<TString> digits = newString("0123456789");
+        ASSERT_EQ(buffer, m_vm->callBufferPrimitive(primitive::bufferAppend, buffer, digits, primitiveFailed));
+        ASSERT_FALSE(primitiveFailed);
+        EXPECT_EQ(16u, buffer->bytes->getSize());
+
+        m_vm->callBufferPrimitive(primitive::bufferAppend, buffer, digits, primitiveFailed);
+        ASSERT_FALSE(primitiveFailed);
+        EXPECT_EQ(20, buffer->size.getValue());
+        EXPECT_EQ(32u, buffer->bytes->getSize());
+        EXPECT_EQ("01234567890123456789", toString(buffer->bytes, 20));
+    }
+    {
+        SCOPED_TRACE("bytes and characters");
+        hptr<TChar> character = m_vm->newObject<TChar>();
+        character->value = TInteger('!');
+        m_vm->callBufferPrimitive(primitive::bufferAppendByte, buffer, character, primitiveFailed);
+        ASSERT_FALSE(primitiveFailed);
+        m_vm->callBufferPrimitive(primitive::bufferAppendByte, buffer, TInteger('A'), primitiveFailed);
+        ASSERT_FALSE(primitiveFailed);
+        EXPECT_EQ("!A", toString(buffer->bytes, 22).substr(20));
+
+        m_vm->callBufferPrimitive(primitive::bufferAppendByte, buffer, TInteger(256), primitiveFailed);
+        EXPECT_TRUE(primitiveFailed);
+        primitiveFailed = false;
+        m_vm->callBufferPrimitive(primitive::bufferAppendByte, buffer, TInteger(-1), primitiveFailed);
+        EXPECT_TRUE(primitiveFailed);
+        primitiveFailed = false;
+        EXPECT_EQ(22, buffer->size.getValue());
+    }
+    {
+        SCOPED_TRACE("negative integer");
+        m_vm->callBufferPrimitive(primitive::bufferAppendInt, buffer, TInteger(-42), primitiveFailed);
+        ASSERT_FALSE(primitiveFailed);
+        EXPECT_EQ("01234567890123456789!A-42", toString(buffer->bytes, 25));
+    }
+    {
+        SCOPED_TRACE("partial buffer is copied and keeps the capacity");
+        TString* const storage = buffer->bytes;
+        TObject* const result = m_vm->callBufferPrimitive(primitive::bufferFreeze, buffer, globals.nilObject, primitiveFailed);
+        ASSERT_FALSE(primitiveFailed);
+        ASSERT_NE(static_cast<TObject*>(storage), result);
+        EXPECT_EQ(25u, result->getSize());
+        EXPECT_EQ("01234567890123456789!A-42", toString(result, 25));
+        EXPECT_EQ(storage, buffer->bytes);
+        EXPECT_EQ(0, buffer->size.getValue());
+    }
+    {
+        SCOPED_TRACE("full buffer hands the storage over");
+        hptr<TString> half = newString("0123456789abcdef");
+        m_vm->callBufferPrimitive(primitive::bufferAppend, buffer, half, primitiveFailed);
+        m_vm->callBufferPrimitive(primitive::bufferAppend, buffer, half, primitiveFailed);
+        ASSERT_FALSE(primitiveFailed);
+        TString* const storage = buffer->bytes;
+        ASSERT_EQ(32u, storage->getSize());
+
+        TObject* const result = m_vm->callBufferPrimitive(primitive::bufferFreeze, buffer, globals.nilObject, primitiveFailed);
+        ASSERT_FALSE(primitiveFailed);
+        EXPECT_EQ(static_cast<TObject*>(storage), result);
+        EXPECT_EQ(globals.nilObject, buffer->bytes);
+        EXPECT_EQ(0, buffer->size.getValue());
+    }
+    {
+        SCOPED_TRACE("instances of subclasses are buffers");
+        TClass* const streamClass = defineClass(1, bufferClass);
+        hptr<TStringBuffer> stream = m_vm->newObject<TStringBuffer>();
+        stream->size = TInteger(0);
+        stream->setClass(streamClass);
+        m_vm->callBufferPrimitive(primitive::bufferAppendInt, stream, TInteger(7), primitiveFailed);
+        ASSERT_FALSE(primitiveFailed);
+        EXPECT_EQ("7", toString(stream->bytes, 1));
+    }
+    {
+        SCOPED_TRACE("other objects with the same fields are not buffers");
+        hptr<TObjectArray> array = m_vm->newObject<TObjectArray>(2);
+        array->putField(1, TInteger(0));
+        m_vm->callBufferPrimitive(primitive::bufferAppendInt, array, TInteger(7), primitiveFailed);
+        EXPECT_TRUE(primitiveFailed);
+    }
+}
+
+TEST_F(VMOwnedPrimitives, copy)
+{
+    bool primitiveFailed = false;
+    {
+        SCOPED_TRACE("shallow copy of a binary object");
+        hptr<TString> original = newString("hello");
+        TObject* const copy = m_vm->copyObject(primitive::shallowCopy, original, globals.nilObject, primitiveFailed);
+        ASSERT_FALSE(primitiveFailed);
+        ASSERT_NE(static_cast<TObject*>(original), copy);
+        EXPECT_EQ(original->getClass(), copy->getClass());
+        ASSERT_EQ(5u, copy->getSize());
+        EXPECT_EQ("hello", toString(copy, 5));
+    }
+    {
+        SCOPED_TRACE("shallow copy of an ordinary object shares the fields");
+        hptr<TString> element = newString("one");
+        hptr<TObjectArray> original = m_vm->newObject<TObjectArray>(2);
+        original->putField(0, element);
+        original->putField(1, TInteger(2));
+        TObject* const copy = m_vm->copyObject(primitive::shallowCopy, original, globals.nilObject, primitiveFailed);
+        ASSERT_FALSE(primitiveFailed);
+        ASSERT_NE(static_cast<TObject*>(original), copy);
+        EXPECT_EQ(original->getClass(), copy->getClass());
+        ASSERT_EQ(2u, copy->getSize());
+        EXPECT_EQ(static_cast<TObject*>(element), copy->getField(0));
+        EXPECT_EQ(2, TInteger(copy->getField(1)).getValue());
+    }
+    {
+        SCOPED_TRACE("unique objects are not copied");
+        EXPECT_EQ(globals.nilObject, m_vm->copyObject(primitive::shallowCopy, globals.nilObject, globals.nilObject, primitiveFailed));
+        EXPECT_EQ(static_cast<TObject*>(globals.badMethodSymbol),
+            m_vm->copyObject(primitive::shallowCopy, globals.badMethodSymbol, globals.nilObject, primitiveFailed));
+        EXPECT_FALSE(primitiveFailed);
+    }
+    {
+        SCOPED_TRACE("deep copy keeps cycles and shared objects");
+        hptr<TObjectArray> original = newGraph();
+        TObject* const copy = m_vm->copyObject(primitive::deepCopy, original, TInteger(2), primitiveFailed);
+        ASSERT_FALSE(primitiveFailed);
+        checkGraphCopy(original, copy);
+        EXPECT_EQ(static_cast<TObject*>(original), original->getField(1)) << "original is intact";
+
+        m_vm->copyObject(primitive::deepCopy, original, TInteger(1), primitiveFailed);
+        EXPECT_TRUE(primitiveFailed) << "graph exceeds the limit";
+        primitiveFailed = false;
+    }
+    {
+        SCOPED_TRACE("deep copy survives the collection");
+        const std::size_t graphsCount = 64;
+        hptr<TObjectArray> graphs = m_vm->newObject<TObjectArray>(graphsCount);
+        for (std::size_t i = 0; i < graphsCount; i++) {
+            hptr<TObjectArray> graph = newGraph();
+            graphs->putField(i, graph);
+        }
+
+        // Only the copy allocates in the loop, so every collection happens during the copy
+        const uint32_t collections = m_memoryManager.getStat().collectionsCount;
+        for (int attempt = 0; attempt < 32; attempt++) {
+            TObject* const copy = m_vm->copyObject(primitive::deepCopy, graphs, TInteger(1000), primitiveFailed);
+            ASSERT_FALSE(primitiveFailed);
+            ASSERT_EQ(graphsCount, copy->getSize());
+            for (std::size_t i = 0; i < graphsCount; i++) {
+                ASSERT_NE(graphs->getField(i), copy->getField(i));
+                checkGraphCopy(graphs->getField(i), copy->getField(i));
+            }
+        }
+        EXPECT_LT(collections, m_memoryManager.getStat().collectionsCount);
+    }
+}
+
+TEST_F(VMOwnedPrimitives, float)
+{
+    bool primitiveFailed = false;
+    {
+        SCOPED_TRACE("image without Float");
+        m_vm->callFloatPrimitive(primitive::floatNew, TInteger(1), globals.nilObject, primitiveFailed);
+        EXPECT_TRUE(primitiveFailed);
+        primitiveFailed = false;
+    }
+
+    classRegistry.classes[TClassRegistry::floatClass] = defineClass(0, m_image.getGlobal<TClass>("Object"));
+    {
+        SCOPED_TRACE("arithmetic with floats and integers");
+        TObject* result = m_vm->callFloatPrimitive(primitive::floatAdd, m_vm->newFloatObject(1.5), TInteger(2), primitiveFailed);
+        ASSERT_FALSE(primitiveFailed);
+        EXPECT_EQ(3.5, static_cast<TFloat*>(result)->getValue());
+
+        result = m_vm->callFloatPrimitive(primitive::floatSub, TInteger(1), m_vm->newFloatObject(0.25), primitiveFailed);
+        EXPECT_EQ(0.75, static_cast<TFloat*>(result)->getValue());
+        result = m_vm->callFloatPrimitive(primitive::floatMul, m_vm->newFloatObject(-1.5), TInteger(4), primitiveFailed);
+        EXPECT_EQ(-6.0, static_cast<TFloat*>(result)->getValue());
+        result = m_vm->callFloatPrimitive(primitive::floatDiv, TInteger(1), m_vm->newFloatObject(8), primitiveFailed);
+        EXPECT_EQ(0.125, static_cast<TFloat*>(result)->getValue());
+        ASSERT_FALSE(primitiveFailed);
+
+        m_vm->callFloatPrimitive(primitive::floatDiv, m_vm->newFloatObject(1), TInteger(0), primitiveFailed);
+        EXPECT_TRUE(primitiveFailed) << "division by zero";
+        primitiveFailed = false;
+        m_vm->callFloatPrimitive(primitive::floatAdd, m_vm->newFloatObject(1), globals.nilObject, primitiveFailed);
+        EXPECT_TRUE(primitiveFailed) << "not a number";
+        primitiveFailed = false;
+    }
+    {
+        SCOPED_TRACE("comparison");
+        EXPECT_EQ(globals.trueObject, m_vm->callFloatPrimitive(primitive::floatLess, m_vm->newFloatObject(1.5), TInteger(2), primitiveFailed));
+        EXPECT_EQ(globals.falseObject, m_vm->callFloatPrimitive(primitive::floatLess, TInteger(2), m_vm->newFloatObject(1.5), primitiveFailed));
+        EXPECT_EQ(globals.trueObject, m_vm->callFloatPrimitive(primitive::floatEqual, m_vm->newFloatObject(2), TInteger(2), primitiveFailed));
+        EXPECT_FALSE(primitiveFailed);
+    }
+    {
+        SCOPED_TRACE("conversion to integers");
+        TObject* result = m_vm->callFloatPrimitive(primitive::floatTruncated, m_vm->newFloatObject(-3.75), globals.nilObject, primitiveFailed);
+        ASSERT_FALSE(primitiveFailed);
+        EXPECT_EQ(-3, TInteger(result).getValue());
+
+        result = m_vm->callFloatPrimitive(primitive::floatTruncated, m_vm->newFloatObject(1e20), globals.nilObject, primitiveFailed);
+        ASSERT_FALSE(primitiveFailed);
+        ASSERT_FALSE(isSmallInteger(result));
+        EXPECT_EQ(classRegistry[TClassRegistry::integerClass], result->getClass());
+
+        const double nan = std::strtod("nan", 0);
+        m_vm->callFloatPrimitive(primitive::floatTruncated, m_vm->newFloatObject(nan), globals.nilObject, primitiveFailed);
+        EXPECT_TRUE(primitiveFailed);
+        primitiveFailed = false;
+
+        result = m_vm->callFloatPrimitive(primitive::floatNew, TInteger(7), globals.nilObject, primitiveFailed);
+        ASSERT_FALSE(primitiveFailed);
+        EXPECT_EQ(7.0, static_cast<TFloat*>(result)->getValue());
+    }
+    {
+        SCOPED_TRACE("printing");
+        const double values[] = { 0.1, 2, -0.5, 1e20, 1e-5 };
+        const char* printed[] = { "0.1", "2.0", "-0.5", "1e20", "1e-05" };
+        for (std::size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+            TObject* const result = m_vm->callFloatPrimitive(primitive::floatPrintString, m_vm->newFloatObject(values[i]), globals.nilObject, primitiveFailed);
+            ASSERT_FALSE(primitiveFailed);
+            EXPECT_EQ(printed[i], toString(result, result->getSize()));
+        }
+    }
+    {
+        SCOPED_TRACE("parsing of the number literals");
+        const char* literals[] = { "3.25", "-0.5", "12", "1e20", "1e-05", "2.5e-3" };
+        const double values[]  = { 3.25, -0.5, 12, 1e20, 1e-5, 2.5e-3 };
+        for (std::size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+            TObject* const result = m_vm->callFloatPrimitive(primitive::floatParse, newString(literals[i]), globals.nilObject, primitiveFailed);
+            ASSERT_FALSE(primitiveFailed) << literals[i];
+            EXPECT_EQ(values[i], static_cast<TFloat*>(result)->getValue()) << literals[i];
+        }
+    }
+    {
+        SCOPED_TRACE("everything else is rejected");
+        const char* invalid[] = { "", " 1.5", "1.5 ", "+1", "1.", ".5", "1e", "1e+5", "1,5",
+                                  "inf", "-inf", "nan", "0x10", "1e999" };
+        for (std::size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+            m_vm->callFloatPrimitive(primitive::floatParse, newString(invalid[i]), globals.nilObject, primitiveFailed);
+            EXPECT_TRUE(primitiveFailed) << "'" << invalid[i] << "'";
+            primitiveFailed = false;
+        }
+    }
+}
+
+TEST_F(VMOwnedPrimitives, graphOfClasses)
+{
+    bool primitiveFailed = false;
+    TClass* const metaclass = globals.arrayClass->getClass();
+    {
+        SCOPED_TRACE("metaclass is resolved through its instance class");
+        hptr<TObjectArray> array = m_vm->newObject<TObjectArray>(3);
+        array[0] = globals.arrayClass;
+        array[1] = metaclass;
+        array[2] = metaclass;
+
+        hptr<TObject> data = m_vm->newPointer(m_vm->serializeGraph(array, primitiveFailed));
+        ASSERT_FALSE(primitiveFailed);
+
+        TObject* const copy = m_vm->materializeGraph(data, primitiveFailed);
+        ASSERT_FALSE(primitiveFailed);
+        ASSERT_EQ(3u, copy->getSize());
+        EXPECT_EQ(static_cast<TObject*>(globals.arrayClass), copy->getField(0));
+        EXPECT_EQ(static_cast<TObject*>(metaclass), copy->getField(1));
+        EXPECT_EQ(static_cast<TObject*>(metaclass), copy->getField(2));
+    }
+    {
+        SCOPED_TRACE("metaclass as the root");
+        hptr<TObject> data = m_vm->newPointer(m_vm->serializeGraph(metaclass, primitiveFailed));
+        ASSERT_FALSE(primitiveFailed);
+        EXPECT_EQ(static_cast<TObject*>(metaclass), m_vm->materializeGraph(data, primitiveFailed));
+        EXPECT_FALSE(primitiveFailed);
+    }
+    {
+        SCOPED_TRACE("class missing from globals is rejected by the writer");
+        m_vm->serializeGraph(defineClass(0, m_image.getGlobal<TClass>("Object")), primitiveFailed);
+        EXPECT_TRUE(primitiveFailed);
+    }
+}